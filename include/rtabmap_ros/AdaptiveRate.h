@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ADAPTIVERATE_H_
+#define ADAPTIVERATE_H_
+
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <rtabmap_ros/Info.h>
+#include <rtabmap_ros/OdomInfo.h>
+
+namespace rtabmap_ros {
+
+/**
+ * Rate control of the throttle nodelets from the processing time of the
+ * nodes downstream: the "Timing/Total/ms" statistic of the rtabmap
+ * "info" topic and the time of the odometry "odom_info" topic. The rate is
+ * set so that the slowest of them is busy "max_load" of the time, bounded
+ * by "min_rate" and the "rate" parameter of the nodelet. Without timing
+ * received for "adaptive_timeout" seconds, the nodelet rate is used.
+ */
+class AdaptiveRate
+{
+public:
+	AdaptiveRate();
+
+	// Reads the parameters and, if "adaptive_rate" is true, subscribes to the timing topics
+	void init(ros::NodeHandle & nh, ros::NodeHandle & pnh);
+
+	bool enabled() const {return enabled_;}
+
+	/**
+	 * @param maxRate the fixed rate of the nodelet (0 = no limit)
+	 * @return the rate to apply (0 = no limit)
+	 */
+	double rate(double maxRate);
+
+private:
+	void infoCallback(const rtabmap_ros::InfoConstPtr & msg);
+	void odomInfoCallback(const rtabmap_ros::OdomInfoConstPtr & msg);
+	void addTime(double & smoothed, ros::Time & lastUpdate, double time);
+
+private:
+	bool enabled_;
+	double maxLoad_;
+	double minRate_;
+	double timeout_;
+
+	boost::mutex mutex_;
+	double rtabmapTime_; // s, smoothed
+	double odomTime_; // s, smoothed
+	ros::Time rtabmapUpdate_;
+	ros::Time odomUpdate_;
+	double lastRate_;
+
+	ros::Subscriber infoSub_;
+	ros::Subscriber odomInfoSub_;
+};
+
+}
+
+#endif /* ADAPTIVERATE_H_ */
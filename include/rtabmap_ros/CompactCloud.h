@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COMPACTCLOUD_H_
+#define COMPACTCLOUD_H_
+
+#include <rtabmap/core/Transform.h>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <boost/cstdint.hpp>
+#include <vector>
+#include <iosfwd>
+
+namespace rtabmap_ros {
+
+/**
+ * Compact storage of a node cloud: 16-bit coordinates quantized relative
+ * to the center of the cloud and packed RGB, 9 bytes per point instead of
+ * 32 for pcl::PointXYZRGB. The quantization step is chosen so the
+ * farthest point fits in 16 bits (e.g. 0.15 mm for a 4 m cloud). Points
+ * are expanded to PCL types only when the cloud is assembled.
+ */
+class CompactCloud
+{
+public:
+	CompactCloud();
+	explicit CompactCloud(const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+
+	void set(const pcl::PointCloud<pcl::PointXYZRGB> & cloud);
+	void clear();
+
+	size_t size() const {return rgb_.size()/3;}
+	bool empty() const {return rgb_.empty();}
+	size_t bytes() const;
+
+	// Expand the points, transformed by "transform" if not null
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr uncompress(const rtabmap::Transform & transform = rtabmap::Transform()) const;
+	// Append the expanded points to "output", transformed by "transform" if not null
+	void appendTo(pcl::PointCloud<pcl::PointXYZRGB> & output, const rtabmap::Transform & transform = rtabmap::Transform()) const;
+
+	// Binary serialization (native endianness), read() returns false on a truncated
+	// or corrupted stream (more than 2^24 points)
+	void write(std::ostream & stream) const;
+	bool read(std::istream & stream);
+
+private:
+	float origin_[3];
+	float step_;
+	std::vector<boost::int16_t> xyz_;
+	std::vector<boost::uint8_t> rgb_;
+};
+
+}
+
+#endif /* COMPACTCLOUD_H_ */
@@ -0,0 +1,323 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DEPTHTOCLOUD_H_
+#define DEPTHTOCLOUD_H_
+
+#include "rtabmap_ros/ThreadPool.h"
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <opencv2/core/core.hpp>
+#include <rtabmap/utilite/UMath.h>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Depth image to point cloud pipeline of the point_cloud_xyz(rgb) nodelets.
+ * Projection, decimation and max depth clipping are done in one pass
+ * parallelized by rows (ThreadPool), then the valid points are
+ * voxelized while they are compacted. The output cloud is owned by this
+ * object and reused between frames, like the intermediate buffers: an
+ * instance must not be used by two threads at the same time.
+ */
+template<typename PointT>
+class DepthToCloud
+{
+public:
+	DepthToCloud() :
+		decimation_(1),
+		maxDepth_(0.0f),
+		voxelSize_(0.0f),
+		organized_(new pcl::PointCloud<PointT>),
+		dense_(new pcl::PointCloud<PointT>),
+		fx_(0), fy_(0), cx_(0), cy_(0),
+		rowsPerJob_(16)
+	{}
+
+	void setDecimation(int decimation) {decimation_ = decimation<1?1:decimation;}
+	void setMaxDepth(float maxDepth) {maxDepth_ = maxDepth;}
+	void setVoxelSize(float voxelSize) {voxelSize_ = voxelSize;}
+
+	/**
+	 * @param depth 16UC1 (mm) or 32FC1 (m)
+	 * @param rgb bgr8 or mono8 image for the colors, it can be empty
+	 *        for PointXYZ. Its size can be a multiple of the depth size,
+	 *        the camera parameters are then the ones of the rgb image
+	 *        (an empty cloud is returned otherwise).
+	 * @return an organized cloud (with NaN for invalid points) if max
+	 *         depth and voxel size are not set, otherwise only valid points.
+	 *         It is valid until the next call.
+	 */
+	const typename pcl::PointCloud<PointT>::Ptr & project(
+			const cv::Mat & depth,
+			const cv::Mat & rgb,
+			float fx, float fy, float cx, float cy)
+	{
+		int cols = depth.cols;
+		int rows = depth.rows;
+		int ratio = 1;
+		if(!rgb.empty())
+		{
+			ratio = depth.cols?rgb.cols / depth.cols:0;
+			if(ratio < 1 || rgb.cols != depth.cols*ratio || rgb.rows != depth.rows*ratio)
+			{
+				organized_->clear();
+				return organized_;
+			}
+			cols = rgb.cols;
+			rows = rgb.rows;
+		}
+		depth_ = depth;
+		rgb_ = rgb;
+		ratio_ = ratio;
+		fx_ = fx;
+		fy_ = fy;
+		cx_ = cx;
+		cy_ = cy;
+
+		organized_->width = cols / decimation_;
+		organized_->height = rows / decimation_;
+		organized_->is_dense = false;
+		organized_->resize(organized_->width * organized_->height);
+
+		int jobs = (organized_->height + rowsPerJob_ - 1) / rowsPerJob_;
+		ThreadPool::instance().parallelFor(jobs, boost::bind(&DepthToCloud<PointT>::projectRows, this, _1));
+
+		// don't keep a reference on the images
+		depth_ = cv::Mat();
+		rgb_ = cv::Mat();
+		return finish(*organized_);
+	}
+
+	// Clips and voxelizes a cloud created by another function, same output as project()
+	const typename pcl::PointCloud<PointT>::Ptr & filter(const pcl::PointCloud<PointT> & cloud)
+	{
+		if(maxDepth_ > 0.0f)
+		{
+			organized_->header = cloud.header;
+			organized_->width = cloud.width;
+			organized_->height = cloud.height;
+			organized_->is_dense = cloud.is_dense;
+			organized_->resize(cloud.size());
+			for(unsigned int i=0; i<cloud.size(); ++i)
+			{
+				organized_->at(i) = clip(cloud.at(i));
+			}
+		}
+		else
+		{
+			*organized_ = cloud;
+		}
+		return finish(*organized_);
+	}
+
+private:
+	struct Voxel
+	{
+		float x, y, z;
+		float r, g, b;
+		int count;
+	};
+
+	void projectRows(int job)
+	{
+		const float bad = std::numeric_limits<float>::quiet_NaN();
+		unsigned int startRow = job * rowsPerJob_;
+		unsigned int endRow = std::min(startRow + rowsPerJob_, organized_->height);
+		bool mm = depth_.type() == CV_16UC1;
+		for(unsigned int h=startRow; h<endRow; ++h)
+		{
+			int v = h*decimation_;
+			PointT * out = &organized_->at(h*organized_->width);
+			const unsigned short * depthRow16 = mm?depth_.ptr<unsigned short>(v/ratio_):0;
+			const float * depthRow32 = mm?0:depth_.ptr<float>(v/ratio_);
+			const unsigned char * rgbRow = rgb_.empty()?0:rgb_.ptr<unsigned char>(v);
+			for(unsigned int w=0; w<organized_->width; ++w)
+			{
+				int u = w*decimation_;
+				PointT & pt = out[w];
+				float z = mm?float(depthRow16[u/ratio_])*0.001f:depthRow32[u/ratio_];
+				if(z > 0.0f && uIsFinite(z) && (maxDepth_ <= 0.0f || z <= maxDepth_))
+				{
+					pt.x = (float(u) - cx_) * z / fx_;
+					pt.y = (float(v) - cy_) * z / fy_;
+					pt.z = z;
+				}
+				else
+				{
+					pt.x = pt.y = pt.z = bad;
+				}
+				if(rgbRow)
+				{
+					setColor(pt, rgbRow, u, rgb_.channels());
+				}
+			}
+		}
+	}
+
+	PointT clip(const PointT & pt) const
+	{
+		if(pcl::isFinite(pt) && (pt.z < 0.0f || pt.z > maxDepth_))
+		{
+			PointT out = pt;
+			out.x = out.y = out.z = std::numeric_limits<float>::quiet_NaN();
+			return out;
+		}
+		return pt;
+	}
+
+	const typename pcl::PointCloud<PointT>::Ptr & finish(const pcl::PointCloud<PointT> & cloud)
+	{
+		if(maxDepth_ <= 0.0f && voxelSize_ <= 0.0f)
+		{
+			return organized_;
+		}
+
+		dense_->header = cloud.header;
+		dense_->clear();
+		if(voxelSize_ > 0.0f)
+		{
+			voxelIndices_.clear();
+			voxels_.clear();
+			for(unsigned int i=0; i<cloud.size(); ++i)
+			{
+				const PointT & pt = cloud.at(i);
+				if(!pcl::isFinite(pt))
+				{
+					continue;
+				}
+				boost::uint64_t k = key(pt);
+				std::pair<typename boost::unordered_map<boost::uint64_t, int>::iterator, bool> p =
+						voxelIndices_.insert(std::make_pair(k, (int)voxels_.size()));
+				if(p.second)
+				{
+					Voxel voxel = {0,0,0,0,0,0,0};
+					voxels_.push_back(voxel);
+				}
+				Voxel & voxel = voxels_[p.first->second];
+				voxel.x += pt.x;
+				voxel.y += pt.y;
+				voxel.z += pt.z;
+				addColor(voxel, pt);
+				++voxel.count;
+			}
+			dense_->resize(voxels_.size());
+			for(unsigned int i=0; i<voxels_.size(); ++i)
+			{
+				const Voxel & voxel = voxels_[i];
+				PointT & pt = dense_->at(i);
+				pt.x = voxel.x / float(voxel.count);
+				pt.y = voxel.y / float(voxel.count);
+				pt.z = voxel.z / float(voxel.count);
+				setColor(pt, voxel);
+			}
+		}
+		else
+		{
+			dense_->reserve(cloud.size());
+			for(unsigned int i=0; i<cloud.size(); ++i)
+			{
+				if(pcl::isFinite(cloud.at(i)))
+				{
+					dense_->push_back(cloud.at(i));
+				}
+			}
+		}
+		dense_->width = dense_->size();
+		dense_->height = 1;
+		dense_->is_dense = true;
+		return dense_;
+	}
+
+	// 21 bits per axis, same as VoxelHash
+	boost::uint64_t key(const PointT & pt) const
+	{
+		boost::uint64_t x = boost::uint64_t(int(std::floor(pt.x / voxelSize_)) & 0x1FFFFF);
+		boost::uint64_t y = boost::uint64_t(int(std::floor(pt.y / voxelSize_)) & 0x1FFFFF);
+		boost::uint64_t z = boost::uint64_t(int(std::floor(pt.z / voxelSize_)) & 0x1FFFFF);
+		return (x << 42) | (y << 21) | z;
+	}
+
+	static void setColor(pcl::PointXYZ &, const unsigned char *, int, int) {}
+	static void setColor(pcl::PointXYZRGB & pt, const unsigned char * row, int u, int channels)
+	{
+		if(channels == 3)
+		{
+			pt.b = row[u*3];
+			pt.g = row[u*3+1];
+			pt.r = row[u*3+2];
+		}
+		else
+		{
+			pt.r = pt.g = pt.b = row[u];
+		}
+		pt.a = 255;
+	}
+	static void addColor(Voxel &, const pcl::PointXYZ &) {}
+	static void addColor(Voxel & voxel, const pcl::PointXYZRGB & pt)
+	{
+		voxel.r += pt.r;
+		voxel.g += pt.g;
+		voxel.b += pt.b;
+	}
+	static void setColor(pcl::PointXYZ &, const Voxel &) {}
+	static void setColor(pcl::PointXYZRGB & pt, const Voxel & voxel)
+	{
+		pt.r = (unsigned char)(voxel.r / float(voxel.count) + 0.5f);
+		pt.g = (unsigned char)(voxel.g / float(voxel.count) + 0.5f);
+		pt.b = (unsigned char)(voxel.b / float(voxel.count) + 0.5f);
+		pt.a = 255;
+	}
+
+private:
+	int decimation_;
+	float maxDepth_;
+	float voxelSize_;
+
+	typename pcl::PointCloud<PointT>::Ptr organized_;
+	typename pcl::PointCloud<PointT>::Ptr dense_;
+	boost::unordered_map<boost::uint64_t, int> voxelIndices_;
+	std::vector<Voxel> voxels_;
+
+	// inputs of projectRows()
+	cv::Mat depth_;
+	cv::Mat rgb_;
+	int ratio_;
+	float fx_, fy_, cx_, cy_;
+	unsigned int rowsPerJob_;
+};
+
+}
+
+#endif /* DEPTHTOCLOUD_H_ */
@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INCREMENTALGRID_H_
+#define INCREMENTALGRID_H_
+
+#include <rtabmap_ros/PosesDiff.h>
+#include <rtabmap/core/Transform.h>
+#include <opencv2/core/core.hpp>
+#include <map>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Occupancy grid kept between updates. Only the local maps of the nodes
+ * added, moved or removed since the last update are rasterized again.
+ * A cell is occupied if at least one local map sees an obstacle in it,
+ * empty if it is only seen as ground, unknown otherwise. Cells are aligned
+ * on the world origin, so the grid can grow without shifting the cells.
+ */
+class IncrementalGrid
+{
+public:
+	IncrementalGrid(float cellSize = 0.05f, float minMapSize = 0.0f, bool eroded = false);
+
+	// The grid is cleared if the parameters change
+	void setParameters(float cellSize, float minMapSize, bool eroded);
+	void clear();
+
+	/**
+	 * @param poses optimized poses, nodes not in poses are removed from the grid
+	 * @param localMaps <ground, obstacles> local maps (CV_32FC2 points in node frame)
+	 * @param linearUpdate nodes moved more than this distance (m) are rasterized again
+	 * @param angularUpdate nodes rotated more than this angle (rad) are rasterized again
+	 * @return the region modified (in cells of map()), empty if nothing changed
+	 */
+	cv::Rect update(
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+			float linearUpdate,
+			float angularUpdate);
+
+	// CV_8SC1: -1=unknown, 0=empty, 100=occupied
+	const cv::Mat & map() const {return map_;}
+	cv::Mat & map() {return map_;}
+	float xMin() const {return float(cellX0_)*cellSize_;}
+	float yMin() const {return float(cellY0_)*cellSize_;}
+	float cellSize() const {return cellSize_;}
+	// true if the map has been resized (or its origin changed) by the last update
+	bool resized() const {return resized_;}
+	int nodes() const {return (int)nodes_.size();}
+	// approximate memory used
+	size_t bytes() const;
+
+	// recompute cells of the region from the local maps (e.g., after modifying map() directly)
+	void refresh(const cv::Rect & region);
+
+private:
+	struct NodeCells
+	{
+		std::vector<cv::Point2i> ground; // world cells
+		std::vector<cv::Point2i> obstacles; // world cells
+		cv::Rect bounds; // world cells
+	};
+	void rasterize(const NodeCells & node, int increment);
+	void grow(const cv::Rect & worldBounds);
+	char rawValue(int row, int col) const;
+	cv::Rect toGrid(const cv::Rect & worldRect) const;
+
+private:
+	float cellSize_;
+	float minMapSize_;
+	bool eroded_;
+	int cellX0_;
+	int cellY0_;
+	bool resized_;
+	PosesDiff posesDiff_;
+	std::map<int, NodeCells> nodes_;
+	cv::Mat groundCounts_; // CV_16UC1
+	cv::Mat obstacleCounts_; // CV_16UC1
+	cv::Mat map_; // CV_8SC1
+};
+
+}
+
+#endif /* INCREMENTALGRID_H_ */
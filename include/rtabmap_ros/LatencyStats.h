@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LATENCYSTATS_H_
+#define LATENCYSTATS_H_
+
+#include <ros/ros.h>
+#include <boost/atomic.hpp>
+#include <string>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Per-stage latency histograms of a node, published as p50/p95/p99 on
+ * /diagnostics. Each stage keeps the last "historySize" durations in a ring
+ * buffer: recording a duration is a relaxed atomic increment and a store,
+ * without lock, so it can stay enabled in production. The stages are added
+ * before init(), then durations can be recorded from any thread.
+ *
+ * Parameter: "latency_stats_period" (s, default 1, 0 = disabled).
+ */
+class LatencyStats
+{
+public:
+	class ScopedTimer
+	{
+	public:
+		ScopedTimer(const LatencyStats & stats, int stage) :
+			stats_(stats),
+			stage_(stage),
+			start_(ros::WallTime::now())
+		{}
+		~ScopedTimer()
+		{
+			stats_.record(stage_, (ros::WallTime::now() - start_).toSec());
+		}
+	private:
+		const LatencyStats & stats_;
+		int stage_;
+		ros::WallTime start_;
+	};
+
+public:
+	LatencyStats(const std::string & name, int historySize = 256);
+	~LatencyStats();
+
+	// Returns the id of the stage to use with record()
+	int addStage(const std::string & name);
+
+	void init(ros::NodeHandle & nh, ros::NodeHandle & pnh);
+	bool enabled() const {return enabled_;}
+
+	// Lock-free, seconds
+	void record(int stage, double duration) const
+	{
+		if(enabled_)
+		{
+			Stage & s = *stages_[stage];
+			unsigned int i = s.count.fetch_add(1, boost::memory_order_relaxed);
+			s.durations[i % s.durations.size()] = (float)duration;
+		}
+	}
+
+private:
+	void timerCallback(const ros::WallTimerEvent &);
+
+private:
+	struct Stage
+	{
+		std::string name;
+		std::vector<float> durations;
+		boost::atomic<unsigned int> count;
+		unsigned int published; // count at the last publication
+	};
+
+	std::string name_;
+	std::string hardwareId_;
+	int historySize_;
+	bool enabled_;
+	std::vector<Stage*> stages_;
+	std::vector<float> sorted_;
+	ros::WallTimer timer_;
+	ros::Publisher diagnosticsPub_;
+};
+
+}
+
+#endif /* LATENCYSTATS_H_ */
@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MAPDATADELTA_H_
+#define MAPDATADELTA_H_
+
+#include <rtabmap_ros/MapData.h>
+#include <rtabmap_ros/PosesDiff.h>
+#include <rtabmap/core/Signature.h>
+#include <rtabmap/core/Link.h>
+#include <rtabmap/core/Transform.h>
+#include <map>
+#include <set>
+
+namespace rtabmap_ros {
+
+/**
+ * Encodes the map graph as a stream of MapData messages containing only
+ * what changed since the previous message: new nodes, moved or relabeled
+ * nodes, new links and removed nodes. The first message, and the one
+ * following a reset or a requested resync, is a keyframe with the
+ * whole graph. Node data are sent only once per node.
+ */
+class MapDataDeltaEncoder
+{
+public:
+	/**
+	 * @param linearTolerance distance (m) under which a node is not sent again
+	 * @param angularTolerance angle (rad) under which a node is not sent again
+	 */
+	MapDataDeltaEncoder(float linearTolerance = 0.001f, float angularTolerance = 0.001f);
+
+	// Next message will be a keyframe
+	void clear();
+
+	void encode(
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::map<int, int> & mapIds,
+			const std::map<int, double> & stamps,
+			const std::map<int, std::string> & labels,
+			const std::map<int, std::vector<unsigned char> > & userDatas,
+			const std::multimap<int, rtabmap::Link> & links,
+			const rtabmap::Transform & mapToOdom,
+			rtabmap_ros::MapData & msg);
+
+	// Add the node data to the message if it has not been already sent
+	bool addNode(const rtabmap::Signature & signature, rtabmap_ros::MapData & msg);
+
+	unsigned int sequence() const {return sequence_;}
+
+private:
+	bool keyframe_;
+	unsigned int sequence_;
+	PosesDiff poses_;
+	std::map<int, std::string> labels_;
+	std::multimap<int, rtabmap::Link> links_;
+	std::set<int> sentNodes_;
+};
+
+/**
+ * Rebuilds the whole graph from the messages of a MapDataDeltaEncoder.
+ * When a message is missing, decode() fails until the next keyframe, which
+ * can be requested with the "resync_map_data" service of rtabmap.
+ */
+class MapDataDeltaDecoder
+{
+public:
+	MapDataDeltaDecoder();
+
+	void clear();
+
+	/**
+	 * Apply "msg" to the graph and set "output" to a MapData with the whole
+	 * graph and the nodes of "msg".
+	 * @return false if the message cannot be applied (missing
+	 *         messages or waiting for a keyframe)
+	 */
+	bool decode(const rtabmap_ros::MapData & msg, rtabmap_ros::MapData & output);
+
+	bool synchronized() const {return synchronized_;}
+
+private:
+	bool synchronized_;
+	unsigned int sequence_;
+	std::map<int, rtabmap::Transform> poses_;
+	std::map<int, int> mapIds_;
+	std::map<int, double> stamps_;
+	std::map<int, std::string> labels_;
+	std::map<int, std::vector<unsigned char> > userDatas_;
+	std::multimap<int, rtabmap::Link> links_;
+};
+
+}
+
+#endif /* MAPDATADELTA_H_ */
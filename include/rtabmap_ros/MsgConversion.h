@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/features2d/features2d.hpp>
+#include <cv_bridge/cv_bridge.h>
 
 #include <rtabmap/core/Transform.h>
 #include <rtabmap/core/Link.h>
@@ -65,6 +66,12 @@ rtabmap::Transform transformFromPoseMsg(const geometry_msgs::Pose & msg);
 void compressedMatToBytes(const cv::Mat & compressed, std::vector<unsigned char> & bytes);
 cv::Mat compressedMatFromBytes(const std::vector<unsigned char> & bytes, bool copy = true);
 
+// Returns image->image without copying the data. If the data belongs to the ROS
+// message (no conversion was done by cv_bridge::toCvShare), the message is kept
+// alive until the last cv::Mat referencing it is released. The data must be
+// treated as read-only.
+cv::Mat sharedImageFromROS(const cv_bridge::CvImageConstPtr & image);
+
 void infoFromROS(const rtabmap_ros::Info & info, rtabmap::Statistics & stat);
 void infoToROS(const rtabmap::Statistics & stats, rtabmap_ros::Info & info);
 
@@ -100,7 +107,12 @@ void mapGraphToROS(
 		const std::map<int, std::vector<unsigned char> > & userDatas,
 		const std::multimap<int, rtabmap::Link> & links,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_ros::Graph & msg);
+		rtabmap_ros::Graph & msg,
+		bool packed = false,      // fill msg.packed instead of the node and link arrays (poses in float32)
+		bool compressed = false); // zlib compress msg.packed
+
+// Returns msg if it is not packed, otherwise unpacks it in "unpacked" and returns it.
+const rtabmap_ros::Graph & mapGraphUnpacked(const rtabmap_ros::Graph & msg, rtabmap_ros::Graph & unpacked);
 
 rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg);
 void nodeDataToROS(const rtabmap::Signature & signature, rtabmap_ros::NodeData & msg);
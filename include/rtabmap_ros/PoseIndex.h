@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef POSEINDEX_H_
+#define POSEINDEX_H_
+
+#include <rtabmap/core/Transform.h>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+#include <map>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Spatial index of the node poses: a 2D grid (x,y) of node IDs, updated
+ * incrementally with the nodes added, moved and removed since the last
+ * update. Radius searches only look at the cells around the query, so
+ * radius filtering and local map selection don't depend on the size of
+ * the whole map.
+ */
+class PoseIndex
+{
+public:
+	PoseIndex(float cellSize = 1.0f);
+
+	void setCellSize(float cellSize);
+	float cellSize() const {return cellSize_;}
+	void clear();
+	size_t size() const {return poses_.size();}
+
+	// Synchronize the index with "poses"
+	void update(const std::map<int, rtabmap::Transform> & poses);
+
+	const std::map<int, rtabmap::Transform> & poses() const {return poses_;}
+
+	// IDs (sorted) of the nodes within "radius" of (x,y,z)
+	std::vector<int> radiusSearch(float x, float y, float z, float radius) const;
+
+	/**
+	 * Same as rtabmap::graph::radiusPosesFiltering() with keepLatest: the poses
+	 * are visited oldest first and the latest node of each cluster is kept,
+	 * on the indexed poses or on the subset "ids" (sorted) if not null.
+	 * @param angle rad, 0 means any orientation
+	 */
+	std::map<int, rtabmap::Transform> radiusFiltering(float radius, float angle, const std::vector<int> * ids = 0) const;
+
+private:
+	boost::uint64_t key(float x, float y) const;
+	void insert(int id, const rtabmap::Transform & pose);
+	void remove(int id, const rtabmap::Transform & pose);
+
+private:
+	float cellSize_;
+	std::map<int, rtabmap::Transform> poses_;
+	boost::unordered_map<boost::uint64_t, std::vector<int> > cells_;
+};
+
+}
+
+#endif /* POSEINDEX_H_ */
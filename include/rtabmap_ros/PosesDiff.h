@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef POSESDIFF_H_
+#define POSESDIFF_H_
+
+#include <rtabmap/core/Transform.h>
+#include <map>
+#include <set>
+
+namespace rtabmap_ros {
+
+/**
+ * Tracks the poses of a graph between updates and reports the nodes
+ * added, removed and moved. Between loop closures most optimized poses
+ * don't change, so map consumers only have to process these nodes. The
+ * reference pose of a node is updated only when it moved more than the
+ * tolerances, so small corrections cannot accumulate unnoticed.
+ */
+class PosesDiff
+{
+public:
+	/**
+	 * @param linearTolerance distance (m) under which a node is not considered moved
+	 * @param angularTolerance angle (rad) under which a node is not considered moved
+	 * @param planar compare only x, y and yaw (for 2D maps)
+	 */
+	PosesDiff(float linearTolerance = 0.01f, float angularTolerance = 0.0175f, bool planar = false);
+
+	void setTolerances(float linearTolerance, float angularTolerance, bool planar = false);
+	void clear();
+
+	// Compare the poses to those of the previous update
+	void update(const std::map<int, rtabmap::Transform> & poses);
+
+	// Forget a node, it will be reported as added on next update if still in the graph
+	void remove(int id);
+
+	const std::set<int> & added() const {return added_;}
+	const std::set<int> & removed() const {return removed_;}
+	const std::set<int> & moved() const {return moved_;}
+	bool changed() const {return added_.size() || removed_.size() || moved_.size();}
+
+	// Reference poses, i.e. the poses used by the consumer
+	const std::map<int, rtabmap::Transform> & poses() const {return poses_;}
+
+	static bool hasMoved(
+			const rtabmap::Transform & previous,
+			const rtabmap::Transform & current,
+			float linearTolerance,
+			float angularTolerance,
+			bool planar = false);
+
+private:
+	float linearTolerance_;
+	float angularTolerance_;
+	bool planar_;
+	std::map<int, rtabmap::Transform> poses_;
+	std::set<int> added_;
+	std::set<int> removed_;
+	std::set<int> moved_;
+};
+
+}
+
+#endif /* POSESDIFF_H_ */
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SESSIONFILTER_H_
+#define SESSIONFILTER_H_
+
+#include <rtabmap_ros/PosesDiff.h>
+#include <rtabmap/core/Transform.h>
+#include <map>
+#include <set>
+
+namespace rtabmap_ros {
+
+/**
+ * Radius filtering of the nodes done per session (map ID). The filtered
+ * poses of a session are kept as long as none of its nodes is added,
+ * removed or moved, so the sessions of a multi-session map that are
+ * finished only cost the comparison of their poses. Changed sessions are
+ * filtered with a PoseIndex. Nodes of overlapping sessions are not
+ * filtered against each other: the assemblers merge them in the same
+ * voxel hash or grid.
+ */
+class SessionFilter
+{
+public:
+	/**
+	 * @param radius filtering radius (m), 0 means no filtering
+	 * @param angle filtering angle (rad), 0 means any orientation
+	 * @param linearUpdate nodes moved less than this distance (m) are not considered moved
+	 * @param angularUpdate nodes rotated less than this angle (rad) are not considered moved
+	 */
+	SessionFilter(float radius = 0.5f, float angle = 0.0f, float linearUpdate = 0.01f, float angularUpdate = 0.0175f);
+
+	// The filter is cleared if the parameters change
+	void setParameters(float radius, float angle, float linearUpdate, float angularUpdate);
+	void clear();
+
+	/**
+	 * @param poses optimized poses of all sessions
+	 * @param mapIds session of each node, nodes not in mapIds are in session -1
+	 * @return the filtered poses of all sessions (reference poses, see PosesDiff)
+	 */
+	std::map<int, rtabmap::Transform> filter(
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::map<int, int> & mapIds);
+
+	// Sessions added, modified or removed by the last filter()
+	const std::set<int> & changed() const {return changed_;}
+	int sessions() const {return (int)sessions_.size();}
+
+private:
+	struct Session
+	{
+		PosesDiff poses;
+		std::map<int, rtabmap::Transform> filtered;
+	};
+
+private:
+	float radius_;
+	float angle_;
+	float linearUpdate_;
+	float angularUpdate_;
+	std::map<int, Session> sessions_;
+	std::set<int> changed_;
+};
+
+}
+
+#endif /* SESSIONFILTER_H_ */
@@ -0,0 +1,90 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/exception_ptr.hpp>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Persistent worker threads to process a batch of independent jobs, like
+ * decompressing and converting the nodes of a MapData message. The caller
+ * thread also processes jobs, and the workers are reused between batches
+ * instead of creating threads for each node.
+ */
+class ThreadPool
+{
+public:
+	// Pool shared by all nodes/nodelets of the process, with one thread per core
+	static ThreadPool & instance();
+
+	/**
+	 * @param threads total number of threads processing a batch, including
+	 *        the caller thread (0 = number of cores)
+	 */
+	ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	int threads() const {return (int)workers_.size()+1;}
+
+	/**
+	 * Call job(i) for each i in [0, count) and return when all jobs are done.
+	 * Jobs must not depend on each other nor call parallelFor(). Batches of
+	 * different threads are processed one after the other. If a job throws,
+	 * the jobs not started yet are skipped and the first exception is
+	 * rethrown once the jobs running are done.
+	 */
+	void parallelFor(int count, const boost::function<void (int)> & job);
+
+private:
+	void workerLoop();
+	void runJobs(boost::mutex::scoped_lock & lock);
+
+private:
+	std::vector<boost::thread*> workers_;
+	boost::mutex batchMutex_; // one batch at a time
+	boost::mutex mutex_;
+	boost::condition_variable jobCondition_;
+	boost::condition_variable doneCondition_;
+	const boost::function<void (int)> * job_;
+	int count_;
+	int next_;
+	int running_;
+	boost::exception_ptr error_; // first exception thrown by a job of the batch
+	bool stop_;
+};
+
+}
+
+#endif /* THREADPOOL_H_ */
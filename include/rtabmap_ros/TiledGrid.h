@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TILEDGRID_H_
+#define TILEDGRID_H_
+
+#include <rtabmap_ros/PosesDiff.h>
+#include <rtabmap/core/Transform.h>
+#include <opencv2/core/core.hpp>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace rtabmap_ros {
+
+/**
+ * Occupancy grid stored in fixed-size square tiles, allocated only where
+ * local maps fall. Like IncrementalGrid, only the local maps of the nodes
+ * added, moved or removed since the last update are rasterized again. The
+ * tiles are kept at full resolution, but each one is exported at a
+ * resolution level depending on its distance to the viewpoint (the robot):
+ * full resolution within "fullResolutionRadius", then the resolution is
+ * halved each time the distance is doubled. A tile always covers the same
+ * area (tileCells*cellSize meters), tile (0,0) starting at the world origin.
+ */
+class TiledGrid
+{
+public:
+	typedef std::pair<int, int> TileKey; // <x,y> tile indexes
+
+public:
+	TiledGrid(float cellSize = 0.05f, int tileCells = 256, int levels = 4, float fullResolutionRadius = 10.0f);
+
+	// The grid is cleared if the parameters change. "tileCells" is rounded
+	// to a multiple of 2^(levels-1).
+	void setParameters(float cellSize, int tileCells, int levels, float fullResolutionRadius);
+	void clear();
+
+	/**
+	 * @param poses optimized poses, nodes not in poses are removed from the grid
+	 * @param localMaps <ground, obstacles> local maps (CV_32FC2 points in node frame)
+	 * @param linearUpdate nodes moved more than this distance (m) are rasterized again
+	 * @param angularUpdate nodes rotated more than this angle (rad) are rasterized again
+	 * @return the number of tiles modified
+	 */
+	int update(
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+			float linearUpdate,
+			float angularUpdate);
+
+	// Sets the resolution level of the tiles from their distance to (x,y)
+	void setViewpoint(float x, float y);
+
+	/**
+	 * Tiles modified (content or resolution level) since the last call, or
+	 * all tiles if "all" is true. "removed" is set to the tiles removed
+	 * since the last call (empty if "all" is true).
+	 */
+	std::vector<TileKey> takeModified(bool all, std::vector<TileKey> & removed);
+
+	// All tiles, the modified tiles are not reset
+	std::vector<TileKey> tileKeys() const;
+
+	// CV_8SC1 (-1=unknown, 0=empty, 100=occupied) of tileCells/2^level cells
+	// per side, at the current level of the tile. Empty if the tile doesn't exist.
+	cv::Mat tileMap(const TileKey & key, int & level) const;
+
+	float cellSize() const {return cellSize_;}
+	int tileCells() const {return tileCells_;}
+	float tileLength() const {return float(tileCells_)*cellSize_;}
+	int tiles() const {return (int)tiles_.size();}
+	int nodes() const {return (int)nodes_.size();}
+	// approximate memory used
+	size_t bytes() const;
+
+private:
+	struct NodeCells
+	{
+		std::vector<cv::Point2i> ground; // world cells
+		std::vector<cv::Point2i> obstacles; // world cells
+	};
+	struct Tile
+	{
+		Tile() : points(0), level(0) {}
+		cv::Mat groundCounts; // CV_16UC1
+		cv::Mat obstacleCounts; // CV_16UC1
+		int points; // sum of the counts, the tile is removed at 0
+		int level;
+	};
+	void rasterize(const NodeCells & node, int increment, std::set<TileKey> & touched);
+	int tileLevel(const TileKey & key) const;
+
+private:
+	float cellSize_;
+	int tileCells_;
+	int levels_;
+	float fullResolutionRadius_;
+	float viewX_;
+	float viewY_;
+	PosesDiff posesDiff_;
+	std::map<int, NodeCells> nodes_;
+	std::map<TileKey, Tile> tiles_;
+	std::set<TileKey> modified_;
+	std::set<TileKey> removed_;
+};
+
+}
+
+#endif /* TILEDGRID_H_ */
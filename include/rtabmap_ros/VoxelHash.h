@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef VOXELHASH_H_
+#define VOXELHASH_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <boost/unordered_map.hpp>
+#include <boost/cstdint.hpp>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+/**
+ * Persistent voxel grid: points can be added and removed without
+ * re-filtering the whole cloud. Each voxel keeps the sum of its points, so
+ * getCloud() returns the centroid of each occupied voxel, like
+ * pcl::VoxelGrid would do on the union of the added clouds.
+ * Removed clouds must be exactly the same as the ones added.
+ */
+template<typename PointT>
+class VoxelHash
+{
+public:
+	VoxelHash(float voxelSize = 0.05f) :
+		voxelSize_(voxelSize)
+	{}
+
+	void setVoxelSize(float voxelSize)
+	{
+		if(voxelSize != voxelSize_)
+		{
+			voxelSize_ = voxelSize;
+			voxels_.clear();
+		}
+	}
+	float voxelSize() const {return voxelSize_;}
+	void clear() {voxels_.clear();}
+	bool empty() const {return voxels_.empty();}
+	size_t size() const {return voxels_.size();}
+	// approximate memory used
+	size_t bytes() const
+	{
+		return voxels_.size()*(sizeof(typename VoxelMap::value_type) + 2*sizeof(void*)) +
+				voxels_.bucket_count()*sizeof(void*);
+	}
+
+	void add(const pcl::PointCloud<PointT> & cloud)
+	{
+		update(cloud, 1);
+	}
+
+	void remove(const pcl::PointCloud<PointT> & cloud)
+	{
+		update(cloud, -1);
+	}
+
+	// merge another voxel hash with the same voxel size
+	void add(const VoxelHash<PointT> & other)
+	{
+		for(typename VoxelMap::const_iterator iter=other.voxels_.begin(); iter!=other.voxels_.end(); ++iter)
+		{
+			Voxel & voxel = voxels_[iter->first];
+			voxel.x += iter->second.x;
+			voxel.y += iter->second.y;
+			voxel.z += iter->second.z;
+			voxel.r += iter->second.r;
+			voxel.g += iter->second.g;
+			voxel.b += iter->second.b;
+			voxel.count += iter->second.count;
+		}
+	}
+
+	typename pcl::PointCloud<PointT>::Ptr getCloud() const
+	{
+		typename pcl::PointCloud<PointT>::Ptr cloud(new pcl::PointCloud<PointT>);
+		cloud->resize(voxels_.size());
+		int oi = 0;
+		for(typename VoxelMap::const_iterator iter=voxels_.begin(); iter!=voxels_.end(); ++iter)
+		{
+			const Voxel & voxel = iter->second;
+			PointT & pt = cloud->at(oi++);
+			pt.x = voxel.x / double(voxel.count);
+			pt.y = voxel.y / double(voxel.count);
+			pt.z = voxel.z / double(voxel.count);
+			setColor(pt, voxel);
+		}
+		return cloud;
+	}
+
+private:
+	struct Voxel
+	{
+		Voxel() : x(0), y(0), z(0), r(0), g(0), b(0), count(0) {}
+		double x, y, z;
+		double r, g, b;
+		int count;
+	};
+	typedef boost::unordered_map<boost::uint64_t, Voxel> VoxelMap;
+
+	// 21 bits per axis: +-52 km with 5 cm voxels
+	boost::uint64_t key(const PointT & pt) const
+	{
+		boost::uint64_t x = boost::uint64_t(int(std::floor(pt.x / voxelSize_)) & 0x1FFFFF);
+		boost::uint64_t y = boost::uint64_t(int(std::floor(pt.y / voxelSize_)) & 0x1FFFFF);
+		boost::uint64_t z = boost::uint64_t(int(std::floor(pt.z / voxelSize_)) & 0x1FFFFF);
+		return (x << 42) | (y << 21) | z;
+	}
+
+	void update(const pcl::PointCloud<PointT> & cloud, int sign)
+	{
+		for(typename pcl::PointCloud<PointT>::const_iterator iter=cloud.begin(); iter!=cloud.end(); ++iter)
+		{
+			if(!pcl::isFinite(*iter))
+			{
+				continue;
+			}
+			boost::uint64_t k = key(*iter);
+			if(sign < 0)
+			{
+				typename VoxelMap::iterator jter = voxels_.find(k);
+				if(jter != voxels_.end())
+				{
+					Voxel & voxel = jter->second;
+					if(--voxel.count <= 0)
+					{
+						voxels_.erase(jter);
+					}
+					else
+					{
+						voxel.x -= iter->x;
+						voxel.y -= iter->y;
+						voxel.z -= iter->z;
+						addColor(voxel, *iter, -1.0);
+					}
+				}
+			}
+			else
+			{
+				Voxel & voxel = voxels_[k];
+				++voxel.count;
+				voxel.x += iter->x;
+				voxel.y += iter->y;
+				voxel.z += iter->z;
+				addColor(voxel, *iter, 1.0);
+			}
+		}
+	}
+
+	static void addColor(Voxel &, const pcl::PointXYZ &, double) {}
+	static void addColor(Voxel & voxel, const pcl::PointXYZRGB & pt, double sign)
+	{
+		voxel.r += sign*pt.r;
+		voxel.g += sign*pt.g;
+		voxel.b += sign*pt.b;
+	}
+	static void setColor(pcl::PointXYZ &, const Voxel &) {}
+	static void setColor(pcl::PointXYZRGB & pt, const Voxel & voxel)
+	{
+		pt.r = (unsigned char)(voxel.r / double(voxel.count) + 0.5);
+		pt.g = (unsigned char)(voxel.g / double(voxel.count) + 0.5);
+		pt.b = (unsigned char)(voxel.b / double(voxel.count) + 0.5);
+		pt.a = 255;
+	}
+
+private:
+	float voxelSize_;
+	VoxelMap voxels_;
+};
+
+}
+
+#endif /* VOXELHASH_H_ */
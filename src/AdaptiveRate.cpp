@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/AdaptiveRate.h"
+#include <rtabmap/core/Statistics.h>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+// weight of a new time in the smoothed time
+static const double kSmoothing = 0.3;
+
+AdaptiveRate::AdaptiveRate() :
+		enabled_(false),
+		maxLoad_(0.8),
+		minRate_(0.5),
+		timeout_(2.0),
+		rtabmapTime_(0.0),
+		odomTime_(0.0),
+		lastRate_(-1.0)
+{
+}
+
+void AdaptiveRate::init(ros::NodeHandle & nh, ros::NodeHandle & pnh)
+{
+	pnh.param("adaptive_rate", enabled_, enabled_);
+	pnh.param("max_load", maxLoad_, maxLoad_);
+	pnh.param("min_rate", minRate_, minRate_);
+	pnh.param("adaptive_timeout", timeout_, timeout_);
+
+	if(enabled_)
+	{
+		ROS_INFO("Adaptive rate: max_load=%f, min_rate=%f Hz, adaptive_timeout=%f s", maxLoad_, minRate_, timeout_);
+		infoSub_ = nh.subscribe("info", 1, &AdaptiveRate::infoCallback, this);
+		odomInfoSub_ = nh.subscribe("odom_info", 1, &AdaptiveRate::odomInfoCallback, this);
+	}
+}
+
+double AdaptiveRate::rate(double maxRate)
+{
+	if(!enabled_)
+	{
+		return maxRate;
+	}
+
+	boost::mutex::scoped_lock lock(mutex_);
+	ros::Time now = ros::Time::now();
+	double time = 0.0;
+	if(!rtabmapUpdate_.isZero() && (now - rtabmapUpdate_).toSec() < timeout_)
+	{
+		time = rtabmapTime_;
+	}
+	if(!odomUpdate_.isZero() && (now - odomUpdate_).toSec() < timeout_ && odomTime_ > time)
+	{
+		time = odomTime_;
+	}
+
+	double rate = maxRate;
+	if(time > 0.0)
+	{
+		rate = maxLoad_ / time;
+		if(maxRate > 0.0 && rate > maxRate)
+		{
+			rate = maxRate;
+		}
+		if(rate < minRate_)
+		{
+			rate = minRate_;
+		}
+	}
+
+	if(lastRate_ < 0.0 || std::fabs(rate - lastRate_) > 0.1*lastRate_)
+	{
+		ROS_DEBUG("Adaptive rate: %f Hz (processing time=%f s)", rate, time);
+		lastRate_ = rate;
+	}
+	return rate;
+}
+
+void AdaptiveRate::infoCallback(const rtabmap_ros::InfoConstPtr & msg)
+{
+	for(unsigned int i=0; i<msg->statsKeys.size() && i<msg->statsValues.size(); ++i)
+	{
+		if(msg->statsKeys[i].compare(rtabmap::Statistics::kTimingTotal()) == 0)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			addTime(rtabmapTime_, rtabmapUpdate_, msg->statsValues[i]/1000.0);
+			break;
+		}
+	}
+}
+
+void AdaptiveRate::odomInfoCallback(const rtabmap_ros::OdomInfoConstPtr & msg)
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	addTime(odomTime_, odomUpdate_, msg->time);
+}
+
+void AdaptiveRate::addTime(double & smoothed, ros::Time & lastUpdate, double time)
+{
+	if(time <= 0.0)
+	{
+		return;
+	}
+	ros::Time now = ros::Time::now();
+	if(lastUpdate.isZero() || (now - lastUpdate).toSec() >= timeout_)
+	{
+		smoothed = time;
+	}
+	else
+	{
+		smoothed = kSmoothing*time + (1.0-kSmoothing)*smoothed;
+	}
+	lastUpdate = now;
+}
+
+}
@@ -0,0 +1,202 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/CompactCloud.h"
+#include <limits>
+#include <cmath>
+#include <istream>
+#include <ostream>
+
+namespace rtabmap_ros {
+
+namespace {
+const boost::uint64_t kMaxPoints = 1<<24; // of a node, a larger count in a stream is a corrupted one
+}
+
+CompactCloud::CompactCloud() :
+		step_(0.0f)
+{
+	origin_[0] = origin_[1] = origin_[2] = 0.0f;
+}
+
+CompactCloud::CompactCloud(const pcl::PointCloud<pcl::PointXYZRGB> & cloud) :
+		step_(0.0f)
+{
+	origin_[0] = origin_[1] = origin_[2] = 0.0f;
+	set(cloud);
+}
+
+void CompactCloud::clear()
+{
+	origin_[0] = origin_[1] = origin_[2] = 0.0f;
+	step_ = 0.0f;
+	xyz_.clear();
+	rgb_.clear();
+}
+
+void CompactCloud::set(const pcl::PointCloud<pcl::PointXYZRGB> & cloud)
+{
+	clear();
+
+	// bounding box of the valid points
+	float min[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+	float max[3] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+	int valid = 0;
+	for(unsigned int i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.points[i];
+		if(pcl::isFinite(pt))
+		{
+			const float * p = pt.data;
+			for(int k=0; k<3; ++k)
+			{
+				if(p[k] < min[k]) min[k] = p[k];
+				if(p[k] > max[k]) max[k] = p[k];
+			}
+			++valid;
+		}
+	}
+	if(valid == 0)
+	{
+		return;
+	}
+
+	float halfExtent = 0.0f;
+	for(int k=0; k<3; ++k)
+	{
+		origin_[k] = (min[k] + max[k]) / 2.0f;
+		if(max[k] - origin_[k] > halfExtent)
+		{
+			halfExtent = max[k] - origin_[k];
+		}
+	}
+	step_ = halfExtent > 0.0f?halfExtent/32767.0f:1.0f;
+	float invStep = 1.0f/step_;
+
+	xyz_.resize(valid*3);
+	rgb_.resize(valid*3);
+	int oi = 0;
+	for(unsigned int i=0; i<cloud.size(); ++i)
+	{
+		const pcl::PointXYZRGB & pt = cloud.points[i];
+		if(pcl::isFinite(pt))
+		{
+			for(int k=0; k<3; ++k)
+			{
+				float q = std::floor((pt.data[k] - origin_[k])*invStep + 0.5f);
+				q = q > 32767.0f?32767.0f:q < -32767.0f?-32767.0f:q;
+				xyz_[oi+k] = boost::int16_t(q);
+			}
+			rgb_[oi] = pt.r;
+			rgb_[oi+1] = pt.g;
+			rgb_[oi+2] = pt.b;
+			oi+=3;
+		}
+	}
+}
+
+size_t CompactCloud::bytes() const
+{
+	return sizeof(CompactCloud) + xyz_.capacity()*sizeof(boost::int16_t) + rgb_.capacity();
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr CompactCloud::uncompress(const rtabmap::Transform & transform) const
+{
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+	appendTo(*cloud, transform);
+	return cloud;
+}
+
+void CompactCloud::appendTo(pcl::PointCloud<pcl::PointXYZRGB> & output, const rtabmap::Transform & transform) const
+{
+	if(empty())
+	{
+		return;
+	}
+
+	// fold the dequantization in the transform: p = T * (origin + step*q)
+	Eigen::Affine3f t = transform.isNull()?Eigen::Affine3f::Identity():transform.toEigen3f();
+	Eigen::Matrix3f rotation = t.linear() * step_;
+	Eigen::Vector3f translation = t * Eigen::Vector3f(origin_[0], origin_[1], origin_[2]);
+
+	size_t first = output.size();
+	output.resize(first + size());
+	for(size_t i=0, j=0; i<size(); ++i, j+=3)
+	{
+		pcl::PointXYZRGB & pt = output.points[first+i];
+		float qx = xyz_[j], qy = xyz_[j+1], qz = xyz_[j+2];
+		pt.x = rotation(0,0)*qx + rotation(0,1)*qy + rotation(0,2)*qz + translation[0];
+		pt.y = rotation(1,0)*qx + rotation(1,1)*qy + rotation(1,2)*qz + translation[1];
+		pt.z = rotation(2,0)*qx + rotation(2,1)*qy + rotation(2,2)*qz + translation[2];
+		pt.r = rgb_[j];
+		pt.g = rgb_[j+1];
+		pt.b = rgb_[j+2];
+		pt.a = 255;
+	}
+}
+
+void CompactCloud::write(std::ostream & stream) const
+{
+	boost::uint32_t points = size();
+	stream.write((const char*)origin_, sizeof(origin_));
+	stream.write((const char*)&step_, sizeof(step_));
+	stream.write((const char*)&points, sizeof(points));
+	if(points)
+	{
+		stream.write((const char*)xyz_.data(), xyz_.size()*sizeof(boost::int16_t));
+		stream.write((const char*)rgb_.data(), rgb_.size());
+	}
+}
+
+bool CompactCloud::read(std::istream & stream)
+{
+	clear();
+	boost::uint32_t points = 0;
+	stream.read((char*)origin_, sizeof(origin_));
+	stream.read((char*)&step_, sizeof(step_));
+	stream.read((char*)&points, sizeof(points));
+	if(!stream || boost::uint64_t(points) > kMaxPoints)
+	{
+		clear();
+		return false;
+	}
+	if(points)
+	{
+		xyz_.resize(size_t(boost::uint64_t(points)*3));
+		rgb_.resize(size_t(boost::uint64_t(points)*3));
+		stream.read((char*)xyz_.data(), xyz_.size()*sizeof(boost::int16_t));
+		stream.read((char*)rgb_.data(), rgb_.size());
+		if(!stream)
+		{
+			clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+}
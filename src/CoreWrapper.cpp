@@ -68,13 +68,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace rtabmap;
 
-float max3( const float& a, const float& b, const float& c)
+static float max3( const float& a, const float& b, const float& c)
 {
 	float m=a>b?a:b;
 	return m>c?m:c;
 }
 
-CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
+CoreWrapper::CoreWrapper(bool deleteDbOnStart, const ros::NodeHandle & nh, const ros::NodeHandle & pnh) :
+		nh_(nh),
+		pnh_(pnh),
 		paused_(false),
 		lastPose_(Transform::getIdentity()),
 		rotVariance_(0),
@@ -86,8 +88,23 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		configPath_(""),
 		databasePath_(UDirectory::homeDir()+"/.ros/"+rtabmap::Parameters::getDefaultDatabaseName()),
 		waitForTransform_(false),
+		tfMessageFilter_(false),
+		tfTolerance_(0.0),
+		tfCacheLocalTransforms_(false),
 		useActionForGoal_(false),
+		zeroCopyImages_(false),
 		mapToOdom_(rtabmap::Transform::getIdentity()),
+		mapsManager_(nh, pnh),
+		latency_("rtabmap"),
+		latencyTf_(latency_.addStage("tf")),
+		latencyConversion_(latency_.addStage("conversion")),
+		latencyInputDelay_(latency_.addStage("input delay")),
+		latencyProcess_(latency_.addStage("process")),
+		latencyStats_(latency_.addStage("stats publishing")),
+		latencyMapsUpdate_(latency_.addStage("maps update")),
+		latencyMapsPublish_(latency_.addStage("maps publishing")),
+		latencyTotal_(latency_.addStage("total")),
+		tfFilter_(0),
 		depthSync_(0),
 		depthScanSync_(0),
 		stereoScanSync_(0),
@@ -99,12 +116,20 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		stereoApproxTFSync_(0),
 		stereoExactTFSync_(0),
 		transformThread_(0),
+		mapsThread_(0),
+		mapsQueueMaxSize_(1),
+		mapsDropped_(0),
+		mapDataDeltaKeyframe_(true),
+		graphPacked_(false),
+		graphPackedCompressed_(false),
 		rate_(Parameters::defaultRtabmapDetectionRate()),
 		time_(ros::Time::now()),
-		mbClient_("move_base", true)
+		serviceSpinner_(0),
+		mbClient_("move_base", true),
+		stopping_(false)
 {
-	ros::NodeHandle nh;
-	ros::NodeHandle pnh("~");
+	ros::NodeHandle & nh = nh_;
+	ros::NodeHandle & pnh = pnh_;
 
 	bool subscribeLaserScan = false;
 	bool subscribeDepth = true;
@@ -113,6 +138,8 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 	bool publishTf = true;
 	double tfDelay = 0.05; // 20 Hz
 	bool stereoApproxSync = false;
+	bool publishMapsAsync = false;
+	int serviceThreads = 0;
 
 	// ROS related parameters (private)
 	pnh.param("subscribe_depth", subscribeDepth, subscribeDepth);
@@ -144,7 +171,21 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 	pnh.param("publish_tf", publishTf, publishTf);
 	pnh.param("tf_delay", tfDelay, tfDelay);
 	pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
+	pnh.param("tf_message_filter", tfMessageFilter_, tfMessageFilter_);
+	pnh.param("tf_tolerance", tfTolerance_, tfTolerance_);
+	pnh.param("tf_cache_local_transforms", tfCacheLocalTransforms_, tfCacheLocalTransforms_);
 	pnh.param("use_action_for_goal", useActionForGoal_, useActionForGoal_);
+	pnh.param("zero_copy_images", zeroCopyImages_, zeroCopyImages_);
+	pnh.param("publish_maps_async", publishMapsAsync, publishMapsAsync);
+	pnh.param("publish_maps_queue_size", mapsQueueMaxSize_, mapsQueueMaxSize_);
+	pnh.param("graph_packed", graphPacked_, graphPacked_);
+	pnh.param("graph_packed_compressed", graphPackedCompressed_, graphPackedCompressed_);
+	pnh.param("service_threads", serviceThreads, serviceThreads);
+	if(mapsQueueMaxSize_ < 1)
+	{
+		ROS_WARN("Parameter publish_maps_queue_size should be >= 1, setting it to 1.");
+		mapsQueueMaxSize_ = 1;
+	}
 
 	ROS_INFO("rtabmap: frame_id = %s", frameId_.c_str());
 	if(!odomFrameId_.empty())
@@ -154,9 +195,19 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 	ROS_INFO("rtabmap: map_frame_id = %s", mapFrameId_.c_str());
 	ROS_INFO("rtabmap: queue_size = %d", queueSize);
 	ROS_INFO("rtabmap: tf_delay = %f", tfDelay);
+	if(publishMapsAsync)
+	{
+		ROS_INFO("rtabmap: publish_maps_queue_size = %d (maps are published asynchronously)", mapsQueueMaxSize_);
+	}
+	if(graphPacked_)
+	{
+		ROS_INFO("rtabmap: graph_packed = true (compressed=%s)", graphPackedCompressed_?"true":"false");
+	}
 
 	infoPub_ = nh.advertise<rtabmap_ros::Info>("info", 1);
 	mapDataPub_ = nh.advertise<rtabmap_ros::MapData>("mapData", 1);
+	// only what changed since the previous message, deltas must not be dropped
+	mapDataDeltaPub_ = nh.advertise<rtabmap_ros::MapData>("mapData_delta", 10);
 	mapGraphPub_ = nh.advertise<rtabmap_ros::Graph>("graph", 1);
 	labelsPub_ = nh.advertise<visualization_msgs::MarkerArray>("labels", 1);
 
@@ -322,6 +373,7 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		{
 			ROS_INFO("rtabmap: Deleted database \"%s\" (--delete_db_on_start is set).", databasePath_.c_str());
 		}
+		mapsManager_.removeMapCachesFile();
 	}
 
 	if(databasePath_.size())
@@ -335,30 +387,51 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 
 	// Init RTAB-Map
 	rtabmap_.init(parameters_, databasePath_);
+	if(databasePath_.size())
+	{
+		// local maps of the nodes already in the database
+		mapsManager_.loadMapCaches(rtabmap_.getMemory(), databasePath_);
+	}
 
 	// setup services
-	updateSrv_ = nh.advertiseService("update_parameters", &CoreWrapper::updateRtabmapCallback, this);
-	resetSrv_ = nh.advertiseService("reset", &CoreWrapper::resetRtabmapCallback, this);
-	pauseSrv_ = nh.advertiseService("pause", &CoreWrapper::pauseRtabmapCallback, this);
-	resumeSrv_ = nh.advertiseService("resume", &CoreWrapper::resumeRtabmapCallback, this);
-	triggerNewMapSrv_ = nh.advertiseService("trigger_new_map", &CoreWrapper::triggerNewMapCallback, this);
-	backupDatabase_ = nh.advertiseService("backup", &CoreWrapper::backupDatabaseCallback, this);
-	setModeLocalizationSrv_ = nh.advertiseService("set_mode_localization", &CoreWrapper::setModeLocalizationCallback, this);
-	setModeMappingSrv_ = nh.advertiseService("set_mode_mapping", &CoreWrapper::setModeMappingCallback, this);
-	getMapDataSrv_ = nh.advertiseService("get_map", &CoreWrapper::getMapCallback, this);
-	getGridMapSrv_ = nh.advertiseService("get_grid_map", &CoreWrapper::getGridMapCallback, this);
-	getProjMapSrv_ = nh.advertiseService("get_proj_map", &CoreWrapper::getProjMapCallback, this);
-	publishMapDataSrv_ = nh.advertiseService("publish_map", &CoreWrapper::publishMapCallback, this);
-	setGoalSrv_ = nh.advertiseService("set_goal", &CoreWrapper::setGoalCallback, this);
-	setLabelSrv_ = nh.advertiseService("set_label", &CoreWrapper::setLabelCallback, this);
-	listLabelsSrv_ = nh.advertiseService("list_labels", &CoreWrapper::listLabelsCallback, this);
+	ros::NodeHandle serviceNh = nh;
+	if(serviceThreads > 0)
+	{
+		// A long request (e.g., get_map on a big database) doesn't
+		// block the sensor callbacks, see rtabmapMutex_
+		serviceNh.setCallbackQueue(&serviceQueue_);
+	}
+	updateSrv_ = serviceNh.advertiseService("update_parameters", &CoreWrapper::updateRtabmapCallback, this);
+	resetSrv_ = serviceNh.advertiseService("reset", &CoreWrapper::resetRtabmapCallback, this);
+	pauseSrv_ = serviceNh.advertiseService("pause", &CoreWrapper::pauseRtabmapCallback, this);
+	resumeSrv_ = serviceNh.advertiseService("resume", &CoreWrapper::resumeRtabmapCallback, this);
+	triggerNewMapSrv_ = serviceNh.advertiseService("trigger_new_map", &CoreWrapper::triggerNewMapCallback, this);
+	backupDatabase_ = serviceNh.advertiseService("backup", &CoreWrapper::backupDatabaseCallback, this);
+	setModeLocalizationSrv_ = serviceNh.advertiseService("set_mode_localization", &CoreWrapper::setModeLocalizationCallback, this);
+	setModeMappingSrv_ = serviceNh.advertiseService("set_mode_mapping", &CoreWrapper::setModeMappingCallback, this);
+	getMapDataSrv_ = serviceNh.advertiseService("get_map", &CoreWrapper::getMapCallback, this);
+	getGridMapSrv_ = serviceNh.advertiseService("get_grid_map", &CoreWrapper::getGridMapCallback, this);
+	getProjMapSrv_ = serviceNh.advertiseService("get_proj_map", &CoreWrapper::getProjMapCallback, this);
+	publishMapDataSrv_ = serviceNh.advertiseService("publish_map", &CoreWrapper::publishMapCallback, this);
+	exportMapSrv_ = serviceNh.advertiseService("export_map", &CoreWrapper::exportMapCallback, this);
+	setGoalSrv_ = serviceNh.advertiseService("set_goal", &CoreWrapper::setGoalCallback, this);
+	setLabelSrv_ = serviceNh.advertiseService("set_label", &CoreWrapper::setLabelCallback, this);
+	listLabelsSrv_ = serviceNh.advertiseService("list_labels", &CoreWrapper::listLabelsCallback, this);
+	resyncMapDataSrv_ = serviceNh.advertiseService("resync_map_data", &CoreWrapper::resyncMapDataCallback, this);
 #ifdef WITH_OCTOMAP
-	octomapBinarySrv_ = nh.advertiseService("octomap_binary", &CoreWrapper::octomapBinaryCallback, this);
-	octomapFullSrv_ = nh.advertiseService("octomap_full", &CoreWrapper::octomapFullCallback, this);
+	octomapBinarySrv_ = serviceNh.advertiseService("octomap_binary", &CoreWrapper::octomapBinaryCallback, this);
+	octomapFullSrv_ = serviceNh.advertiseService("octomap_full", &CoreWrapper::octomapFullCallback, this);
 #endif
 
+	latency_.init(nh, pnh);
+
 	setupCallbacks(subscribeDepth, subscribeLaserScan, subscribeStereo, queueSize, stereoApproxSync);
 
+	if(publishMapsAsync)
+	{
+		mapsThread_ = new boost::thread(boost::bind(&CoreWrapper::mapsPublishLoop, this));
+	}
+
 	int optimizeIterations = 0;
 	Parameters::parse(parameters_, Parameters::kRGBDOptimizeIterations(), optimizeIterations);
 	if(publishTf && optimizeIterations != 0)
@@ -370,15 +443,39 @@ CoreWrapper::CoreWrapper(bool deleteDbOnStart) :
 		UWARN("Graph optimization is disabled (%s=0), the tf between frame \"%s\" and odometry frame will not be published. You can safely ignore this warning if you are using map_optimizer node.",
 				Parameters::kRGBDOptimizeIterations().c_str(), mapFrameId_.c_str());
 	}
+
+	if(serviceThreads > 0)
+	{
+		serviceSpinner_ = new ros::AsyncSpinner(serviceThreads, &serviceQueue_);
+		serviceSpinner_->start();
+		ROS_INFO("rtabmap: service_threads = %d (services are called on their own queue)", serviceThreads);
+	}
 }
 
 CoreWrapper::~CoreWrapper()
 {
+	if(serviceSpinner_)
+	{
+		serviceSpinner_->stop();
+		delete serviceSpinner_;
+	}
+
+	mapToOdomMutex_.lock();
+	mapsQueueMutex_.lock();
+	stopping_ = true;
+	mapsQueueMutex_.unlock();
+	mapToOdomMutex_.unlock();
 	if(transformThread_)
 	{
 		transformThread_->join();
 		delete transformThread_;
 	}
+	if(mapsThread_)
+	{
+		mapsQueueCondition_.notify_all();
+		mapsThread_->join();
+		delete mapsThread_;
+	}
 
 	if(depthSync_)
 		delete depthSync_;
@@ -400,10 +497,18 @@ CoreWrapper::~CoreWrapper()
 		delete stereoApproxTFSync_;
 	if(stereoExactTFSync_)
 		delete stereoExactTFSync_;
+	if(tfFilter_)
+		delete tfFilter_;
+
+	if(databasePath_.size())
+	{
+		boost::mutex::scoped_lock lock(mapsManagerMutex_);
+		mapsManager_.saveMapCaches(rtabmap_.getMemory(), databasePath_);
+	}
 
 	this->saveParameters(configPath_);
 
-	ros::NodeHandle nh;
+	ros::NodeHandle & nh = nh_;
 	ParametersMap parameters = Parameters::getDefaultParameters();
 	for(ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
 	{
@@ -443,7 +548,7 @@ void CoreWrapper::saveParameters(const std::string & configFile)
 		}
 
 		ParametersMap parameters = Parameters::getDefaultParameters();
-		ros::NodeHandle nh;
+		ros::NodeHandle & nh = nh_;
 		for(ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
 		{
 			std::string value;
@@ -466,11 +571,13 @@ void CoreWrapper::publishLoop(double tfDelay)
 	if(tfDelay == 0)
 		return;
 	ros::Rate r(1.0 / tfDelay);
-	while(ros::ok())
+	bool stopping = false;
+	while(ros::ok() && !stopping)
 	{
-		if(!odomFrameId_.empty())
+		mapToOdomMutex_.lock();
+		stopping = stopping_;
+		if(!stopping && !odomFrameId_.empty())
 		{
-			mapToOdomMutex_.lock();
 			ros::Time tfExpiration = ros::Time::now() + ros::Duration(tfDelay);
 			geometry_msgs::TransformStamped msg;
 			msg.child_frame_id = odomFrameId_;
@@ -478,12 +585,68 @@ void CoreWrapper::publishLoop(double tfDelay)
 			msg.header.stamp = tfExpiration;
 			rtabmap_ros::transformToGeometryMsg(mapToOdom_, msg.transform);
 			tfBroadcaster_.sendTransform(msg);
-			mapToOdomMutex_.unlock();
 		}
+		mapToOdomMutex_.unlock();
 		r.sleep();
 	}
 }
 
+void CoreWrapper::mapsPublishLoop()
+{
+	while(ros::ok())
+	{
+		MapsSnapshot snapshot;
+		{
+			boost::mutex::scoped_lock lock(mapsQueueMutex_);
+			if(stopping_)
+			{
+				break;
+			}
+			if(mapsQueue_.empty())
+			{
+				// timed wait to check ros::ok() periodically
+				mapsQueueCondition_.timed_wait(lock, boost::posix_time::milliseconds(100));
+				continue;
+			}
+			snapshot = mapsQueue_.front();
+			mapsQueue_.pop_front();
+		}
+
+		UTimer timer;
+		boost::mutex::scoped_lock lock(mapsManagerMutex_);
+		std::map<int, rtabmap::Transform> filteredPoses = mapsManager_.updateMapCaches(
+				snapshot.poses,
+				0, // memory is not thread-safe, use only the snapshot's signatures
+				false,
+				false,
+				false,
+				snapshot.signatures);
+		double updateTime = timer.ticks();
+		latency_.record(latencyMapsUpdate_, updateTime);
+		mapsManager_.publishMaps(filteredPoses, snapshot.stamp, mapFrameId_);
+		double publishTime = timer.ticks();
+		latency_.record(latencyMapsPublish_, publishTime);
+		UDEBUG("Maps published asynchronously (%fs)", updateTime + publishTime);
+	}
+}
+
+CoreWrapper::MapsSnapshot CoreWrapper::takeMapsSnapshot(const ros::Time & stamp, bool updateCloud, bool updateProj, bool updateGrid)
+{
+	MapsSnapshot snapshot;
+	snapshot.stamp = stamp;
+	snapshot.poses = rtabmap_.getLocalOptimizedPoses();
+
+	// Memory is not thread-safe, get the data of the nodes to add to the caches now
+	mapsManagerMutex_.lock();
+	std::set<int> ids = mapsManager_.getUncachedNodes(snapshot.poses, updateCloud, updateProj, updateGrid);
+	mapsManagerMutex_.unlock();
+	for(std::set<int>::iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	{
+		snapshot.signatures.insert(std::make_pair(*iter, rtabmap_.getMemory()->getSignatureDataConst(*iter)));
+	}
+	return snapshot;
+}
+
 void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 {
 	if(!paused_)
@@ -518,10 +681,11 @@ void CoreWrapper::defaultCallback(const sensor_msgs::ImageConstPtr & imageMsg)
 		}
 
 		// process data
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
 		UTimer timer;
 		if(rtabmap_.isIDsGenerated() || ptrImage->header.seq > 0)
 		{
-			if(!rtabmap_.process(ptrImage->image.clone(), ptrImage->header.seq))
+			if(!rtabmap_.process(zeroCopyImages_?rtabmap_ros::sharedImageFromROS(ptrImage):ptrImage->image.clone(), ptrImage->header.seq))
 			{
 				ROS_WARN("RTAB-Map could not process the data received! (ROS id = %d)", ptrImage->header.seq);
 			}
@@ -551,6 +715,7 @@ bool CoreWrapper::commonOdomUpdate(const nav_msgs::OdometryConstPtr & odomMsg)
 	if(!paused_)
 	{
 		Transform odom = rtabmap_ros::transformFromPoseMsg(odomMsg->pose.pose);
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
 		if(!lastPose_.isIdentity() && odom.isIdentity())
 		{
 			UWARN("Odometry is reset (identity pose detected). Increment map id!");
@@ -561,6 +726,7 @@ bool CoreWrapper::commonOdomUpdate(const nav_msgs::OdometryConstPtr & odomMsg)
 
 		lastPose_ = odom;
 		lastPoseStamp_ = odomMsg->header.stamp;
+		lock.unlock();
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
 		float rotVariance = max3(odomMsg->pose.covariance[21], odomMsg->pose.covariance[28], odomMsg->pose.covariance[35]);
 		if(uIsFinite(rotVariance) && rotVariance > rotVariance_)
@@ -594,7 +760,7 @@ bool CoreWrapper::commonOdomTFUpdate(const ros::Time & stamp)
 		Transform odom;
 		try
 		{
-			if(waitForTransform_)
+			if(waitForTransform_ && !tfMessageFilter_)
 			{
 				//if(!tfBuffer_.canTransform(odomFrameId_, frameId_, stamp, ros::Duration(1)))
 				if(!tfListener_.waitForTransform(odomFrameId_, frameId_, stamp, ros::Duration(1)))
@@ -614,6 +780,7 @@ bool CoreWrapper::commonOdomTFUpdate(const ros::Time & stamp)
 			return false;
 		}
 
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
 		if(!lastPose_.isIdentity() && odom.isIdentity())
 		{
 			UWARN("Odometry is reset (identity pose detected). Increment map id!");
@@ -624,6 +791,7 @@ bool CoreWrapper::commonOdomTFUpdate(const ros::Time & stamp)
 
 		lastPose_ = odom;
 		lastPoseStamp_ = stamp;
+		lock.unlock();
 		// Throttle
 		if(rate_>0.0f)
 		{
@@ -640,29 +808,50 @@ bool CoreWrapper::commonOdomTFUpdate(const ros::Time & stamp)
 
 Transform CoreWrapper::getTransform(const std::string & fromFrameId, const std::string & toFrameId, const ros::Time & stamp) const
 {
+	LatencyStats::ScopedTimer latencyTimer(latency_, latencyTf_);
+
+	// The sensors are assumed fixed on the robot with tf_cache_local_transforms
+	bool localTransform = tfCacheLocalTransforms_ && fromFrameId.compare(frameId_) == 0;
+	if(localTransform)
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		std::map<std::string, Transform>::iterator iter = localTransforms_.find(toFrameId);
+		if(iter != localTransforms_.end())
+		{
+			return iter->second;
+		}
+	}
+
 	// TF ready?
-	Transform localTransform;
+	Transform transform;
 	try
 	{
-		if(waitForTransform_)
+		// with tf_message_filter, the transforms of the sensor data are already available
+		if(waitForTransform_ && !tfMessageFilter_)
 		{
 			//if(!tfBuffer_.canTransform(fromFrameId, toFrameId, stamp, ros::Duration(1)))
 			if(!tfListener_.waitForTransform(fromFrameId, toFrameId, stamp, ros::Duration(1)))
 			{
 				ROS_WARN("Could not get transform from %s to %s after 1 second!", fromFrameId.c_str(), toFrameId.c_str());
-				return localTransform;
+				return transform;
 			}
 		}
 
 		tf::StampedTransform tmp;
 		tfListener_.lookupTransform(fromFrameId, toFrameId, stamp, tmp);
-		localTransform = rtabmap_ros::transformFromTF(tmp);
+		transform = rtabmap_ros::transformFromTF(tmp);
 	}
 	catch(tf::TransformException & ex)
 	{
 		ROS_WARN("%s",ex.what());
 	}
-	return localTransform;
+
+	if(localTransform && !transform.isNull())
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		localTransforms_.insert(std::make_pair(toFrameId, transform));
+	}
+	return transform;
 }
 
 void CoreWrapper::commonDepthCallback(
@@ -721,11 +910,13 @@ void CoreWrapper::commonDepthCallback(
 		}
 
 		// set maps manager laser scan range parameter
+		mapsManagerMutex_.lock();
 		mapsManager_.setLaserScanParameters(
 				scanMsg->range_max,
 				scanMsg->angle_min,
 				scanMsg->angle_max,
 				scanMsg->angle_increment);
+		mapsManagerMutex_.unlock();
 
 		//transform in frameId_ frame
 		sensor_msgs::PointCloud2 scanOut;
@@ -752,6 +943,7 @@ void CoreWrapper::commonDepthCallback(
 		scan = util3d::laserScanFromPointCloud(*pclScan);
 	}
 
+	ros::WallTime conversionStart = ros::WallTime::now();
 	cv_bridge::CvImageConstPtr ptrImage;
 	if(imageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 	   imageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
@@ -763,6 +955,7 @@ void CoreWrapper::commonDepthCallback(
 		ptrImage = cv_bridge::toCvShare(imageMsg, "bgr8");
 	}
 	cv_bridge::CvImageConstPtr ptrDepth = cv_bridge::toCvShare(depthMsg);
+	latency_.record(latencyConversion_, (ros::WallTime::now() - conversionStart).toSec());
 
 	image_geometry::PinholeCameraModel model;
 	model.fromCameraInfo(*cameraInfoMsg);
@@ -773,12 +966,12 @@ void CoreWrapper::commonDepthCallback(
 
 	process(ptrImage->header.seq,
 			scanMsg.get() != 0?scanMsg->header.stamp:ptrDepth->header.stamp,
-			ptrImage->image,
+			zeroCopyImages_?rtabmap_ros::sharedImageFromROS(ptrImage):ptrImage->image,
 			lastPose_,
 			odomFrameId,
 			rotVariance_>0?rotVariance_:1.0f,
 			transVariance_>0?transVariance_:1.0f,
-			ptrDepth->image,
+			zeroCopyImages_?rtabmap_ros::sharedImageFromROS(ptrDepth):ptrDepth->image,
 			fx,
 			fy,
 			cx,
@@ -849,11 +1042,13 @@ void CoreWrapper::commonStereoCallback(
 		}
 
 		// set maps manager laser scan range parameter
+		mapsManagerMutex_.lock();
 		mapsManager_.setLaserScanParameters(
 				scanMsg->range_max,
 				scanMsg->angle_min,
 				scanMsg->angle_max,
 				scanMsg->angle_increment);
+		mapsManagerMutex_.unlock();
 
 		//transform in frameId_ frame
 		sensor_msgs::PointCloud2 scanOut;
@@ -881,6 +1076,7 @@ void CoreWrapper::commonStereoCallback(
 		scan = util3d::laserScanFromPointCloud(*pclScan);
 	}
 
+	ros::WallTime conversionStart = ros::WallTime::now();
 	cv_bridge::CvImageConstPtr ptrLeftImage, ptrRightImage;
 	if(leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 	   leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
@@ -892,6 +1088,7 @@ void CoreWrapper::commonStereoCallback(
 		ptrLeftImage = cv_bridge::toCvShare(leftImageMsg, "bgr8");
 	}
 	ptrRightImage = cv_bridge::toCvShare(rightImageMsg, "mono8");
+	latency_.record(latencyConversion_, (ros::WallTime::now() - conversionStart).toSec());
 
 	image_geometry::StereoCameraModel model;
 	model.fromCameraInfo(*leftCamInfoMsg, *rightCamInfoMsg);
@@ -903,12 +1100,12 @@ void CoreWrapper::commonStereoCallback(
 
 	process(leftImageMsg->header.seq,
 			scanMsg.get() != 0?scanMsg->header.stamp:leftImageMsg->header.stamp,
-			ptrLeftImage->image,
+			zeroCopyImages_?rtabmap_ros::sharedImageFromROS(ptrLeftImage):ptrLeftImage->image,
 			lastPose_,
 			odomFrameId,
 			rotVariance_>0?rotVariance_:1.0f,
 			transVariance_>0?transVariance_:1.0f,
-			ptrRightImage->image,
+			zeroCopyImages_?rtabmap_ros::sharedImageFromROS(ptrRightImage):ptrRightImage->image,
 			fx,
 			baseline,
 			cx,
@@ -1047,9 +1244,13 @@ void CoreWrapper::process(
 		const cv::Mat & scan,
 		int scanMaxPts)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	UTimer timer;
 	if(rtabmap_.isIDsGenerated() || id > 0)
 	{
+		// time between the sensor data and its processing (synchronization, TF and conversion)
+		latency_.record(latencyInputDelay_, (ros::Time::now() - stamp).toSec());
+
 		double timeRtabmap = 0.0;
 		cv::Mat imageB;
 		if(!depthOrRightImage.empty())
@@ -1057,7 +1258,7 @@ void CoreWrapper::process(
 			if(depthOrRightImage.type() == CV_8UC1)
 			{
 				//right image
-				imageB = depthOrRightImage.clone();
+				imageB = zeroCopyImages_?depthOrRightImage:depthOrRightImage.clone();
 			}
 			else if(depthOrRightImage.type() != CV_16UC1)
 			{
@@ -1083,13 +1284,13 @@ void CoreWrapper::process(
 			else
 			{
 				// depth short
-				imageB = depthOrRightImage.clone();
+				imageB = zeroCopyImages_?depthOrRightImage:depthOrRightImage.clone();
 			}
 		}
 
 		SensorData data(scan,
 				scanMaxPts,
-				image.clone(),
+				zeroCopyImages_?image:image.clone(),
 				imageB,
 				fx,
 				fyOrBaseline,
@@ -1105,22 +1306,51 @@ void CoreWrapper::process(
 		if(rtabmap_.process(data))
 		{
 			timeRtabmap = timer.ticks();
+			latency_.record(latencyProcess_, timeRtabmap);
 			mapToOdomMutex_.lock();
 			mapToOdom_ = rtabmap_.getMapCorrection();
 			odomFrameId_ = odomFrameId;
 			mapToOdomMutex_.unlock();
 
 			// Publish local graph, info
-			this->publishStats(stamp);
-			std::map<int, rtabmap::Transform> filteredPoses;
+			{
+				LatencyStats::ScopedTimer latencyTimer(latency_, latencyStats_);
+				this->publishStats(stamp);
+			}
 
-			filteredPoses = mapsManager_.updateMapCaches(
-					rtabmap_.getLocalOptimizedPoses(),
-					rtabmap_.getMemory(),
-					false,
-					false,
-					false);
-			mapsManager_.publishMaps(filteredPoses, stamp, mapFrameId_);
+			if(mapsThread_)
+			{
+				// Only take a snapshot, the maps are created and published by mapsPublishLoop()
+				MapsSnapshot snapshot = takeMapsSnapshot(stamp, false, false, false);
+
+				mapsQueueMutex_.lock();
+				mapsQueue_.push_back(snapshot);
+				while((int)mapsQueue_.size() > mapsQueueMaxSize_)
+				{
+					// latest wins
+					mapsQueue_.pop_front();
+					++mapsDropped_;
+				}
+				mapsQueueMutex_.unlock();
+				mapsQueueCondition_.notify_one();
+			}
+			else
+			{
+				boost::mutex::scoped_lock lock(mapsManagerMutex_);
+				std::map<int, rtabmap::Transform> filteredPoses;
+
+				ros::WallTime mapsStart = ros::WallTime::now();
+				filteredPoses = mapsManager_.updateMapCaches(
+						rtabmap_.getLocalOptimizedPoses(),
+						rtabmap_.getMemory(),
+						false,
+						false,
+						false);
+				ros::WallTime mapsUpdated = ros::WallTime::now();
+				latency_.record(latencyMapsUpdate_, (mapsUpdated - mapsStart).toSec());
+				mapsManager_.publishMaps(filteredPoses, stamp, mapFrameId_);
+				latency_.record(latencyMapsPublish_, (ros::WallTime::now() - mapsUpdated).toSec());
+			}
 
 			// update goal if planning is enabled
 			if(!currentMetricGoal_.isNull())
@@ -1181,12 +1411,15 @@ void CoreWrapper::process(
 		else
 		{
 			timeRtabmap = timer.ticks();
+			latency_.record(latencyProcess_, timeRtabmap);
 		}
+		double timePublishing = timer.ticks();
+		latency_.record(latencyTotal_, timeRtabmap + timePublishing);
 		ROS_INFO("rtabmap: Rate=%.2fs, Limit=%.3fs, RTAB-Map=%.4fs, Pub=%.4fs (local map=%d, WM=%d)",
 				rate_>0?1.0f/rate_:0,
 				rtabmap_.getTimeThreshold()/1000.0f,
 				timeRtabmap,
-				timer.ticks(),
+				timePublishing,
 				(int)rtabmap_.getLocalOptimizedPoses().size(),
 				rtabmap_.getWMSize()+rtabmap_.getSTMSize());
 	}
@@ -1287,6 +1520,7 @@ void CoreWrapper::goalCallback(const geometry_msgs::PoseStampedConstPtr & msg)
 		return;
 	}
 	ROS_INFO("Planning: set goal %s", targetPose.prettyPrint().c_str());
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	UTimer timer;
 	rtabmap_.computePath(targetPose, false);
 	ROS_INFO("Planning: Time computing path = %f s", timer.ticks());
@@ -1302,6 +1536,7 @@ void CoreWrapper::goalGlobalCallback(const geometry_msgs::PoseStampedConstPtr &
 		return;
 	}
 	ROS_INFO("Planning: set goal %s", targetPose.prettyPrint().c_str());
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	UTimer timer;
 	rtabmap_.computePath(targetPose, true);
 	ROS_INFO("Planning: Time computing path = %f s", timer.ticks());
@@ -1311,7 +1546,7 @@ void CoreWrapper::goalGlobalCallback(const geometry_msgs::PoseStampedConstPtr &
 bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
 	rtabmap::ParametersMap parameters = rtabmap::Parameters::getDefaultParameters();
-	ros::NodeHandle nh;
+	ros::NodeHandle & nh = nh_;
 	for(rtabmap::ParametersMap::iterator iter=parameters.begin(); iter!=parameters.end(); ++iter)
 	{
 		std::string vStr;
@@ -1340,6 +1575,7 @@ bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 		}
 	}
 	ROS_INFO("rtabmap: Updating parameters");
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	if(parameters.find(Parameters::kRtabmapDetectionRate()) != parameters.end())
 	{
 		rate_ = uStr2Float(parameters.at(Parameters::kRtabmapDetectionRate()));
@@ -1351,6 +1587,7 @@ bool CoreWrapper::updateRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::resetRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	ROS_INFO("rtabmap: Reset");
 	rtabmap_.resetMemory();
 	rotVariance_ = 0;
@@ -1358,7 +1595,14 @@ bool CoreWrapper::resetRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empt
 	lastPose_.setIdentity();
 	currentMetricGoal_.setNull();
 	latestNodeWasReached_ = false;
+	mapsQueueMutex_.lock();
+	mapsQueue_.clear();
+	mapsQueueMutex_.unlock();
+	mapsManagerMutex_.lock();
 	mapsManager_.clear();
+	mapsManager_.removeMapCachesFile();
+	mapsManagerMutex_.unlock();
+	mapDataDeltaKeyframe_ = true;
 	return true;
 }
 
@@ -1372,7 +1616,7 @@ bool CoreWrapper::pauseRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Empt
 	{
 		paused_ = true;
 		ROS_INFO("rtabmap: paused!");
-		ros::NodeHandle nh;
+		ros::NodeHandle & nh = nh_;
 		nh.setParam("is_rtabmap_paused", true);
 	}
 	return true;
@@ -1388,7 +1632,7 @@ bool CoreWrapper::resumeRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 	{
 		paused_ = false;
 		ROS_INFO("rtabmap: resumed!");
-		ros::NodeHandle nh;
+		ros::NodeHandle & nh = nh_;
 		nh.setParam("is_rtabmap_paused", false);
 	}
 	return true;
@@ -1396,6 +1640,7 @@ bool CoreWrapper::resumeRtabmapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::triggerNewMapCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	ROS_INFO("rtabmap: Trigger new map");
 	rtabmap_.triggerNewMap();
 	return true;
@@ -1403,6 +1648,7 @@ bool CoreWrapper::triggerNewMapCallback(std_srvs::Empty::Request&, std_srvs::Emp
 
 bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	ROS_INFO("Backup: Saving memory...");
 	rtabmap_.close();
 	ROS_INFO("Backup: Saving memory... done!");
@@ -1426,6 +1672,7 @@ bool CoreWrapper::backupDatabaseCallback(std_srvs::Empty::Request&, std_srvs::Em
 
 bool CoreWrapper::setModeLocalizationCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	ROS_INFO("rtabmap: Set localization mode");
 	rtabmap::ParametersMap parameters;
 	parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "false"));
@@ -1435,6 +1682,7 @@ bool CoreWrapper::setModeLocalizationCallback(std_srvs::Empty::Request&, std_srv
 
 bool CoreWrapper::setModeMappingCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	ROS_INFO("rtabmap: Set mapping mode");
 	rtabmap::ParametersMap parameters;
 	parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "true"));
@@ -1456,8 +1704,10 @@ bool CoreWrapper::getMapCallback(rtabmap_ros::GetMap::Request& req, rtabmap_ros:
 	std::map<int, std::string> labels;
 	std::map<int, std::vector<unsigned char> > userDatas;
 
-	if(req.graphOnly)
+	// the graph is copied under the lock, then the data of the nodes are
+	// loaded in batches, releasing rtabmap_ between them
 	{
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
 		rtabmap_.getGraph(
 				poses,
 				constraints,
@@ -1468,18 +1718,9 @@ bool CoreWrapper::getMapCallback(rtabmap_ros::GetMap::Request& req, rtabmap_ros:
 				req.optimized,
 				req.global);
 	}
-	else
+	if(!req.graphOnly)
 	{
-		rtabmap_.get3DMap(
-				signatures,
-				poses,
-				constraints,
-				mapIds,
-				stamps,
-				labels,
-				userDatas,
-				req.optimized,
-				req.global);
+		signatures = getNodesDataInBatches(poses);
 	}
 
 	if(poses.size() && poses.size() != mapIds.size())
@@ -1496,7 +1737,9 @@ bool CoreWrapper::getMapCallback(rtabmap_ros::GetMap::Request& req, rtabmap_ros:
 		userDatas,
 		constraints,
 		Transform::getIdentity(),
-		res.data.graph);
+		res.data.graph,
+		graphPacked_,
+		graphPackedCompressed_);
 
 	// add data
 	res.data.nodes.resize(signatures.size());
@@ -1514,13 +1757,20 @@ bool CoreWrapper::getMapCallback(rtabmap_ros::GetMap::Request& req, rtabmap_ros:
 
 bool CoreWrapper::getProjMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
 {
+	MapsSnapshot snapshot;
+	{
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
+		snapshot = takeMapsSnapshot(ros::Time::now(), false, true, false);
+	}
+	boost::mutex::scoped_lock lock(mapsManagerMutex_);
 	std::map<int, rtabmap::Transform> filteredPoses;
 	filteredPoses = mapsManager_.updateMapCaches(
-			rtabmap_.getLocalOptimizedPoses(),
-			rtabmap_.getMemory(),
+			snapshot.poses,
+			0,
 			false,
 			true,
-			false);
+			false,
+			snapshot.signatures);
 	if(filteredPoses.size())
 	{
 		// create the projection map
@@ -1557,13 +1807,20 @@ bool CoreWrapper::getProjMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::
 
 bool CoreWrapper::getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
 {
+	MapsSnapshot snapshot;
+	{
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
+		snapshot = takeMapsSnapshot(ros::Time::now(), false, false, true);
+	}
+	boost::mutex::scoped_lock lock(mapsManagerMutex_);
 	std::map<int, rtabmap::Transform> filteredPoses;
 	filteredPoses = mapsManager_.updateMapCaches(
-			rtabmap_.getLocalOptimizedPoses(),
-			rtabmap_.getMemory(),
+			snapshot.poses,
+			0,
 			false,
 			false,
-			true);
+			true,
+			snapshot.signatures);
 	if(filteredPoses.size())
 	{
 		// create the grid map
@@ -1614,8 +1871,9 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 		std::map<int, std::string> labels;
 		std::map<int, std::vector<unsigned char> > userDatas;
 
-		if(req.graphOnly)
+		// like getMapCallback(), the data are loaded in batches
 		{
+			boost::mutex::scoped_lock rtabmapLock(rtabmapMutex_);
 			rtabmap_.getGraph(
 					poses,
 					constraints,
@@ -1626,18 +1884,9 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 					req.optimized,
 					req.global);
 		}
-		else
+		if(!req.graphOnly)
 		{
-			rtabmap_.get3DMap(
-					signatures,
-					poses,
-					constraints,
-					mapIds,
-					stamps,
-					labels,
-					userDatas,
-					req.optimized,
-					req.global);
+			signatures = getNodesDataInBatches(poses);
 		}
 
 		if(poses.size() && poses.size() != mapIds.size())
@@ -1659,7 +1908,9 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 				userDatas,
 				constraints,
 				Transform::getIdentity(),
-				*graphMsg);
+				*graphMsg,
+				graphPacked_,
+				graphPackedCompressed_);
 
 			if(mapDataPub_.getNumSubscribers())
 			{
@@ -1687,12 +1938,14 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 
 		if(!req.graphOnly)
 		{
+			boost::mutex::scoped_lock lock(mapsManagerMutex_);
 			std::map<int, Transform> filteredPoses;
 			if(signatures.size())
 			{
+				// all the data is in "signatures"
 				filteredPoses = mapsManager_.updateMapCaches(
 						poses,
-						rtabmap_.getMemory(),
+						0,
 						true,
 						true,
 						true,
@@ -1793,6 +2046,7 @@ bool CoreWrapper::publishMapCallback(rtabmap_ros::PublishMap::Request& req, rtab
 
 bool CoreWrapper::setGoalCallback(rtabmap_ros::SetGoal::Request& req, rtabmap_ros::SetGoal::Response& res)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	int id = req.node_id;
 	if(id == 0 && !req.node_label.empty() && rtabmap_.getMemory())
 	{
@@ -1824,6 +2078,7 @@ bool CoreWrapper::setGoalCallback(rtabmap_ros::SetGoal::Request& req, rtabmap_ro
 
 bool CoreWrapper::setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_ros::SetLabel::Response& res)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	if(rtabmap_.labelLocation(req.node_id, req.node_label))
 	{
 		if(req.node_id > 0)
@@ -1849,8 +2104,80 @@ bool CoreWrapper::setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_
 	return true;
 }
 
+// Export the assembled cloud directly to a file, the nodes are loaded by
+// batches from the memory, so the whole map is never in memory
+bool CoreWrapper::exportMapCallback(rtabmap_ros::ExportMap::Request& req, rtabmap_ros::ExportMap::Response& res)
+{
+	ROS_INFO("rtabmap: Exporting map to \"%s\" (global=%s optimized=%s batch_size=%d)...",
+			req.path.c_str(),
+			req.global?"true":"false",
+			req.optimized?"true":"false",
+			req.batch_size);
+
+	std::map<int, Transform> poses;
+	std::multimap<int, Link> constraints;
+	std::map<int, int> mapIds;
+	std::map<int, double> stamps;
+	std::map<int, std::string> labels;
+	std::map<int, std::vector<unsigned char> > userDatas;
+	{
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
+		rtabmap_.getGraph(
+				poses,
+				constraints,
+				mapIds,
+				stamps,
+				labels,
+				userDatas,
+				req.optimized,
+				req.global);
+	}
+
+	size_t points = 0;
+	std::string error;
+	if(!mapsManager_.exportCloud(req.path, poses, boost::bind(&CoreWrapper::getNodesData, this, _1), req.batch_size, req.binary, points, error))
+	{
+		ROS_ERROR("rtabmap: Export map failed: %s", error.c_str());
+		return false;
+	}
+	res.nodes = poses.size();
+	res.points = points;
+	return true;
+}
+
+std::map<int, rtabmap::Signature> CoreWrapper::getNodesData(const std::vector<int> & ids)
+{
+	std::map<int, Signature> signatures;
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
+	if(rtabmap_.getMemory())
+	{
+		for(unsigned int i=0; i<ids.size(); ++i)
+		{
+			signatures.insert(std::make_pair(ids[i], rtabmap_.getMemory()->getSignatureDataConst(ids[i])));
+		}
+	}
+	return signatures;
+}
+
+// rtabmapMutex_ is released between the batches (of "map_cache_batch_size"
+// nodes), so a big map doesn't block the processing of the new data
+std::map<int, rtabmap::Signature> CoreWrapper::getNodesDataInBatches(const std::map<int, rtabmap::Transform> & poses)
+{
+	std::map<int, Signature> signatures;
+	std::vector<int> ids = uKeys(poses);
+	unsigned int batchSize = mapsManager_.getCacheBatchSize() > 0?mapsManager_.getCacheBatchSize():50;
+	for(unsigned int first=0; first<ids.size(); first+=batchSize)
+	{
+		unsigned int last = first+batchSize < ids.size()?first+batchSize:ids.size();
+		std::map<int, Signature> batch = getNodesData(std::vector<int>(ids.begin()+first, ids.begin()+last));
+		signatures.insert(batch.begin(), batch.end());
+	}
+	return signatures;
+}
+
 bool CoreWrapper::listLabelsCallback(rtabmap_ros::ListLabels::Request& req, rtabmap_ros::ListLabels::Response& res)
 {
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
 	if(rtabmap_.getMemory())
 	{
 		std::map<int, std::string> labels = rtabmap_.getMemory()->getAllLabels();
@@ -1860,6 +2187,50 @@ bool CoreWrapper::listLabelsCallback(rtabmap_ros::ListLabels::Request& req, rtab
 	return true;
 }
 
+void CoreWrapper::publishMapDataKeyframe(const ros::Time & stamp)
+{
+	std::map<int, Signature> signatures;
+	std::map<int, Transform> poses;
+	std::multimap<int, Link> constraints;
+	std::map<int, int> mapIds;
+	std::map<int, double> stamps;
+	std::map<int, std::string> labels;
+	std::map<int, std::vector<unsigned char> > userDatas;
+	rtabmap_.get3DMap(
+			signatures,
+			poses,
+			constraints,
+			mapIds,
+			stamps,
+			labels,
+			userDatas,
+			true,
+			false);
+
+	rtabmap_ros::MapDataPtr msg(new rtabmap_ros::MapData);
+	msg->header.stamp = stamp;
+	msg->header.frame_id = mapFrameId_;
+	mapDataDeltaEncoder_.clear();
+	mapDataDeltaEncoder_.encode(poses, mapIds, stamps, labels, userDatas, constraints, rtabmap_.getMapCorrection(), *msg);
+	msg->graph.header = msg->header;
+	for(std::map<int, Signature>::iterator iter = signatures.begin(); iter!=signatures.end(); ++iter)
+	{
+		mapDataDeltaEncoder_.addNode(iter->second, *msg);
+	}
+	mapDataDeltaPub_.publish(msg);
+	mapDataDeltaKeyframe_ = false;
+	ROS_INFO("rtabmap: Published map data keyframe (sequence=%u, %d poses, %d nodes)",
+			msg->sequence, (int)poses.size(), (int)msg->nodes.size());
+}
+
+bool CoreWrapper::resyncMapDataCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+{
+	boost::mutex::scoped_lock lock(rtabmapMutex_);
+	ROS_INFO("rtabmap: Resync of map data requested");
+	publishMapDataKeyframe(ros::Time::now());
+	return true;
+}
+
 void CoreWrapper::publishStats(const ros::Time & stamp)
 {
 	UDEBUG("Publishing stats...");
@@ -1873,6 +2244,28 @@ void CoreWrapper::publishStats(const ros::Time & stamp)
 		msg->header.frame_id = mapFrameId_;
 
 		rtabmap_ros::infoToROS(stats, *msg);
+		if(mapsThread_)
+		{
+			mapsQueueMutex_.lock();
+			msg->statsKeys.push_back("RosMaps/Queue_size/");
+			msg->statsValues.push_back(mapsQueue_.size());
+			msg->statsKeys.push_back("RosMaps/Dropped_snapshots/");
+			msg->statsValues.push_back(mapsDropped_);
+			mapsQueueMutex_.unlock();
+		}
+		MapsManager::CacheStatistics cacheStats = mapsManager_.getCacheStatistics();
+		msg->statsKeys.push_back("RosMaps/Cache_size/MB");
+		msg->statsValues.push_back(float(cacheStats.bytes)/(1024.0f*1024.0f));
+		msg->statsKeys.push_back("RosMaps/Cache_assembly_size/MB");
+		msg->statsValues.push_back(float(cacheStats.assemblyBytes)/(1024.0f*1024.0f));
+		msg->statsKeys.push_back("RosMaps/Cache_nodes/");
+		msg->statsValues.push_back(cacheStats.nodes);
+		msg->statsKeys.push_back("RosMaps/Cache_hits/");
+		msg->statsValues.push_back(cacheStats.hits);
+		msg->statsKeys.push_back("RosMaps/Cache_misses/");
+		msg->statsValues.push_back(cacheStats.misses);
+		msg->statsKeys.push_back("RosMaps/Cache_evictions/");
+		msg->statsValues.push_back(cacheStats.evictions);
 		infoPub_.publish(msg);
 	}
 
@@ -1895,7 +2288,9 @@ void CoreWrapper::publishStats(const ros::Time & stamp)
 				stats.getUserDatas(),
 				stats.constraints(),
 				stats.mapCorrection(),
-				*graphMsg);
+				*graphMsg,
+				graphPacked_,
+				graphPackedCompressed_);
 
 			if(mapDataPub_.getNumSubscribers())
 			{
@@ -1922,6 +2317,40 @@ void CoreWrapper::publishStats(const ros::Time & stamp)
 		}
 	}
 
+	if(mapDataDeltaPub_.getNumSubscribers())
+	{
+		if(mapDataDeltaKeyframe_)
+		{
+			publishMapDataKeyframe(stamp);
+		}
+		else if(stats.poses().size() == stats.getMapIds().size() &&
+				stats.poses().size() == stats.getStamps().size() &&
+				stats.poses().size() == stats.getLabels().size() &&
+				stats.poses().size() == stats.getUserDatas().size())
+		{
+			rtabmap_ros::MapDataPtr msg(new rtabmap_ros::MapData);
+			msg->header.stamp = stamp;
+			msg->header.frame_id = mapFrameId_;
+			mapDataDeltaEncoder_.encode(
+				stats.poses(),
+				stats.getMapIds(),
+				stats.getStamps(),
+				stats.getLabels(),
+				stats.getUserDatas(),
+				stats.constraints(),
+				stats.mapCorrection(),
+				*msg);
+			msg->graph.header = msg->header;
+			mapDataDeltaEncoder_.addNode(stats.getSignature(), *msg);
+			mapDataDeltaPub_.publish(msg);
+		}
+	}
+	else
+	{
+		// new subscribers will need the whole map
+		mapDataDeltaKeyframe_ = true;
+	}
+
 	if(labelsPub_.getNumSubscribers())
 	{
 		if(stats.poses().size() && stats.getLabels().size())
@@ -2138,8 +2567,13 @@ bool CoreWrapper::octomapBinaryCallback(
 	res.map.header.frame_id = mapFrameId_;
 	res.map.header.stamp = ros::Time::now();
 
-	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
-	poses = mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false, false);
+	MapsSnapshot snapshot;
+	{
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
+		snapshot = takeMapsSnapshot(res.map.header.stamp, true, false, false);
+	}
+	boost::mutex::scoped_lock lock(mapsManagerMutex_);
+	std::map<int, Transform> poses = mapsManager_.updateMapCaches(snapshot.poses, 0, true, false, false, snapshot.signatures);
 
 	octomap::OcTree * octree = mapsManager_.createOctomap(poses);
 	bool success = octree != 0 && octree->size() && octomap_msgs::binaryMapToMsg(*octree, res.map);
@@ -2158,8 +2592,13 @@ bool CoreWrapper::octomapFullCallback(
 	res.map.header.frame_id = mapFrameId_;
 	res.map.header.stamp = ros::Time::now();
 
-	std::map<int, Transform> poses = rtabmap_.getLocalOptimizedPoses();
-	poses = mapsManager_.updateMapCaches(poses, rtabmap_.getMemory(), true, false, false);
+	MapsSnapshot snapshot;
+	{
+		boost::mutex::scoped_lock lock(rtabmapMutex_);
+		snapshot = takeMapsSnapshot(res.map.header.stamp, true, false, false);
+	}
+	boost::mutex::scoped_lock lock(mapsManagerMutex_);
+	std::map<int, Transform> poses = mapsManager_.updateMapCaches(snapshot.poses, 0, true, false, false, snapshot.signatures);
 
 	octomap::OcTree * octree = mapsManager_.createOctomap(poses);
 	bool success = octree != 0 && octree->size() && octomap_msgs::fullMapToMsg(*octree, res.map);
@@ -2182,6 +2621,30 @@ bool CoreWrapper::octomapFullCallback(
  *     bool subscribe_laserScan
  *     bool subscribe_depth
  */
+void CoreWrapper::setupTFFilter(image_transport::SubscriberFilter & imageSub, int queueSize)
+{
+	if(tfMessageFilter_)
+	{
+		// Transforms needed by the callbacks: the sensor frame to frame_id
+		// and, with odometry from TF, to the odometry frame
+		std::vector<std::string> targetFrames;
+		targetFrames.push_back(frameId_);
+		if(!odomFrameId_.empty())
+		{
+			targetFrames.push_back(odomFrameId_);
+		}
+		tfFilter_ = new tf::MessageFilter<sensor_msgs::Image>(imageSub, tfListener_, frameId_, queueSize, nh_);
+		tfFilter_->setTargetFrames(targetFrames);
+		tfFilter_->setTolerance(ros::Duration(tfTolerance_));
+		imageTFInput_.connectInput(*tfFilter_);
+		ROS_INFO("Sensor data is synchronized when its TF is available (tf_tolerance=%f s)", tfTolerance_);
+	}
+	else
+	{
+		imageTFInput_.connectInput(imageSub);
+	}
+}
+
 void CoreWrapper::setupCallbacks(
 		bool subscribeDepth,
 		bool subscribeLaserScan,
@@ -2189,8 +2652,8 @@ void CoreWrapper::setupCallbacks(
 		int queueSize,
 		bool stereoApproxSync)
 {
-	ros::NodeHandle nh; // public
-	ros::NodeHandle pnh("~"); // private
+	ros::NodeHandle & nh = nh_; // public
+	ros::NodeHandle & pnh = pnh_; // private
 
 	if(subscribeDepth)
 	{
@@ -2206,6 +2669,7 @@ void CoreWrapper::setupCallbacks(
 		imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
 		imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
 		cameraInfoSub_.subscribe(rgb_nh, "camera_info", 1);
+		setupTFFilter(imageDepthSub_, queueSize);
 
 		if(odomFrameId_.empty())
 		{
@@ -2214,7 +2678,7 @@ void CoreWrapper::setupCallbacks(
 			{
 				ROS_INFO("Registering Depth+LaserScan callback...");
 				scanSub_.subscribe(nh, "scan", 1);
-				depthScanSync_ = new message_filters::Synchronizer<MyDepthScanSyncPolicy>(MyDepthScanSyncPolicy(queueSize), imageSub_, odomSub_, imageDepthSub_, cameraInfoSub_, scanSub_);
+				depthScanSync_ = new message_filters::Synchronizer<MyDepthScanSyncPolicy>(MyDepthScanSyncPolicy(queueSize), imageSub_, odomSub_, imageTFInput_, cameraInfoSub_, scanSub_);
 				depthScanSync_->registerCallback(boost::bind(&CoreWrapper::depthScanCallback, this, _1, _2, _3, _4, _5));
 
 				ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -2228,7 +2692,7 @@ void CoreWrapper::setupCallbacks(
 			else //!subscribeLaserScan
 			{
 				ROS_INFO("Registering Depth callback...");
-				depthSync_ = new message_filters::Synchronizer<MyDepthSyncPolicy>(MyDepthSyncPolicy(queueSize), imageSub_, odomSub_, imageDepthSub_, cameraInfoSub_);
+				depthSync_ = new message_filters::Synchronizer<MyDepthSyncPolicy>(MyDepthSyncPolicy(queueSize), imageSub_, odomSub_, imageTFInput_, cameraInfoSub_);
 				depthSync_->registerCallback(boost::bind(&CoreWrapper::depthCallback, this, _1, _2, _3, _4));
 
 				ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s",
@@ -2245,7 +2709,7 @@ void CoreWrapper::setupCallbacks(
 			if(subscribeLaserScan)
 			{
 				scanSub_.subscribe(nh, "scan", 1);
-				depthScanTFSync_ = new message_filters::Synchronizer<MyDepthScanTFSyncPolicy>(MyDepthScanTFSyncPolicy(queueSize), imageSub_, imageDepthSub_, cameraInfoSub_, scanSub_);
+				depthScanTFSync_ = new message_filters::Synchronizer<MyDepthScanTFSyncPolicy>(MyDepthScanTFSyncPolicy(queueSize), imageSub_, imageTFInput_, cameraInfoSub_, scanSub_);
 				depthScanTFSync_->registerCallback(boost::bind(&CoreWrapper::depthScanTFCallback, this, _1, _2, _3, _4));
 
 				ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s",
@@ -2257,7 +2721,7 @@ void CoreWrapper::setupCallbacks(
 			}
 			else //!subscribeLaserScan
 			{
-				depthTFSync_ = new message_filters::Synchronizer<MyDepthTFSyncPolicy>(MyDepthTFSyncPolicy(queueSize), imageSub_, imageDepthSub_, cameraInfoSub_);
+				depthTFSync_ = new message_filters::Synchronizer<MyDepthTFSyncPolicy>(MyDepthTFSyncPolicy(queueSize), imageSub_, imageTFInput_, cameraInfoSub_);
 				depthTFSync_->registerCallback(boost::bind(&CoreWrapper::depthTFCallback, this, _1, _2, _3));
 
 				ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s",
@@ -2283,6 +2747,7 @@ void CoreWrapper::setupCallbacks(
 		imageRectRight_.subscribe(right_it, right_nh.resolveName("image_rect"), 1, hintsRight);
 		cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
 		cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
+		setupTFFilter(imageRectLeft_, queueSize);
 
 		if(odomFrameId_.empty())
 		{
@@ -2290,7 +2755,7 @@ void CoreWrapper::setupCallbacks(
 			if(subscribeLaserScan)
 			{
 				scanSub_.subscribe(nh, "scan", 1);
-				stereoScanSync_ = new message_filters::Synchronizer<MyStereoScanSyncPolicy>(MyStereoScanSyncPolicy(queueSize), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, scanSub_, odomSub_);
+				stereoScanSync_ = new message_filters::Synchronizer<MyStereoScanSyncPolicy>(MyStereoScanSyncPolicy(queueSize), imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, scanSub_, odomSub_);
 				stereoScanSync_->registerCallback(boost::bind(&CoreWrapper::stereoScanCallback, this, _1, _2, _3, _4, _5, _6));
 
 				ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -2307,13 +2772,13 @@ void CoreWrapper::setupCallbacks(
 				if(stereoApproxSync)
 				{
 					ROS_INFO("Registering Stereo Approx callback...");
-					stereoApproxSync_ = new message_filters::Synchronizer<MyStereoApproxSyncPolicy>(MyStereoApproxSyncPolicy(queueSize), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, odomSub_);
+					stereoApproxSync_ = new message_filters::Synchronizer<MyStereoApproxSyncPolicy>(MyStereoApproxSyncPolicy(queueSize), imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, odomSub_);
 					stereoApproxSync_->registerCallback(boost::bind(&CoreWrapper::stereoCallback, this, _1, _2, _3, _4, _5));
 				}
 				else
 				{
 					ROS_INFO("Registering Stereo Exact callback...");
-					stereoExactSync_ = new message_filters::Synchronizer<MyStereoExactSyncPolicy>(MyStereoExactSyncPolicy(queueSize), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, odomSub_);
+					stereoExactSync_ = new message_filters::Synchronizer<MyStereoExactSyncPolicy>(MyStereoExactSyncPolicy(queueSize), imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, odomSub_);
 					stereoExactSync_->registerCallback(boost::bind(&CoreWrapper::stereoCallback, this, _1, _2, _3, _4, _5));
 				}
 
@@ -2333,7 +2798,7 @@ void CoreWrapper::setupCallbacks(
 			{
 				ROS_INFO("Registering Stereo+LaserScan+OdomTF callback...");
 				scanSub_.subscribe(nh, "scan", 1);
-				stereoScanTFSync_ = new message_filters::Synchronizer<MyStereoScanTFSyncPolicy>(MyStereoScanTFSyncPolicy(queueSize), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, scanSub_);
+				stereoScanTFSync_ = new message_filters::Synchronizer<MyStereoScanTFSyncPolicy>(MyStereoScanTFSyncPolicy(queueSize), imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_, scanSub_);
 				stereoScanTFSync_->registerCallback(boost::bind(&CoreWrapper::stereoScanTFCallback, this, _1, _2, _3, _4, _5));
 
 				ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -2349,13 +2814,13 @@ void CoreWrapper::setupCallbacks(
 				if(stereoApproxSync)
 				{
 					ROS_INFO("Registering Stereo+OdomTF Approx callback...");
-					stereoApproxTFSync_ = new message_filters::Synchronizer<MyStereoApproxTFSyncPolicy>(MyStereoApproxTFSyncPolicy(queueSize), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+					stereoApproxTFSync_ = new message_filters::Synchronizer<MyStereoApproxTFSyncPolicy>(MyStereoApproxTFSyncPolicy(queueSize), imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
 					stereoApproxTFSync_->registerCallback(boost::bind(&CoreWrapper::stereoTFCallback, this, _1, _2, _3, _4));
 				}
 				else
 				{
 					ROS_INFO("Registering Stereo+OdomTF Exact callback...");
-					stereoExactTFSync_ = new message_filters::Synchronizer<MyStereoExactTFSyncPolicy>(MyStereoExactTFSyncPolicy(queueSize), imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+					stereoExactTFSync_ = new message_filters::Synchronizer<MyStereoExactTFSyncPolicy>(MyStereoExactTFSyncPolicy(queueSize), imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
 					stereoExactTFSync_->registerCallback(boost::bind(&CoreWrapper::stereoTFCallback, this, _1, _2, _3, _4));
 				}
 
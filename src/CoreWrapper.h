@@ -30,10 +30,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
+
+#include <boost/thread.hpp>
+#include <list>
 
 #include <std_srvs/Empty.h>
 
 #include <tf/transform_listener.h>
+#include <tf/message_filter.h>
 #include <tf2_ros/transform_broadcaster.h>
 
 #include <std_msgs/Empty.h>
@@ -50,14 +55,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap_ros/GetMap.h"
 #include "rtabmap_ros/ListLabels.h"
+#include "rtabmap_ros/ExportMap.h"
 #include "rtabmap_ros/PublishMap.h"
 #include "rtabmap_ros/SetGoal.h"
 #include "rtabmap_ros/SetLabel.h"
 
+#include "rtabmap_ros/MapDataDelta.h"
+
 #include "MapsManager.h"
+#include "rtabmap_ros/LatencyStats.h"
 
 #include <message_filters/subscriber.h>
 #include <message_filters/synchronizer.h>
+#include <message_filters/pass_through.h>
 #include <message_filters/sync_policies/approximate_time.h>
 #include <message_filters/sync_policies/exact_time.h>
 
@@ -79,7 +89,9 @@ typedef actionlib::SimpleActionClient<move_base_msgs::MoveBaseAction> MoveBaseCl
 class CoreWrapper
 {
 public:
-	CoreWrapper(bool deleteDbOnStart);
+	CoreWrapper(bool deleteDbOnStart,
+			const ros::NodeHandle & nh = ros::NodeHandle(),
+			const ros::NodeHandle & pnh = ros::NodeHandle("~"));
 	virtual ~CoreWrapper();
 
 private:
@@ -89,6 +101,7 @@ private:
 	bool commonOdomUpdate(const nav_msgs::OdometryConstPtr & odomMsg);
 	bool commonOdomTFUpdate(const ros::Time & stamp); // TF odom
 	rtabmap::Transform getTransform(const std::string & fromFrameId, const std::string & toFrameId, const ros::Time & stamp) const;
+	void setupTFFilter(image_transport::SubscriberFilter & imageSub, int queueSize);
 
 	void commonDepthCallback(
 				const std::string & odomFrameId,
@@ -186,9 +199,13 @@ private:
 	bool getProjMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
 	bool getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res);
 	bool publishMapCallback(rtabmap_ros::PublishMap::Request&, rtabmap_ros::PublishMap::Response&);
+	bool exportMapCallback(rtabmap_ros::ExportMap::Request& req, rtabmap_ros::ExportMap::Response& res);
+	std::map<int, rtabmap::Signature> getNodesData(const std::vector<int> & ids);
+	std::map<int, rtabmap::Signature> getNodesDataInBatches(const std::map<int, rtabmap::Transform> & poses);
 	bool setGoalCallback(rtabmap_ros::SetGoal::Request& req, rtabmap_ros::SetGoal::Response& res);
 	bool setLabelCallback(rtabmap_ros::SetLabel::Request& req, rtabmap_ros::SetLabel::Response& res);
 	bool listLabelsCallback(rtabmap_ros::ListLabels::Request& req, rtabmap_ros::ListLabels::Response& res);
+	bool resyncMapDataCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
 #ifdef WITH_OCTOMAP
 	bool octomapBinaryCallback(octomap_msgs::GetOctomap::Request  &req, octomap_msgs::GetOctomap::Response &res);
 	bool octomapFullCallback(octomap_msgs::GetOctomap::Request  &req, octomap_msgs::GetOctomap::Response &res);
@@ -198,8 +215,10 @@ private:
 	void saveParameters(const std::string & configFile);
 
 	void publishLoop(double tfDelay);
+	void mapsPublishLoop();
 
 	void publishStats(const ros::Time & stamp);
+	void publishMapDataKeyframe(const ros::Time & stamp);
 	void publishCurrentGoal(const ros::Time & stamp);
 	void goalDoneCb(const actionlib::SimpleClientGoalState& state, const move_base_msgs::MoveBaseResultConstPtr& result);
 	void goalActiveCb();
@@ -207,7 +226,10 @@ private:
 	void publishLocalPath(const ros::Time & stamp);
 
 private:
+	ros::NodeHandle nh_; // public
+	ros::NodeHandle pnh_; // private
 	rtabmap::Rtabmap rtabmap_;
+	boost::mutex rtabmapMutex_; // rtabmap_ is shared by the sensor and the service callbacks
 	bool paused_;
 	rtabmap::Transform lastPose_;
 	ros::Time lastPoseStamp_;
@@ -223,15 +245,53 @@ private:
 	std::string configPath_;
 	std::string databasePath_;
 	bool waitForTransform_;
+	bool tfMessageFilter_; // sensor data is received only when its transforms are available
+	double tfTolerance_;
+	bool tfCacheLocalTransforms_;
+	mutable std::map<std::string, rtabmap::Transform> localTransforms_; // sensor frame -> frame_id
+	mutable boost::mutex localTransformsMutex_;
 	bool useActionForGoal_;
+	bool zeroCopyImages_;
 
 	rtabmap::Transform mapToOdom_;
 	boost::mutex mapToOdomMutex_;
 
 	MapsManager mapsManager_;
+	boost::mutex mapsManagerMutex_;
+
+	LatencyStats latency_;
+	int latencyTf_;
+	int latencyConversion_;
+	int latencyInputDelay_;
+	int latencyProcess_;
+	int latencyStats_;
+	int latencyMapsUpdate_;
+	int latencyMapsPublish_;
+	int latencyTotal_;
+
+	// asynchronous maps publishing
+	struct MapsSnapshot
+	{
+		ros::Time stamp;
+		std::map<int, rtabmap::Transform> poses;
+		std::map<int, rtabmap::Signature> signatures; // nodes not already in the caches
+	};
+	// Called with rtabmapMutex_ locked, the caches can then be updated without rtabmap_
+	MapsSnapshot takeMapsSnapshot(const ros::Time & stamp, bool updateCloud, bool updateProj, bool updateGrid);
+	boost::thread* mapsThread_;
+	std::list<MapsSnapshot> mapsQueue_;
+	boost::mutex mapsQueueMutex_;
+	boost::condition_variable mapsQueueCondition_;
+	int mapsQueueMaxSize_;
+	unsigned int mapsDropped_;
 
 	ros::Publisher infoPub_;
 	ros::Publisher mapDataPub_;
+	ros::Publisher mapDataDeltaPub_;
+	rtabmap_ros::MapDataDeltaEncoder mapDataDeltaEncoder_;
+	bool mapDataDeltaKeyframe_; // next message on mapData_delta is a keyframe with all node data
+	bool graphPacked_; // graphs are sent in Graph::packed
+	bool graphPackedCompressed_;
 	ros::Publisher mapGraphPub_;
 	ros::Publisher labelsPub_;
 
@@ -251,6 +311,11 @@ private:
 	image_transport::SubscriberFilter imageDepthSub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
 
+	// Input of the synchronizers for the depth (or left) image, connected to
+	// the image subscriber or to tfFilter_ with tf_message_filter
+	message_filters::PassThrough<sensor_msgs::Image> imageTFInput_;
+	tf::MessageFilter<sensor_msgs::Image> * tfFilter_;
+
 	//stereo callback
 	image_transport::SubscriberFilter imageRectLeft_;
 	image_transport::SubscriberFilter imageRectRight_;
@@ -351,13 +416,18 @@ private:
 	ros::ServiceServer getProjMapSrv_;
 	ros::ServiceServer getGridMapSrv_;
 	ros::ServiceServer publishMapDataSrv_;
+	ros::ServiceServer exportMapSrv_;
 	ros::ServiceServer setGoalSrv_;
 	ros::ServiceServer setLabelSrv_;
 	ros::ServiceServer listLabelsSrv_;
+	ros::ServiceServer resyncMapDataSrv_;
 #ifdef WITH_OCTOMAP
 	ros::ServiceServer octomapBinarySrv_;
 	ros::ServiceServer octomapFullSrv_;
 #endif
+	// with service_threads > 0, the services are called on their own queue
+	ros::CallbackQueue serviceQueue_;
+	ros::AsyncSpinner * serviceSpinner_;
 
 	MoveBaseClient mbClient_;
 
@@ -365,6 +435,7 @@ private:
 
 	float rate_;
 	ros::Time time_;
+	bool stopping_; // threads must exit (nodelet unloaded)
 };
 
 #endif /* COREWRAPPER_H_ */
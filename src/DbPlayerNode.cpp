@@ -37,9 +37,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <tf2_ros/transform_broadcaster.h>
 #include <std_srvs/Empty.h>
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/ThreadPool.h>
 #include <rtabmap/utilite/ULogger.h>
 #include <rtabmap/core/util3d_conversions.h>
 #include <rtabmap/core/DBReader.h>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <deque>
 
 bool paused = false;
 bool pauseCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
@@ -70,6 +76,263 @@ bool resumeCallback(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 	return true;
 }
 
+// Messages of a sensor data, the stamps are set when published
+struct Frame
+{
+	Frame() : type(-1) {}
+	rtabmap::SensorData data;
+	int type; // -1=image only, 0=rgb+depth, 1=stereo
+	sensor_msgs::CameraInfo camInfoA; //rgb or left
+	sensor_msgs::CameraInfo camInfoB; //depth or right
+	sensor_msgs::ImagePtr image;
+	sensor_msgs::ImagePtr depthOrRight;
+	sensor_msgs::PointCloud2Ptr scan;
+};
+
+// The image and scan messages are created only if requested, the camera
+// infos and the type always.
+void createFrame(
+		Frame & frame,
+		const std::string & frameId,
+		const std::string & cameraFrameId,
+		bool createImage = true,
+		bool createDepthOrRight = true,
+		bool createScan = true)
+{
+	const rtabmap::SensorData & data = frame.data;
+	sensor_msgs::CameraInfo & camInfoA = frame.camInfoA;
+	sensor_msgs::CameraInfo & camInfoB = frame.camInfoB;
+
+	camInfoA.K.assign(0);
+	camInfoA.K[0] = camInfoA.K[4] = camInfoA.K[8] = 1;
+	camInfoA.R.assign(0);
+	camInfoA.R[0] = camInfoA.R[4] = camInfoA.R[8] = 1;
+	camInfoA.P.assign(0);
+	camInfoA.P[10] = 1;
+
+	camInfoA.header.frame_id = cameraFrameId;
+
+	camInfoB = camInfoA;
+
+	if(!data.depth().empty() && (data.depth().type() == CV_32FC1 || data.depth().type() == CV_16UC1))
+	{
+		//depth
+		camInfoA.D.resize(5,0);
+
+		camInfoA.P[0] = data.fx();
+		camInfoA.K[0] = data.fx();
+		camInfoA.P[5] = data.fy();
+		camInfoA.K[4] = data.fy();
+		camInfoA.P[2] = data.cx();
+		camInfoA.K[2] = data.cx();
+		camInfoA.P[6] = data.cy();
+		camInfoA.K[5] = data.cy();
+
+		camInfoB = camInfoA;
+
+		frame.type=0;
+	}
+	else if(!data.rightImage().empty() && data.rightImage().type() == CV_8U)
+	{
+		//stereo
+		camInfoA.D.resize(8,0);
+
+		camInfoA.P[0] = data.fx();
+		camInfoA.K[0] = data.fx();
+		camInfoA.P[5] = data.fx(); // fx = fy
+		camInfoA.K[4] = data.fx(); // fx = fy
+		camInfoA.P[2] = data.cx();
+		camInfoA.K[2] = data.cx();
+		camInfoA.P[6] = data.cy();
+		camInfoA.K[5] = data.cy();
+
+		camInfoB = camInfoA;
+		camInfoB.P[3] = data.baseline()*-data.fx(); // Right_Tx = -baseline*fx
+
+		frame.type=1;
+	}
+
+	camInfoA.height = data.image().rows;
+	camInfoA.width = data.image().cols;
+	camInfoB.height = data.depthOrRightImage().rows;
+	camInfoB.width = data.depthOrRightImage().cols;
+
+	if(!data.image().empty() && createImage)
+	{
+		cv_bridge::CvImage img;
+		if(data.image().channels() == 1)
+		{
+			img.encoding = sensor_msgs::image_encodings::MONO8;
+		}
+		else
+		{
+			img.encoding = sensor_msgs::image_encodings::BGR8;
+		}
+		img.image = data.image();
+		frame.image = img.toImageMsg();
+		frame.image->header.frame_id = cameraFrameId;
+	}
+
+	if(!createDepthOrRight)
+	{
+		// not requested
+	}
+	else if(!data.depth().empty() && frame.type==0)
+	{
+		cv_bridge::CvImage img;
+		if(data.depth().type() == CV_32FC1)
+		{
+			img.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
+		}
+		else
+		{
+			img.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
+		}
+		img.image = data.depth();
+		frame.depthOrRight = img.toImageMsg();
+		frame.depthOrRight->header.frame_id = cameraFrameId;
+	}
+	else if(!data.rightImage().empty() && frame.type==1)
+	{
+		cv_bridge::CvImage img;
+		img.encoding = sensor_msgs::image_encodings::MONO8;
+		img.image = data.rightImage();
+		frame.depthOrRight = img.toImageMsg();
+		frame.depthOrRight->header.frame_id = cameraFrameId;
+	}
+
+	if(!data.laserScan().empty() && createScan)
+	{
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = rtabmap::util3d::laserScanToPointCloud(data.laserScan());
+		frame.scan.reset(new sensor_msgs::PointCloud2);
+		pcl::toROSMsg(*cloud, *frame.scan);
+		frame.scan->header.frame_id = frameId;
+	}
+}
+
+void createFrameWorker(std::vector<Frame> * frames, const std::string * frameId, const std::string * cameraFrameId, int index)
+{
+	createFrame(frames->at(index), *frameId, *cameraFrameId);
+}
+
+/**
+ * Reads the database in its own thread, up to "readAhead" frames before the
+ * published one. The database is read (and decompressed) sequentially by
+ * DBReader, then the messages of the frames read are created in parallel.
+ */
+class FramePrefetcher
+{
+public:
+	FramePrefetcher(rtabmap::DBReader & reader, int readAhead, const std::string & frameId, const std::string & cameraFrameId) :
+		reader_(reader),
+		readAhead_(readAhead),
+		frameId_(frameId),
+		cameraFrameId_(cameraFrameId),
+		done_(false),
+		stop_(false)
+	{
+		thread_ = new boost::thread(boost::bind(&FramePrefetcher::run, this));
+	}
+
+	~FramePrefetcher()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			stop_ = true;
+		}
+		notFullCondition_.notify_all();
+		thread_->join();
+		delete thread_;
+	}
+
+	// Wait for the next frame, returns false at the end of the database
+	bool take(Frame & frame)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		while(frames_.empty() && !done_)
+		{
+			notEmptyCondition_.wait(lock);
+		}
+		if(frames_.empty())
+		{
+			return false;
+		}
+		frame = frames_.front();
+		frames_.pop_front();
+		notFullCondition_.notify_one();
+		return true;
+	}
+
+	int size()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return (int)frames_.size();
+	}
+
+private:
+	void run()
+	{
+		bool end = false;
+		while(!end)
+		{
+			int count = 0;
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				while((int)frames_.size() >= readAhead_ && !stop_)
+				{
+					notFullCondition_.wait(lock);
+				}
+				if(stop_)
+				{
+					break;
+				}
+				count = readAhead_ - (int)frames_.size();
+			}
+
+			std::vector<Frame> frames;
+			frames.reserve(count);
+			for(int i=0; i<count; ++i)
+			{
+				rtabmap::SensorData data = reader_.getNextData();
+				if(!data.isValid())
+				{
+					end = true;
+					break;
+				}
+				frames.push_back(Frame());
+				frames.back().data = data;
+			}
+			rtabmap_ros::ThreadPool::instance().parallelFor(frames.size(), boost::bind(&createFrameWorker, &frames, &frameId_, &cameraFrameId_, _1));
+
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				frames_.insert(frames_.end(), frames.begin(), frames.end());
+			}
+			notEmptyCondition_.notify_one();
+		}
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			done_ = true;
+		}
+		notEmptyCondition_.notify_one();
+	}
+
+private:
+	rtabmap::DBReader & reader_;
+	int readAhead_;
+	std::string frameId_;
+	std::string cameraFrameId_;
+
+	boost::thread * thread_;
+	boost::mutex mutex_;
+	boost::condition_variable notEmptyCondition_;
+	boost::condition_variable notFullCondition_;
+	std::deque<Frame> frames_;
+	bool done_;
+	bool stop_;
+};
+
 int main(int argc, char** argv)
 {
 	ros::init(argc, argv, "data_player");
@@ -89,6 +352,7 @@ int main(int argc, char** argv)
 	std::string databasePath = "";
 	bool publishTf = true;
 	int startId = 0;
+	int readAhead = 0;
 
 	pnh.param("frame_id", frameId, frameId);
 	pnh.param("odom_frame_id", odomFrameId, odomFrameId);
@@ -97,6 +361,7 @@ int main(int argc, char** argv)
 	pnh.param("database", databasePath, databasePath);
 	pnh.param("publish_tf", publishTf, publishTf);
 	pnh.param("start_id", startId, startId);
+	pnh.param("read_ahead", readAhead, readAhead); // frames read in advance in a thread, 0=read before publishing
 
 	ROS_INFO("frame_id = %s", frameId.c_str());
 	ROS_INFO("odom_frame_id = %s", odomFrameId.c_str());
@@ -104,8 +369,10 @@ int main(int argc, char** argv)
 	ROS_INFO("database = %s", databasePath.c_str());
 	ROS_INFO("rate = %f", rate);
 	ROS_INFO("publish_tf = %s", publishTf?"true":"false");
+	ROS_INFO("read_ahead = %d", readAhead);
 
-	rtabmap::DBReader reader(databasePath, rate);
+	// The frames read ahead are paced when published, not when read
+	rtabmap::DBReader reader(databasePath, readAhead > 0?0.0:rate);
 
 	if(databasePath.empty())
 	{
@@ -136,71 +403,87 @@ int main(int argc, char** argv)
 	ros::Publisher scanPub;
 	tf2_ros::TransformBroadcaster tfBroadcaster;
 
-	rtabmap::SensorData data = reader.getNextData();
-	while(ros::ok() && data.isValid())
+	FramePrefetcher * prefetcher = 0;
+	if(readAhead > 0)
 	{
-		ROS_INFO("Reading sensor data %d...", data.id());
-
-		ros::Time time = ros::Time::now();
-
-		sensor_msgs::CameraInfo camInfoA; //rgb or left
-		sensor_msgs::CameraInfo camInfoB; //depth or right
-
-		camInfoA.K.assign(0);
-		camInfoA.K[0] = camInfoA.K[4] = camInfoA.K[8] = 1;
-		camInfoA.R.assign(0);
-		camInfoA.R[0] = camInfoA.R[4] = camInfoA.R[8] = 1;
-		camInfoA.P.assign(0);
-		camInfoA.P[10] = 1;
-
-		camInfoA.header.frame_id = cameraFrameId;
-		camInfoA.header.stamp = time;
+		prefetcher = new FramePrefetcher(reader, readAhead, frameId, cameraFrameId);
+	}
 
-		camInfoB = camInfoA;
+	Frame frame;
+	ros::WallTime lastPublished;
+	double lastStamp = 0.0;
+	while(ros::ok())
+	{
+		if(prefetcher)
+		{
+			if(!prefetcher->take(frame))
+			{
+				break;
+			}
 
-		int type = -1;
-		if(!data.depth().empty() && (data.depth().type() == CV_32FC1 || data.depth().type() == CV_16UC1))
+			// pace like DBReader would do
+			if(!lastPublished.isZero())
+			{
+				double period = 0.0;
+				if(rate > 0.0)
+				{
+					period = 1.0/rate;
+				}
+				else if(rate < 0.0 && frame.data.stamp() > lastStamp)
+				{
+					period = frame.data.stamp() - lastStamp;
+				}
+				ros::WallDuration remaining = lastPublished + ros::WallDuration(period) - ros::WallTime::now();
+				if(remaining > ros::WallDuration(0))
+				{
+					remaining.sleep();
+				}
+			}
+			lastPublished = ros::WallTime::now();
+			lastStamp = frame.data.stamp();
+		}
+		else
 		{
-			//depth
-			camInfoA.D.resize(5,0);
+			frame = Frame();
+			frame.data = reader.getNextData();
+			if(!frame.data.isValid())
+			{
+				break;
+			}
+			// only the messages subscribed are created
+			createFrame(frame, frameId, cameraFrameId,
+					imagePub.getNumSubscribers() || rgbPub.getNumSubscribers() || leftPub.getNumSubscribers(),
+					depthPub.getNumSubscribers() || rightPub.getNumSubscribers(),
+					scanPub.getNumSubscribers());
+		}
+		const rtabmap::SensorData & data = frame.data;
+		const int type = frame.type;
 
-			camInfoA.P[0] = data.fx();
-			camInfoA.K[0] = data.fx();
-			camInfoA.P[5] = data.fy();
-			camInfoA.K[4] = data.fy();
-			camInfoA.P[2] = data.cx();
-			camInfoA.K[2] = data.cx();
-			camInfoA.P[6] = data.cy();
-			camInfoA.K[5] = data.cy();
+		if(prefetcher)
+		{
+			ROS_INFO("Reading sensor data %d... (%d read ahead)", data.id(), prefetcher->size());
+		}
+		else
+		{
+			ROS_INFO("Reading sensor data %d...", data.id());
+		}
 
-			camInfoB = camInfoA;
+		ros::Time time = ros::Time::now();
 
-			type=0;
+		sensor_msgs::CameraInfo & camInfoA = frame.camInfoA; //rgb or left
+		sensor_msgs::CameraInfo & camInfoB = frame.camInfoB; //depth or right
+		camInfoA.header.stamp = time;
+		camInfoB.header.stamp = time;
 
+		if(type == 0)
+		{
 			if(rgbPub.getTopic().empty()) rgbPub = it.advertise("rgb/image", 1);
 			if(depthPub.getTopic().empty()) depthPub = it.advertise("depth_registered/image", 1);
 			if(rgbCamInfoPub.getTopic().empty()) rgbCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("rgb/camera_info", 1);
 			if(depthCamInfoPub.getTopic().empty()) depthCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("depth_registered/camera_info", 1);
 		}
-		else if(!data.rightImage().empty() && data.rightImage().type() == CV_8U)
+		else if(type == 1)
 		{
-			//stereo
-			camInfoA.D.resize(8,0);
-
-			camInfoA.P[0] = data.fx();
-			camInfoA.K[0] = data.fx();
-			camInfoA.P[5] = data.fx(); // fx = fy
-			camInfoA.K[4] = data.fx(); // fx = fy
-			camInfoA.P[2] = data.cx();
-			camInfoA.K[2] = data.cx();
-			camInfoA.P[6] = data.cy();
-			camInfoA.K[5] = data.cy();
-
-			camInfoB = camInfoA;
-			camInfoB.P[3] = data.baseline()*-data.fx(); // Right_Tx = -baseline*fx
-
-			type=1;
-
 			if(leftPub.getTopic().empty()) leftPub = it.advertise("left/image", 1);
 			if(rightPub.getTopic().empty()) rightPub = it.advertise("right/image", 1);
 			if(leftCamInfoPub.getTopic().empty()) leftCamInfoPub = nh.advertise<sensor_msgs::CameraInfo>("left/camera_info", 1);
@@ -212,16 +495,10 @@ int main(int argc, char** argv)
 			if(imagePub.getTopic().empty()) imagePub = it.advertise("image", 1);
 		}
 
-		camInfoA.height = data.image().rows;
-		camInfoA.width = data.image().cols;
-		camInfoB.height = data.depthOrRightImage().rows;
-		camInfoB.width = data.depthOrRightImage().cols;
-
 		if(!data.laserScan().empty())
 		{
 			if(scanPub.getTopic().empty()) scanPub = nh.advertise<sensor_msgs::PointCloud2>("scan_cloud", 1);
 		}
-
 		// publish transforms first
 		if(publishTf)
 		{
@@ -287,20 +564,9 @@ int main(int argc, char** argv)
 			}
 		}
 
-		if(imagePub.getNumSubscribers() || rgbPub.getNumSubscribers() || leftPub.getNumSubscribers())
+		if(frame.image.get() && (imagePub.getNumSubscribers() || rgbPub.getNumSubscribers() || leftPub.getNumSubscribers()))
 		{
-			cv_bridge::CvImage img;
-			if(data.image().channels() == 1)
-			{
-				img.encoding = sensor_msgs::image_encodings::MONO8;
-			}
-			else
-			{
-				img.encoding = sensor_msgs::image_encodings::BGR8;
-			}
-			img.image = data.image();
-			sensor_msgs::ImagePtr imageRosMsg = img.toImageMsg();
-			imageRosMsg->header.frame_id = cameraFrameId;
+			sensor_msgs::ImagePtr imageRosMsg = frame.image;
 			imageRosMsg->header.stamp = time;
 
 			if(imagePub.getNumSubscribers())
@@ -318,47 +584,28 @@ int main(int argc, char** argv)
 			}
 		}
 
-		if(depthPub.getNumSubscribers() && !data.depth().empty() && type==0)
+		if(depthPub.getNumSubscribers() && frame.depthOrRight.get() && type==0)
 		{
-			cv_bridge::CvImage img;
-			if(data.depth().type() == CV_32FC1)
-			{
-				img.encoding = sensor_msgs::image_encodings::TYPE_32FC1;
-			}
-			else
-			{
-				img.encoding = sensor_msgs::image_encodings::TYPE_16UC1;
-			}
-			img.image = data.depth();
-			sensor_msgs::ImagePtr imageRosMsg = img.toImageMsg();
-			imageRosMsg->header.frame_id = cameraFrameId;
+			sensor_msgs::ImagePtr imageRosMsg = frame.depthOrRight;
 			imageRosMsg->header.stamp = time;
 
 			depthPub.publish(imageRosMsg);
 			depthCamInfoPub.publish(camInfoB);
 		}
 
-		if(rightPub.getNumSubscribers() && !data.rightImage().empty() && type==1)
+		if(rightPub.getNumSubscribers() && frame.depthOrRight.get() && type==1)
 		{
-			cv_bridge::CvImage img;
-			img.encoding = sensor_msgs::image_encodings::MONO8;
-			img.image = data.rightImage();
-			sensor_msgs::ImagePtr imageRosMsg = img.toImageMsg();
-			imageRosMsg->header.frame_id = cameraFrameId;
+			sensor_msgs::ImagePtr imageRosMsg = frame.depthOrRight;
 			imageRosMsg->header.stamp = time;
 
 			rightPub.publish(imageRosMsg);
 			rightCamInfoPub.publish(camInfoB);
 		}
 
-		if(scanPub.getNumSubscribers() && !data.laserScan().empty())
+		if(scanPub.getNumSubscribers() && frame.scan.get())
 		{
-			pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = rtabmap::util3d::laserScanToPointCloud(data.laserScan());
-			sensor_msgs::PointCloud2 msg;
-			pcl::toROSMsg(*cloud, msg);
-			msg.header.frame_id = frameId;
-			msg.header.stamp = time;
-			scanPub.publish(msg);
+			frame.scan->header.stamp = time;
+			scanPub.publish(frame.scan);
 		}
 
 		ros::spinOnce();
@@ -368,10 +615,12 @@ int main(int argc, char** argv)
 			uSleep(100);
 			ros::spinOnce();
 		}
-
-		data = reader.getNextData();
 	}
 
+	if(prefetcher)
+	{
+		delete prefetcher;
+	}
 
 	return 0;
 }
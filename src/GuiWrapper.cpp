@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/utilite/UConversion.h>
 
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 
 #include <image_geometry/pinhole_camera_model.h>
 #include <image_geometry/stereo_camera_model.h>
@@ -52,6 +53,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap_ros/MsgConversion.h"
 #include "rtabmap_ros/GetMap.h"
+#include "rtabmap_ros/ThreadPool.h"
+#include <boost/bind.hpp>
 
 #include "PreferencesDialogROS.h"
 
@@ -65,13 +68,40 @@ float max3( const float& a, const float& b, const float& c)
 	return m>c?m:c;
 }
 
+namespace {
+// The image given to the GUI must not refer to the message data. The
+// cv::Mat is reference counted, so the SensorData copied to the Qt thread
+// shares its buffer.
+cv::Mat guiImage(const cv_bridge::CvImageConstPtr & ptr, const sensor_msgs::ImageConstPtr & msg, int decimation)
+{
+	if(decimation > 1)
+	{
+		// nearest neighbor, to not interpolate depth values
+		cv::Mat decimated;
+		cv::resize(ptr->image, decimated, cv::Size(ptr->image.cols/decimation, ptr->image.rows/decimation), 0, 0, cv::INTER_NEAREST);
+		return decimated;
+	}
+	if(msg->data.size() && ptr->image.data == &msg->data[0])
+	{
+		return ptr->image.clone();
+	}
+	return ptr->image; // already converted in its own buffer
+}
+}
+
 GuiWrapper::GuiWrapper(int & argc, char** argv) :
 		app_(0),
 		mainWindow_(0),
 		frameId_("base_link"),
 		waitForTransform_(false),
+		tfMessageFilter_(false),
+		tfTolerance_(0.0),
+		tfCacheLocalTransforms_(false),
 		cameraNodeName_(""),
 		lastOdomInfoUpdateTime_(0),
+		updatePeriod_(0.1),
+		imageDecimation_(1),
+		tfFilter_(0),
 		depthScanSync_(0),
 		depthSync_(0),
 		depthOdomInfoSync_(0),
@@ -123,7 +153,19 @@ GuiWrapper::GuiWrapper(int & argc, char** argv) :
 	pnh.param("subscribe_stereo", subscribeStereo, subscribeStereo);
 	pnh.param("queue_size", queueSize, queueSize);
 	pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
+	pnh.param("tf_message_filter", tfMessageFilter_, tfMessageFilter_);
+	pnh.param("tf_tolerance", tfTolerance_, tfTolerance_);
+	pnh.param("tf_cache_local_transforms", tfCacheLocalTransforms_, tfCacheLocalTransforms_);
 	pnh.param("camera_node_name", cameraNodeName_, cameraNodeName_); // used to pause the rtabmap/camera when pausing the process
+	double maxUpdateRate = 1.0/updatePeriod_;
+	pnh.param("max_update_rate", maxUpdateRate, maxUpdateRate);
+	updatePeriod_ = maxUpdateRate>0.0?1.0/maxUpdateRate:0.0;
+	pnh.param("image_decimation", imageDecimation_, imageDecimation_);
+	if(imageDecimation_ < 1)
+	{
+		imageDecimation_ = 1;
+	}
+	ROS_INFO("rtabmapviz: max_update_rate=%f Hz, image_decimation=%d", maxUpdateRate, imageDecimation_);
 	this->setupCallbacks(subscribeDepth, subscribeLaserScan, subscribeOdomInfo, subscribeStereo, queueSize);
 
 	UEventsManager::addHandler(this);
@@ -161,6 +203,10 @@ GuiWrapper::~GuiWrapper()
 	{
 		delete stereoOdomInfoSync_;
 	}
+	if(tfFilter_)
+	{
+		delete tfFilter_;
+	}
 	delete infoMapSync_;
 	delete mainWindow_;
 	delete app_;
@@ -215,6 +261,13 @@ void GuiWrapper::infoMapCallback(
 	this->post(new RtabmapEvent(stat));
 }
 
+namespace {
+void nodeDataFromROSWorker(const std::vector<rtabmap_ros::NodeData> * msgs, std::vector<Signature> * signatures, int index)
+{
+	signatures->at(index) = rtabmap_ros::nodeDataFromROS(msgs->at(index));
+}
+}
+
 void GuiWrapper::processRequestedMap(const rtabmap_ros::MapData & map)
 {
 	std::map<int, Signature> signatures;
@@ -242,10 +295,12 @@ void GuiWrapper::processRequestedMap(const rtabmap_ros::MapData & map)
 
 	rtabmap_ros::mapGraphFromROS(map.graph, poses, mapIds, stamps, labels, userDatas, constraints, mapToOdom);
 
-	//data
+	//data, converted in parallel
+	std::vector<Signature> nodes(map.nodes.size());
+	rtabmap_ros::ThreadPool::instance().parallelFor(map.nodes.size(), boost::bind(&nodeDataFromROSWorker, &map.nodes, &nodes, _1));
 	for(unsigned int i=0; i<map.nodes.size(); ++i)
 	{
-		signatures.insert(std::make_pair(map.nodes[i].id, rtabmap_ros::nodeDataFromROS(map.nodes[i])));
+		signatures.insert(std::make_pair(map.nodes[i].id, nodes[i]));
 	}
 
 	RtabmapEvent3DMap e(signatures,
@@ -404,33 +459,23 @@ void GuiWrapper::depthCallback(
 		const sensor_msgs::ImageConstPtr& depthMsg,
 		const sensor_msgs::CameraInfoConstPtr& cameraInfoMsg)
 {
-	// limit 10 Hz max
-	if(UTimer::now() - lastOdomInfoUpdateTime_ > 0.1 &&
+	// limit to max_update_rate
+	if(UTimer::now() - lastOdomInfoUpdateTime_ > updatePeriod_ &&
 		!mainWindow_->isProcessingOdometry() &&
 		!mainWindow_->isProcessingStatistics())
 	{
 		lastOdomInfoUpdateTime_ = UTimer::now();
-
-		// TF ready?
-		Transform localTransform;
-		try
+		if(!imagesVisible())
 		{
-			if(waitForTransform_)
-			{
-				if(!tfListener_.waitForTransform(frameId_, depthMsg->header.frame_id, depthMsg->header.stamp, ros::Duration(1)))
-				{
-					ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), depthMsg->header.frame_id.c_str());
-					return;
-				}
-			}
-
-			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, depthMsg->header.frame_id, depthMsg->header.stamp, tmp);
-			localTransform = rtabmap_ros::transformFromTF(tmp);
+			// don't convert the images, only the pose is updated
+			defaultCallback(odomMsg);
+			return;
 		}
-		catch(tf::TransformException & ex)
+
+		// TF ready?
+		Transform localTransform = getLocalTransform(depthMsg->header.frame_id, depthMsg->header.stamp);
+		if(localTransform.isNull())
 		{
-			ROS_WARN("%s",ex.what());
 			return;
 		}
 
@@ -439,17 +484,17 @@ void GuiWrapper::depthCallback(
 
 		image_geometry::PinholeCameraModel model;
 		model.fromCameraInfo(*cameraInfoMsg);
-		float fx = model.fx();
-		float fy = model.fy();
-		float cx = model.cx();
-		float cy = model.cy();
+		float fx = model.fx()/imageDecimation_;
+		float fy = model.fy()/imageDecimation_;
+		float cx = model.cx()/imageDecimation_;
+		float cy = model.cy()/imageDecimation_;
 
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
 		float rotVariance = max3(odomMsg->pose.covariance[21], odomMsg->pose.covariance[28], odomMsg->pose.covariance[35]);
 
 		rtabmap::SensorData image(
-				ptrImage->image.clone(),
-				ptrDepth->image.clone(),
+				guiImage(ptrImage, imageMsg, imageDecimation_),
+				guiImage(ptrDepth, depthMsg, imageDecimation_),
 				fx,
 				fy,
 				cx,
@@ -473,32 +518,22 @@ void GuiWrapper::depthOdomInfoCallback(
 		const sensor_msgs::ImageConstPtr& depthMsg,
 		const sensor_msgs::CameraInfoConstPtr& cameraInfoMsg)
 {
-	// limit 10 Hz max
-	if(UTimer::now() - lastOdomInfoUpdateTime_ > 0.1 &&
+	// limit to max_update_rate
+	if(UTimer::now() - lastOdomInfoUpdateTime_ > updatePeriod_ &&
 		!mainWindow_->isProcessingOdometry() &&
 		!mainWindow_->isProcessingStatistics())
 	{
 		lastOdomInfoUpdateTime_ = UTimer::now();
-		// TF ready?
-		Transform localTransform;
-		try
+		if(!imagesVisible())
 		{
-			if(waitForTransform_)
-			{
-				if(!tfListener_.waitForTransform(frameId_, depthMsg->header.frame_id, depthMsg->header.stamp, ros::Duration(1)))
-				{
-					ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), depthMsg->header.frame_id.c_str());
-					return;
-				}
-			}
-
-			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, depthMsg->header.frame_id, depthMsg->header.stamp, tmp);
-			localTransform = rtabmap_ros::transformFromTF(tmp);
+			// don't convert the images, only the pose is updated
+			defaultCallback(odomMsg);
+			return;
 		}
-		catch(tf::TransformException & ex)
+		// TF ready?
+		Transform localTransform = getLocalTransform(depthMsg->header.frame_id, depthMsg->header.stamp);
+		if(localTransform.isNull())
 		{
-			ROS_WARN("%s",ex.what());
 			return;
 		}
 
@@ -507,17 +542,17 @@ void GuiWrapper::depthOdomInfoCallback(
 
 		image_geometry::PinholeCameraModel model;
 		model.fromCameraInfo(*cameraInfoMsg);
-		float fx = model.fx();
-		float fy = model.fy();
-		float cx = model.cx();
-		float cy = model.cy();
+		float fx = model.fx()/imageDecimation_;
+		float fy = model.fy()/imageDecimation_;
+		float cx = model.cx()/imageDecimation_;
+		float cy = model.cy()/imageDecimation_;
 
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
 		float rotVariance = max3(odomMsg->pose.covariance[21], odomMsg->pose.covariance[28], odomMsg->pose.covariance[35]);
 
 		rtabmap::SensorData image(
-				ptrImage->image.clone(),
-				ptrDepth->image.clone(),
+				guiImage(ptrImage, imageMsg, imageDecimation_),
+				guiImage(ptrDepth, depthMsg, imageDecimation_),
 				fx,
 				fy,
 				cx,
@@ -541,12 +576,18 @@ void GuiWrapper::depthScanCallback(
 		const sensor_msgs::CameraInfoConstPtr& cameraInfoMsg,
 		const sensor_msgs::LaserScanConstPtr& scanMsg)
 {
-	// limit 10 Hz max
-	if(UTimer::now() - lastOdomInfoUpdateTime_ > 0.1 &&
+	// limit to max_update_rate
+	if(UTimer::now() - lastOdomInfoUpdateTime_ > updatePeriod_ &&
 		!mainWindow_->isProcessingOdometry() &&
 		!mainWindow_->isProcessingStatistics())
 	{
 		lastOdomInfoUpdateTime_ = UTimer::now();
+		if(!imagesVisible())
+		{
+			// don't convert the images, only the pose is updated
+			defaultCallback(odomMsg);
+			return;
+		}
 		// TF ready?
 		Transform localTransform;
 		sensor_msgs::PointCloud2 scanOut;
@@ -556,18 +597,11 @@ void GuiWrapper::depthScanCallback(
 			laser_geometry::LaserProjection projection;
 			projection.transformLaserScanToPointCloud(frameId_, *scanMsg, scanOut, tfListener_);
 
-			if(waitForTransform_)
+			localTransform = getLocalTransform(depthMsg->header.frame_id, depthMsg->header.stamp);
+			if(localTransform.isNull())
 			{
-				if(!tfListener_.waitForTransform(frameId_, depthMsg->header.frame_id, depthMsg->header.stamp, ros::Duration(1)))
-				{
-					ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), depthMsg->header.frame_id.c_str());
-					return;
-				}
+				return;
 			}
-
-			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, depthMsg->header.frame_id, depthMsg->header.stamp, tmp);
-			localTransform = rtabmap_ros::transformFromTF(tmp);
 		}
 		catch(tf::TransformException & ex)
 		{
@@ -584,10 +618,10 @@ void GuiWrapper::depthScanCallback(
 
 		image_geometry::PinholeCameraModel model;
 		model.fromCameraInfo(*cameraInfoMsg);
-		float fx = model.fx();
-		float fy = model.fy();
-		float cx = model.cx();
-		float cy = model.cy();
+		float fx = model.fx()/imageDecimation_;
+		float fy = model.fy()/imageDecimation_;
+		float cx = model.cx()/imageDecimation_;
+		float cy = model.cy()/imageDecimation_;
 
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
 		float rotVariance = max3(odomMsg->pose.covariance[21], odomMsg->pose.covariance[28], odomMsg->pose.covariance[35]);
@@ -595,8 +629,8 @@ void GuiWrapper::depthScanCallback(
 		rtabmap::SensorData image(
 				scan,
 				(int)scanMsg->ranges.size(),
-				ptrImage->image.clone(),
-				ptrDepth->image.clone(),
+				guiImage(ptrImage, imageMsg, imageDecimation_),
+				guiImage(ptrDepth, depthMsg, imageDecimation_),
 				fx,
 				fy,
 				cx,
@@ -621,12 +655,18 @@ void GuiWrapper::stereoScanCallback(
 		const sensor_msgs::CameraInfoConstPtr& leftCameraInfoMsg,
 		const sensor_msgs::CameraInfoConstPtr& rightCameraInfoMsg)
 {
-	// limit 10 Hz max
-	if(UTimer::now() - lastOdomInfoUpdateTime_ > 0.1 &&
+	// limit to max_update_rate
+	if(UTimer::now() - lastOdomInfoUpdateTime_ > updatePeriod_ &&
 		!mainWindow_->isProcessingOdometry() &&
 		!mainWindow_->isProcessingStatistics())
 	{
 		lastOdomInfoUpdateTime_ = UTimer::now();
+		if(!imagesVisible())
+		{
+			// don't convert the images, only the pose is updated
+			defaultCallback(odomMsg);
+			return;
+		}
 		if(!(leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 			leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0 ||
 			leftImageMsg->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
@@ -649,18 +689,11 @@ void GuiWrapper::stereoScanCallback(
 			laser_geometry::LaserProjection projection;
 			projection.transformLaserScanToPointCloud(frameId_, *scanMsg, scanOut, tfListener_);
 
-			if(waitForTransform_)
+			localTransform = getLocalTransform(leftImageMsg->header.frame_id, leftImageMsg->header.stamp);
+			if(localTransform.isNull())
 			{
-				if(!tfListener_.waitForTransform(frameId_, leftImageMsg->header.frame_id, leftImageMsg->header.stamp, ros::Duration(1)))
-				{
-					ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), leftImageMsg->header.frame_id.c_str());
-					return;
-				}
+				return;
 			}
-
-			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, leftImageMsg->header.frame_id, leftImageMsg->header.stamp, tmp);
-			localTransform = rtabmap_ros::transformFromTF(tmp);
 		}
 		catch(tf::TransformException & ex)
 		{
@@ -687,9 +720,9 @@ void GuiWrapper::stereoScanCallback(
 		image_geometry::StereoCameraModel model;
 		model.fromCameraInfo(*leftCameraInfoMsg, *rightCameraInfoMsg);
 
-		float fx = model.left().fx();
-		float cx = model.left().cx();
-		float cy = model.left().cy();
+		float fx = model.left().fx()/imageDecimation_;
+		float cx = model.left().cx()/imageDecimation_;
+		float cy = model.left().cy()/imageDecimation_;
 		float baseline = model.baseline();
 
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
@@ -698,8 +731,8 @@ void GuiWrapper::stereoScanCallback(
 		rtabmap::SensorData image(
 				scan,
 				(int)scanMsg->ranges.size(),
-				ptrLeftImage->image.clone(),
-				ptrRightImage->image.clone(),
+				guiImage(ptrLeftImage, leftImageMsg, imageDecimation_),
+				guiImage(ptrRightImage, rightImageMsg, imageDecimation_),
 				fx,
 				baseline,
 				cx,
@@ -724,12 +757,18 @@ void GuiWrapper::stereoOdomInfoCallback(
 		const sensor_msgs::CameraInfoConstPtr& leftCameraInfoMsg,
 		const sensor_msgs::CameraInfoConstPtr& rightCameraInfoMsg)
 {
-	// limit 10 Hz max
-	if(UTimer::now() - lastOdomInfoUpdateTime_ > 0.1 &&
+	// limit to max_update_rate
+	if(UTimer::now() - lastOdomInfoUpdateTime_ > updatePeriod_ &&
 		!mainWindow_->isProcessingOdometry() &&
 		!mainWindow_->isProcessingStatistics())
 	{
 		lastOdomInfoUpdateTime_ = UTimer::now();
+		if(!imagesVisible())
+		{
+			// don't convert the images, only the pose is updated
+			defaultCallback(odomMsg);
+			return;
+		}
 		if(!(leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 			leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0 ||
 			leftImageMsg->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
@@ -744,25 +783,9 @@ void GuiWrapper::stereoOdomInfoCallback(
 		}
 
 		// TF ready?
-		Transform localTransform;
-		try
+		Transform localTransform = getLocalTransform(leftImageMsg->header.frame_id, leftImageMsg->header.stamp);
+		if(localTransform.isNull())
 		{
-			if(waitForTransform_)
-			{
-				if(!tfListener_.waitForTransform(frameId_, leftImageMsg->header.frame_id, leftImageMsg->header.stamp, ros::Duration(1)))
-				{
-					ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), leftImageMsg->header.frame_id.c_str());
-					return;
-				}
-			}
-
-			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, leftImageMsg->header.frame_id, leftImageMsg->header.stamp, tmp);
-			localTransform = rtabmap_ros::transformFromTF(tmp);
-		}
-		catch(tf::TransformException & ex)
-		{
-			ROS_WARN("%s",ex.what());
 			return;
 		}
 
@@ -781,17 +804,17 @@ void GuiWrapper::stereoOdomInfoCallback(
 		image_geometry::StereoCameraModel model;
 		model.fromCameraInfo(*leftCameraInfoMsg, *rightCameraInfoMsg);
 
-		float fx = model.left().fx();
-		float cx = model.left().cx();
-		float cy = model.left().cy();
+		float fx = model.left().fx()/imageDecimation_;
+		float cx = model.left().cx()/imageDecimation_;
+		float cy = model.left().cy()/imageDecimation_;
 		float baseline = model.baseline();
 
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
 		float rotVariance = max3(odomMsg->pose.covariance[21], odomMsg->pose.covariance[28], odomMsg->pose.covariance[35]);
 
 		rtabmap::SensorData image(
-				ptrLeftImage->image.clone(),
-				ptrRightImage->image.clone(),
+				guiImage(ptrLeftImage, leftImageMsg, imageDecimation_),
+				guiImage(ptrRightImage, rightImageMsg, imageDecimation_),
 				fx,
 				baseline,
 				cx,
@@ -815,12 +838,18 @@ void GuiWrapper::stereoCallback(
 		const sensor_msgs::CameraInfoConstPtr& leftCameraInfoMsg,
 		const sensor_msgs::CameraInfoConstPtr& rightCameraInfoMsg)
 {
-	// limit 10 Hz max
-	if(UTimer::now() - lastOdomInfoUpdateTime_ > 0.1 &&
+	// limit to max_update_rate
+	if(UTimer::now() - lastOdomInfoUpdateTime_ > updatePeriod_ &&
 		!mainWindow_->isProcessingOdometry() &&
 		!mainWindow_->isProcessingStatistics())
 	{
 		lastOdomInfoUpdateTime_ = UTimer::now();
+		if(!imagesVisible())
+		{
+			// don't convert the images, only the pose is updated
+			defaultCallback(odomMsg);
+			return;
+		}
 		if(!(leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 			leftImageMsg->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0 ||
 			leftImageMsg->encoding.compare(sensor_msgs::image_encodings::BGR8) == 0 ||
@@ -835,25 +864,9 @@ void GuiWrapper::stereoCallback(
 		}
 
 		// TF ready?
-		Transform localTransform;
-		try
-		{
-			if(waitForTransform_)
-			{
-				if(!tfListener_.waitForTransform(frameId_, leftImageMsg->header.frame_id, leftImageMsg->header.stamp, ros::Duration(1)))
-				{
-					ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), leftImageMsg->header.frame_id.c_str());
-					return;
-				}
-			}
-
-			tf::StampedTransform tmp;
-			tfListener_.lookupTransform(frameId_, leftImageMsg->header.frame_id, leftImageMsg->header.stamp, tmp);
-			localTransform = rtabmap_ros::transformFromTF(tmp);
-		}
-		catch(tf::TransformException & ex)
+		Transform localTransform = getLocalTransform(leftImageMsg->header.frame_id, leftImageMsg->header.stamp);
+		if(localTransform.isNull())
 		{
-			ROS_WARN("%s",ex.what());
 			return;
 		}
 
@@ -872,17 +885,17 @@ void GuiWrapper::stereoCallback(
 		image_geometry::StereoCameraModel model;
 		model.fromCameraInfo(*leftCameraInfoMsg, *rightCameraInfoMsg);
 
-		float fx = model.left().fx();
-		float cx = model.left().cx();
-		float cy = model.left().cy();
+		float fx = model.left().fx()/imageDecimation_;
+		float cx = model.left().cx()/imageDecimation_;
+		float cy = model.left().cy()/imageDecimation_;
 		float baseline = model.baseline();
 
 		float transVariance = max3(odomMsg->pose.covariance[0], odomMsg->pose.covariance[7], odomMsg->pose.covariance[14]);
 		float rotVariance = max3(odomMsg->pose.covariance[21], odomMsg->pose.covariance[28], odomMsg->pose.covariance[35]);
 
 		rtabmap::SensorData image(
-				ptrLeftImage->image.clone(),
-				ptrRightImage->image.clone(),
+				guiImage(ptrLeftImage, leftImageMsg, imageDecimation_),
+				guiImage(ptrRightImage, rightImageMsg, imageDecimation_),
 				fx,
 				baseline,
 				cx,
@@ -899,6 +912,72 @@ void GuiWrapper::stereoCallback(
 	}
 }
 
+// The images are not converted when the window cannot show them
+bool GuiWrapper::imagesVisible() const
+{
+	return mainWindow_->isVisible() && !mainWindow_->isMinimized();
+}
+
+rtabmap::Transform GuiWrapper::getLocalTransform(const std::string & sensorFrameId, const ros::Time & stamp)
+{
+	// The sensors are assumed fixed on the robot with tf_cache_local_transforms
+	if(tfCacheLocalTransforms_)
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		std::map<std::string, Transform>::iterator iter = localTransforms_.find(sensorFrameId);
+		if(iter != localTransforms_.end())
+		{
+			return iter->second;
+		}
+	}
+
+	Transform localTransform;
+	try
+	{
+		// with tf_message_filter, the transform of the sensor data is already available
+		if(waitForTransform_ && !tfMessageFilter_)
+		{
+			if(!tfListener_.waitForTransform(frameId_, sensorFrameId, stamp, ros::Duration(1)))
+			{
+				ROS_WARN("Could not get transform from %s to %s after 1 second!", frameId_.c_str(), sensorFrameId.c_str());
+				return localTransform;
+			}
+		}
+
+		tf::StampedTransform tmp;
+		tfListener_.lookupTransform(frameId_, sensorFrameId, stamp, tmp);
+		localTransform = rtabmap_ros::transformFromTF(tmp);
+	}
+	catch(tf::TransformException & ex)
+	{
+		ROS_WARN("%s",ex.what());
+		return localTransform;
+	}
+
+	if(tfCacheLocalTransforms_)
+	{
+		boost::mutex::scoped_lock lock(localTransformsMutex_);
+		localTransforms_.insert(std::make_pair(sensorFrameId, localTransform));
+	}
+	return localTransform;
+}
+
+void GuiWrapper::setupTFFilter(image_transport::SubscriberFilter & imageSub, int queueSize)
+{
+	if(tfMessageFilter_)
+	{
+		ros::NodeHandle nh;
+		tfFilter_ = new tf::MessageFilter<sensor_msgs::Image>(imageSub, tfListener_, frameId_, queueSize, nh);
+		tfFilter_->setTolerance(ros::Duration(tfTolerance_));
+		imageTFInput_.connectInput(*tfFilter_);
+		ROS_INFO("rtabmapviz: Sensor data is synchronized when its TF is available (tf_tolerance=%f s)", tfTolerance_);
+	}
+	else
+	{
+		imageTFInput_.connectInput(imageSub);
+	}
+}
+
 void GuiWrapper::setupCallbacks(
 		bool subscribeDepth,
 		bool subscribeLaserScan,
@@ -932,12 +1011,13 @@ void GuiWrapper::setupCallbacks(
 		odomSub_.subscribe(nh, "odom", 1);
 		imageSub_.subscribe(rgb_it, rgb_nh.resolveName("image"), 1, hintsRgb);
 		imageDepthSub_.subscribe(depth_it, depth_nh.resolveName("image"), 1, hintsDepth);
+		setupTFFilter(imageDepthSub_, queueSize);
 		cameraInfoSub_.subscribe(rgb_nh, "camera_info", 1);
 
 		if(subscribeLaserScan)
 		{
 			scanSub_.subscribe(nh, "scan", 1);
-			depthScanSync_ = new message_filters::Synchronizer<MyDepthScanSyncPolicy>(MyDepthScanSyncPolicy(queueSize), imageSub_, odomSub_, imageDepthSub_, cameraInfoSub_, scanSub_);
+			depthScanSync_ = new message_filters::Synchronizer<MyDepthScanSyncPolicy>(MyDepthScanSyncPolicy(queueSize), imageSub_, odomSub_, imageTFInput_, cameraInfoSub_, scanSub_);
 			depthScanSync_->registerCallback(boost::bind(&GuiWrapper::depthScanCallback, this, _1, _2, _3, _4, _5));
 
 			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -951,7 +1031,7 @@ void GuiWrapper::setupCallbacks(
 		else if(subscribeOdomInfo)
 		{
 			odomInfoSub_.subscribe(nh, "odom_info", 1);
-			depthOdomInfoSync_ = new message_filters::Synchronizer<MyDepthOdomInfoSyncPolicy>(MyDepthOdomInfoSyncPolicy(queueSize), imageSub_, odomSub_, odomInfoSub_, imageDepthSub_, cameraInfoSub_);
+			depthOdomInfoSync_ = new message_filters::Synchronizer<MyDepthOdomInfoSyncPolicy>(MyDepthOdomInfoSyncPolicy(queueSize), imageSub_, odomSub_, odomInfoSub_, imageTFInput_, cameraInfoSub_);
 			depthOdomInfoSync_->registerCallback(boost::bind(&GuiWrapper::depthOdomInfoCallback, this, _1, _2, _3, _4, _5));
 
 			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -964,7 +1044,7 @@ void GuiWrapper::setupCallbacks(
 		}
 		else
 		{
-			depthSync_ = new message_filters::Synchronizer<MyDepthSyncPolicy>(MyDepthSyncPolicy(queueSize), imageSub_, odomSub_, imageDepthSub_, cameraInfoSub_);
+			depthSync_ = new message_filters::Synchronizer<MyDepthSyncPolicy>(MyDepthSyncPolicy(queueSize), imageSub_, odomSub_, imageTFInput_, cameraInfoSub_);
 			depthSync_->registerCallback(boost::bind(&GuiWrapper::depthCallback, this, _1, _2, _3, _4));
 
 			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s",
@@ -987,6 +1067,7 @@ void GuiWrapper::setupCallbacks(
 		image_transport::TransportHints hintsRight("raw", ros::TransportHints(), right_pnh);
 
 		imageRectLeft_.subscribe(left_it, left_nh.resolveName("image_rect"), 1, hintsLeft);
+		setupTFFilter(imageRectLeft_, queueSize);
 		imageRectRight_.subscribe(right_it, right_nh.resolveName("image_rect"), 1, hintsRight);
 		cameraInfoLeft_.subscribe(left_nh, "camera_info", 1);
 		cameraInfoRight_.subscribe(right_nh, "camera_info", 1);
@@ -995,7 +1076,7 @@ void GuiWrapper::setupCallbacks(
 		if(subscribeLaserScan)
 		{
 			scanSub_.subscribe(nh, "scan", 1);
-			stereoScanSync_ = new message_filters::Synchronizer<MyStereoScanSyncPolicy>(MyStereoScanSyncPolicy(queueSize), odomSub_, scanSub_, imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+			stereoScanSync_ = new message_filters::Synchronizer<MyStereoScanSyncPolicy>(MyStereoScanSyncPolicy(queueSize), odomSub_, scanSub_, imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
 			stereoScanSync_->registerCallback(boost::bind(&GuiWrapper::stereoScanCallback, this, _1, _2, _3, _4, _5, _6));
 
 			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -1010,7 +1091,7 @@ void GuiWrapper::setupCallbacks(
 		else if(subscribeOdomInfo)
 		{
 			odomInfoSub_.subscribe(nh, "odom_info", 1);
-			stereoOdomInfoSync_ = new message_filters::Synchronizer<MyStereoOdomInfoSyncPolicy>(MyStereoOdomInfoSyncPolicy(queueSize), odomSub_, odomInfoSub_, imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+			stereoOdomInfoSync_ = new message_filters::Synchronizer<MyStereoOdomInfoSyncPolicy>(MyStereoOdomInfoSyncPolicy(queueSize), odomSub_, odomInfoSub_, imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
 			stereoOdomInfoSync_->registerCallback(boost::bind(&GuiWrapper::stereoOdomInfoCallback, this, _1, _2, _3, _4, _5, _6));
 
 			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
@@ -1024,7 +1105,7 @@ void GuiWrapper::setupCallbacks(
 		}
 		else
 		{
-			stereoSync_ = new message_filters::Synchronizer<MyStereoSyncPolicy>(MyStereoSyncPolicy(queueSize), odomSub_, imageRectLeft_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
+			stereoSync_ = new message_filters::Synchronizer<MyStereoSyncPolicy>(MyStereoSyncPolicy(queueSize), odomSub_, imageTFInput_, imageRectRight_, cameraInfoLeft_, cameraInfoRight_);
 			stereoSync_->registerCallback(boost::bind(&GuiWrapper::stereoCallback, this, _1, _2, _3, _4, _5));
 
 			ROS_INFO("\n%s subscribed to:\n   %s,\n   %s,\n   %s,\n   %s,\n   %s",
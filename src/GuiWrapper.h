@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/UEventsHandler.h"
 
 #include <tf/transform_listener.h>
+#include <tf/message_filter.h>
 
 #include <geometry_msgs/TwistStamped.h>
 #include <sensor_msgs/PointCloud2.h>
@@ -45,12 +46,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <message_filters/subscriber.h>
 #include <message_filters/synchronizer.h>
+#include <message_filters/pass_through.h>
 #include <message_filters/sync_policies/approximate_time.h>
 #include <message_filters/sync_policies/exact_time.h>
 
 #include <image_transport/image_transport.h>
 #include <image_transport/subscriber_filter.h>
 
+#include <rtabmap/core/Transform.h>
+
+#include <boost/thread/mutex.hpp>
+
 namespace rtabmap
 {
 	class MainWindow;
@@ -112,16 +118,26 @@ private:
 			const sensor_msgs::CameraInfoConstPtr& rightCameraInfoMsg);
 
 	void processRequestedMap(const rtabmap_ros::MapData & map);
+	rtabmap::Transform getLocalTransform(const std::string & sensorFrameId, const ros::Time & stamp);
+	void setupTFFilter(image_transport::SubscriberFilter & imageSub, int queueSize);
+	bool imagesVisible() const;
 
 private:
 	QApplication * app_;
 	rtabmap::MainWindow * mainWindow_;
 	std::string cameraNodeName_;
 	double lastOdomInfoUpdateTime_;
+	double updatePeriod_; // 1/max_update_rate, 0=no limit
+	int imageDecimation_;
 
 	// odometry subscription stuffs
 	std::string frameId_;
 	bool waitForTransform_;
+	bool tfMessageFilter_; // sensor data is received only when its transform is available
+	double tfTolerance_;
+	bool tfCacheLocalTransforms_;
+	std::map<std::string, rtabmap::Transform> localTransforms_; // sensor frame -> frame_id
+	boost::mutex localTransformsMutex_;
 	tf::TransformListener tfListener_;
 
 	message_filters::Subscriber<rtabmap_ros::Info> infoTopic_;
@@ -140,6 +156,11 @@ private:
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoLeft_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoRight_;
 
+	// Input of the synchronizers for the depth (or left) image, connected to
+	// the image subscriber or to tfFilter_ with tf_message_filter
+	message_filters::PassThrough<sensor_msgs::Image> imageTFInput_;
+	tf::MessageFilter<sensor_msgs::Image> * tfFilter_;
+
 	typedef message_filters::sync_policies::ExactTime<
 			rtabmap_ros::Info,
 			rtabmap_ros::MapData> MyInfoMapSyncPolicy;
@@ -0,0 +1,317 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/IncrementalGrid.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <limits>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+// extra cells added around the map when it grows, to avoid resizing it on every update
+static const int GROW_STEP = 50;
+// margin around the local maps, same as rtabmap::util3d::create2DMapFromOccupancyLocalMaps()
+static const int MARGIN = 10;
+
+// union ignoring empty rectangles
+static void unite(cv::Rect & a, const cv::Rect & b)
+{
+	if(a.area() == 0)
+	{
+		a = b;
+	}
+	else if(b.area())
+	{
+		a |= b;
+	}
+}
+
+IncrementalGrid::IncrementalGrid(float cellSize, float minMapSize, bool eroded) :
+		cellSize_(cellSize),
+		minMapSize_(minMapSize),
+		eroded_(eroded),
+		cellX0_(0),
+		cellY0_(0),
+		resized_(false)
+{
+	UASSERT(cellSize_ > 0.0f);
+}
+
+void IncrementalGrid::setParameters(float cellSize, float minMapSize, bool eroded)
+{
+	UASSERT(cellSize > 0.0f);
+	if(cellSize != cellSize_ || minMapSize != minMapSize_ || eroded != eroded_)
+	{
+		cellSize_ = cellSize;
+		minMapSize_ = minMapSize;
+		eroded_ = eroded;
+		clear();
+	}
+}
+
+void IncrementalGrid::clear()
+{
+	nodes_.clear();
+	posesDiff_.clear();
+	groundCounts_ = cv::Mat();
+	obstacleCounts_ = cv::Mat();
+	map_ = cv::Mat();
+	cellX0_ = 0;
+	cellY0_ = 0;
+	resized_ = false;
+}
+
+size_t IncrementalGrid::bytes() const
+{
+	size_t bytes = groundCounts_.total()*groundCounts_.elemSize() +
+			obstacleCounts_.total()*obstacleCounts_.elemSize() +
+			map_.total()*map_.elemSize();
+	for(std::map<int, NodeCells>::const_iterator iter=nodes_.begin(); iter!=nodes_.end(); ++iter)
+	{
+		bytes += sizeof(NodeCells) + (iter->second.ground.capacity() + iter->second.obstacles.capacity())*sizeof(cv::Point2i);
+	}
+	return bytes;
+}
+
+cv::Rect IncrementalGrid::update(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+		float linearUpdate,
+		float angularUpdate)
+{
+	resized_ = false;
+	cv::Rect dirty; // world cells
+
+	// only nodes with a local map are in the grid
+	std::map<int, rtabmap::Transform> posesWithMaps;
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(localMaps.find(iter->first) != localMaps.end())
+		{
+			posesWithMaps.insert(posesWithMaps.end(), *iter);
+		}
+	}
+	posesDiff_.setTolerances(linearUpdate, angularUpdate, true);
+	posesDiff_.update(posesWithMaps);
+
+	// remove nodes not in the graph anymore or moved
+	std::vector<int> toRemove(posesDiff_.removed().begin(), posesDiff_.removed().end());
+	toRemove.insert(toRemove.end(), posesDiff_.moved().begin(), posesDiff_.moved().end());
+	for(unsigned int i=0; i<toRemove.size(); ++i)
+	{
+		std::map<int, NodeCells>::iterator iter = nodes_.find(toRemove[i]);
+		if(iter != nodes_.end())
+		{
+			rasterize(iter->second, -1);
+			unite(dirty, iter->second.bounds);
+			nodes_.erase(iter);
+		}
+	}
+
+	// compute the cells of the new and moved nodes
+	std::vector<int> added;
+	cv::Rect needed;
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=posesDiff_.poses().begin(); iter!=posesDiff_.poses().end(); ++iter)
+	{
+		if(nodes_.find(iter->first) == nodes_.end())
+		{
+			const std::pair<cv::Mat, cv::Mat> & localMap = localMaps.at(iter->first);
+			NodeCells & node = nodes_[iter->first];
+
+			float x,y,z,roll,pitch,yaw;
+			iter->second.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+			float cosT = cos(yaw);
+			float sinT = sin(yaw);
+
+			cv::Point2i cell(std::floor(x/cellSize_ + 0.5f), std::floor(y/cellSize_ + 0.5f));
+			int minX = cell.x, maxX = cell.x, minY = cell.y, maxY = cell.y;
+			for(int k=0; k<2; ++k)
+			{
+				const cv::Mat & points = k==0?localMap.first:localMap.second;
+				std::vector<cv::Point2i> & cells = k==0?node.ground:node.obstacles;
+				if(points.empty())
+				{
+					continue;
+				}
+				UASSERT(points.type() == CV_32FC2);
+				cells.resize(points.total());
+				const cv::Point2f * ptr = points.ptr<cv::Point2f>();
+				for(unsigned int i=0; i<cells.size(); ++i)
+				{
+					float px = cosT*ptr[i].x - sinT*ptr[i].y + x;
+					float py = sinT*ptr[i].x + cosT*ptr[i].y + y;
+					cells[i].x = std::floor(px/cellSize_ + 0.5f);
+					cells[i].y = std::floor(py/cellSize_ + 0.5f);
+					if(cells[i].x < minX) minX = cells[i].x;
+					else if(cells[i].x > maxX) maxX = cells[i].x;
+					if(cells[i].y < minY) minY = cells[i].y;
+					else if(cells[i].y > maxY) maxY = cells[i].y;
+				}
+			}
+			node.bounds = cv::Rect(minX, minY, maxX-minX+1, maxY-minY+1);
+			unite(needed, node.bounds);
+			added.push_back(iter->first);
+		}
+	}
+
+	if(map_.empty() && added.empty())
+	{
+		return cv::Rect();
+	}
+
+	if(map_.empty() && minMapSize_ > 0.0f)
+	{
+		int half = std::ceil(minMapSize_/2.0f/cellSize_);
+		unite(needed, cv::Rect(-half, -half, 2*half+1, 2*half+1));
+	}
+	if(needed.area())
+	{
+		grow(cv::Rect(needed.x-MARGIN, needed.y-MARGIN, needed.width+2*MARGIN, needed.height+2*MARGIN));
+	}
+
+	for(unsigned int i=0; i<added.size(); ++i)
+	{
+		const NodeCells & node = nodes_.at(added[i]);
+		rasterize(node, 1);
+		unite(dirty, node.bounds);
+	}
+
+	cv::Rect region = resized_?cv::Rect(0, 0, map_.cols, map_.rows):dirty.area()?toGrid(dirty):cv::Rect();
+	if(eroded_ && !resized_ && region.area())
+	{
+		// erosion of the neighbors may have changed
+		region = cv::Rect(region.x-1, region.y-1, region.width+2, region.height+2);
+	}
+	region &= cv::Rect(0, 0, map_.cols, map_.rows);
+	refresh(region);
+
+	UDEBUG("nodes=%d added=%d map=%dx%d region=%dx%d resized=%d",
+			(int)nodes_.size(), (int)added.size(), map_.cols, map_.rows, region.width, region.height, resized_?1:0);
+	return region;
+}
+
+void IncrementalGrid::refresh(const cv::Rect & region)
+{
+	for(int i=region.y; i<region.y+region.height; ++i)
+	{
+		char * row = map_.ptr<char>(i);
+		for(int j=region.x; j<region.x+region.width; ++j)
+		{
+			char value = rawValue(i, j);
+			if(eroded_ && value == 100 &&
+			   i>0 && j>0 && i<map_.rows-1 && j<map_.cols-1)
+			{
+				// remove obstacles touching at least 3 empty cells and no unknown cell
+				char n[4] = {rawValue(i+1, j), rawValue(i-1, j), rawValue(i, j+1), rawValue(i, j-1)};
+				int touchEmpty = (n[0]==0?1:0) + (n[1]==0?1:0) + (n[2]==0?1:0) + (n[3]==0?1:0);
+				if(touchEmpty >= 3 && n[0]!=-1 && n[1]!=-1 && n[2]!=-1 && n[3]!=-1)
+				{
+					value = 0;
+				}
+			}
+			row[j] = value;
+		}
+	}
+}
+
+void IncrementalGrid::rasterize(const NodeCells & node, int increment)
+{
+	static const unsigned short saturated = std::numeric_limits<unsigned short>::max();
+	for(int k=0; k<2; ++k)
+	{
+		cv::Mat & counts = k==0?groundCounts_:obstacleCounts_;
+		const std::vector<cv::Point2i> & cells = k==0?node.ground:node.obstacles;
+		for(unsigned int i=0; i<cells.size(); ++i)
+		{
+			// saturated counters stay saturated
+			unsigned short & count = counts.at<unsigned short>(cells[i].y - cellY0_, cells[i].x - cellX0_);
+			if(count != saturated)
+			{
+				UASSERT(increment > 0 || count > 0);
+				count += increment;
+			}
+		}
+	}
+}
+
+void IncrementalGrid::grow(const cv::Rect & worldBounds)
+{
+	cv::Rect current(cellX0_, cellY0_, map_.cols, map_.rows);
+	if(!map_.empty() && (current & worldBounds) == worldBounds)
+	{
+		return;
+	}
+
+	cv::Rect bounds = worldBounds;
+	if(!map_.empty())
+	{
+		// grow by steps in the directions needed
+		int minX = bounds.x < current.x?bounds.x-GROW_STEP:current.x;
+		int minY = bounds.y < current.y?bounds.y-GROW_STEP:current.y;
+		int maxX = bounds.br().x > current.br().x?bounds.br().x+GROW_STEP:current.br().x;
+		int maxY = bounds.br().y > current.br().y?bounds.br().y+GROW_STEP:current.br().y;
+		bounds = cv::Rect(minX, minY, maxX-minX, maxY-minY);
+	}
+
+	cv::Mat groundCounts = cv::Mat::zeros(bounds.height, bounds.width, CV_16UC1);
+	cv::Mat obstacleCounts = cv::Mat::zeros(bounds.height, bounds.width, CV_16UC1);
+	cv::Mat map = cv::Mat(bounds.height, bounds.width, CV_8SC1, cv::Scalar(-1));
+	if(!map_.empty())
+	{
+		cv::Rect roi(current.x - bounds.x, current.y - bounds.y, current.width, current.height);
+		groundCounts_.copyTo(groundCounts(roi));
+		obstacleCounts_.copyTo(obstacleCounts(roi));
+		map_.copyTo(map(roi));
+	}
+	groundCounts_ = groundCounts;
+	obstacleCounts_ = obstacleCounts;
+	map_ = map;
+	cellX0_ = bounds.x;
+	cellY0_ = bounds.y;
+	resized_ = true;
+	UDEBUG("Grid resized to %dx%d (origin cell %d,%d)", map_.cols, map_.rows, cellX0_, cellY0_);
+}
+
+char IncrementalGrid::rawValue(int row, int col) const
+{
+	if(obstacleCounts_.at<unsigned short>(row, col))
+	{
+		return 100;
+	}
+	else if(groundCounts_.at<unsigned short>(row, col))
+	{
+		return 0;
+	}
+	return -1;
+}
+
+cv::Rect IncrementalGrid::toGrid(const cv::Rect & worldRect) const
+{
+	return cv::Rect(worldRect.x - cellX0_, worldRect.y - cellY0_, worldRect.width, worldRect.height);
+}
+
+}
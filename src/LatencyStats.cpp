@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/LatencyStats.h"
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <algorithm>
+
+namespace rtabmap_ros {
+
+LatencyStats::LatencyStats(const std::string & name, int historySize) :
+		name_(name),
+		historySize_(historySize),
+		enabled_(false)
+{
+}
+
+LatencyStats::~LatencyStats()
+{
+	timer_.stop();
+	for(unsigned int i=0; i<stages_.size(); ++i)
+	{
+		delete stages_[i];
+	}
+}
+
+int LatencyStats::addStage(const std::string & name)
+{
+	ROS_ASSERT(!enabled_);
+	Stage * stage = new Stage();
+	stage->name = name;
+	stage->durations.resize(historySize_, 0.0f);
+	stage->count = 0;
+	stage->published = 0;
+	stages_.push_back(stage);
+	return (int)stages_.size()-1;
+}
+
+void LatencyStats::init(ros::NodeHandle & nh, ros::NodeHandle & pnh)
+{
+	double period = 1.0;
+	pnh.param("latency_stats_period", period, period);
+	if(period > 0.0 && stages_.size())
+	{
+		// private namespace = node or nodelet name
+		hardwareId_ = pnh.getNamespace();
+		diagnosticsPub_ = nh.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+		timer_ = nh.createWallTimer(ros::WallDuration(period), &LatencyStats::timerCallback, this);
+		enabled_ = true;
+	}
+}
+
+static void addValue(diagnostic_msgs::DiagnosticStatus & status, const std::string & key, double value)
+{
+	diagnostic_msgs::KeyValue keyValue;
+	keyValue.key = key;
+	keyValue.value = uNumber2Str(value);
+	status.values.push_back(keyValue);
+}
+
+void LatencyStats::timerCallback(const ros::WallTimerEvent &)
+{
+	if(diagnosticsPub_.getNumSubscribers() == 0)
+	{
+		return;
+	}
+
+	diagnostic_msgs::DiagnosticArrayPtr msg(new diagnostic_msgs::DiagnosticArray);
+	msg->header.stamp = ros::Time::now();
+	msg->status.resize(1);
+	diagnostic_msgs::DiagnosticStatus & status = msg->status[0];
+	status.level = diagnostic_msgs::DiagnosticStatus::OK;
+	status.name = name_ + ": latency";
+	status.hardware_id = hardwareId_;
+	for(unsigned int i=0; i<stages_.size(); ++i)
+	{
+		Stage & stage = *stages_[i];
+		unsigned int count = stage.count.load(boost::memory_order_relaxed);
+		unsigned int samples = std::min(count, (unsigned int)stage.durations.size());
+		addValue(status, stage.name + " count", count - stage.published);
+		stage.published = count;
+		if(samples == 0)
+		{
+			continue;
+		}
+		// the slots written while copying are from the current period, they
+		// are as valid as the others
+		sorted_.assign(stage.durations.begin(), stage.durations.begin()+samples);
+		std::vector<float>::iterator p50 = sorted_.begin() + (samples*50)/100;
+		std::vector<float>::iterator p95 = sorted_.begin() + std::min(samples-1, (samples*95)/100);
+		std::vector<float>::iterator p99 = sorted_.begin() + std::min(samples-1, (samples*99)/100);
+		std::nth_element(sorted_.begin(), p50, sorted_.end());
+		std::nth_element(p50, p95, sorted_.end());
+		std::nth_element(p95, p99, sorted_.end());
+		addValue(status, stage.name + " p50 (ms)", *p50*1000.0);
+		addValue(status, stage.name + " p95 (ms)", *p95*1000.0);
+		addValue(status, stage.name + " p99 (ms)", *p99*1000.0);
+	}
+	status.message = uFormat("%d stages", (int)stages_.size());
+	diagnosticsPub_.publish(msg);
+}
+
+}
@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/MapDataDelta.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include <rtabmap/utilite/ULogger.h>
+
+namespace rtabmap_ros {
+
+namespace {
+bool containsLink(const std::multimap<int, rtabmap::Link> & links, const rtabmap::Link & link)
+{
+	std::pair<std::multimap<int, rtabmap::Link>::const_iterator, std::multimap<int, rtabmap::Link>::const_iterator> range = links.equal_range(link.from());
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=range.first; iter!=range.second; ++iter)
+	{
+		if(iter->second.to() == link.to() && iter->second.type() == link.type())
+		{
+			return true;
+		}
+	}
+	return false;
+}
+}
+
+MapDataDeltaEncoder::MapDataDeltaEncoder(float linearTolerance, float angularTolerance) :
+		keyframe_(true),
+		sequence_(0),
+		poses_(linearTolerance, angularTolerance)
+{
+}
+
+void MapDataDeltaEncoder::clear()
+{
+	keyframe_ = true;
+	poses_.clear();
+	labels_.clear();
+	links_.clear();
+	sentNodes_.clear();
+}
+
+void MapDataDeltaEncoder::encode(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, int> & mapIds,
+		const std::map<int, double> & stamps,
+		const std::map<int, std::string> & labels,
+		const std::map<int, std::vector<unsigned char> > & userDatas,
+		const std::multimap<int, rtabmap::Link> & links,
+		const rtabmap::Transform & mapToOdom,
+		rtabmap_ros::MapData & msg)
+{
+	msg.sequence = ++sequence_;
+	poses_.update(poses);
+
+	std::multimap<int, rtabmap::Link> newLinks;
+	bool linksRemoved = false;
+	if(!keyframe_)
+	{
+		for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+		{
+			if(!containsLink(links_, iter->second))
+			{
+				newLinks.insert(*iter);
+			}
+		}
+		// links of removed nodes are removed implicitly, other ones need a keyframe
+		for(std::multimap<int, rtabmap::Link>::const_iterator iter=links_.begin(); iter!=links_.end() && !linksRemoved; ++iter)
+		{
+			linksRemoved = poses.find(iter->second.from()) != poses.end() &&
+						   poses.find(iter->second.to()) != poses.end() &&
+						   !containsLink(links, iter->second);
+		}
+	}
+
+	if(keyframe_ || linksRemoved)
+	{
+		msg.delta = false;
+		msg.removedIds.clear();
+		mapGraphToROS(poses, mapIds, stamps, labels, userDatas, links, mapToOdom, msg.graph);
+	}
+	else
+	{
+		// new, moved and relabeled nodes
+		std::set<int> ids = poses_.added();
+		ids.insert(poses_.moved().begin(), poses_.moved().end());
+		for(std::map<int, std::string>::const_iterator iter=labels.begin(); iter!=labels.end(); ++iter)
+		{
+			std::map<int, std::string>::const_iterator jter = labels_.find(iter->first);
+			if((jter == labels_.end() || jter->second.compare(iter->second) != 0) &&
+				poses_.poses().find(iter->first) != poses_.poses().end())
+			{
+				ids.insert(iter->first);
+			}
+		}
+
+		std::map<int, rtabmap::Transform> deltaPoses;
+		std::map<int, int> deltaMapIds;
+		std::map<int, double> deltaStamps;
+		std::map<int, std::string> deltaLabels;
+		std::map<int, std::vector<unsigned char> > deltaUserDatas;
+		for(std::set<int>::iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+		{
+			int id = *iter;
+			std::map<int, rtabmap::Transform>::const_iterator poseIter = poses.find(id);
+			std::map<int, int>::const_iterator mapIdIter = mapIds.find(id);
+			std::map<int, double>::const_iterator stampIter = stamps.find(id);
+			std::map<int, std::string>::const_iterator labelIter = labels.find(id);
+			std::map<int, std::vector<unsigned char> >::const_iterator userDataIter = userDatas.find(id);
+			UASSERT(poseIter != poses.end());
+			deltaPoses.insert(*poseIter);
+			deltaMapIds.insert(std::make_pair(id, mapIdIter!=mapIds.end()?mapIdIter->second:-1));
+			deltaStamps.insert(std::make_pair(id, stampIter!=stamps.end()?stampIter->second:0.0));
+			deltaLabels.insert(std::make_pair(id, labelIter!=labels.end()?labelIter->second:std::string()));
+			// user data are sent only with new nodes
+			deltaUserDatas.insert(std::make_pair(id,
+					userDataIter!=userDatas.end() && poses_.added().find(id) != poses_.added().end()?
+							userDataIter->second:std::vector<unsigned char>()));
+		}
+
+		msg.delta = true;
+		msg.removedIds = std::vector<int>(poses_.removed().begin(), poses_.removed().end());
+		mapGraphToROS(deltaPoses, deltaMapIds, deltaStamps, deltaLabels, deltaUserDatas, newLinks, mapToOdom, msg.graph);
+	}
+
+	labels_ = labels;
+	links_ = links;
+	keyframe_ = false;
+}
+
+bool MapDataDeltaEncoder::addNode(const rtabmap::Signature & signature, rtabmap_ros::MapData & msg)
+{
+	if(sentNodes_.insert(signature.id()).second)
+	{
+		msg.nodes.resize(msg.nodes.size()+1);
+		nodeDataToROS(signature, msg.nodes.back());
+		return true;
+	}
+	return false;
+}
+
+MapDataDeltaDecoder::MapDataDeltaDecoder() :
+		synchronized_(false),
+		sequence_(0)
+{
+}
+
+void MapDataDeltaDecoder::clear()
+{
+	synchronized_ = false;
+	sequence_ = 0;
+	poses_.clear();
+	mapIds_.clear();
+	stamps_.clear();
+	labels_.clear();
+	userDatas_.clear();
+	links_.clear();
+}
+
+bool MapDataDeltaDecoder::decode(const rtabmap_ros::MapData & msg, rtabmap_ros::MapData & output)
+{
+	if(!msg.delta)
+	{
+		clear();
+		synchronized_ = true;
+	}
+	else if(!synchronized_ || msg.sequence != sequence_+1)
+	{
+		if(synchronized_)
+		{
+			UWARN("Missing map data messages (received %u, expected %u), waiting for a keyframe...", msg.sequence, sequence_+1);
+		}
+		synchronized_ = false;
+		return false;
+	}
+	sequence_ = msg.sequence;
+
+	for(unsigned int i=0; i<msg.removedIds.size(); ++i)
+	{
+		int id = msg.removedIds[i];
+		poses_.erase(id);
+		mapIds_.erase(id);
+		stamps_.erase(id);
+		labels_.erase(id);
+		userDatas_.erase(id);
+	}
+	if(msg.removedIds.size())
+	{
+		for(std::multimap<int, rtabmap::Link>::iterator iter=links_.begin(); iter!=links_.end();)
+		{
+			if(poses_.find(iter->second.from()) == poses_.end() || poses_.find(iter->second.to()) == poses_.end())
+			{
+				links_.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+
+	std::map<int, rtabmap::Transform> poses;
+	std::map<int, int> mapIds;
+	std::map<int, double> stamps;
+	std::map<int, std::string> labels;
+	std::map<int, std::vector<unsigned char> > userDatas;
+	std::multimap<int, rtabmap::Link> links;
+	rtabmap::Transform mapToOdom;
+	mapGraphFromROS(msg.graph, poses, mapIds, stamps, labels, userDatas, links, mapToOdom);
+
+	for(std::map<int, rtabmap::Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		int id = iter->first;
+		poses_[id] = iter->second;
+		mapIds_[id] = mapIds.at(id);
+		stamps_[id] = stamps.at(id);
+		labels_[id] = labels.at(id);
+		// user data are not resent with moved nodes
+		userDatas_.insert(*userDatas.find(id));
+	}
+	for(std::multimap<int, rtabmap::Link>::iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		if(!containsLink(links_, iter->second))
+		{
+			links_.insert(*iter);
+		}
+	}
+
+	output.header = msg.header;
+	output.sequence = msg.sequence;
+	output.delta = false;
+	output.removedIds.clear();
+	output.nodes = msg.nodes;
+	mapGraphToROS(poses_, mapIds_, stamps_, labels_, userDatas_, links_, mapToOdom, output.graph);
+	output.graph.header = msg.graph.header;
+	return true;
+}
+
+}
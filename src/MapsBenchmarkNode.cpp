@@ -0,0 +1,358 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap_ros/MapData.h>
+#include <rtabmap/core/Rtabmap.h>
+#include <rtabmap/core/Parameters.h>
+#include <rtabmap/core/Compression.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UConversion.h>
+#include <fstream>
+#include "MapsManager.h"
+
+#ifdef WITH_OCTOMAP
+#include <octomap/octomap.h>
+#endif
+
+/**
+ * Times the map building hot paths for graphs of different sizes. Nodes are
+ * taken from a database ("database" parameter) or synthesized. Results are
+ * printed (and saved to "output" if set) as CSV: stage,nodes,iteration,seconds
+ */
+
+void noopCloud(const sensor_msgs::PointCloud2ConstPtr &) {}
+void noopMap(const nav_msgs::OccupancyGridConstPtr &) {}
+
+void synthesizeGraph(
+		int count,
+		int imageWidth,
+		int imageHeight,
+		std::map<int, rtabmap::Transform> & poses,
+		std::map<int, rtabmap::Signature> & signatures,
+		std::multimap<int, rtabmap::Link> & links)
+{
+	// same camera data for all nodes: a textured wall 2 m in front of the robot
+	cv::Mat image(imageHeight, imageWidth, CV_8UC3);
+	cv::RNG rng(42);
+	rng.fill(image, cv::RNG::UNIFORM, 0, 255);
+	cv::Mat depth(imageHeight, imageWidth, CV_16UC1);
+	rng.fill(depth, cv::RNG::UNIFORM, 1950, 2050);
+	cv::Mat scan(1, 360, CV_32FC2);
+	for(int i=0; i<scan.cols; ++i)
+	{
+		float a = float(i)*M_PI/float(scan.cols) - M_PI/2.0f;
+		scan.at<cv::Vec2f>(i) = cv::Vec2f(3.0f*cos(a), 3.0f*sin(a));
+	}
+	cv::Mat imageCompressed = rtabmap::compressImage2(image, ".jpg");
+	cv::Mat depthCompressed = rtabmap::compressImage2(depth, ".png");
+	cv::Mat scanCompressed = rtabmap::compressData2(scan);
+	float f = float(imageWidth)*0.8f;
+	rtabmap::Transform localTransform(0,0,1,0, -1,0,0,0, 0,-1,0,0.5); // camera optical frame, 50 cm high
+
+	// serpentine path in rows of 30 m, nodes every 0.6 m so radius filtering keeps them
+	const int nodesPerRow = 50;
+	for(int i=0; i<count; ++i)
+	{
+		int id = i+1;
+		int row = i/nodesPerRow;
+		int col = i%nodesPerRow;
+		bool forward = row%2 == 0;
+		float x = 0.6f*float(forward?col:nodesPerRow-1-col);
+		float y = 1.0f*float(row);
+		rtabmap::Transform pose(x, y, 0, 0, 0, forward?0:M_PI);
+		poses.insert(std::make_pair(id, pose));
+		signatures.insert(std::make_pair(id, rtabmap::Signature(
+				id,
+				0,
+				0,
+				double(i),
+				"",
+				std::multimap<int, cv::KeyPoint>(),
+				std::multimap<int, pcl::PointXYZ>(),
+				pose,
+				std::vector<unsigned char>(),
+				scanCompressed,
+				imageCompressed,
+				depthCompressed,
+				f,
+				f,
+				float(imageWidth)/2.0f,
+				float(imageHeight)/2.0f,
+				localTransform)));
+		if(i>0)
+		{
+			links.insert(std::make_pair(id-1, rtabmap::Link(id-1, id, rtabmap::Link::kNeighbor, poses.at(id-1).inverse()*pose, 1.0f, 1.0f)));
+		}
+	}
+}
+
+class Results
+{
+public:
+	void add(const std::string & stage, int nodes, int iteration, double seconds)
+	{
+		std::string line = uFormat("%s,%d,%d,%f", stage.c_str(), nodes, iteration, seconds);
+		lines_.push_back(line);
+		printf("%s\n", line.c_str());
+		fflush(stdout);
+	}
+	bool save(const std::string & path) const
+	{
+		std::ofstream file(path.c_str());
+		if(!file.is_open())
+		{
+			return false;
+		}
+		file << "stage,nodes,iteration,seconds\n";
+		for(std::list<std::string>::const_iterator iter=lines_.begin(); iter!=lines_.end(); ++iter)
+		{
+			file << *iter << "\n";
+		}
+		return true;
+	}
+private:
+	std::list<std::string> lines_;
+};
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "maps_benchmark");
+	ULogger::setType(ULogger::kTypeConsole);
+	ULogger::setLevel(ULogger::kWarning);
+
+	ros::NodeHandle nh;
+	ros::NodeHandle pnh("~");
+
+	std::string database;
+	std::string nodesStr = "100 1000 10000";
+	std::string output;
+	int repeat = 1;
+	int imageWidth = 160;
+	int imageHeight = 120;
+	bool octomap = true;
+	pnh.param("database", database, database);
+	pnh.param("nodes", nodesStr, nodesStr); // graph sizes to test, separated by spaces
+	pnh.param("output", output, output); // CSV file
+	pnh.param("repeat", repeat, repeat);
+	pnh.param("image_width", imageWidth, imageWidth);
+	pnh.param("image_height", imageHeight, imageHeight);
+	pnh.param("octomap", octomap, octomap);
+
+	// keep the caches between calls, MapsManager clears them if nobody is subscribed
+	pnh.setParam("map_mapsManager_cleanup", false);
+
+	std::list<std::string> nodesList = uSplit(nodesStr, ' ');
+	std::vector<int> sizes;
+	int maxSize = 0;
+	for(std::list<std::string>::iterator iter=nodesList.begin(); iter!=nodesList.end(); ++iter)
+	{
+		int size = uStr2Int(*iter);
+		if(size > 0)
+		{
+			sizes.push_back(size);
+			maxSize = size > maxSize?size:maxSize;
+		}
+	}
+
+	// get the graph
+	std::map<int, rtabmap::Transform> allPoses;
+	std::map<int, rtabmap::Signature> allSignatures;
+	std::multimap<int, rtabmap::Link> allLinks;
+	if(!database.empty())
+	{
+		rtabmap::ParametersMap parameters;
+		parameters.insert(rtabmap::ParametersPair(rtabmap::Parameters::kMemIncrementalMemory(), "false"));
+		rtabmap::Rtabmap rtabmap;
+		rtabmap.init(parameters, database);
+		std::map<int, int> mapIds;
+		std::map<int, double> stamps;
+		std::map<int, std::string> labels;
+		std::map<int, std::vector<unsigned char> > userDatas;
+		rtabmap.get3DMap(allSignatures, allPoses, allLinks, mapIds, stamps, labels, userDatas, true, true);
+		rtabmap.close();
+		ROS_INFO("Loaded %d nodes from \"%s\"", (int)allPoses.size(), database.c_str());
+	}
+	else
+	{
+		synthesizeGraph(maxSize, imageWidth, imageHeight, allPoses, allSignatures, allLinks);
+		ROS_INFO("Synthesized %d nodes (images %dx%d)", (int)allPoses.size(), imageWidth, imageHeight);
+	}
+
+	// Created once, so the subscribers below are connected to its publishers
+	// before timing (the maps are only created if they have subscribers).
+	// The caches are cleared at each iteration.
+	MapsManager mapsManager;
+
+	// subscribers so that the maps are created and published
+	ros::Subscriber cloudSub = nh.subscribe("cloud_map", 1, noopCloud);
+	ros::Subscriber projSub = nh.subscribe("proj_map", 1, noopMap);
+	ros::Subscriber gridSub = nh.subscribe("grid_map", 1, noopMap);
+	ros::WallTime connectionStart = ros::WallTime::now();
+	while(ros::ok() &&
+		  (cloudSub.getNumPublishers() == 0 || projSub.getNumPublishers() == 0 || gridSub.getNumPublishers() == 0))
+	{
+		if(ros::WallTime::now() - connectionStart > ros::WallDuration(5.0))
+		{
+			ROS_WARN("Map topics not connected after 5 s, the maps may not be created.");
+			break;
+		}
+		ros::spinOnce();
+		ros::WallDuration(0.01).sleep();
+	}
+
+	Results results;
+	for(unsigned int s=0; s<sizes.size() && ros::ok(); ++s)
+	{
+		// first nodes of the graph
+		std::map<int, rtabmap::Transform> poses;
+		std::map<int, rtabmap::Signature> signatures;
+		for(std::map<int, rtabmap::Transform>::iterator iter=allPoses.begin(); iter!=allPoses.end() && (int)poses.size()<sizes[s]; ++iter)
+		{
+			poses.insert(*iter);
+			if(uContains(allSignatures, iter->first))
+			{
+				signatures.insert(*allSignatures.find(iter->first));
+			}
+		}
+		std::multimap<int, rtabmap::Link> links;
+		for(std::multimap<int, rtabmap::Link>::iterator iter=allLinks.begin(); iter!=allLinks.end(); ++iter)
+		{
+			if(uContains(poses, iter->second.from()) && uContains(poses, iter->second.to()))
+			{
+				links.insert(*iter);
+			}
+		}
+		int n = (int)poses.size();
+		if(n < sizes[s])
+		{
+			ROS_WARN("Only %d nodes available for size %d", n, sizes[s]);
+		}
+
+		for(int it=0; it<repeat && ros::ok(); ++it)
+		{
+			mapsManager.clear();
+			ros::spinOnce();
+			UTimer timer;
+
+			std::map<int, rtabmap::Transform> filteredPoses = mapsManager.updateMapCaches(poses, 0, true, true, true, signatures);
+			results.add("updateMapCaches", n, it, timer.ticks());
+
+			mapsManager.updateMapCaches(poses, 0, true, true, true, signatures);
+			results.add("updateMapCaches_cached", n, it, timer.ticks());
+
+			mapsManager.publishMaps(filteredPoses, ros::Time::now(), "map");
+			results.add("publishMaps", n, it, timer.ticks());
+
+			float xMin, yMin, cellSize;
+			mapsManager.generateProjMap(filteredPoses, xMin, yMin, cellSize);
+			results.add("generateProjMap", n, it, timer.ticks());
+
+			mapsManager.generateGridMap(filteredPoses, xMin, yMin, cellSize);
+			results.add("generateGridMap", n, it, timer.ticks());
+
+#ifdef WITH_OCTOMAP
+			if(octomap)
+			{
+				octomap::OcTree * octree = mapsManager.createOctomap(filteredPoses);
+				results.add("createOctomap", n, it, timer.ticks());
+				delete octree;
+				timer.ticks();
+			}
+#endif
+
+			std::vector<rtabmap_ros::NodeData> nodes(signatures.size());
+			int i=0;
+			for(std::map<int, rtabmap::Signature>::iterator iter=signatures.begin(); iter!=signatures.end(); ++iter)
+			{
+				rtabmap_ros::nodeDataToROS(iter->second, nodes[i++]);
+			}
+			results.add("nodeDataToROS", n, it, timer.ticks());
+
+			for(unsigned int j=0; j<nodes.size(); ++j)
+			{
+				rtabmap::Signature signature = rtabmap_ros::nodeDataFromROS(nodes[j]);
+			}
+			results.add("nodeDataFromROS", n, it, timer.ticks());
+
+			std::map<int, int> mapIds;
+			std::map<int, double> stamps;
+			std::map<int, std::string> labels;
+			std::map<int, std::vector<unsigned char> > userDatas;
+			for(std::map<int, rtabmap::Transform>::iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+			{
+				mapIds.insert(std::make_pair(iter->first, 0));
+				stamps.insert(std::make_pair(iter->first, 0.0));
+				labels.insert(std::make_pair(iter->first, std::string()));
+				userDatas.insert(std::make_pair(iter->first, std::vector<unsigned char>()));
+			}
+			timer.ticks();
+			rtabmap_ros::Graph graph;
+			rtabmap_ros::mapGraphToROS(poses, mapIds, stamps, labels, userDatas, links, rtabmap::Transform::getIdentity(), graph);
+			results.add("mapGraphToROS", n, it, timer.ticks());
+
+			rtabmap_ros::Graph packedGraph;
+			rtabmap_ros::mapGraphToROS(poses, mapIds, stamps, labels, userDatas, links, rtabmap::Transform::getIdentity(), packedGraph, true, true);
+			results.add("mapGraphToROS_packed", n, it, timer.ticks());
+
+			std::map<int, rtabmap::Transform> posesOut;
+			std::multimap<int, rtabmap::Link> linksOut;
+			rtabmap::Transform mapToOdom;
+			mapIds.clear();
+			stamps.clear();
+			labels.clear();
+			userDatas.clear();
+			timer.ticks();
+			rtabmap_ros::mapGraphFromROS(packedGraph, posesOut, mapIds, stamps, labels, userDatas, linksOut, mapToOdom);
+			results.add("mapGraphFromROS_packed", n, it, timer.ticks());
+			if(it == 0)
+			{
+				ROS_INFO("Graph of %d nodes: %d bytes, %d bytes packed", n,
+						(int)ros::serialization::serializationLength(graph),
+						(int)ros::serialization::serializationLength(packedGraph));
+			}
+		}
+	}
+
+	if(!output.empty())
+	{
+		if(results.save(output))
+		{
+			ROS_INFO("Results saved to \"%s\"", output.c_str());
+		}
+		else
+		{
+			ROS_ERROR("Cannot save results to \"%s\"", output.c_str());
+		}
+	}
+	return 0;
+}
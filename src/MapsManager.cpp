@@ -11,6 +11,7 @@
 #include <rtabmap/utilite/UTimer.h>
 #include <rtabmap/utilite/UStl.h>
 #include <rtabmap/utilite/UConversion.h>
+#include <rtabmap/utilite/UFile.h>
 #include <rtabmap/core/util3d_mapping.h>
 #include <rtabmap/core/util3d_filtering.h>
 #include <rtabmap/core/util3d_transforms.h>
@@ -19,9 +20,17 @@
 #include <rtabmap/core/Graph.h>
 
 #include <nav_msgs/OccupancyGrid.h>
+#include <map_msgs/OccupancyGridUpdate.h>
 #include <ros/ros.h>
 
 #include <pcl_conversions/pcl_conversions.h>
+#include <pcl/common/point_tests.h>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <fstream>
+#include <algorithm>
 
 #ifdef WITH_OCTOMAP
 #include <octomap/octomap.h>
@@ -29,34 +38,52 @@
 
 using namespace rtabmap;
 
-MapsManager::MapsManager() :
+MapsManager::MapsManager(ros::NodeHandle nh, ros::NodeHandle pnh) :
 		cloudDecimation_(4),
 		cloudMaxDepth_(4.0), // meters
 		cloudVoxelSize_(0.05), // meters
 		cloudOutputVoxelized_(false),
+		cloudIncrementalAssembly_(false),
+		cloudCompactStorage_(false),
 		projMaxGroundAngle_(45.0), // degrees
 		projMinClusterSize_(20),
 		projMaxHeight_(2.0), // meters
 		gridCellSize_(0.05), // meters
 		gridSize_(0), // meters
 		gridEroded_(false),
+		gridIncremental_(false),
+		gridTiled_(false),
+		gridTileCells_(256),
+		gridTileLevels_(4),
+		gridTileFullResRadius_(10.0), // meters
+		mapIncrementalLinearUpdate_(0.01), // meters
+		mapIncrementalAngularUpdate_(1.0), // degrees
 		mapFilterRadius_(0.5),
 		mapFilterAngle_(30.0), // degrees
+		mapLocalRadius_(0), // meters
 		mapCacheCleanup_(true),
+		mapCacheThreads_(1),
+		mapCacheBatchSize_(50),
+		mapCacheDisparities_(20),
+		mapCacheMaxSize_(0), // MB
+		octomapIncremental_(false),
+		octomapBackgroundRebuild_(true),
+		mapCachePersistClouds_(false),
 		laserScanMaxRange_(0),
 		laserScanMinAngle_(0),
 		laserScanMaxAngle_(0),
-		laserScanIncrement_(0)
+		laserScanIncrement_(0),
+		octree_(0),
+		octomapRebuildThread_(0),
+		rebuiltOctree_(0)
 {
-
-	ros::NodeHandle nh;
-	ros::NodeHandle pnh("~");
-
 	// cloud map stuff
 	pnh.param("cloud_decimation", cloudDecimation_, cloudDecimation_);
 	pnh.param("cloud_max_depth", cloudMaxDepth_, cloudMaxDepth_);
 	pnh.param("cloud_voxel_size", cloudVoxelSize_, cloudVoxelSize_);
 	pnh.param("cloud_output_voxelized", cloudOutputVoxelized_, cloudOutputVoxelized_);
+	pnh.param("cloud_incremental_assembly", cloudIncrementalAssembly_, cloudIncrementalAssembly_);
+	pnh.param("cloud_compact_storage", cloudCompactStorage_, cloudCompactStorage_);
 
 	//projection map stuff
 	pnh.param("proj_max_ground_angle", projMaxGroundAngle_, projMaxGroundAngle_);
@@ -67,16 +94,104 @@ MapsManager::MapsManager() :
 	pnh.param("grid_cell_size", gridCellSize_, gridCellSize_); // m
 	pnh.param("grid_size", gridSize_, gridSize_); // m
 	pnh.param("grid_eroded", gridEroded_, gridEroded_);
+	pnh.param("grid_incremental", gridIncremental_, gridIncremental_);
+	pnh.param("grid_tiled", gridTiled_, gridTiled_);
+	pnh.param("grid_tile_cells", gridTileCells_, gridTileCells_); // cells per side at grid_cell_size
+	pnh.param("grid_tile_levels", gridTileLevels_, gridTileLevels_);
+	pnh.param("grid_tile_full_res_radius", gridTileFullResRadius_, gridTileFullResRadius_); // m
 
 	// common map stuff
 	pnh.param("map_filter_radius", mapFilterRadius_, mapFilterRadius_);
 	pnh.param("map_filter_angle", mapFilterAngle_, mapFilterAngle_);
+	pnh.param("map_local_radius", mapLocalRadius_, mapLocalRadius_); // m, 0=whole map
 	pnh.param("map_mapsManager_cleanup", mapCacheCleanup_, mapCacheCleanup_);
+	pnh.param("map_cache_threads", mapCacheThreads_, mapCacheThreads_);
+	pnh.param("map_cache_batch_size", mapCacheBatchSize_, mapCacheBatchSize_);
+	pnh.param("map_cache_disparities", mapCacheDisparities_, mapCacheDisparities_); // stereo nodes, 0=disabled
+	pnh.param("map_cache_max_size", mapCacheMaxSize_, mapCacheMaxSize_); // MB, 0=unlimited
+	pnh.param("map_cache_path", mapCachePath_, mapCachePath_); // empty=not persisted
+	pnh.param("map_cache_persist_clouds", mapCachePersistClouds_, mapCachePersistClouds_);
+	if(!mapCachePath_.empty())
+	{
+		ROS_INFO("rtabmap: map_cache_path = \"%s\" (clouds persisted=%s)", mapCachePath_.c_str(), mapCachePersistClouds_?"true":"false");
+		// the loaded caches would be cleared as soon as a map has no subscriber
+		mapCacheCleanup_ = false;
+	}
+	if(mapCacheMaxSize_ > 0)
+	{
+		ROS_INFO("rtabmap: map_cache_max_size = %f MB", mapCacheMaxSize_);
+	}
+	// used by incremental cloud assembly, incremental grids and incremental octomap
+	// (cloud_incremental_*_update are the old names, still read)
+	if(pnh.hasParam("cloud_incremental_linear_update") || pnh.hasParam("cloud_incremental_angular_update"))
+	{
+		ROS_WARN("rtabmap: Parameters \"cloud_incremental_linear_update\" and \"cloud_incremental_angular_update\" "
+				"are deprecated, use \"map_incremental_linear_update\" and \"map_incremental_angular_update\" instead.");
+		pnh.param("cloud_incremental_linear_update", mapIncrementalLinearUpdate_, mapIncrementalLinearUpdate_);
+		pnh.param("cloud_incremental_angular_update", mapIncrementalAngularUpdate_, mapIncrementalAngularUpdate_);
+	}
+	pnh.param("map_incremental_linear_update", mapIncrementalLinearUpdate_, mapIncrementalLinearUpdate_);
+	pnh.param("map_incremental_angular_update", mapIncrementalAngularUpdate_, mapIncrementalAngularUpdate_);
+
+	// octomap stuff
+	pnh.param("octomap_incremental", octomapIncremental_, octomapIncremental_);
+	pnh.param("octomap_background_rebuild", octomapBackgroundRebuild_, octomapBackgroundRebuild_);
+	octomapPoses_.setTolerances(mapIncrementalLinearUpdate_, mapIncrementalAngularUpdate_*M_PI/180.0);
+#ifdef WITH_OCTOMAP
+	if(octomapIncremental_)
+	{
+		ROS_INFO("rtabmap: octomap_incremental = true (background rebuild=%s)", octomapBackgroundRebuild_?"true":"false");
+	}
+#endif
+	if(mapLocalRadius_ > 0.0)
+	{
+		ROS_INFO("rtabmap: map_local_radius = %f m, only the nodes around the latest node are assembled", mapLocalRadius_);
+	}
+	poseIndex_.setCellSize(mapFilterRadius_>0.0?mapFilterRadius_:1.0);
+	if(mapCacheThreads_ > 1)
+	{
+		ROS_INFO("rtabmap: map_cache_threads = %d (batch size=%d)", mapCacheThreads_, mapCacheBatchSize_);
+	}
 
 	// mapping topics
 	cloudMapPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud_map", 1);
-	projMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("proj_map", 1);
-	gridMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("grid_map", 1);
+	if(gridIncremental_)
+	{
+		// only the updates are published after the full map, new
+		// subscribers receive it on connection
+		projMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("proj_map", 1,
+				boost::bind(&MapsManager::incrementalMapConnectCallback, this, _1, &incrementalProjMap_));
+		gridMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("grid_map", 1,
+				boost::bind(&MapsManager::incrementalMapConnectCallback, this, _1, &incrementalGridMap_));
+		incrementalProjMap_.grid.setParameters(gridCellSize_, gridSize_, gridEroded_);
+		incrementalGridMap_.grid.setParameters(gridCellSize_, gridSize_, gridEroded_);
+		projMapUpdatesPub_ = nh.advertise<map_msgs::OccupancyGridUpdate>("proj_map_updates", 1);
+		gridMapUpdatesPub_ = nh.advertise<map_msgs::OccupancyGridUpdate>("grid_map_updates", 1);
+		ROS_INFO("rtabmap: grid_incremental = true, only modified cells are published on map updates topics");
+	}
+	else
+	{
+		projMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("proj_map", 1);
+		gridMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("grid_map", 1);
+	}
+	if(gridTiled_)
+	{
+		if(gridTileLevels_ < 1 || gridTileLevels_ > 16)
+		{
+			ROS_WARN("rtabmap: grid_tile_levels (%d) should be between 1 and 16, setting it to 4.", gridTileLevels_);
+			gridTileLevels_ = 4;
+		}
+		tiledProjMap_.grid.setParameters(gridCellSize_, gridTileCells_, gridTileLevels_, gridTileFullResRadius_);
+		tiledGridMap_.grid.setParameters(gridCellSize_, gridTileCells_, gridTileLevels_, gridTileFullResRadius_);
+		// only the modified tiles are published after all of them, new
+		// subscribers receive all the tiles on connection
+		projTilesPub_ = nh.advertise<rtabmap_ros::MapTiles>("proj_map_tiles", 1,
+				boost::bind(&MapsManager::tiledMapConnectCallback, this, _1, &tiledProjMap_));
+		gridTilesPub_ = nh.advertise<rtabmap_ros::MapTiles>("grid_map_tiles", 1,
+				boost::bind(&MapsManager::tiledMapConnectCallback, this, _1, &tiledGridMap_));
+		ROS_INFO("rtabmap: grid_tiled = true, tiles of %d cells (%d levels, full resolution up to %f m) "
+				"are published on map tiles topics", tiledGridMap_.grid.tileCells(), gridTileLevels_, gridTileFullResRadius_);
+	}
 }
 
 MapsManager::~MapsManager() {
@@ -86,8 +201,28 @@ MapsManager::~MapsManager() {
 void MapsManager::clear()
 {
 	clouds_.clear();
+	compactClouds_.clear();
+	assembledClouds_.clear();
+	assembledPoses_.clear();
+	assembledVoxels_.clear();
 	projMaps_.clear();
 	gridMaps_.clear();
+	disparities_.clear();
+	disparitiesOrder_.clear();
+	incrementalProjMap_.clear();
+	incrementalGridMap_.clear();
+	tiledProjMap_.clear();
+	tiledGridMap_.clear();
+#ifdef WITH_OCTOMAP
+	clearOctomap();
+#endif
+	cacheLru_.clear();
+	cacheEntries_.clear();
+	poseIndex_.clear();
+	{
+		boost::mutex::scoped_lock lock(cacheStatsMutex_);
+		cacheStats_ = CacheStatistics();
+	}
 	laserScanMaxRange_ = 0;
 	laserScanMinAngle_ = 0;
 	laserScanMaxAngle_ = 0;
@@ -108,38 +243,89 @@ void MapsManager::setLaserScanParameters(
 
 std::map<int, Transform> MapsManager::getFilteredPoses(const std::map<int, Transform> & poses)
 {
-	if(mapFilterRadius_ > 0.0)
+	if(mapFilterRadius_ > 0.0 || mapLocalRadius_ > 0.0)
 	{
 		// filter nodes
-		double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-		return rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
+		return filterPoses(poses);
 	}
 	return std::map<int, Transform>();
 }
 
-std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
-		const std::map<int, rtabmap::Transform> & poses,
-		const rtabmap::Memory * memory,
-		bool updateCloud,
-		bool updateProj,
-		bool updateGrid,
-		const std::map<int, rtabmap::Signature> & signatures)
+void MapsManager::resolveUpdateFlags(bool & updateCloud, bool & updateProj, bool & updateGrid) const
 {
 	if(!updateCloud && !updateProj && !updateGrid)
 	{
 		//  all false, udpate only those where we have subscribers
 		updateCloud = cloudMapPub_.getNumSubscribers() != 0;
-		updateProj = projMapPub_.getNumSubscribers() != 0;
-		updateGrid = gridMapPub_.getNumSubscribers() != 0;
+		updateProj = projMapPub_.getNumSubscribers() != 0 || projTilesPub_.getNumSubscribers() != 0;
+		updateGrid = gridMapPub_.getNumSubscribers() != 0 || gridTilesPub_.getNumSubscribers() != 0;
 	}
+}
 
-	UDEBUG("Updating map caches...");
+// The radius searches are done in the pose index, so only the nodes around
+// each query are compared instead of all the other nodes of the map.
+std::map<int, rtabmap::Transform> MapsManager::filterPoses(const std::map<int, rtabmap::Transform> & poses)
+{
+	if(mapFilterRadius_ > 0.0 || mapLocalRadius_ > 0.0)
+	{
+		poseIndex_.update(poses);
+		if(poseIndex_.size() == 0)
+		{
+			return std::map<int, rtabmap::Transform>();
+		}
+
+		std::vector<int> localIds;
+		if(mapLocalRadius_ > 0.0)
+		{
+			// only the nodes around the latest node
+			const rtabmap::Transform & latest = poseIndex_.poses().rbegin()->second;
+			localIds = poseIndex_.radiusSearch(latest.x(), latest.y(), latest.z(), mapLocalRadius_);
+		}
+		// angle=0 means any orientation
+		return poseIndex_.radiusFiltering(
+				mapFilterRadius_,
+				mapFilterAngle_*CV_PI/180.0,
+				mapLocalRadius_ > 0.0?&localIds:0);
+	}
+	return poses;
+}
 
-	if(!memory && signatures.size() == 0)
+std::set<int> MapsManager::getUncachedNodes(
+		const std::map<int, rtabmap::Transform> & poses,
+		bool updateCloud,
+		bool updateProj,
+		bool updateGrid)
+{
+	std::set<int> ids;
+	resolveUpdateFlags(updateCloud, updateProj, updateGrid);
+	if(updateCloud || updateProj || updateGrid)
 	{
-		ROS_FATAL("Memory should not be null!?");
-		return std::map<int, rtabmap::Transform>();
+		std::map<int, rtabmap::Transform> filteredPoses = filterPoses(poses);
+		for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
+		{
+			if(!iter->second.isNull() &&
+				((updateCloud && !hasCloud(iter->first)) ||
+				 (updateProj && !uContains(projMaps_, iter->first)) ||
+				 (updateGrid && !uContains(gridMaps_, iter->first))))
+			{
+				ids.insert(iter->first);
+			}
+		}
 	}
+	return ids;
+}
+
+std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
+		const std::map<int, rtabmap::Transform> & poses,
+		const rtabmap::Memory * memory,
+		bool updateCloud,
+		bool updateProj,
+		bool updateGrid,
+		const std::map<int, rtabmap::Signature> & signatures)
+{
+	resolveUpdateFlags(updateCloud, updateProj, updateGrid);
+
+	UDEBUG("Updating map caches...");
 
 	std::map<int, rtabmap::Transform> filteredPoses;
 
@@ -147,211 +333,127 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 	if(updateCloud || updateProj || updateGrid)
 	{
 		// filter nodes
-		if(mapFilterRadius_ > 0.0)
-		{
-			double angle = mapFilterAngle_ == 0.0?CV_PI+0.1:mapFilterAngle_*CV_PI/180.0;
-			filteredPoses = rtabmap::graph::radiusPosesFiltering(poses, mapFilterRadius_, angle);
-		}
-		else
-		{
-			filteredPoses = poses;
-		}
-
+		filteredPoses = filterPoses(poses);
 
+		// find which nodes should be added to the caches
+		std::vector<LocalMapsRequest> requests;
+		int hits = 0;
 		for(std::map<int, rtabmap::Transform>::iterator iter=filteredPoses.begin(); iter!=filteredPoses.end(); ++iter)
 		{
 			if(!iter->second.isNull())
 			{
-				rtabmap::Signature data;
-				bool rgbDepthRequired = updateCloud && !uContains(clouds_, iter->first);
-				bool depthRequired = updateProj && !uContains(projMaps_, iter->first);
-				bool scanRequired = updateGrid && !uContains(gridMaps_, iter->first);
-				if(rgbDepthRequired ||
-					depthRequired ||
-					scanRequired)
+				LocalMapsRequest request;
+				request.id = iter->first;
+				request.rgbDepthRequired = updateCloud && !hasCloud(iter->first);
+				request.depthRequired = updateProj && !uContains(projMaps_, iter->first);
+				request.scanRequired = updateGrid && !uContains(gridMaps_, iter->first);
+				if(request.rgbDepthRequired ||
+					request.depthRequired ||
+					request.scanRequired)
+				{
+					requests.push_back(request);
+				}
+				else
+				{
+					++hits;
+				}
+			}
+			else
+			{
+				ROS_ERROR("Pose null for node %d", iter->first);
+			}
+		}
+
+		if(requests.size())
+		{
+			UTimer time;
+			int batchSize = mapCacheBatchSize_ > 0?mapCacheBatchSize_:(int)requests.size();
+			for(unsigned int first=0; first<requests.size(); first+=batchSize)
+			{
+				unsigned int last = first+batchSize < requests.size()?first+batchSize:requests.size();
+
+				// Get the data on this thread, memory is not thread-safe. The
+				// signatures are only read by the workers, they are not copied.
+				for(unsigned int i=first; i<last; ++i)
 				{
-					if(signatures.size())
+					LocalMapsRequest & request = requests[i];
+					std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(request.id);
+					if(findIter != signatures.end())
+					{
+						request.data = &findIter->second;
+					}
+					else if(memory)
 					{
-						std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(iter->first);
-						if(findIter != signatures.end())
+						const rtabmap::Signature * s = memory->getSignature(request.id);
+						if(s && (!s->getImageCompressed().empty() || !s->getDepthCompressed().empty() || !s->getLaserScanCompressed().empty()))
 						{
-							data = findIter->second;
+							request.data = s;
+						}
+						else
+						{
+							// not in memory or without its data
+							request.loaded = memory->getSignatureDataConst(request.id);
+							request.data = &request.loaded;
 						}
 					}
-					else
+					std::map<int, cv::Mat>::iterator jter = disparities_.find(request.id);
+					if(jter != disparities_.end())
 					{
-						data = memory->getSignatureDataConst(iter->first);
+						request.disparity = jter->second;
 					}
 				}
 
-				if(data.id() > 0)
+				if(mapCacheThreads_ > 1 && last-first > 1)
 				{
-					rtabmap::Transform localTransform = data.getLocalTransform();
-					if(!localTransform.isNull())
+					// each thread processes its own slice of the batch
+					boost::thread_group workers;
+					int threads = mapCacheThreads_ < int(last-first)?mapCacheThreads_:int(last-first);
+					for(int t=0; t<threads; ++t)
 					{
-						// Which data should we decompress?
-						cv::Mat image, depth, scan;
-						data.uncompressDataConst(rgbDepthRequired?&image:0, rgbDepthRequired||depthRequired?&depth:0, scanRequired?&scan:0);
-						if(!depth.empty() &&
-							depth.type() == CV_8UC1 &&
-							image.empty() &&
-							!rgbDepthRequired)
-						{
-							// Stereo detected, we should uncompress left image too
-							data.uncompressDataConst(&image, 0, 0);
-						}
-						float fx = data.getFx();
-						float fy = data.getFy();
-						float cx = data.getCx();
-						float cy = data.getCy();
-
-						pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudRGB;
-						pcl::PointCloud<pcl::PointXYZ>::Ptr cloudXYZ;
-						if(rgbDepthRequired)
-						{
-							if(!image.empty() &&
-								!depth.empty() &&
-								fx > 0.0f && fy > 0.0f &&
-								cx >= 0.0f && cy >= 0.0f)
-							{
-								if(depth.type() == CV_8UC1)
-								{
-									cloudRGB = util3d::cloudFromStereoImages(image, depth, cx, cy, fx, fy, cloudDecimation_);
-								}
-								else
-								{
-									cloudRGB = util3d::cloudFromDepthRGB(image, depth, cx, cy, fx, fy, cloudDecimation_);
-								}
-
-								if(cloudRGB->size() && cloudMaxDepth_ > 0)
-								{
-									cloudRGB = util3d::passThrough(cloudRGB, "z", 0, cloudMaxDepth_);
-								}
-								if(cloudRGB->size() && cloudVoxelSize_ > 0)
-								{
-									cloudRGB = util3d::voxelize(cloudRGB, cloudVoxelSize_);
-								}
-								if(cloudRGB->size())
-								{
-									cloudRGB = util3d::transformPointCloud(cloudRGB, localTransform);
-								}
-							}
-							else
-							{
-								ROS_ERROR("RGB or Depth image not found (node=%d)!", iter->first);
-							}
-						}
-						else if(depthRequired)
-						{
-							if(	!depth.empty() &&
-								fx > 0.0f && fy > 0.0f &&
-								cx >= 0.0f && cy >= 0.0f)
-							{
-								if(depth.type() == CV_8UC1)
-								{
-									if(!image.empty())
-									{
-										cv::Mat leftMono;
-										if(image.channels() == 3)
-										{
-											cv::cvtColor(image, leftMono, CV_BGR2GRAY);
-										}
-										else
-										{
-											leftMono = image;
-										}
-										cloudXYZ = rtabmap::util3d::cloudFromDisparity(
-												util2d::disparityFromStereoImages(leftMono, depth),
-												cx, cy,
-												fx, fy,
-												cloudDecimation_);
-									}
-								}
-								else
-								{
-									cloudXYZ = util3d::cloudFromDepth(depth, cx, cy, fx, fy, cloudDecimation_);
-								}
-
-								if(cloudXYZ.get())
-								{
-									if(cloudXYZ->size() && cloudMaxDepth_ > 0)
-									{
-										cloudXYZ = util3d::passThrough(cloudXYZ, "z", 0, cloudMaxDepth_);
-									}
-									if(cloudXYZ->size() && gridCellSize_ > 0)
-									{
-										// use gridCellSize since this cloud is only for the projection map
-										cloudXYZ = util3d::voxelize(cloudXYZ, gridCellSize_);
-									}
-									if(cloudXYZ->size())
-									{
-										cloudXYZ = util3d::transformPointCloud(cloudXYZ, localTransform);
-									}
-								}
-								else
-								{
-									ROS_ERROR("Left stereo image was empty! (node=%d)", iter->first);
-								}
-							}
-							else
-							{
-								ROS_ERROR("RGB or Depth image not found (node=%d)!", iter->first);
-							}
-						}
-
-						if(cloudRGB.get())
-						{
-							clouds_.insert(std::make_pair(iter->first, cloudRGB));
-						}
+						workers.create_thread(boost::bind(&MapsManager::createLocalMapsWorker, this, &requests, first+t, last, threads));
+					}
+					workers.join_all();
+				}
+				else
+				{
+					createLocalMapsWorker(&requests, first, last, 1);
+				}
 
-						if(depthRequired)
+				// merge results in node ID order, so the output doesn't depend on the threads scheduling
+				for(unsigned int i=first; i<last; ++i)
+				{
+					LocalMapsRequest & request = requests[i];
+					if(request.cloud.get())
+					{
+						if(cloudCompactStorage_)
 						{
-							cv::Mat ground, obstacles;
-							if(cloudRGB.get())
-							{
-								pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudClipped = cloudRGB;
-								if(cloudClipped->size() && projMaxHeight_ > 0)
-								{
-									cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
-								}
-								if(cloudClipped->size())
-								{
-									cloudClipped = util3d::voxelize(cloudClipped, gridCellSize_);
-									util3d::occupancy2DFromCloud3D<pcl::PointXYZRGB>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
-								}
-							}
-							else if(cloudXYZ.get())
-							{
-								pcl::PointCloud<pcl::PointXYZ>::Ptr cloudClipped = cloudXYZ;
-								if(cloudClipped->size() && projMaxHeight_ > 0)
-								{
-									cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
-								}
-								if(cloudClipped->size())
-								{
-									util3d::occupancy2DFromCloud3D<pcl::PointXYZ>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
-								}
-							}
-							projMaps_.insert(std::make_pair(iter->first, std::make_pair(ground, obstacles)));
+							compactClouds_.insert(std::make_pair(request.id, rtabmap_ros::CompactCloud(*request.cloud)));
 						}
-
-						if(scanRequired)
+						else
 						{
-							cv::Mat ground, obstacles;
-							util3d::occupancy2DFromLaserScan(scan, ground, obstacles, gridCellSize_);
-							gridMaps_.insert(std::make_pair(iter->first, std::make_pair(ground, obstacles)));
+							clouds_.insert(std::make_pair(request.id, request.cloud));
 						}
 					}
-					else
+					if(request.projCreated)
+					{
+						projMaps_.insert(std::make_pair(request.id, request.projMap));
+					}
+					if(request.gridCreated)
 					{
-						ROS_ERROR("Local transform detected for node %d", iter->first);
+						gridMaps_.insert(std::make_pair(request.id, request.gridMap));
 					}
+					if(request.disparityCreated)
+					{
+						cacheDisparity(request.id, request.disparity);
+					}
+					else if(!request.disparity.empty() && hasCloud(request.id) && uContains(projMaps_, request.id))
+					{
+						removeDisparity(request.id);
+					}
+					request = LocalMapsRequest(); // free memory
 				}
 			}
-			else
-			{
-				ROS_ERROR("Pose null for node %d", iter->first);
-			}
+			UDEBUG("Created local maps of %d nodes (threads=%d, %fs)", (int)requests.size(), mapCacheThreads_, time.ticks());
 		}
 
 		// cleanup not used nodes
@@ -367,6 +469,18 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 				++iter;
 			}
 		}
+		for(std::map<int, rtabmap_ros::CompactCloud>::iterator iter=compactClouds_.begin();
+			iter!=compactClouds_.end();)
+		{
+			if(!uContains(poses, iter->first))
+			{
+				compactClouds_.erase(iter++);
+			}
+			else
+			{
+				++iter;
+			}
+		}
 		for(std::map<int, std::pair<cv::Mat, cv::Mat> >::iterator iter=projMaps_.begin();
 			iter!=projMaps_.end();)
 		{
@@ -391,161 +505,1213 @@ std::map<int, rtabmap::Transform> MapsManager::updateMapCaches(
 				++iter;
 			}
 		}
+		for(std::list<int>::iterator iter=disparitiesOrder_.begin(); iter!=disparitiesOrder_.end();)
+		{
+			if(!uContains(poses, *iter))
+			{
+				disparities_.erase(*iter);
+				iter = disparitiesOrder_.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+
+		updateCacheUsage(filteredPoses, hits, (int)requests.size());
 	}
 
 	return filteredPoses;
 }
 
-void MapsManager::publishMaps(
-		const std::map<int, rtabmap::Transform> & poses,
-		const ros::Time & stamp,
-		const std::string & mapFrameId)
+bool MapsManager::hasCloud(int id) const
 {
-	UDEBUG("Publishing maps...");
+	return clouds_.find(id) != clouds_.end() || compactClouds_.find(id) != compactClouds_.end();
+}
 
-	// publish maps
-	if(cloudMapPub_.getNumSubscribers())
+// Returns the cloud of the node transformed by "transform" (if not null), null if not cached
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr MapsManager::getCloud(int id, const rtabmap::Transform & transform) const
+{
+	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::const_iterator iter = clouds_.find(id);
+	if(iter != clouds_.end())
 	{
-		// generate the assembled cloud!
-		UTimer time;
-		pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud(new pcl::PointCloud<pcl::PointXYZRGB>);
-		int count = 0;
-		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
-		{
-			std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator jter = clouds_.find(iter->first);
-			if(jter != clouds_.end())
-			{
-				pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(jter->second, iter->second);
-				*assembledCloud+=*transformed;
-				++count;
-			}
-		}
-
-		if(assembledCloud->size())
-		{
-			if(cloudVoxelSize_ > 0 && cloudOutputVoxelized_)
-			{
-				assembledCloud = util3d::voxelize(assembledCloud, cloudVoxelSize_);
-			}
-			ROS_INFO("Assembled %d clouds (%fs)", count, time.ticks());
-
-			sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
-			pcl::toROSMsg(*assembledCloud, *cloudMsg);
-			cloudMsg->header.stamp = stamp;
-			cloudMsg->header.frame_id = mapFrameId;
-			cloudMapPub_.publish(cloudMsg);
-		}
-		else if(poses.size())
-		{
-			ROS_WARN("Cloud map is empty! (clouds=%d)", (int)clouds_.size());
-		}
+		return transform.isNull()?iter->second:util3d::transformPointCloud(iter->second, transform);
 	}
-	else if(mapCacheCleanup_)
+	std::map<int, rtabmap_ros::CompactCloud>::const_iterator jter = compactClouds_.find(id);
+	if(jter != compactClouds_.end())
 	{
-		clouds_.clear();
+		return jter->second.uncompress(transform);
 	}
+	return pcl::PointCloud<pcl::PointXYZRGB>::Ptr();
+}
 
-	if(projMapPub_.getNumSubscribers())
-	{
-		// create the projection map
-		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-		cv::Mat pixels = this->generateProjMap(poses, xMin, yMin, gridCellSize);
+MapsManager::CacheStatistics MapsManager::getCacheStatistics() const
+{
+	boost::mutex::scoped_lock lock(cacheStatsMutex_);
+	return cacheStats_;
+}
 
-		if(!pixels.empty())
-		{
-			//init
-			nav_msgs::OccupancyGrid map;
-			map.info.resolution = gridCellSize;
-			map.info.origin.position.x = 0.0;
-			map.info.origin.position.y = 0.0;
-			map.info.origin.position.z = 0.0;
-			map.info.origin.orientation.x = 0.0;
-			map.info.origin.orientation.y = 0.0;
-			map.info.origin.orientation.z = 0.0;
-			map.info.origin.orientation.w = 1.0;
+namespace {
 
-			map.info.width = pixels.cols;
-			map.info.height = pixels.rows;
-			map.info.origin.position.x = xMin;
-			map.info.origin.position.y = yMin;
-			map.data.resize(map.info.width * map.info.height);
+const boost::uint32_t kMapCacheMagic = 0x434d5452; // "RTMC"
+const boost::uint32_t kMapCacheVersion = 2; // increase when the file format changes
+const boost::int64_t kMapCacheMaxMatElements = 1<<24; // local maps are points or cells of a node
+
+void writeMat(std::ostream & stream, const cv::Mat & mat)
+{
+	cv::Mat m = mat.isContinuous()?mat:mat.clone();
+	boost::int32_t header[3] = {m.rows, m.cols, m.type()};
+	stream.write((const char*)header, sizeof(header));
+	if(!m.empty())
+	{
+		stream.write((const char*)m.data, m.total()*m.elemSize());
+	}
+}
 
-			memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
+bool readMat(std::istream & stream, cv::Mat & mat)
+{
+	boost::int32_t header[3] = {0, 0, 0};
+	stream.read((char*)header, sizeof(header));
+	if(!stream ||
+	   header[0] < 0 || header[1] < 0 ||
+	   boost::int64_t(header[0])*boost::int64_t(header[1]) > kMapCacheMaxMatElements ||
+	   (header[0] > 0 && header[1] > 0 && header[2] != CV_32FC2 && header[2] != CV_8SC1))
+	{
+		// corrupted: local maps are CV_32FC2 points or CV_8SC1 cells
+		return false;
+	}
+	mat = cv::Mat();
+	if(header[0] > 0 && header[1] > 0)
+	{
+		mat.create(header[0], header[1], header[2]);
+		stream.read((char*)mat.data, mat.total()*mat.elemSize());
+	}
+	return (bool)stream;
+}
 
-			map.header.frame_id = mapFrameId;
-			map.header.stamp = stamp;
+bool readLocalMap(std::istream & stream, std::pair<cv::Mat, cv::Mat> & localMap)
+{
+	return readMat(stream, localMap.first) && readMat(stream, localMap.second);
+}
 
-			projMapPub_.publish(map);
+// The database the caches were created from: path, last node ID and number of nodes
+struct MapCacheIdentity
+{
+	MapCacheIdentity() : lastId(0), nodes(0) {}
+	MapCacheIdentity(const rtabmap::Memory * memory, const std::string & databasePath) :
+		path(databasePath),
+		lastId(memory?memory->getLastSignatureId():0),
+		nodes(memory?(boost::uint32_t)memory->getAllSignatureIds().size():0)
+	{}
+	bool operator==(const MapCacheIdentity & other) const
+	{
+		return path.compare(other.path) == 0 && lastId == other.lastId && nodes == other.nodes;
+	}
+	void write(std::ostream & stream) const
+	{
+		boost::uint32_t length = (boost::uint32_t)path.size();
+		stream.write((const char*)&length, sizeof(length));
+		stream.write(path.data(), length);
+		stream.write((const char*)&lastId, sizeof(lastId));
+		stream.write((const char*)&nodes, sizeof(nodes));
+	}
+	bool read(std::istream & stream)
+	{
+		boost::uint32_t length = 0;
+		stream.read((char*)&length, sizeof(length));
+		if(!stream || length > 4096)
+		{
+			return false;
 		}
-		else if(poses.size())
+		path.resize(length);
+		if(length)
 		{
-			ROS_WARN("Projection map is empty! (proj maps=%d)", (int)projMaps_.size());
+			stream.read(&path[0], length);
 		}
+		stream.read((char*)&lastId, sizeof(lastId));
+		stream.read((char*)&nodes, sizeof(nodes));
+		return (bool)stream;
 	}
-	else if(mapCacheCleanup_)
+	std::string path;
+	boost::int32_t lastId;
+	boost::uint32_t nodes;
+};
+
+// The parameters used to create the local maps, a cache created
+// with other parameters is ignored
+std::vector<double> mapCacheParameters(
+		int cloudDecimation,
+		double cloudMaxDepth,
+		double cloudVoxelSize,
+		double projMaxGroundAngle,
+		int projMinClusterSize,
+		double projMaxHeight,
+		double gridCellSize)
+{
+	std::vector<double> parameters(7);
+	parameters[0] = cloudDecimation;
+	parameters[1] = cloudMaxDepth;
+	parameters[2] = cloudVoxelSize;
+	parameters[3] = projMaxGroundAngle;
+	parameters[4] = projMinClusterSize;
+	parameters[5] = projMaxHeight;
+	parameters[6] = gridCellSize;
+	return parameters;
+}
+
+}
+
+// File: magic, version, database identity, parameters, then for each node: id,
+// flags (1=proj, 2=grid, 4=cloud) and the data. The clouds are saved in compact form.
+bool MapsManager::saveMapCaches(const rtabmap::Memory * memory, const std::string & databasePath) const
+{
+	if(mapCachePath_.empty())
 	{
-		projMaps_.clear();
+		return false;
 	}
 
-	if(gridMapPub_.getNumSubscribers())
+	UTimer timer;
+	std::set<int> ids;
+	for(std::map<int, std::pair<cv::Mat, cv::Mat> >::const_iterator iter=projMaps_.begin(); iter!=projMaps_.end(); ++iter)
 	{
-		// create the grid map
-		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
-		cv::Mat pixels = this->generateGridMap(poses, xMin, yMin, gridCellSize);
-
-		if(!pixels.empty())
+		ids.insert(iter->first);
+	}
+	for(std::map<int, std::pair<cv::Mat, cv::Mat> >::const_iterator iter=gridMaps_.begin(); iter!=gridMaps_.end(); ++iter)
+	{
+		ids.insert(iter->first);
+	}
+	if(mapCachePersistClouds_)
+	{
+		for(std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::const_iterator iter=clouds_.begin(); iter!=clouds_.end(); ++iter)
 		{
-			//init
-			nav_msgs::OccupancyGrid map;
-			map.info.resolution = gridCellSize;
-			map.info.origin.position.x = 0.0;
-			map.info.origin.position.y = 0.0;
-			map.info.origin.position.z = 0.0;
-			map.info.origin.orientation.x = 0.0;
-			map.info.origin.orientation.y = 0.0;
-			map.info.origin.orientation.z = 0.0;
-			map.info.origin.orientation.w = 1.0;
-
-			map.info.width = pixels.cols;
-			map.info.height = pixels.rows;
-			map.info.origin.position.x = xMin;
-			map.info.origin.position.y = yMin;
-			map.data.resize(map.info.width * map.info.height);
+			ids.insert(iter->first);
+		}
+		for(std::map<int, rtabmap_ros::CompactCloud>::const_iterator iter=compactClouds_.begin(); iter!=compactClouds_.end(); ++iter)
+		{
+			ids.insert(iter->first);
+		}
+	}
 
-			memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
+	// written in a temporary file first, so a crash doesn't leave a truncated cache
+	std::string tmpPath = mapCachePath_ + ".tmp";
+	std::ofstream stream(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if(!stream.is_open())
+	{
+		ROS_ERROR("rtabmap: Cannot open \"%s\" to save the map caches!", tmpPath.c_str());
+		return false;
+	}
 
-			map.header.frame_id = mapFrameId;
-			map.header.stamp = stamp;
+	std::vector<double> parameters = mapCacheParameters(cloudDecimation_, cloudMaxDepth_, cloudVoxelSize_,
+			projMaxGroundAngle_, projMinClusterSize_, projMaxHeight_, gridCellSize_);
+	boost::uint32_t header[3] = {kMapCacheMagic, kMapCacheVersion, (boost::uint32_t)ids.size()};
+	stream.write((const char*)header, 2*sizeof(boost::uint32_t));
+	MapCacheIdentity(memory, databasePath).write(stream);
+	stream.write((const char*)parameters.data(), parameters.size()*sizeof(double));
+	stream.write((const char*)&header[2], sizeof(boost::uint32_t));
 
-			gridMapPub_.publish(map);
+	for(std::set<int>::iterator iter=ids.begin(); iter!=ids.end(); ++iter)
+	{
+		std::map<int, std::pair<cv::Mat, cv::Mat> >::const_iterator projIter = projMaps_.find(*iter);
+		std::map<int, std::pair<cv::Mat, cv::Mat> >::const_iterator gridIter = gridMaps_.find(*iter);
+		std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::const_iterator cloudIter = clouds_.find(*iter);
+		std::map<int, rtabmap_ros::CompactCloud>::const_iterator compactIter = compactClouds_.find(*iter);
+		bool hasCloud = mapCachePersistClouds_ &&
+				((cloudIter != clouds_.end() && cloudIter->second.get()) || compactIter != compactClouds_.end());
+
+		boost::int32_t id = *iter;
+		boost::uint8_t flags = (projIter != projMaps_.end()?1:0) | (gridIter != gridMaps_.end()?2:0) | (hasCloud?4:0);
+		stream.write((const char*)&id, sizeof(id));
+		stream.write((const char*)&flags, sizeof(flags));
+		if(projIter != projMaps_.end())
+		{
+			writeMat(stream, projIter->second.first);
+			writeMat(stream, projIter->second.second);
 		}
-		else if(poses.size())
+		if(gridIter != gridMaps_.end())
 		{
-			ROS_WARN("Grid map is empty! (local maps=%d)", (int)gridMaps_.size());
+			writeMat(stream, gridIter->second.first);
+			writeMat(stream, gridIter->second.second);
+		}
+		if(hasCloud)
+		{
+			if(compactIter != compactClouds_.end())
+			{
+				compactIter->second.write(stream);
+			}
+			else
+			{
+				rtabmap_ros::CompactCloud(*cloudIter->second).write(stream);
+			}
 		}
 	}
-	else if(mapCacheCleanup_)
+	stream.close();
+	if(stream.fail())
+	{
+		ROS_ERROR("rtabmap: Failed to write the map caches in \"%s\"!", tmpPath.c_str());
+		UFile::erase(tmpPath);
+		return false;
+	}
+	UFile::erase(mapCachePath_);
+	if(UFile::rename(tmpPath, mapCachePath_) != 0)
 	{
-		gridMaps_.clear();
+		ROS_ERROR("rtabmap: Cannot rename \"%s\" to \"%s\"!", tmpPath.c_str(), mapCachePath_.c_str());
+		return false;
 	}
+	ROS_INFO("rtabmap: Saved the map caches of %d nodes in \"%s\" (%fs)", (int)ids.size(), mapCachePath_.c_str(), timer.ticks());
+	return true;
 }
 
-cv::Mat MapsManager::generateProjMap(
-		const std::map<int, rtabmap::Transform> & poses,
-		float & xMin,
-		float & yMin,
-		float & gridCellSize)
+// Loaded nodes which are not in the graph anymore are removed on the next update
+bool MapsManager::loadMapCaches(const rtabmap::Memory * memory, const std::string & databasePath)
 {
-	gridCellSize = gridCellSize_;
-	return util3d::create2DMapFromOccupancyLocalMaps(
-			poses,
-			projMaps_,
-			gridCellSize_,
-			xMin, yMin,
-			gridSize_,
-			gridEroded_);
-}
-
+	if(mapCachePath_.empty() || !UFile::exists(mapCachePath_))
+	{
+		return false;
+	}
+
+	UTimer timer;
+	std::ifstream stream(mapCachePath_.c_str(), std::ios::in | std::ios::binary);
+	if(!stream.is_open())
+	{
+		ROS_ERROR("rtabmap: Cannot open \"%s\" to load the map caches!", mapCachePath_.c_str());
+		return false;
+	}
+
+	boost::uint32_t header[2] = {0, 0};
+	std::vector<double> parameters = mapCacheParameters(cloudDecimation_, cloudMaxDepth_, cloudVoxelSize_,
+			projMaxGroundAngle_, projMinClusterSize_, projMaxHeight_, gridCellSize_);
+	std::vector<double> savedParameters(parameters.size());
+	boost::uint32_t count = 0;
+	MapCacheIdentity savedIdentity;
+	stream.read((char*)header, sizeof(header));
+	if(!stream || header[0] != kMapCacheMagic || header[1] != kMapCacheVersion || !savedIdentity.read(stream))
+	{
+		ROS_WARN("rtabmap: \"%s\" is not a map caches file (or an old version), ignoring it.", mapCachePath_.c_str());
+		return false;
+	}
+	stream.read((char*)savedParameters.data(), savedParameters.size()*sizeof(double));
+	stream.read((char*)&count, sizeof(count));
+	if(!stream)
+	{
+		ROS_ERROR("rtabmap: The map caches file \"%s\" is truncated, ignoring it.", mapCachePath_.c_str());
+		return false;
+	}
+	MapCacheIdentity identity(memory, databasePath);
+	if(!(savedIdentity == identity))
+	{
+		ROS_WARN("rtabmap: The map caches in \"%s\" were saved with another database (\"%s\", last node=%d, "
+				"nodes=%d) than the current one (\"%s\", last node=%d, nodes=%d), ignoring them.",
+				mapCachePath_.c_str(),
+				savedIdentity.path.c_str(), savedIdentity.lastId, (int)savedIdentity.nodes,
+				identity.path.c_str(), identity.lastId, (int)identity.nodes);
+		return false;
+	}
+	if(savedParameters != parameters)
+	{
+		ROS_WARN("rtabmap: The map caches in \"%s\" were created with other cloud/proj/grid "
+				"parameters, ignoring them.", mapCachePath_.c_str());
+		return false;
+	}
+
+	std::map<int, std::pair<cv::Mat, cv::Mat> > projMaps;
+	std::map<int, std::pair<cv::Mat, cv::Mat> > gridMaps;
+	std::map<int, rtabmap_ros::CompactCloud> clouds;
+	bool ok = true;
+	for(boost::uint32_t i=0; i<count && ok; ++i)
+	{
+		boost::int32_t id = 0;
+		boost::uint8_t flags = 0;
+		stream.read((char*)&id, sizeof(id));
+		stream.read((char*)&flags, sizeof(flags));
+		ok = (bool)stream;
+		if(ok && (flags & 1))
+		{
+			ok = readLocalMap(stream, projMaps[id]);
+		}
+		if(ok && (flags & 2))
+		{
+			ok = readLocalMap(stream, gridMaps[id]);
+		}
+		if(ok && (flags & 4))
+		{
+			ok = clouds[id].read(stream);
+		}
+	}
+	if(!ok)
+	{
+		ROS_ERROR("rtabmap: The map caches file \"%s\" is truncated or corrupted, ignoring it.", mapCachePath_.c_str());
+		return false;
+	}
+
+	projMaps_.swap(projMaps);
+	gridMaps_.swap(gridMaps);
+	clouds_.clear();
+	compactClouds_.clear();
+	if(mapCachePersistClouds_)
+	{
+		for(std::map<int, rtabmap_ros::CompactCloud>::iterator iter=clouds.begin(); iter!=clouds.end(); ++iter)
+		{
+			if(cloudCompactStorage_)
+			{
+				compactClouds_.insert(*iter);
+			}
+			else
+			{
+				clouds_.insert(std::make_pair(iter->first, iter->second.uncompress()));
+			}
+		}
+	}
+	ROS_INFO("rtabmap: Loaded the map caches of %d nodes from \"%s\" (%fs)", (int)count, mapCachePath_.c_str(), timer.ticks());
+	return true;
+}
+
+void MapsManager::removeMapCachesFile() const
+{
+	if(!mapCachePath_.empty() && UFile::exists(mapCachePath_))
+	{
+		UFile::erase(mapCachePath_);
+	}
+}
+
+namespace {
+
+// Writes the points as they come in a PLY or PCD file (from the extension).
+// The number of points is written at the end in the fixed-width field of
+// the header, so the whole cloud doesn't have to be in memory.
+class CloudFileWriter
+{
+public:
+	CloudFileWriter() : ply_(false), binary_(false), points_(0), countPos_(0), countPos2_(0) {}
+
+	bool open(const std::string & path, bool binary)
+	{
+		std::string extension = UFile::getExtension(path);
+		std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+		if(extension.compare("ply") != 0 && extension.compare("pcd") != 0)
+		{
+			return false;
+		}
+		ply_ = extension.compare("ply") == 0;
+		binary_ = binary;
+		stream_.open(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if(!stream_.is_open())
+		{
+			return false;
+		}
+		if(ply_)
+		{
+			stream_ << "ply\nformat " << (binary_?"binary_little_endian":"ascii") << " 1.0\nelement vertex ";
+			countPos_ = stream_.tellp();
+			stream_ << countField(0) << "\n";
+			stream_ << "property float x\nproperty float y\nproperty float z\n"
+					   "property uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n";
+		}
+		else
+		{
+			stream_ << "# .PCD v0.7 - Point Cloud Data file format\nVERSION 0.7\n"
+					   "FIELDS x y z rgb\nSIZE 4 4 4 4\nTYPE F F F F\nCOUNT 1 1 1 1\nWIDTH ";
+			countPos_ = stream_.tellp();
+			stream_ << countField(0) << "\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS ";
+			countPos2_ = stream_.tellp();
+			stream_ << countField(0) << "\nDATA " << (binary_?"binary":"ascii") << "\n";
+		}
+		return (bool)stream_;
+	}
+
+	void write(const pcl::PointCloud<pcl::PointXYZRGB> & cloud, const Eigen::Affine3f & transform)
+	{
+		for(unsigned int i=0; i<cloud.size(); ++i)
+		{
+			const pcl::PointXYZRGB & pt = cloud.at(i);
+			if(!pcl::isFinite(pt))
+			{
+				continue;
+			}
+			Eigen::Vector3f v = transform * pt.getVector3fMap();
+			if(binary_)
+			{
+				stream_.write((const char*)v.data(), 3*sizeof(float));
+				if(ply_)
+				{
+					unsigned char rgb[3] = {pt.r, pt.g, pt.b};
+					stream_.write((const char*)rgb, 3);
+				}
+				else
+				{
+					stream_.write((const char*)&pt.rgb, sizeof(float));
+				}
+			}
+			else if(ply_)
+			{
+				stream_ << v[0] << " " << v[1] << " " << v[2] << " " << (int)pt.r << " " << (int)pt.g << " " << (int)pt.b << "\n";
+			}
+			else
+			{
+				stream_ << v[0] << " " << v[1] << " " << v[2] << " " << *reinterpret_cast<const boost::uint32_t*>(&pt.rgb) << "\n";
+			}
+			++points_;
+		}
+	}
+
+	bool close()
+	{
+		stream_.seekp(countPos_);
+		stream_ << countField(points_);
+		if(!ply_)
+		{
+			stream_.seekp(countPos2_);
+			stream_ << countField(points_);
+		}
+		bool ok = (bool)stream_;
+		stream_.close();
+		return ok;
+	}
+
+	size_t points() const {return points_;}
+
+private:
+	static std::string countField(size_t count)
+	{
+		return uFormat("%012lu", (unsigned long)count);
+	}
+
+private:
+	bool ply_;
+	bool binary_;
+	size_t points_;
+	std::ofstream stream_;
+	std::streampos countPos_;
+	std::streampos countPos2_; // PCD POINTS
+};
+
+}
+
+bool MapsManager::exportCloud(
+		const std::string & path,
+		const std::map<int, rtabmap::Transform> & poses,
+		const boost::function<std::map<int, rtabmap::Signature> (const std::vector<int> &)> & getData,
+		int batchSize,
+		bool binary,
+		size_t & points,
+		std::string & error) const
+{
+	points = 0;
+	CloudFileWriter writer;
+	if(!writer.open(path, binary))
+	{
+		error = uFormat("Cannot open \"%s\" (the extension should be .ply or .pcd)", path.c_str());
+		return false;
+	}
+
+	UTimer timer;
+	std::vector<int> ids;
+	ids.reserve(poses.size());
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(!iter->second.isNull())
+		{
+			ids.push_back(iter->first);
+		}
+	}
+
+	if(batchSize <= 0)
+	{
+		batchSize = mapCacheBatchSize_ > 0?mapCacheBatchSize_:50;
+	}
+	int threads = mapCacheThreads_ > 1?mapCacheThreads_:(int)boost::thread::hardware_concurrency();
+	if(threads < 1)
+	{
+		threads = 1;
+	}
+	for(unsigned int first=0; first<ids.size(); first+=batchSize)
+	{
+		unsigned int last = first+batchSize < ids.size()?first+batchSize:ids.size();
+
+		std::vector<int> batchIds(ids.begin()+first, ids.begin()+last);
+		std::map<int, rtabmap::Signature> signatures = getData(batchIds);
+
+		std::vector<LocalMapsRequest> requests(batchIds.size());
+		for(unsigned int i=0; i<batchIds.size(); ++i)
+		{
+			requests[i].id = batchIds[i];
+			requests[i].rgbDepthRequired = true;
+			std::map<int, rtabmap::Signature>::const_iterator findIter = signatures.find(batchIds[i]);
+			if(findIter != signatures.end())
+			{
+				requests[i].data = &findIter->second;
+			}
+		}
+
+		int batchThreads = threads < (int)requests.size()?threads:(int)requests.size();
+		if(batchThreads > 1)
+		{
+			boost::thread_group workers;
+			for(int t=0; t<batchThreads; ++t)
+			{
+				workers.create_thread(boost::bind(&MapsManager::createLocalMapsWorker, this, &requests, t, requests.size(), batchThreads));
+			}
+			workers.join_all();
+		}
+		else
+		{
+			createLocalMapsWorker(&requests, 0, requests.size(), 1);
+		}
+
+		// written in node ID order
+		for(unsigned int i=0; i<requests.size(); ++i)
+		{
+			if(requests[i].cloud.get())
+			{
+				writer.write(*requests[i].cloud, poses.at(requests[i].id).toEigen3f());
+			}
+		}
+		ROS_INFO("rtabmap: Exported %d/%d nodes (%lu points)...", (int)last, (int)ids.size(), (unsigned long)writer.points());
+	}
+
+	points = writer.points();
+	if(!writer.close())
+	{
+		error = uFormat("Error while writing \"%s\"", path.c_str());
+		return false;
+	}
+	ROS_INFO("rtabmap: Exported %lu points of %d nodes to \"%s\" (%fs)", (unsigned long)points, (int)ids.size(), path.c_str(), timer.ticks());
+	return true;
+}
+
+size_t MapsManager::cachedBytes(int id) const
+{
+	size_t bytes = 0;
+	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::const_iterator iter = clouds_.find(id);
+	if(iter != clouds_.end() && iter->second.get())
+	{
+		bytes += sizeof(pcl::PointCloud<pcl::PointXYZRGB>) + iter->second->points.capacity()*sizeof(pcl::PointXYZRGB);
+	}
+	std::map<int, rtabmap_ros::CompactCloud>::const_iterator kter = compactClouds_.find(id);
+	if(kter != compactClouds_.end())
+	{
+		bytes += kter->second.bytes();
+	}
+	const std::map<int, std::pair<cv::Mat, cv::Mat> > * caches[2] = {&projMaps_, &gridMaps_};
+	for(int i=0; i<2; ++i)
+	{
+		std::map<int, std::pair<cv::Mat, cv::Mat> >::const_iterator jter = caches[i]->find(id);
+		if(jter != caches[i]->end())
+		{
+			bytes += jter->second.first.total()*jter->second.first.elemSize() +
+					jter->second.second.total()*jter->second.second.elemSize();
+		}
+	}
+	return bytes;
+}
+
+// Memory used by the structures built from the caches. They are not evicted, but
+// they count in "map_cache_max_size".
+size_t MapsManager::assemblyBytes() const
+{
+	size_t bytes = 0;
+	for(std::map<int, rtabmap_ros::CompactCloud>::const_iterator iter=assembledClouds_.begin(); iter!=assembledClouds_.end(); ++iter)
+	{
+		bytes += iter->second.bytes();
+	}
+	bytes += assembledVoxels_.bytes();
+	bytes += incrementalProjMap_.grid.bytes() + incrementalGridMap_.grid.bytes();
+	bytes += tiledProjMap_.grid.bytes() + tiledGridMap_.grid.bytes();
+	for(std::map<int, cv::Mat>::const_iterator iter=disparities_.begin(); iter!=disparities_.end(); ++iter)
+	{
+		bytes += iter->second.total()*iter->second.elemSize();
+	}
+#ifdef WITH_OCTOMAP
+	if(octree_)
+	{
+		bytes += octree_->memoryUsage();
+	}
+#endif
+	return bytes;
+}
+
+void MapsManager::removeFromCaches(int id)
+{
+	clouds_.erase(id);
+	compactClouds_.erase(id);
+	projMaps_.erase(id);
+	gridMaps_.erase(id);
+	removeDisparity(id);
+}
+
+// The disparity of a stereo node is kept until both its cloud and its
+// projection map are cached, so the other one doesn't have to compute it
+// again. At most "map_cache_disparities" are kept, the oldest are dropped.
+void MapsManager::cacheDisparity(int id, const cv::Mat & disparity)
+{
+	if(mapCacheDisparities_ <= 0 || disparity.empty() || (hasCloud(id) && uContains(projMaps_, id)))
+	{
+		removeDisparity(id);
+		return;
+	}
+	if(disparities_.insert(std::make_pair(id, disparity)).second)
+	{
+		disparitiesOrder_.push_back(id);
+	}
+	while((int)disparities_.size() > mapCacheDisparities_)
+	{
+		disparities_.erase(disparitiesOrder_.front());
+		disparitiesOrder_.pop_front();
+	}
+}
+
+void MapsManager::removeDisparity(int id)
+{
+	if(disparities_.erase(id))
+	{
+		disparitiesOrder_.remove(id);
+	}
+}
+
+// Evicted nodes are created again from the memory the next time they are needed.
+// The nodes of the current map are never evicted, the budget is exceeded instead.
+void MapsManager::updateCacheUsage(const std::map<int, rtabmap::Transform> & usedPoses, int hits, int misses)
+{
+	// refresh sizes, forget nodes not in the caches anymore
+	size_t otherBytes = assemblyBytes();
+	size_t totalBytes = otherBytes;
+	for(std::map<int, std::pair<std::list<int>::iterator, size_t> >::iterator iter=cacheEntries_.begin();
+		iter!=cacheEntries_.end();)
+	{
+		if(!hasCloud(iter->first) &&
+		   !uContains(projMaps_, iter->first) &&
+		   !uContains(gridMaps_, iter->first))
+		{
+			cacheLru_.erase(iter->second.first);
+			cacheEntries_.erase(iter++);
+		}
+		else
+		{
+			iter->second.second = cachedBytes(iter->first);
+			totalBytes += iter->second.second;
+			++iter;
+		}
+	}
+
+	// nodes used by this update become the most recently used
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=usedPoses.begin(); iter!=usedPoses.end(); ++iter)
+	{
+		std::map<int, std::pair<std::list<int>::iterator, size_t> >::iterator jter = cacheEntries_.find(iter->first);
+		if(jter != cacheEntries_.end())
+		{
+			cacheLru_.splice(cacheLru_.end(), cacheLru_, jter->second.first);
+		}
+		else if(hasCloud(iter->first) ||
+				uContains(projMaps_, iter->first) ||
+				uContains(gridMaps_, iter->first))
+		{
+			size_t bytes = cachedBytes(iter->first);
+			cacheEntries_.insert(std::make_pair(iter->first, std::make_pair(cacheLru_.insert(cacheLru_.end(), iter->first), bytes)));
+			totalBytes += bytes;
+		}
+	}
+
+	int evictions = 0;
+	if(mapCacheMaxSize_ > 0.0)
+	{
+		size_t maxBytes = size_t(mapCacheMaxSize_*1024.0*1024.0);
+		// the nodes used are the most recently used, at the end
+		while(totalBytes > maxBytes && cacheLru_.size() && !uContains(usedPoses, cacheLru_.front()))
+		{
+			int id = cacheLru_.front();
+			std::map<int, std::pair<std::list<int>::iterator, size_t> >::iterator iter = cacheEntries_.find(id);
+			totalBytes -= iter->second.second;
+			cacheEntries_.erase(iter);
+			cacheLru_.pop_front();
+			removeFromCaches(id);
+			++evictions;
+		}
+		if(totalBytes > maxBytes)
+		{
+			ROS_WARN_THROTTLE(10.0, "rtabmap: map_cache_max_size (%f MB) is smaller than the current map (%f MB, "
+					"%f MB for the assembled map and grids), the nodes of the map are not evicted.",
+					mapCacheMaxSize_, float(totalBytes)/(1024.0f*1024.0f), float(otherBytes)/(1024.0f*1024.0f));
+		}
+	}
+	UDEBUG("Map caches: nodes=%d size=%f MB hits=%d misses=%d evictions=%d",
+			(int)cacheEntries_.size(), float(totalBytes)/(1024.0f*1024.0f), hits, misses, evictions);
+
+	boost::mutex::scoped_lock lock(cacheStatsMutex_);
+	cacheStats_.bytes = totalBytes;
+	cacheStats_.assemblyBytes = otherBytes;
+	cacheStats_.nodes = (int)cacheEntries_.size();
+	cacheStats_.hits += hits;
+	cacheStats_.misses += misses;
+	cacheStats_.evictions += evictions;
+}
+
+void MapsManager::createLocalMapsWorker(
+		std::vector<LocalMapsRequest> * requests,
+		unsigned int first,
+		unsigned int last,
+		int step) const
+{
+	for(unsigned int i=first; i<last; i+=step)
+	{
+		createLocalMaps(requests->at(i));
+	}
+}
+
+// Must not access the caches, may be called from multiple threads at the same time
+void MapsManager::createLocalMaps(LocalMapsRequest & request) const
+{
+	if(request.data == 0 || request.data->id() <= 0)
+	{
+		return;
+	}
+	const rtabmap::Signature & data = *request.data;
+
+	bool rgbDepthRequired = request.rgbDepthRequired;
+	bool depthRequired = request.depthRequired;
+	bool scanRequired = request.scanRequired;
+
+	rtabmap::Transform localTransform = data.getLocalTransform();
+	if(!localTransform.isNull())
+	{
+		// Which data should we decompress? Only stereo nodes have a disparity,
+		// the right image is not needed if it is already computed.
+		cv::Mat image, depth, scan;
+		cv::Mat disparity = request.disparity;
+		data.uncompressDataConst(
+				rgbDepthRequired?&image:0,
+				(rgbDepthRequired||depthRequired) && disparity.empty()?&depth:0,
+				scanRequired?&scan:0);
+		bool stereo = !disparity.empty() || (!depth.empty() && depth.type() == CV_8UC1);
+		if(stereo && disparity.empty())
+		{
+			if(image.empty())
+			{
+				// Stereo detected, we should uncompress left image too
+				data.uncompressDataConst(&image, 0, 0);
+			}
+			if(!image.empty())
+			{
+				// computed once for the cloud and the projection map
+				cv::Mat leftMono;
+				if(image.channels() == 3)
+				{
+					cv::cvtColor(image, leftMono, CV_BGR2GRAY);
+				}
+				else
+				{
+					leftMono = image;
+				}
+				disparity = util2d::disparityFromStereoImages(leftMono, depth);
+				request.disparity = disparity;
+				request.disparityCreated = true;
+			}
+		}
+		float fx = data.getFx();
+		float fy = data.getFy();
+		float cx = data.getCx();
+		float cy = data.getCy();
+
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudRGB;
+		pcl::PointCloud<pcl::PointXYZ>::Ptr cloudXYZ;
+		if(rgbDepthRequired)
+		{
+			if(!image.empty() &&
+				(!depth.empty() || !disparity.empty()) &&
+				fx > 0.0f && fy > 0.0f &&
+				cx >= 0.0f && cy >= 0.0f)
+			{
+				if(stereo)
+				{
+					// fy is the baseline
+					cloudRGB = util3d::cloudFromDisparityRGB(image, disparity, cx, cy, fx, fy, cloudDecimation_);
+				}
+				else
+				{
+					cloudRGB = util3d::cloudFromDepthRGB(image, depth, cx, cy, fx, fy, cloudDecimation_);
+				}
+
+				if(cloudRGB->size() && cloudMaxDepth_ > 0)
+				{
+					cloudRGB = util3d::passThrough(cloudRGB, "z", 0, cloudMaxDepth_);
+				}
+				if(cloudRGB->size() && cloudVoxelSize_ > 0)
+				{
+					cloudRGB = util3d::voxelize(cloudRGB, cloudVoxelSize_);
+				}
+				if(cloudRGB->size())
+				{
+					cloudRGB = util3d::transformPointCloud(cloudRGB, localTransform);
+				}
+			}
+			else
+			{
+				ROS_ERROR("RGB or Depth image not found (node=%d)!", data.id());
+			}
+		}
+		else if(depthRequired)
+		{
+			if(	(!depth.empty() || !disparity.empty()) &&
+				fx > 0.0f && fy > 0.0f &&
+				cx >= 0.0f && cy >= 0.0f)
+			{
+				if(stereo)
+				{
+					if(!disparity.empty())
+					{
+						cloudXYZ = rtabmap::util3d::cloudFromDisparity(
+								disparity,
+								cx, cy,
+								fx, fy,
+								cloudDecimation_);
+					}
+				}
+				else
+				{
+					cloudXYZ = util3d::cloudFromDepth(depth, cx, cy, fx, fy, cloudDecimation_);
+				}
+
+				if(cloudXYZ.get())
+				{
+					if(cloudXYZ->size() && cloudMaxDepth_ > 0)
+					{
+						cloudXYZ = util3d::passThrough(cloudXYZ, "z", 0, cloudMaxDepth_);
+					}
+					if(cloudXYZ->size() && gridCellSize_ > 0)
+					{
+						// use gridCellSize since this cloud is only for the projection map
+						cloudXYZ = util3d::voxelize(cloudXYZ, gridCellSize_);
+					}
+					if(cloudXYZ->size())
+					{
+						cloudXYZ = util3d::transformPointCloud(cloudXYZ, localTransform);
+					}
+				}
+				else
+				{
+					ROS_ERROR("Left stereo image was empty! (node=%d)", data.id());
+				}
+			}
+			else
+			{
+				ROS_ERROR("RGB or Depth image not found (node=%d)!", data.id());
+			}
+		}
+
+		if(cloudRGB.get())
+		{
+			request.cloud = cloudRGB;
+		}
+
+		if(depthRequired)
+		{
+			cv::Mat ground, obstacles;
+			if(cloudRGB.get())
+			{
+				pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudClipped = cloudRGB;
+				if(cloudClipped->size() && projMaxHeight_ > 0)
+				{
+					cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
+				}
+				if(cloudClipped->size())
+				{
+					cloudClipped = util3d::voxelize(cloudClipped, gridCellSize_);
+					util3d::occupancy2DFromCloud3D<pcl::PointXYZRGB>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
+				}
+			}
+			else if(cloudXYZ.get())
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr cloudClipped = cloudXYZ;
+				if(cloudClipped->size() && projMaxHeight_ > 0)
+				{
+					cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), projMaxHeight_);
+				}
+				if(cloudClipped->size())
+				{
+					util3d::occupancy2DFromCloud3D<pcl::PointXYZ>(cloudClipped, ground, obstacles, gridCellSize_, projMaxGroundAngle_*M_PI/180.0, projMinClusterSize_);
+				}
+			}
+			request.projMap = std::make_pair(ground, obstacles);
+			request.projCreated = true;
+		}
+
+		if(scanRequired)
+		{
+			cv::Mat ground, obstacles;
+			util3d::occupancy2DFromLaserScan(scan, ground, obstacles, gridCellSize_);
+			request.gridMap = std::make_pair(ground, obstacles);
+			request.gridCreated = true;
+		}
+	}
+	else
+	{
+		ROS_ERROR("Local transform detected for node %d", data.id());
+	}
+}
+
+void MapsManager::publishMaps(
+		const std::map<int, rtabmap::Transform> & poses,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	UDEBUG("Publishing maps...");
+
+	// publish maps
+	if(cloudMapPub_.getNumSubscribers())
+	{
+		// generate the assembled cloud!
+		UTimer time;
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud;
+		int count = 0;
+		if(cloudIncrementalAssembly_)
+		{
+			assembledCloud = assembleCloudIncremental(poses, count);
+		}
+		else
+		{
+			assembledCloud.reset(new pcl::PointCloud<pcl::PointXYZRGB>);
+			for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+			{
+				std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator jter = clouds_.find(iter->first);
+				std::map<int, rtabmap_ros::CompactCloud>::iterator kter = compactClouds_.find(iter->first);
+				if(jter != clouds_.end())
+				{
+					pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = util3d::transformPointCloud(jter->second, iter->second);
+					*assembledCloud+=*transformed;
+					++count;
+				}
+				else if(kter != compactClouds_.end())
+				{
+					// expanded directly in the assembled cloud
+					kter->second.appendTo(*assembledCloud, iter->second);
+					++count;
+				}
+			}
+			if(assembledCloud->size() && cloudVoxelSize_ > 0 && cloudOutputVoxelized_)
+			{
+				assembledCloud = util3d::voxelize(assembledCloud, cloudVoxelSize_);
+			}
+		}
+
+		if(assembledCloud->size())
+		{
+			ROS_INFO("Assembled %d clouds (%fs)", count, time.ticks());
+
+			sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
+			pcl::toROSMsg(*assembledCloud, *cloudMsg);
+			cloudMsg->header.stamp = stamp;
+			cloudMsg->header.frame_id = mapFrameId;
+			cloudMapPub_.publish(cloudMsg);
+		}
+		else if(poses.size())
+		{
+			ROS_WARN("Cloud map is empty! (clouds=%d)", (int)(clouds_.size()+compactClouds_.size()));
+		}
+	}
+	else if(mapCacheCleanup_)
+	{
+		if(!octomapIncremental_)
+		{
+			// with octomap_incremental, the clouds are kept to rebuild the octree
+			clouds_.clear();
+			compactClouds_.clear();
+		}
+		assembledClouds_.clear();
+		assembledPoses_.clear();
+		assembledVoxels_.clear();
+	}
+
+	if(projMapPub_.getNumSubscribers())
+	{
+		// create the projection map
+		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
+		cv::Mat pixels = this->generateProjMap(poses, xMin, yMin, gridCellSize);
+
+		if(!pixels.empty() && gridIncremental_ &&
+			publishIncrementalMap(incrementalProjMap_, projMapUpdatesPub_, pixels, stamp, mapFrameId))
+		{
+			// only the modified cells have been published
+		}
+		else if(!pixels.empty())
+		{
+			publishFullMap(incrementalProjMap_, projMapPub_, pixels, xMin, yMin, gridCellSize, stamp, mapFrameId);
+		}
+		else if(poses.size())
+		{
+			ROS_WARN("Projection map is empty! (proj maps=%d)", (int)projMaps_.size());
+		}
+	}
+	else if(mapCacheCleanup_)
+	{
+		if(projTilesPub_.getNumSubscribers() == 0)
+		{
+			projMaps_.clear();
+		}
+		incrementalProjMap_.clear();
+	}
+
+	if(projTilesPub_.getNumSubscribers())
+	{
+		publishTiledMap(tiledProjMap_, projTilesPub_, poses, projMaps_, stamp, mapFrameId);
+	}
+	else if(mapCacheCleanup_)
+	{
+		tiledProjMap_.clear();
+	}
+
+	if(gridMapPub_.getNumSubscribers())
+	{
+		// create the grid map
+		float xMin=0.0f, yMin=0.0f, gridCellSize = 0.05f;
+		cv::Mat pixels = this->generateGridMap(poses, xMin, yMin, gridCellSize);
+
+		if(!pixels.empty() && gridIncremental_ &&
+			publishIncrementalMap(incrementalGridMap_, gridMapUpdatesPub_, pixels, stamp, mapFrameId))
+		{
+			// only the modified cells have been published
+		}
+		else if(!pixels.empty())
+		{
+			publishFullMap(incrementalGridMap_, gridMapPub_, pixels, xMin, yMin, gridCellSize, stamp, mapFrameId);
+		}
+		else if(poses.size())
+		{
+			ROS_WARN("Grid map is empty! (local maps=%d)", (int)gridMaps_.size());
+		}
+	}
+	else if(mapCacheCleanup_)
+	{
+		if(gridTilesPub_.getNumSubscribers() == 0)
+		{
+			gridMaps_.clear();
+		}
+		incrementalGridMap_.clear();
+	}
+
+	if(gridTilesPub_.getNumSubscribers())
+	{
+		publishTiledMap(tiledGridMap_, gridTilesPub_, poses, gridMaps_, stamp, mapFrameId);
+	}
+	else if(mapCacheCleanup_)
+	{
+		tiledGridMap_.clear();
+	}
+}
+
+pcl::PointCloud<pcl::PointXYZRGB>::Ptr MapsManager::assembleCloudIncremental(
+		const std::map<int, rtabmap::Transform> & poses,
+		int & count)
+{
+	bool voxelized = cloudVoxelSize_ > 0 && cloudOutputVoxelized_;
+	if(voxelized)
+	{
+		if(assembledVoxels_.voxelSize() != float(cloudVoxelSize_) ||
+		   (assembledVoxels_.empty() && assembledClouds_.size()))
+		{
+			assembledVoxels_.setVoxelSize(cloudVoxelSize_);
+			// re-add everything
+			assembledClouds_.clear();
+			assembledPoses_.clear();
+		}
+	}
+	else if(!assembledVoxels_.empty())
+	{
+		assembledVoxels_.clear();
+	}
+
+	// only nodes with a cloud are assembled
+	std::map<int, Transform> posesWithClouds;
+	for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(hasCloud(iter->first))
+		{
+			posesWithClouds.insert(posesWithClouds.end(), *iter);
+		}
+	}
+	assembledPoses_.setTolerances(mapIncrementalLinearUpdate_, mapIncrementalAngularUpdate_*M_PI/180.0);
+	assembledPoses_.update(posesWithClouds);
+
+	// Remove nodes not in the graph anymore or that have moved (e.g., after a loop closure)
+	std::vector<int> removed(assembledPoses_.removed().begin(), assembledPoses_.removed().end());
+	removed.insert(removed.end(), assembledPoses_.moved().begin(), assembledPoses_.moved().end());
+	for(unsigned int i=0; i<removed.size(); ++i)
+	{
+		std::map<int, rtabmap_ros::CompactCloud>::iterator iter = assembledClouds_.find(removed[i]);
+		if(iter != assembledClouds_.end())
+		{
+			if(voxelized)
+			{
+				assembledVoxels_.remove(*iter->second.uncompress());
+			}
+			assembledClouds_.erase(iter);
+		}
+	}
+
+	// Add new nodes (and those removed above) in map frame. The voxels are
+	// updated with the points expanded from the compact form, which are the
+	// same when removed.
+	int added = 0;
+	for(std::map<int, Transform>::const_iterator iter = assembledPoses_.poses().begin(); iter!=assembledPoses_.poses().end(); ++iter)
+	{
+		if(!uContains(assembledClouds_, iter->first))
+		{
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformed = getCloud(iter->first, iter->second);
+			rtabmap_ros::CompactCloud & compact = assembledClouds_[iter->first];
+			if(transformed.get())
+			{
+				compact.set(*transformed);
+			}
+			if(voxelized)
+			{
+				assembledVoxels_.add(*compact.uncompress());
+			}
+			++added;
+		}
+	}
+	count = (int)assembledClouds_.size();
+	UDEBUG("Incremental assembly: added=%d removed=%d total=%d", added, (int)removed.size(), count);
+
+	if(voxelized)
+	{
+		return assembledVoxels_.getCloud();
+	}
+
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud(new pcl::PointCloud<pcl::PointXYZRGB>);
+	size_t totalSize = 0;
+	for(std::map<int, rtabmap_ros::CompactCloud>::iterator iter=assembledClouds_.begin();
+		iter!=assembledClouds_.end();
+		++iter)
+	{
+		totalSize += iter->second.size();
+	}
+	assembledCloud->reserve(totalSize);
+	for(std::map<int, rtabmap_ros::CompactCloud>::iterator iter=assembledClouds_.begin();
+		iter!=assembledClouds_.end();
+		++iter)
+	{
+		iter->second.appendTo(*assembledCloud);
+	}
+	return assembledCloud;
+}
+
+cv::Mat MapsManager::generateProjMap(
+		const std::map<int, rtabmap::Transform> & poses,
+		float & xMin,
+		float & yMin,
+		float & gridCellSize)
+{
+	gridCellSize = gridCellSize_;
+	if(gridIncremental_)
+	{
+		return updateIncrementalMap(incrementalProjMap_, poses, projMaps_, xMin, yMin);
+	}
+	return util3d::create2DMapFromOccupancyLocalMaps(
+			poses,
+			projMaps_,
+			gridCellSize_,
+			xMin, yMin,
+			gridSize_,
+			gridEroded_);
+}
+
 cv::Mat MapsManager::generateGridMap(
 		const std::map<int, rtabmap::Transform> & poses,
 		float & xMin,
@@ -553,6 +1719,31 @@ cv::Mat MapsManager::generateGridMap(
 		float & gridCellSize)
 {
 	gridCellSize = gridCellSize_;
+	if(gridIncremental_)
+	{
+		// restore the cells filled around the previous pose before updating the grid
+		if(incrementalGridMap_.filled.area())
+		{
+			incrementalGridMap_.grid.refresh(incrementalGridMap_.filled);
+			incrementalGridMap_.dirty = incrementalGridMap_.dirty.area()?
+					incrementalGridMap_.dirty | incrementalGridMap_.filled:
+					incrementalGridMap_.filled;
+			incrementalGridMap_.filled = cv::Rect();
+		}
+		cv::Mat map = updateIncrementalMap(incrementalGridMap_, poses, gridMaps_, xMin, yMin);
+		if(!map.empty())
+		{
+			incrementalGridMap_.filled = fillUnknownSpace(map, poses, xMin, yMin);
+			if(incrementalGridMap_.filled.area())
+			{
+				incrementalGridMap_.dirty = incrementalGridMap_.dirty.area()?
+						incrementalGridMap_.dirty | incrementalGridMap_.filled:
+						incrementalGridMap_.filled;
+			}
+		}
+		return map;
+	}
+
 	cv::Mat map = util3d::create2DMapFromOccupancyLocalMaps(
 			poses,
 			gridMaps_,
@@ -561,6 +1752,19 @@ cv::Mat MapsManager::generateGridMap(
 			gridSize_,
 			gridEroded_);
 
+	fillUnknownSpace(map, poses, xMin, yMin);
+
+	return map;
+}
+
+// Returns the region modified
+cv::Rect MapsManager::fillUnknownSpace(
+		cv::Mat & map,
+		const std::map<int, rtabmap::Transform> & poses,
+		float xMin,
+		float yMin) const
+{
+	cv::Rect region;
 	// Fill unknown space around the last pose
 	if(!map.empty() &&
 		laserScanMaxRange_ &&
@@ -588,6 +1792,8 @@ cv::Mat MapsManager::generateGridMap(
 														 sin(yaw), cos(yaw));
 
 		cv::Mat endCurrent = initRotation*endFirst + origin;
+		int range = laserScanMaxRange_/gridCellSize_ + 1;
+		region = cv::Rect(start.x-range, start.y-range, 2*range+1, 2*range+1) & cv::Rect(0, 0, map.cols, map.rows);
 		for(float a=laserScanMinAngle_; a<=laserScanMaxAngle_; a+=laserScanIncrement_)
 		{
 			cv::Point2i end((endCurrent.at<float>(0)-xMin)/gridCellSize_ + 0.5f, (endCurrent.at<float>(1)-yMin)/gridCellSize_ + 0.5f);
@@ -602,8 +1808,227 @@ cv::Mat MapsManager::generateGridMap(
 			endCurrent = rotation*(endCurrent - origin) + origin;
 		}
 	}
+	return region;
+}
 
-	return map;
+cv::Mat MapsManager::updateIncrementalMap(
+		IncrementalMap & map,
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+		float & xMin,
+		float & yMin)
+{
+	UTimer time;
+	cv::Rect region = map.grid.update(poses, localMaps, mapIncrementalLinearUpdate_, mapIncrementalAngularUpdate_*M_PI/180.0);
+	if(map.grid.resized())
+	{
+		// cells not published yet are in the full map
+		map.resized = true;
+		map.dirty = cv::Rect();
+	}
+	else if(region.area())
+	{
+		map.dirty = map.dirty.area()?map.dirty | region:region;
+	}
+	xMin = map.grid.xMin();
+	yMin = map.grid.yMin();
+	UDEBUG("Incremental grid updated: nodes=%d region=%dx%d resized=%d (%fs)",
+			map.grid.nodes(), region.width, region.height, map.grid.resized()?1:0, time.ticks());
+	return map.grid.map();
+}
+
+// Returns false if the full map should be published
+bool MapsManager::publishIncrementalMap(
+		IncrementalMap & map,
+		ros::Publisher & updatesPub,
+		const cv::Mat & pixels,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	bool fullMap = map.resized;
+	cv::Rect dirty = map.dirty & cv::Rect(0, 0, pixels.cols, pixels.rows);
+	map.dirty = cv::Rect();
+	map.resized = false;
+	{
+		boost::mutex::scoped_lock lock(map.publishedMutex);
+		if(fullMap ||
+		   map.published.data.empty() ||
+		   (int)map.published.info.width != pixels.cols ||
+		   (int)map.published.info.height != pixels.rows)
+		{
+			return false;
+		}
+		// keep the full map up to date for the new subscribers
+		map.published.header.stamp = stamp;
+		for(int i=0; i<dirty.height; ++i)
+		{
+			memcpy(map.published.data.data() + (dirty.y+i)*pixels.cols + dirty.x, pixels.ptr<char>(dirty.y+i) + dirty.x, dirty.width);
+		}
+	}
+
+	if(dirty.area() && updatesPub.getNumSubscribers())
+	{
+		map_msgs::OccupancyGridUpdate update;
+		update.header.frame_id = mapFrameId;
+		update.header.stamp = stamp;
+		update.x = dirty.x;
+		update.y = dirty.y;
+		update.width = dirty.width;
+		update.height = dirty.height;
+		update.data.resize(dirty.width * dirty.height);
+		for(int i=0; i<dirty.height; ++i)
+		{
+			memcpy(update.data.data() + i*dirty.width, pixels.ptr<char>(dirty.y+i) + dirty.x, dirty.width);
+		}
+		updatesPub.publish(update);
+		UDEBUG("Published map update %dx%d at (%d,%d)", dirty.width, dirty.height, dirty.x, dirty.y);
+	}
+	return true;
+}
+
+void MapsManager::publishFullMap(
+		IncrementalMap & map,
+		ros::Publisher & mapPub,
+		const cv::Mat & pixels,
+		float xMin,
+		float yMin,
+		float gridCellSize,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	//init
+	nav_msgs::OccupancyGrid msg;
+	msg.info.resolution = gridCellSize;
+	msg.info.origin.position.x = 0.0;
+	msg.info.origin.position.y = 0.0;
+	msg.info.origin.position.z = 0.0;
+	msg.info.origin.orientation.x = 0.0;
+	msg.info.origin.orientation.y = 0.0;
+	msg.info.origin.orientation.z = 0.0;
+	msg.info.origin.orientation.w = 1.0;
+
+	msg.info.width = pixels.cols;
+	msg.info.height = pixels.rows;
+	msg.info.origin.position.x = xMin;
+	msg.info.origin.position.y = yMin;
+	msg.data.resize(msg.info.width * msg.info.height);
+
+	memcpy(msg.data.data(), pixels.data, msg.info.width * msg.info.height);
+
+	msg.header.frame_id = mapFrameId;
+	msg.header.stamp = stamp;
+
+	mapPub.publish(msg);
+
+	if(gridIncremental_)
+	{
+		// sent to the subscribers connecting later, then kept up to date with the updates
+		boost::mutex::scoped_lock lock(map.publishedMutex);
+		map.published = msg;
+	}
+}
+
+// Called on the ROS callback threads. Only the updates are published after
+// the full map (e.g., costmap_2d's static layer resubscribes on reset and waits
+// for a full map), so it is sent to each new subscriber.
+void MapsManager::incrementalMapConnectCallback(const ros::SingleSubscriberPublisher & pub, IncrementalMap * map)
+{
+	boost::mutex::scoped_lock lock(map->publishedMutex);
+	if(map->published.data.size())
+	{
+		pub.publish(map->published);
+		UDEBUG("Sent the full map (%dx%d) to new subscriber %s",
+				(int)map->published.info.width, (int)map->published.info.height, pub.getSubscriberName().c_str());
+	}
+}
+
+// The tiles are updated with the nodes added, moved or removed, and their
+// resolution is set from their distance to the latest pose. Only the tiles
+// modified since the previous call are published, all of them the first time.
+void MapsManager::publishTiledMap(
+		TiledMap & map,
+		ros::Publisher & tilesPub,
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+		const ros::Time & stamp,
+		const std::string & mapFrameId)
+{
+	UTimer time;
+	boost::mutex::scoped_lock lock(map.mutex);
+	map.grid.update(poses, localMaps, mapIncrementalLinearUpdate_, mapIncrementalAngularUpdate_*M_PI/180.0);
+	if(poses.size())
+	{
+		const Transform & pose = poses.rbegin()->second;
+		map.grid.setViewpoint(pose.x(), pose.y());
+	}
+
+	bool full = !map.published || map.frameId != mapFrameId;
+	map.published = true;
+	map.stamp = stamp;
+	map.frameId = mapFrameId;
+	std::vector<rtabmap_ros::TiledGrid::TileKey> removed;
+	std::vector<rtabmap_ros::TiledGrid::TileKey> tiles = map.grid.takeModified(full, removed);
+	if(!full && tiles.empty() && removed.empty())
+	{
+		return;
+	}
+
+	rtabmap_ros::MapTilesPtr msg = tilesMessage(map, tiles, removed, full);
+	tilesPub.publish(msg);
+	UDEBUG("Published %d tiles (%d removed, full=%d) of %d (%fs)",
+			(int)tiles.size(), (int)removed.size(), full?1:0, map.grid.tiles(), time.ticks());
+}
+
+rtabmap_ros::MapTilesPtr MapsManager::tilesMessage(
+		const TiledMap & map,
+		const std::vector<rtabmap_ros::TiledGrid::TileKey> & tiles,
+		const std::vector<rtabmap_ros::TiledGrid::TileKey> & removed,
+		bool full) const
+{
+	rtabmap_ros::MapTilesPtr msg(new rtabmap_ros::MapTiles);
+	msg->header.frame_id = map.frameId;
+	msg->header.stamp = map.stamp;
+	msg->resolution = map.grid.cellSize();
+	msg->tile_length = map.grid.tileLength();
+	msg->full = full;
+	msg->tiles.resize(tiles.size() + removed.size());
+	for(unsigned int i=0; i<tiles.size(); ++i)
+	{
+		rtabmap_ros::MapTile & tile = msg->tiles[i];
+		int level = 0;
+		cv::Mat pixels = map.grid.tileMap(tiles[i], level);
+		tile.x = tiles[i].first;
+		tile.y = tiles[i].second;
+		tile.level = level;
+		tile.resolution = map.grid.cellSize() * float(1 << level);
+		tile.size = pixels.cols;
+		tile.data.resize(pixels.total());
+		memcpy(tile.data.data(), pixels.data, pixels.total());
+	}
+	for(unsigned int i=0; i<removed.size(); ++i)
+	{
+		// without data
+		rtabmap_ros::MapTile & tile = msg->tiles[tiles.size()+i];
+		tile.x = removed[i].first;
+		tile.y = removed[i].second;
+		tile.resolution = map.grid.cellSize();
+	}
+	return msg;
+}
+
+// Called on the ROS callback threads. Only the modified tiles are published
+// after all of them (e.g., the tiled costmap layer resubscribes on reset and
+// waits for all the tiles), so they are sent to each new subscriber.
+void MapsManager::tiledMapConnectCallback(const ros::SingleSubscriberPublisher & pub, TiledMap * map)
+{
+	boost::mutex::scoped_lock lock(map->mutex);
+	if(map->published)
+	{
+		std::vector<rtabmap_ros::TiledGrid::TileKey> removed;
+		rtabmap_ros::MapTilesPtr msg = tilesMessage(*map, map->grid.tileKeys(), removed, true);
+		pub.publish(msg);
+		UDEBUG("Sent %d tiles to new subscriber %s", (int)msg->tiles.size(), pub.getSubscriberName().c_str());
+	}
 }
 
 #ifdef WITH_OCTOMAP
@@ -611,22 +2036,32 @@ cv::Mat MapsManager::generateGridMap(
 // RTAB-Map optimizes the graph at almost each iteration, an octomap cannot
 // be updated online. Only available on service. To have an "online" octomap published as a topic,
 // you may want to subscribe an octomap_server to /rtabmap/cloud topic.
+// With octomap_incremental, a persistent octree is updated with the new nodes
+// only, and rebuilt (in background by default) when nodes moved or were removed.
 //
 octomap::OcTree * MapsManager::createOctomap(const std::map<int, Transform> & poses)
 {
+	if(octomapIncremental_)
+	{
+		// The clouds are kept in cache for the next updates, they are
+		// needed to rebuild the octree after a loop closure.
+		updateOctomap(poses);
+		return octree_?new octomap::OcTree(*octree_):new octomap::OcTree(gridCellSize_);
+	}
+
 	octomap::OcTree * octree = new octomap::OcTree(gridCellSize_);
 	UTimer time;
 	for(std::map<int, Transform>::const_iterator posesIter = poses.begin(); posesIter!=poses.end(); ++posesIter)
 	{
-		std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr >::iterator cloudsIter = clouds_.find(posesIter->first);
-		if(cloudsIter != clouds_.end() && cloudsIter->second->size())
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = getCloud(posesIter->first);
+		if(cloud.get() && cloud->size())
 		{
 			octomap::Pointcloud * scan = new octomap::Pointcloud();
 
-			//octomap::pointcloudPCLToOctomap(*cloudsIter->second, *scan); // Not anymore in Indigo!
-			scan->reserve(cloudsIter->second->size());
-			for(pcl::PointCloud<pcl::PointXYZRGB>::const_iterator it = cloudsIter->second->begin();
-				it != cloudsIter->second->end();
+			//octomap::pointcloudPCLToOctomap(*cloud, *scan); // Not anymore in Indigo!
+			scan->reserve(cloud->size());
+			for(pcl::PointCloud<pcl::PointXYZRGB>::const_iterator it = cloud->begin();
+				it != cloud->end();
 				++it)
 			{
 				// Check if the point is invalid
@@ -651,8 +2086,226 @@ octomap::OcTree * MapsManager::createOctomap(const std::map<int, Transform> & po
 	if(mapCacheCleanup_ && cloudMapPub_.getNumSubscribers() == 0)
 	{
 		clouds_.clear();
+		compactClouds_.clear();
 	}
 	return octree;
 }
+
+struct MapsManager::OctomapScanKeys
+{
+	octomap::KeySet freeCells;
+	octomap::KeySet occupiedCells;
+};
+
+// Same cells as OcTree::insertPointCloud() with discretize=true, but
+// computed without modifying the tree so scans can be processed in parallel.
+void MapsManager::computeOctomapKeysWorker(
+		const octomap::OcTree * octree,
+		const std::vector<OctomapScan> * scans,
+		std::vector<OctomapScanKeys> * keys,
+		unsigned int first,
+		unsigned int last,
+		int step) const
+{
+	octomap::KeyRay ray;
+	for(unsigned int i=first; i<last; i+=step)
+	{
+		const OctomapScan & scan = scans->at(i);
+		OctomapScanKeys & output = keys->at(i);
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud = util3d::transformPointCloud(scan.cloud, scan.pose);
+		octomap::point3d origin(scan.pose.x(), scan.pose.y(), scan.pose.z());
+
+		// one ray per end voxel
+		std::vector<octomap::point3d> clippedEnds;
+		for(pcl::PointCloud<pcl::PointXYZRGB>::const_iterator it = cloud->begin(); it != cloud->end(); ++it)
+		{
+			if(pcl::isFinite(*it))
+			{
+				octomap::point3d end(it->x, it->y, it->z);
+				if(cloudMaxDepth_ <= 0.0 || (end - origin).norm() <= cloudMaxDepth_)
+				{
+					octomap::OcTreeKey key;
+					if(octree->coordToKeyChecked(end, key))
+					{
+						output.occupiedCells.insert(key);
+					}
+				}
+				else
+				{
+					clippedEnds.push_back(origin + (end - origin).normalized() * cloudMaxDepth_);
+				}
+			}
+		}
+		for(octomap::KeySet::iterator it = output.occupiedCells.begin(); it != output.occupiedCells.end(); ++it)
+		{
+			if(octree->computeRayKeys(origin, octree->keyToCoord(*it), ray))
+			{
+				output.freeCells.insert(ray.begin(), ray.end());
+			}
+		}
+		for(unsigned int j=0; j<clippedEnds.size(); ++j)
+		{
+			if(octree->computeRayKeys(origin, clippedEnds[j], ray))
+			{
+				output.freeCells.insert(ray.begin(), ray.end());
+			}
+		}
+
+		// occupied cells have priority over free cells
+		for(octomap::KeySet::iterator it = output.occupiedCells.begin(); it != output.occupiedCells.end(); ++it)
+		{
+			output.freeCells.erase(*it);
+		}
+	}
+}
+
+void MapsManager::insertOctomapScans(octomap::OcTree & octree, const std::vector<OctomapScan> & scans) const
+{
+	// by batches to limit the memory used by the key sets
+	unsigned int batchSize = mapCacheBatchSize_ > 0?mapCacheBatchSize_:scans.size();
+	std::vector<OctomapScanKeys> keys(scans.size());
+	for(unsigned int first=0; first<scans.size(); first+=batchSize)
+	{
+		unsigned int last = first+batchSize < scans.size()?first+batchSize:scans.size();
+		if(mapCacheThreads_ > 1 && last-first > 1)
+		{
+			boost::thread_group workers;
+			int threads = mapCacheThreads_ < int(last-first)?mapCacheThreads_:int(last-first);
+			for(int t=0; t<threads; ++t)
+			{
+				workers.create_thread(boost::bind(&MapsManager::computeOctomapKeysWorker, this, &octree, &scans, &keys, first+t, last, threads));
+			}
+			workers.join_all();
+		}
+		else
+		{
+			computeOctomapKeysWorker(&octree, &scans, &keys, first, last, 1);
+		}
+
+		// update in node ID order, like insertPointCloud() would have done
+		for(unsigned int i=first; i<last; ++i)
+		{
+			for(octomap::KeySet::iterator it = keys[i].freeCells.begin(); it != keys[i].freeCells.end(); ++it)
+			{
+				octree.updateNode(*it, false, true);
+			}
+			for(octomap::KeySet::iterator it = keys[i].occupiedCells.begin(); it != keys[i].occupiedCells.end(); ++it)
+			{
+				octree.updateNode(*it, true, true);
+			}
+			UDEBUG("inserted %d free=%d occupied=%d", scans[i].id, (int)keys[i].freeCells.size(), (int)keys[i].occupiedCells.size());
+			keys[i] = OctomapScanKeys();
+		}
+	}
+	octree.updateInnerOccupancy();
+}
+
+void MapsManager::rebuildOctomap(const std::vector<OctomapScan> & scans, const std::map<int, Transform> & poses)
+{
+	UTimer time;
+	octomap::OcTree * octree = new octomap::OcTree(gridCellSize_);
+	insertOctomapScans(*octree, scans);
+
+	boost::mutex::scoped_lock lock(octomapRebuildMutex_);
+	delete rebuiltOctree_;
+	rebuiltOctree_ = octree;
+	rebuiltOctomapPoses_ = poses;
+	ROS_INFO("Octomap rebuilt in background with %d nodes (%fs)", (int)scans.size(), time.ticks());
+}
+
+void MapsManager::updateOctomap(const std::map<int, Transform> & poses)
+{
+	UTimer time;
+	if(octomapRebuildThread_)
+	{
+		octomap::OcTree * rebuilt = 0;
+		std::map<int, Transform> rebuiltPoses;
+		{
+			boost::mutex::scoped_lock lock(octomapRebuildMutex_);
+			rebuilt = rebuiltOctree_;
+			rebuiltOctree_ = 0;
+			rebuiltPoses.swap(rebuiltOctomapPoses_);
+		}
+		if(rebuilt == 0)
+		{
+			ROS_INFO("Octomap is being rebuilt, the last consistent octomap is used");
+			return;
+		}
+		octomapRebuildThread_->join();
+		delete octomapRebuildThread_;
+		octomapRebuildThread_ = 0;
+
+		delete octree_;
+		octree_ = rebuilt;
+		octomapPoses_.clear();
+		octomapPoses_.update(rebuiltPoses);
+	}
+
+	std::map<int, Transform> posesWithClouds;
+	for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(hasCloud(iter->first))
+		{
+			posesWithClouds.insert(*iter);
+		}
+	}
+	octomapPoses_.update(posesWithClouds);
+
+	// Octomap cannot remove a scan, the whole tree is rebuilt if the graph changed
+	if(octree_ && (octomapPoses_.removed().size() || octomapPoses_.moved().size()))
+	{
+		ROS_INFO("Graph changed (moved=%d, removed=%d), rebuilding octomap...",
+				(int)octomapPoses_.moved().size(), (int)octomapPoses_.removed().size());
+		if(octomapBackgroundRebuild_)
+		{
+			std::vector<OctomapScan> scans;
+			scans.reserve(posesWithClouds.size());
+			for(std::map<int, Transform>::iterator iter = posesWithClouds.begin(); iter!=posesWithClouds.end(); ++iter)
+			{
+				scans.push_back(OctomapScan(iter->first, iter->second, getCloud(iter->first)));
+			}
+			// nodes added in the meantime are inserted after the rebuilt tree is swapped
+			octomapRebuildThread_ = new boost::thread(boost::bind(&MapsManager::rebuildOctomap, this, scans, posesWithClouds));
+			return;
+		}
+		delete octree_;
+		octree_ = 0;
+		octomapPoses_.clear();
+		octomapPoses_.update(posesWithClouds);
+	}
+
+	if(octree_ == 0)
+	{
+		octree_ = new octomap::OcTree(gridCellSize_);
+	}
+	if(octomapPoses_.added().size())
+	{
+		std::vector<OctomapScan> scans;
+		scans.reserve(octomapPoses_.added().size());
+		for(std::set<int>::const_iterator iter = octomapPoses_.added().begin(); iter!=octomapPoses_.added().end(); ++iter)
+		{
+			scans.push_back(OctomapScan(*iter, octomapPoses_.poses().at(*iter), getCloud(*iter)));
+		}
+		insertOctomapScans(*octree_, scans);
+		ROS_INFO("Octomap updated with %d new nodes (%d total, %fs)",
+				(int)scans.size(), (int)octomapPoses_.poses().size(), time.ticks());
+	}
+}
+
+void MapsManager::clearOctomap()
+{
+	if(octomapRebuildThread_)
+	{
+		octomapRebuildThread_->join();
+		delete octomapRebuildThread_;
+		octomapRebuildThread_ = 0;
+	}
+	delete rebuiltOctree_;
+	rebuiltOctree_ = 0;
+	rebuiltOctomapPoses_.clear();
+	delete octree_;
+	octree_ = 0;
+	octomapPoses_.clear();
+}
 #endif
 
@@ -13,6 +13,21 @@
 #include <pcl/point_types.h>
 #include <ros/time.h>
 #include <ros/publisher.h>
+#include <ros/single_subscriber_publisher.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <ros/node_handle.h>
+#include <rtabmap_ros/VoxelHash.h>
+#include <rtabmap_ros/IncrementalGrid.h>
+#include <rtabmap_ros/TiledGrid.h>
+#include <rtabmap_ros/MapTiles.h>
+#include <rtabmap_ros/PosesDiff.h>
+#include <rtabmap_ros/PoseIndex.h>
+#include <rtabmap_ros/CompactCloud.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/function.hpp>
+#include <set>
+#include <list>
 
 namespace octomap{
 class OcTree;
@@ -26,13 +41,40 @@ class Memory;
 
 class MapsManager {
 public:
-	MapsManager();
+	struct CacheStatistics
+	{
+		CacheStatistics() :
+			bytes(0),
+			assemblyBytes(0),
+			nodes(0),
+			hits(0),
+			misses(0),
+			evictions(0)
+		{}
+		size_t bytes; // all the structures below
+		size_t assemblyBytes; // assembled map, grids, octree and disparities, not evicted
+		int nodes;
+		unsigned long hits; // cached nodes requested
+		unsigned long misses; // nodes added to the caches
+		unsigned long evictions; // nodes removed to respect map_cache_max_size
+	};
+
+public:
+	MapsManager(ros::NodeHandle nh = ros::NodeHandle(), ros::NodeHandle pnh = ros::NodeHandle("~"));
 	virtual ~MapsManager();
 	void clear();
 
 	std::map<int, rtabmap::Transform> getFilteredPoses(
 			const std::map<int, rtabmap::Transform> & poses);
 
+	// IDs of the nodes that updateMapCaches() would add to the caches with the same arguments
+	std::set<int> getUncachedNodes(
+			const std::map<int, rtabmap::Transform> & poses,
+			bool updateCloud,
+			bool updateProj,
+			bool updateGrid);
+
+	// Data of nodes not found in "signatures" are taken from "memory" (if not null)
 	std::map<int, rtabmap::Transform> updateMapCaches(
 			const std::map<int, rtabmap::Transform> & poses,
 			const rtabmap::Memory * memory,
@@ -60,25 +102,224 @@ public:
 
 	void setLaserScanParameters(float maxRange, float minAngle, float maxAngle, float increment);
 
+	// Thread-safe
+	CacheStatistics getCacheStatistics() const;
+	int getCacheBatchSize() const {return mapCacheBatchSize_;}
+
+	// The local maps caches are saved in "map_cache_path" so they don't have
+	// to be created again from the database when the node is restarted. Ignored
+	// if "map_cache_path" is empty. The file is ignored if it was saved with
+	// another database (path, last node ID and number of nodes of "memory").
+	bool loadMapCaches(const rtabmap::Memory * memory, const std::string & databasePath);
+	bool saveMapCaches(const rtabmap::Memory * memory, const std::string & databasePath) const;
+	void removeMapCachesFile() const;
+
+	// Streams the clouds of the nodes (transformed by their pose) to a PLY or
+	// PCD file, "batchSize" nodes at a time, so the memory used doesn't
+	// depend on the size of the map. The caches are not used nor updated.
+	// "getData" is called on this thread for each batch and must return the
+	// data of the nodes (the memory is not thread-safe).
+	bool exportCloud(
+			const std::string & path,
+			const std::map<int, rtabmap::Transform> & poses,
+			const boost::function<std::map<int, rtabmap::Signature> (const std::vector<int> &)> & getData,
+			int batchSize,
+			bool binary,
+			size_t & points,
+			std::string & error) const;
+
 #ifdef WITH_OCTOMAP
+	// Returned OcTree must be deleted. With octomap_incremental, it is a copy
+	// of the persistent octree, which may be older than "poses" while it is
+	// rebuilt in background.
 	octomap::OcTree * createOctomap(const std::map<int, rtabmap::Transform> & poses);
 #endif
 
+private:
+	struct LocalMapsRequest
+	{
+		LocalMapsRequest() :
+			id(0),
+			rgbDepthRequired(false),
+			depthRequired(false),
+			scanRequired(false),
+			data(0),
+			projCreated(false),
+			gridCreated(false),
+			disparityCreated(false)
+		{}
+		int id;
+		bool rgbDepthRequired;
+		bool depthRequired;
+		bool scanRequired;
+		const rtabmap::Signature * data; // not copied if already in memory, otherwise points to "loaded"
+		rtabmap::Signature loaded; // data loaded from the database
+		cv::Mat disparity; // stereo disparity, from the cache or computed (disparityCreated)
+
+		// outputs
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+		bool projCreated;
+		std::pair<cv::Mat, cv::Mat> projMap; // <ground, obstacles>
+		bool gridCreated;
+		std::pair<cv::Mat, cv::Mat> gridMap; // <ground, obstacles>
+		bool disparityCreated;
+	};
+	void resolveUpdateFlags(bool & updateCloud, bool & updateProj, bool & updateGrid) const;
+	std::map<int, rtabmap::Transform> filterPoses(const std::map<int, rtabmap::Transform> & poses);
+	void createLocalMaps(LocalMapsRequest & request) const;
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembleCloudIncremental(
+			const std::map<int, rtabmap::Transform> & poses,
+			int & count);
+	void createLocalMapsWorker(std::vector<LocalMapsRequest> * requests, unsigned int first, unsigned int last, int step) const;
+	bool hasCloud(int id) const;
+	pcl::PointCloud<pcl::PointXYZRGB>::Ptr getCloud(int id, const rtabmap::Transform & transform = rtabmap::Transform()) const;
+	size_t cachedBytes(int id) const;
+	size_t assemblyBytes() const;
+	void updateCacheUsage(const std::map<int, rtabmap::Transform> & usedPoses, int hits, int misses);
+	void removeFromCaches(int id);
+	void cacheDisparity(int id, const cv::Mat & disparity);
+	void removeDisparity(int id);
+
+	struct OctomapScan
+	{
+		OctomapScan() : id(0) {}
+		OctomapScan(int id, const rtabmap::Transform & pose, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud) :
+			id(id),
+			pose(pose),
+			cloud(cloud)
+		{}
+		int id;
+		rtabmap::Transform pose;
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud; // in node frame
+	};
+	struct OctomapScanKeys;
+#ifdef WITH_OCTOMAP
+	void updateOctomap(const std::map<int, rtabmap::Transform> & poses);
+	void insertOctomapScans(octomap::OcTree & octree, const std::vector<OctomapScan> & scans) const;
+	void computeOctomapKeysWorker(
+			const octomap::OcTree * octree,
+			const std::vector<OctomapScan> * scans,
+			std::vector<OctomapScanKeys> * keys,
+			unsigned int first,
+			unsigned int last,
+			int step) const;
+	void rebuildOctomap(const std::vector<OctomapScan> & scans, const std::map<int, rtabmap::Transform> & poses);
+	void clearOctomap();
+#endif
+
+	struct IncrementalMap
+	{
+		IncrementalMap() :
+			resized(false)
+		{}
+		void clear()
+		{
+			grid.clear();
+			dirty = cv::Rect();
+			resized = false;
+			filled = cv::Rect();
+			boost::mutex::scoped_lock lock(publishedMutex);
+			published = nav_msgs::OccupancyGrid();
+		}
+		rtabmap_ros::IncrementalGrid grid;
+		cv::Rect dirty; // cells modified since the last time the map was published
+		bool resized; // the map has been resized since the last time it was published
+		cv::Rect filled; // unknown space filled around the last pose
+		nav_msgs::OccupancyGrid published; // full map with the updates published, empty if never published
+		boost::mutex publishedMutex; // published is sent to new subscribers from the ROS callback threads
+	};
+	cv::Mat updateIncrementalMap(
+			IncrementalMap & map,
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+			float & xMin,
+			float & yMin);
+	cv::Rect fillUnknownSpace(
+			cv::Mat & map,
+			const std::map<int, rtabmap::Transform> & poses,
+			float xMin,
+			float yMin) const;
+	bool publishIncrementalMap(
+			IncrementalMap & map,
+			ros::Publisher & updatesPub,
+			const cv::Mat & pixels,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	void publishFullMap(
+			IncrementalMap & map,
+			ros::Publisher & mapPub,
+			const cv::Mat & pixels,
+			float xMin,
+			float yMin,
+			float gridCellSize,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	void incrementalMapConnectCallback(const ros::SingleSubscriberPublisher & pub, IncrementalMap * map);
+
+	struct TiledMap
+	{
+		TiledMap() :
+			published(false)
+		{}
+		void clear()
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			grid.clear();
+			published = false;
+		}
+		rtabmap_ros::TiledGrid grid;
+		bool published; // all the tiles have been published once
+		ros::Time stamp; // of the last tiles published
+		std::string frameId;
+		boost::mutex mutex; // all the tiles are sent to new subscribers from the ROS callback threads
+	};
+	void publishTiledMap(
+			TiledMap & map,
+			ros::Publisher & tilesPub,
+			const std::map<int, rtabmap::Transform> & poses,
+			const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+			const ros::Time & stamp,
+			const std::string & mapFrameId);
+	rtabmap_ros::MapTilesPtr tilesMessage(
+			const TiledMap & map,
+			const std::vector<rtabmap_ros::TiledGrid::TileKey> & tiles,
+			const std::vector<rtabmap_ros::TiledGrid::TileKey> & removed,
+			bool full) const;
+	void tiledMapConnectCallback(const ros::SingleSubscriberPublisher & pub, TiledMap * map);
+
 private:
 	// mapping stuff
 	int cloudDecimation_;
 	double cloudMaxDepth_;
 	double cloudVoxelSize_;
 	bool cloudOutputVoxelized_;
+	bool cloudIncrementalAssembly_;
+	bool cloudCompactStorage_;
 	double projMaxGroundAngle_;
 	int projMinClusterSize_;
 	double projMaxHeight_;
 	double gridCellSize_;
 	double gridSize_;
 	bool gridEroded_;
+	bool gridIncremental_;
+	bool gridTiled_;
+	int gridTileCells_;
+	int gridTileLevels_;
+	double gridTileFullResRadius_; // m
+	double mapIncrementalLinearUpdate_;
+	double mapIncrementalAngularUpdate_;
 	double mapFilterRadius_;
 	double mapFilterAngle_;
+	double mapLocalRadius_; // m, 0=whole map
 	bool mapCacheCleanup_;
+	int mapCacheThreads_;
+	int mapCacheBatchSize_;
+	int mapCacheDisparities_;
+	double mapCacheMaxSize_; // MB
+	bool octomapIncremental_;
+	bool octomapBackgroundRebuild_;
+	std::string mapCachePath_;
+	bool mapCachePersistClouds_;
 
 	float laserScanMaxRange_;
 	float laserScanMinAngle_;
@@ -88,10 +329,43 @@ private:
 	ros::Publisher cloudMapPub_;
 	ros::Publisher projMapPub_;
 	ros::Publisher gridMapPub_;
+	ros::Publisher projMapUpdatesPub_;
+	ros::Publisher gridMapUpdatesPub_;
+	ros::Publisher projTilesPub_;
+	ros::Publisher gridTilesPub_;
 
 	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > clouds_;
+	std::map<int, rtabmap_ros::CompactCloud> compactClouds_; // used instead of clouds_ with cloud_compact_storage
 	std::map<int, std::pair<cv::Mat, cv::Mat> > projMaps_; // <ground, obstacles>
 	std::map<int, std::pair<cv::Mat, cv::Mat> > gridMaps_; // <ground, obstacles>
+	std::map<int, cv::Mat> disparities_; // stereo nodes without both their cloud and projection map cached
+	std::list<int> disparitiesOrder_; // oldest first
+
+	// LRU accounting of the caches above, by node
+	std::list<int> cacheLru_; // least recently used first
+	std::map<int, std::pair<std::list<int>::iterator, size_t> > cacheEntries_; // <LRU position, bytes>
+	CacheStatistics cacheStats_;
+	mutable boost::mutex cacheStatsMutex_;
+
+	// radius filtering and local maps
+	rtabmap_ros::PoseIndex poseIndex_;
+
+	// incremental assembly
+	rtabmap_ros::PosesDiff assembledPoses_;
+	std::map<int, rtabmap_ros::CompactCloud> assembledClouds_; // in map frame, compact
+	rtabmap_ros::VoxelHash<pcl::PointXYZRGB> assembledVoxels_;
+	IncrementalMap incrementalProjMap_;
+	IncrementalMap incrementalGridMap_;
+	TiledMap tiledProjMap_;
+	TiledMap tiledGridMap_;
+
+	// incremental octomap
+	octomap::OcTree * octree_; // contains the reference poses of octomapPoses_
+	rtabmap_ros::PosesDiff octomapPoses_;
+	boost::thread * octomapRebuildThread_;
+	octomap::OcTree * rebuiltOctree_; // set by the rebuild thread when done
+	std::map<int, rtabmap::Transform> rebuiltOctomapPoses_;
+	boost::mutex octomapRebuildMutex_;
 };
 
 #endif /* MAPSMANAGER_H_ */
@@ -35,9 +35,84 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <pcl_conversions/pcl_conversions.h>
 #include <eigen_conversions/eigen_msg.h>
 #include <tf_conversions/tf_eigen.h>
+#include <boost/thread/mutex.hpp>
+#include <cstring>
 
 namespace rtabmap_ros {
 
+#if CV_MAJOR_VERSION < 3
+// Releases the ROS message when the last cv::Mat referencing its data is released
+class SharedImageAllocator : public cv::MatAllocator
+{
+public:
+	virtual ~SharedImageAllocator() {}
+
+	void share(cv::Mat & mat, const cv_bridge::CvImageConstPtr & image)
+	{
+		mat.refcount = new int(1);
+		mat.allocator = this;
+		boost::mutex::scoped_lock lock(mutex_);
+		images_.insert(std::make_pair(mat.refcount, image));
+	}
+
+	// Called only if the cv::Mat is re-created, same as the default allocator
+	virtual void allocate(int dims, const int* sizes, int type, int*& refcount,
+						  uchar*& datastart, uchar*& data, size_t* step)
+	{
+		size_t total = CV_ELEM_SIZE(type);
+		for(int i=dims-1; i>=0; --i)
+		{
+			if(step)
+			{
+				step[i] = total;
+			}
+			total *= sizes[i];
+		}
+		uchar * ptr = (uchar*)cv::fastMalloc(total + sizeof(*refcount));
+		refcount = (int*)(ptr + total);
+		*refcount = 1;
+		datastart = data = ptr;
+	}
+
+	virtual void deallocate(int* refcount, uchar* datastart, uchar*)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::map<int*, cv_bridge::CvImageConstPtr>::iterator iter = images_.find(refcount);
+		if(iter != images_.end())
+		{
+			images_.erase(iter);
+			delete refcount;
+		}
+		else
+		{
+			cv::fastFree(datastart);
+		}
+	}
+
+private:
+	boost::mutex mutex_;
+	std::map<int*, cv_bridge::CvImageConstPtr> images_;
+};
+#endif
+
+cv::Mat sharedImageFromROS(const cv_bridge::CvImageConstPtr & image)
+{
+	UASSERT(image.get());
+#if CV_MAJOR_VERSION < 3
+	if(image->image.empty() || image->image.refcount)
+	{
+		// data already owned by the cv::Mat (e.g., after a color conversion)
+		return image->image;
+	}
+	static SharedImageAllocator allocator;
+	cv::Mat mat = image->image; // header only
+	allocator.share(mat, image);
+	return mat;
+#else
+	return image->image.u?image->image:image->image.clone();
+#endif
+}
+
 void transformToTF(const rtabmap::Transform & transform, tf::Transform & tfTransform)
 {
 	if(!transform.isNull())
@@ -241,12 +316,35 @@ void keypointToROS(const cv::KeyPoint & kpt, rtabmap_ros::KeyPoint & msg)
 	msg.size = kpt.size;
 }
 
+// rtabmap_ros::KeyPoint declares the same fields in the same order as
+// cv::KeyPoint (and rtabmap_ros::Point2f as cv::Point2f), so arrays can be
+// copied in one block when the compiler didn't add different padding.
+static bool keypointLayoutMatches()
+{
+	return sizeof(rtabmap_ros::KeyPoint) == sizeof(cv::KeyPoint) &&
+		   sizeof(rtabmap_ros::Point2f) == sizeof(cv::Point2f) &&
+		   sizeof(cv::KeyPoint) == 5*sizeof(float) + 2*sizeof(int);
+}
+
+static bool point2fLayoutMatches()
+{
+	return sizeof(rtabmap_ros::Point2f) == sizeof(cv::Point2f) &&
+		   sizeof(cv::Point2f) == 2*sizeof(float);
+}
+
 std::vector<cv::KeyPoint> keypointsFromROS(const std::vector<rtabmap_ros::KeyPoint> & msg)
 {
 	std::vector<cv::KeyPoint> v(msg.size());
-	for(unsigned int i=0; i<msg.size(); ++i)
+	if(msg.size() && keypointLayoutMatches())
 	{
-		v[i] = keypointFromROS(msg[i]);
+		memcpy(&v[0], &msg[0], msg.size()*sizeof(cv::KeyPoint));
+	}
+	else
+	{
+		for(unsigned int i=0; i<msg.size(); ++i)
+		{
+			v[i] = keypointFromROS(msg[i]);
+		}
 	}
 	return v;
 }
@@ -254,9 +352,16 @@ std::vector<cv::KeyPoint> keypointsFromROS(const std::vector<rtabmap_ros::KeyPoi
 void keypointsToROS(const std::vector<cv::KeyPoint> & kpts, std::vector<rtabmap_ros::KeyPoint> & msg)
 {
 	msg.resize(kpts.size());
-	for(unsigned int i=0; i<msg.size(); ++i)
+	if(kpts.size() && keypointLayoutMatches())
+	{
+		memcpy(&msg[0], &kpts[0], kpts.size()*sizeof(cv::KeyPoint));
+	}
+	else
 	{
-		keypointToROS(kpts[i], msg[i]);
+		for(unsigned int i=0; i<msg.size(); ++i)
+		{
+			keypointToROS(kpts[i], msg[i]);
+		}
 	}
 }
 
@@ -274,9 +379,16 @@ void point2fToROS(const cv::Point2f & kpt, rtabmap_ros::Point2f & msg)
 std::vector<cv::Point2f> points2fFromROS(const std::vector<rtabmap_ros::Point2f> & msg)
 {
 	std::vector<cv::Point2f> v(msg.size());
-	for(unsigned int i=0; i<msg.size(); ++i)
+	if(msg.size() && point2fLayoutMatches())
 	{
-		v[i] = point2fFromROS(msg[i]);
+		memcpy(&v[0], &msg[0], msg.size()*sizeof(cv::Point2f));
+	}
+	else
+	{
+		for(unsigned int i=0; i<msg.size(); ++i)
+		{
+			v[i] = point2fFromROS(msg[i]);
+		}
 	}
 	return v;
 }
@@ -284,12 +396,393 @@ std::vector<cv::Point2f> points2fFromROS(const std::vector<rtabmap_ros::Point2f>
 void points2fToROS(const std::vector<cv::Point2f> & kpts, std::vector<rtabmap_ros::Point2f> & msg)
 {
 	msg.resize(kpts.size());
-	for(unsigned int i=0; i<msg.size(); ++i)
+	if(kpts.size() && point2fLayoutMatches())
+	{
+		memcpy(&msg[0], &kpts[0], kpts.size()*sizeof(cv::Point2f));
+	}
+	else
+	{
+		for(unsigned int i=0; i<msg.size(); ++i)
+		{
+			point2fToROS(kpts[i], msg[i]);
+		}
+	}
+}
+
+//
+// Packed graph encoding (Graph::packed), version 1:
+//   uint8 version
+//   varint nodes, then columns of: zigzag id deltas, zigzag map id deltas,
+//   float64 stamps, 7 x float32 poses (x y z qx qy qz qw, all 0 if null),
+//   labels and user data (varint size + bytes)
+//   varint links, then columns of: zigzag from id deltas, zigzag (to - from),
+//   uint8 types, float32 rotVariance, float32 transVariance, 7 x float32 transforms
+//
+static const unsigned char kPackedGraphVersion = 1;
+
+static void packVarint(std::vector<unsigned char> & out, unsigned int value)
+{
+	while(value >= 0x80)
+	{
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+static void packSignedVarint(std::vector<unsigned char> & out, int value)
+{
+	packVarint(out, ((unsigned int)value << 1) ^ (unsigned int)(value >> 31));
+}
+
+static void packBytes(std::vector<unsigned char> & out, const void * data, unsigned int size)
+{
+	if(size)
+	{
+		const unsigned char * bytes = (const unsigned char *)data;
+		out.insert(out.end(), bytes, bytes + size);
+	}
+}
+
+static void packTransform(std::vector<unsigned char> & out, const rtabmap::Transform & transform)
+{
+	float values[7] = {0,0,0,0,0,0,0};
+	if(!transform.isNull())
+	{
+		Eigen::Affine3d t = transform.toEigen3d();
+		Eigen::Quaterniond q(t.rotation());
+		values[0] = (float)t.translation().x();
+		values[1] = (float)t.translation().y();
+		values[2] = (float)t.translation().z();
+		values[3] = (float)q.x();
+		values[4] = (float)q.y();
+		values[5] = (float)q.z();
+		values[6] = (float)q.w();
+	}
+	packBytes(out, values, sizeof(values));
+}
+
+class PackedGraphReader
+{
+public:
+	PackedGraphReader(const unsigned char * data, unsigned int size) :
+		data_(data),
+		size_(size),
+		pos_(0),
+		ok_(true)
+	{}
+
+	bool ok() const {return ok_;}
+	bool atEnd() const {return pos_ == size_;}
+
+	unsigned int varint()
+	{
+		unsigned int value = 0;
+		for(int shift=0; shift<35; shift+=7)
+		{
+			if(pos_ >= size_)
+			{
+				ok_ = false;
+				return 0;
+			}
+			unsigned char byte = data_[pos_++];
+			value |= (unsigned int)(byte & 0x7F) << shift;
+			if((byte & 0x80) == 0)
+			{
+				return value;
+			}
+		}
+		ok_ = false;
+		return 0;
+	}
+
+	int signedVarint()
+	{
+		unsigned int value = varint();
+		return (int)(value >> 1) ^ -(int)(value & 1);
+	}
+
+	bool bytes(void * data, unsigned int size)
+	{
+		if(!ok_ || size > size_ - pos_)
+		{
+			ok_ = false;
+			return false;
+		}
+		if(size)
+		{
+			memcpy(data, data_ + pos_, size);
+			pos_ += size;
+		}
+		return true;
+	}
+
+	rtabmap::Transform transform()
+	{
+		float v[7];
+		if(!bytes(v, sizeof(v)) || (v[3] == 0 && v[4] == 0 && v[5] == 0 && v[6] == 0))
+		{
+			return rtabmap::Transform();
+		}
+		Eigen::Quaterniond q(v[6], v[3], v[4], v[5]);
+		q.normalize();
+		Eigen::Affine3d t = Eigen::Translation3d(v[0], v[1], v[2]) * q;
+		return rtabmap::Transform::fromEigen3d(t);
+	}
+
+private:
+	const unsigned char * data_;
+	unsigned int size_;
+	unsigned int pos_;
+	bool ok_;
+};
+
+// Column of the graph read in the order of the pose IDs: values of IDs not
+// in the poses are skipped, missing values are replaced by "defaultValue".
+template<typename V>
+class GraphColumn
+{
+public:
+	GraphColumn(const std::map<int, V> & column, const V & defaultValue) :
+		column_(column),
+		iter_(column.begin()),
+		default_(defaultValue)
+	{}
+
+	// "id" must be greater than the previous one
+	const V & value(int id)
+	{
+		while(iter_ != column_.end() && iter_->first < id)
+		{
+			++iter_;
+		}
+		return iter_ != column_.end() && iter_->first == id?iter_->second:default_;
+	}
+
+private:
+	const std::map<int, V> & column_;
+	typename std::map<int, V>::const_iterator iter_;
+	V default_;
+};
+
+static void packGraph(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, int> & mapIds,
+		const std::map<int, double> & stamps,
+		const std::map<int, std::string> & labels,
+		const std::map<int, std::vector<unsigned char> > & userDatas,
+		const std::multimap<int, rtabmap::Link> & links,
+		bool compressed,
+		rtabmap_ros::Graph & msg)
+{
+	std::vector<unsigned char> & out = msg.packed;
+	out.clear();
+	// empty labels and user data take one byte each
+	out.reserve(8 + poses.size()*(4+1+8+7*sizeof(float)+2) + links.size()*(4+2+1+9*sizeof(float)));
+
+	out.push_back(kPackedGraphVersion);
+	packVarint(out, (unsigned int)poses.size());
+	int previous = 0;
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		packSignedVarint(out, iter->first - previous);
+		previous = iter->first;
+	}
+	// the columns are written for each pose, so the unpacked graph is consistent
+	previous = 0;
+	GraphColumn<int> mapIdsColumn(mapIds, -1);
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		int mapId = mapIdsColumn.value(iter->first);
+		packSignedVarint(out, mapId - previous);
+		previous = mapId;
+	}
+	GraphColumn<double> stampsColumn(stamps, 0.0);
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		packBytes(out, &stampsColumn.value(iter->first), sizeof(double));
+	}
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		packTransform(out, iter->second);
+	}
+	GraphColumn<std::string> labelsColumn(labels, std::string());
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		const std::string & label = labelsColumn.value(iter->first);
+		packVarint(out, (unsigned int)label.size());
+		packBytes(out, label.data(), (unsigned int)label.size());
+	}
+	GraphColumn<std::vector<unsigned char> > userDatasColumn(userDatas, std::vector<unsigned char>());
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		const std::vector<unsigned char> & userData = userDatasColumn.value(iter->first);
+		packVarint(out, (unsigned int)userData.size());
+		packBytes(out, userData.data(), (unsigned int)userData.size());
+	}
+
+	packVarint(out, (unsigned int)links.size());
+	previous = 0;
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		packSignedVarint(out, iter->second.from() - previous);
+		previous = iter->second.from();
+	}
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
 	{
-		point2fToROS(kpts[i], msg[i]);
+		packSignedVarint(out, iter->second.to() - iter->second.from());
+	}
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		out.push_back((unsigned char)iter->second.type());
+	}
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		float variance = iter->second.rotVariance();
+		packBytes(out, &variance, sizeof(float));
+	}
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		float variance = iter->second.transVariance();
+		packBytes(out, &variance, sizeof(float));
+	}
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		packTransform(out, iter->second.transform());
+	}
+
+	msg.packedSize = 0;
+	if(compressed)
+	{
+		uLongf compressedSize = compressBound(out.size());
+		std::vector<unsigned char> compressedBytes(compressedSize);
+		if(compress2(compressedBytes.data(), &compressedSize, out.data(), out.size(), Z_BEST_SPEED) == Z_OK &&
+		   compressedSize < out.size())
+		{
+			msg.packedSize = out.size();
+			compressedBytes.resize(compressedSize);
+			out.swap(compressedBytes);
+		}
 	}
 }
 
+static bool unpackGraph(
+		const rtabmap_ros::Graph & msg,
+		std::map<int, rtabmap::Transform> & poses,
+		std::map<int, int> & mapIds,
+		std::map<int, double> & stamps,
+		std::map<int, std::string> & labels,
+		std::map<int, std::vector<unsigned char> > & userDatas,
+		std::multimap<int, rtabmap::Link> & links)
+{
+	std::vector<unsigned char> uncompressed;
+	const unsigned char * data = msg.packed.data();
+	unsigned int size = msg.packed.size();
+	if(msg.packedSize)
+	{
+		uLongf uncompressedSize = msg.packedSize;
+		uncompressed.resize(uncompressedSize);
+		if(uncompress(uncompressed.data(), &uncompressedSize, msg.packed.data(), msg.packed.size()) != Z_OK ||
+		   uncompressedSize != msg.packedSize)
+		{
+			return false;
+		}
+		data = uncompressed.data();
+		size = uncompressed.size();
+	}
+
+	PackedGraphReader reader(data, size);
+	unsigned char version = 0;
+	if(!reader.bytes(&version, 1) || version != kPackedGraphVersion)
+	{
+		return false;
+	}
+
+	unsigned int nodes = reader.varint();
+	if(!reader.ok() || nodes > size)
+	{
+		return false;
+	}
+	std::vector<int> ids(nodes);
+	int previous = 0;
+	for(unsigned int i=0; i<nodes; ++i)
+	{
+		previous += reader.signedVarint();
+		ids[i] = previous;
+	}
+	previous = 0;
+	for(unsigned int i=0; i<nodes; ++i)
+	{
+		previous += reader.signedVarint();
+		mapIds.insert(mapIds.end(), std::make_pair(ids[i], previous));
+	}
+	for(unsigned int i=0; i<nodes; ++i)
+	{
+		double stamp = 0.0;
+		reader.bytes(&stamp, sizeof(double));
+		stamps.insert(stamps.end(), std::make_pair(ids[i], stamp));
+	}
+	for(unsigned int i=0; i<nodes; ++i)
+	{
+		poses.insert(poses.end(), std::make_pair(ids[i], reader.transform()));
+	}
+	for(unsigned int i=0; i<nodes && reader.ok(); ++i)
+	{
+		std::map<int, std::string>::iterator iter = labels.insert(labels.end(), std::make_pair(ids[i], std::string()));
+		unsigned int length = reader.varint();
+		if(length > size)
+		{
+			return false;
+		}
+		iter->second.resize(length);
+		reader.bytes(length?&iter->second[0]:0, length);
+	}
+	for(unsigned int i=0; i<nodes && reader.ok(); ++i)
+	{
+		std::map<int, std::vector<unsigned char> >::iterator iter = userDatas.insert(userDatas.end(), std::make_pair(ids[i], std::vector<unsigned char>()));
+		unsigned int length = reader.varint();
+		if(length > size)
+		{
+			return false;
+		}
+		iter->second.resize(length);
+		reader.bytes(length?&iter->second[0]:0, length);
+	}
+
+	unsigned int linksCount = reader.varint();
+	if(!reader.ok() || linksCount > size)
+	{
+		return false;
+	}
+	std::vector<int> from(linksCount);
+	std::vector<int> to(linksCount);
+	std::vector<unsigned char> types(linksCount);
+	std::vector<float> rotVariances(linksCount);
+	std::vector<float> transVariances(linksCount);
+	previous = 0;
+	for(unsigned int i=0; i<linksCount; ++i)
+	{
+		previous += reader.signedVarint();
+		from[i] = previous;
+	}
+	for(unsigned int i=0; i<linksCount; ++i)
+	{
+		to[i] = from[i] + reader.signedVarint();
+	}
+	if(linksCount)
+	{
+		reader.bytes(&types[0], linksCount);
+		reader.bytes(&rotVariances[0], linksCount*sizeof(float));
+		reader.bytes(&transVariances[0], linksCount*sizeof(float));
+	}
+	for(unsigned int i=0; i<linksCount && reader.ok(); ++i)
+	{
+		links.insert(links.end(), std::make_pair(from[i],
+				rtabmap::Link(from[i], to[i], (rtabmap::Link::Type)types[i], reader.transform(), rotVariances[i], transVariances[i])));
+	}
+	return reader.ok() && reader.atEnd();
+}
+
 void mapGraphFromROS(
 		const rtabmap_ros::Graph & msg,
 		std::map<int, rtabmap::Transform> & poses,
@@ -302,25 +795,46 @@ void mapGraphFromROS(
 {
 	mapToOdom = transformFromGeometryMsg(msg.mapToOdom);
 
+	if(msg.packed.size())
+	{
+		if(!unpackGraph(msg, poses, mapIds, stamps, labels, userDatas, links))
+		{
+			ROS_ERROR("Failed to unpack graph (%d bytes)!", (int)msg.packed.size());
+			// nothing partially unpacked
+			poses.clear();
+			mapIds.clear();
+			stamps.clear();
+			labels.clear();
+			userDatas.clear();
+			links.clear();
+		}
+		return;
+	}
+
 	UASSERT(msg.nodeIds.size() == msg.mapIds.size());
 	UASSERT(msg.nodeIds.size() == msg.poses.size());
 	UASSERT(msg.nodeIds.size() == msg.stamps.size());
 	UASSERT(msg.nodeIds.size() == msg.labels.size());
 	UASSERT(msg.nodeIds.size() == msg.userDatas.size());
 
+	// Ids are sorted when the message comes from mapGraphToROS(), so
+	// inserting with the end() hint is done in constant time. The
+	// hint is only a hint, unsorted messages are still inserted correctly.
 	for(unsigned int i=0; i<msg.nodeIds.size(); ++i)
 	{
-		poses.insert(std::make_pair(msg.nodeIds[i], rtabmap_ros::transformFromPoseMsg(msg.poses[i])));
-		mapIds.insert(std::make_pair(msg.nodeIds[i], msg.mapIds[i]));
-		stamps.insert(std::make_pair(msg.nodeIds[i], msg.stamps[i]));
-		labels.insert(std::make_pair(msg.nodeIds[i], msg.labels[i]));
-		userDatas.insert(std::make_pair(msg.nodeIds[i], msg.userDatas[i].data));
+		int id = msg.nodeIds[i];
+		poses.insert(poses.end(), std::make_pair(id, rtabmap_ros::transformFromPoseMsg(msg.poses[i])));
+		mapIds.insert(mapIds.end(), std::make_pair(id, msg.mapIds[i]));
+		stamps.insert(stamps.end(), std::make_pair(id, msg.stamps[i]));
+		std::map<int, std::string>::iterator iterLabel = labels.insert(labels.end(), std::make_pair(id, std::string()));
+		iterLabel->second = msg.labels[i];
+		std::map<int, std::vector<unsigned char> >::iterator iterUserData = userDatas.insert(userDatas.end(), std::make_pair(id, std::vector<unsigned char>()));
+		iterUserData->second = msg.userDatas[i].data;
 	}
 
 	for(unsigned int i=0; i<msg.links.size(); ++i)
 	{
-		rtabmap::Transform t = rtabmap_ros::transformFromGeometryMsg(msg.links[i].transform);
-		links.insert(std::make_pair(msg.links[i].fromId, linkFromROS(msg.links[i])));
+		links.insert(links.end(), std::make_pair(msg.links[i].fromId, linkFromROS(msg.links[i])));
 	}
 }
 void mapGraphToROS(
@@ -331,16 +845,28 @@ void mapGraphToROS(
 		const std::map<int, std::vector<unsigned char> > & userDatas,
 		const std::multimap<int, rtabmap::Link> & links,
 		const rtabmap::Transform & mapToOdom,
-		rtabmap_ros::Graph & msg)
+		rtabmap_ros::Graph & msg,
+		bool packed,
+		bool compressed)
 {
-	UASSERT(poses.size() == 0 ||
-			(poses.size() == mapIds.size() &&
-			 poses.size() == labels.size() &&
-			 poses.size() == stamps.size() &&
-			 poses.size() == userDatas.size()));
-
+	// the other columns are written for each pose (see GraphColumn)
 	transformToGeometryMsg(mapToOdom, msg.mapToOdom);
 
+	if(packed)
+	{
+		msg.nodeIds.clear();
+		msg.poses.clear();
+		msg.mapIds.clear();
+		msg.stamps.clear();
+		msg.labels.clear();
+		msg.userDatas.clear();
+		msg.links.clear();
+		packGraph(poses, mapIds, stamps, labels, userDatas, links, compressed, msg);
+		return;
+	}
+	msg.packed.clear();
+	msg.packedSize = 0;
+
 	msg.nodeIds.resize(poses.size());
 	msg.poses.resize(poses.size());
 	msg.mapIds.resize(poses.size());
@@ -348,24 +874,18 @@ void mapGraphToROS(
 	msg.labels.resize(poses.size());
 	msg.userDatas.resize(poses.size());
 	int index = 0;
-	std::map<int, rtabmap::Transform>::const_iterator iterPoses = poses.begin();
-	std::map<int, int>::const_iterator iterMapIds = mapIds.begin();
-	std::map<int, double>::const_iterator iterStamps = stamps.begin();
-	std::map<int, std::string>::const_iterator iterLabels = labels.begin();
-	std::map<int, std::vector<unsigned char> >::const_iterator iterUserDatas = userDatas.begin();
-	while(iterPoses != poses.end())
+	GraphColumn<int> mapIdsColumn(mapIds, -1);
+	GraphColumn<double> stampsColumn(stamps, 0.0);
+	GraphColumn<std::string> labelsColumn(labels, std::string());
+	GraphColumn<std::vector<unsigned char> > userDatasColumn(userDatas, std::vector<unsigned char>());
+	for(std::map<int, rtabmap::Transform>::const_iterator iterPoses = poses.begin(); iterPoses != poses.end(); ++iterPoses)
 	{
 		msg.nodeIds[index] = iterPoses->first;
-		msg.mapIds[index] = iterMapIds->second;
-		msg.stamps[index] = iterStamps->second;
-		msg.labels[index] = iterLabels->second;
-		msg.userDatas[index].data = iterUserDatas->second;
+		msg.mapIds[index] = mapIdsColumn.value(iterPoses->first);
+		msg.stamps[index] = stampsColumn.value(iterPoses->first);
+		msg.labels[index] = labelsColumn.value(iterPoses->first);
+		msg.userDatas[index].data = userDatasColumn.value(iterPoses->first);
 		transformToPoseMsg(iterPoses->second, msg.poses[index]);
-		++iterPoses;
-		++iterMapIds;
-		++iterStamps;
-		++iterLabels;
-		++iterUserDatas;
 		++index;
 	}
 
@@ -377,6 +897,26 @@ void mapGraphToROS(
 	}
 }
 
+const rtabmap_ros::Graph & mapGraphUnpacked(const rtabmap_ros::Graph & msg, rtabmap_ros::Graph & unpacked)
+{
+	if(msg.packed.empty())
+	{
+		return msg;
+	}
+	std::map<int, rtabmap::Transform> poses;
+	std::map<int, int> mapIds;
+	std::map<int, double> stamps;
+	std::map<int, std::string> labels;
+	std::map<int, std::vector<unsigned char> > userDatas;
+	std::multimap<int, rtabmap::Link> links;
+	rtabmap::Transform mapToOdom;
+	mapGraphFromROS(msg, poses, mapIds, stamps, labels, userDatas, links, mapToOdom);
+	mapGraphToROS(poses, mapIds, stamps, labels, userDatas, links, mapToOdom, unpacked);
+	unpacked.header = msg.header;
+	unpacked.mapToOdom = msg.mapToOdom;
+	return unpacked;
+}
+
 rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg)
 {
 	//Features stuff...
@@ -392,10 +932,10 @@ rtabmap::Signature nodeDataFromROS(const rtabmap_ros::NodeData & msg)
 	{
 		cv::KeyPoint pt = keypointFromROS(msg.wordKpts.at(i));
 		int wordId = msg.wordIds.at(i);
-		words.insert(std::make_pair(wordId, pt));
+		words.insert(words.end(), std::make_pair(wordId, pt));
 		if(i< cloud.size())
 		{
-			words3D.insert(std::make_pair(wordId, cloud[i]));
+			words3D.insert(words3D.end(), std::make_pair(wordId, cloud[i]));
 		}
 	}
 
@@ -490,7 +1030,7 @@ rtabmap::OdometryInfo odomInfoFromROS(const rtabmap_ros::OdomInfo & msg)
 	UASSERT(msg.wordsKeys.size() == msg.wordsValues.size());
 	for(unsigned int i=0; i<msg.wordsKeys.size(); ++i)
 	{
-		info.words.insert(std::make_pair(msg.wordsKeys[i], keypointFromROS(msg.wordsValues[i])));
+		info.words.insert(info.words.end(), std::make_pair(msg.wordsKeys[i], keypointFromROS(msg.wordsValues[i])));
 	}
 
 	info.wordMatches = msg.wordMatches;
@@ -515,8 +1055,14 @@ void odomInfoToROS(const rtabmap::OdometryInfo & info, rtabmap_ros::OdomInfo & m
 
 	msg.type = info.type;
 
-	msg.wordsKeys = uKeys(info.words);
-	keypointsToROS(uValues(info.words), msg.wordsValues);
+	msg.wordsKeys.resize(info.words.size());
+	msg.wordsValues.resize(info.words.size());
+	int index = 0;
+	for(std::multimap<int, cv::KeyPoint>::const_iterator iter=info.words.begin(); iter!=info.words.end(); ++iter)
+	{
+		msg.wordsKeys[index] = iter->first;
+		keypointToROS(iter->second, msg.wordsValues[index++]);
+	}
 
 	msg.wordMatches = info.wordMatches;
 	msg.wordInliers = info.wordInliers;
@@ -46,6 +46,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "rtabmap/utilite/ULogger.h"
 #include "rtabmap/utilite/UStl.h"
 
+#include <boost/bind.hpp>
+
 using namespace rtabmap;
 
 namespace rtabmap_ros {
@@ -57,7 +59,18 @@ OdometryROS::OdometryROS(int argc, char * argv[]) :
 	groundTruthFrameId_(""),
 	publishTf_(true),
 	waitForTransform_(false),
-	paused_(false)
+	paused_(false),
+	latency_("odometry"),
+	latencyInputDelay_(latency_.addStage("input delay")),
+	latencyOdometry_(latency_.addStage("odometry")),
+	latencyPublishing_(latency_.addStage("publishing")),
+	pipelined_(false),
+	pipelineQueueSize_(1),
+	stopping_(false),
+	odometryThread_(0),
+	localMapDecimation_(1),
+	localMapCount_(0),
+	debugThread_(0)
 {
 	this->processArguments(argc, argv);
 
@@ -78,6 +91,20 @@ OdometryROS::OdometryROS(int argc, char * argv[]) :
 	pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 	pnh.param("initial_pose", initialPoseStr, initialPoseStr); // "x y z roll pitch yaw"
 	pnh.param("ground_truth_frame_id", groundTruthFrameId_, groundTruthFrameId_);
+	pnh.param("pipelined", pipelined_, pipelined_);
+	pnh.param("pipeline_queue_size", pipelineQueueSize_, pipelineQueueSize_);
+	pnh.param("local_map_decimation", localMapDecimation_, localMapDecimation_);
+	latency_.init(nh, pnh);
+	if(localMapDecimation_ < 1)
+	{
+		ROS_WARN("Parameter local_map_decimation must be >= 1, setting to 1...");
+		localMapDecimation_ = 1;
+	}
+	if(pipelineQueueSize_ < 1)
+	{
+		ROS_WARN("Parameter pipeline_queue_size must be >= 1, setting to 1...");
+		pipelineQueueSize_ = 1;
+	}
 	if(initialPoseStr.size())
 	{
 		std::vector<std::string> values = uListToVector(uSplit(initialPoseStr, ' '));
@@ -216,6 +243,13 @@ OdometryROS::OdometryROS(int argc, char * argv[]) :
 	resetToPoseSrv_ = nh.advertiseService("reset_odom_to_pose", &OdometryROS::resetToPose, this);
 	pauseSrv_ = nh.advertiseService("pause_odom", &OdometryROS::pause, this);
 	resumeSrv_ = nh.advertiseService("resume_odom", &OdometryROS::resume, this);
+
+	if(pipelined_)
+	{
+		ROS_INFO("Pipelined odometry (queue size=%d)", pipelineQueueSize_);
+		odometryThread_ = new boost::thread(boost::bind(&OdometryROS::odometryLoop, this));
+		debugThread_ = new boost::thread(boost::bind(&OdometryROS::debugLoop, this));
+	}
 }
 
 OdometryROS::~OdometryROS()
@@ -226,6 +260,24 @@ OdometryROS::~OdometryROS()
 		pnh.deleteParam(iter->first);
 	}
 
+	{
+		boost::mutex::scoped_lock lock(queueMutex_);
+		boost::mutex::scoped_lock debugLock(debugMutex_);
+		stopping_ = true;
+		queueCondition_.notify_all();
+		debugCondition_.notify_all();
+	}
+	if(odometryThread_)
+	{
+		odometryThread_->join();
+		delete odometryThread_;
+	}
+	if(debugThread_)
+	{
+		debugThread_->join();
+		delete debugThread_;
+	}
+
 	delete odometry_;
 }
 
@@ -278,6 +330,179 @@ void OdometryROS::processArguments(int argc, char * argv[])
 
 void OdometryROS::processData(const SensorData & data, const std_msgs::Header & header)
 {
+	if(!pipelined_)
+	{
+		process(data, header);
+		return;
+	}
+
+	boost::mutex::scoped_lock lock(queueMutex_);
+	if((int)queue_.size() >= pipelineQueueSize_)
+	{
+		// keep the latency bounded: drop the oldest frame
+		ROS_WARN_THROTTLE(5.0, "Odometry is slower than the input rate, dropping frames "
+				"(pipeline_queue_size=%d).", pipelineQueueSize_);
+		queue_.pop_front();
+	}
+	queue_.push_back(std::make_pair(data, header));
+	queueCondition_.notify_one();
+}
+
+void OdometryROS::odometryLoop()
+{
+	while(true)
+	{
+		std::pair<rtabmap::SensorData, std_msgs::Header> frame;
+		{
+			boost::mutex::scoped_lock lock(queueMutex_);
+			while(!stopping_ && queue_.empty())
+			{
+				queueCondition_.wait(lock);
+			}
+			if(stopping_)
+			{
+				break;
+			}
+			frame = queue_.front();
+			queue_.pop_front();
+		}
+		process(frame.first, frame.second);
+	}
+}
+
+void OdometryROS::debugLoop()
+{
+	while(true)
+	{
+		sensor_msgs::PointCloud2Ptr localMap;
+		sensor_msgs::PointCloud2Ptr lastFrame;
+		{
+			boost::mutex::scoped_lock lock(debugMutex_);
+			while(!stopping_ && !debugLocalMap_.get() && !debugLastFrame_.get())
+			{
+				debugCondition_.wait(lock);
+			}
+			if(stopping_)
+			{
+				break;
+			}
+			localMap.swap(debugLocalMap_);
+			lastFrame.swap(debugLastFrame_);
+		}
+		if(localMap.get())
+		{
+			odomLocalMap_.publish(localMap);
+		}
+		if(lastFrame.get())
+		{
+			odomLastFrame_.publish(lastFrame);
+		}
+	}
+}
+
+// Returns a message to fill with "size" points with the pcl::PointXYZ
+// layout. The message is reused if it is not referenced anymore (by the
+// publisher or the debug thread), so its buffer is not reallocated.
+static sensor_msgs::PointCloud2 & xyzCloudMsg(sensor_msgs::PointCloud2Ptr & msg, size_t size, const std_msgs::Header & header, const std::string & frameId)
+{
+	if(!msg.get() || !msg.unique())
+	{
+		msg.reset(new sensor_msgs::PointCloud2);
+		msg->fields.resize(3);
+		const char * names[3] = {"x", "y", "z"};
+		for(int i=0; i<3; ++i)
+		{
+			msg->fields[i].name = names[i];
+			msg->fields[i].offset = i*4;
+			msg->fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+			msg->fields[i].count = 1;
+		}
+		msg->point_step = 16;
+		msg->is_bigendian = false;
+		msg->height = 1;
+		msg->is_dense = false;
+	}
+	msg->header.stamp = header.stamp; // use corresponding time stamp to image
+	msg->header.frame_id = frameId;
+	msg->width = size;
+	msg->row_step = size*msg->point_step;
+	msg->data.resize(msg->row_step);
+	return *msg;
+}
+
+// Called with odometryMutex_ locked. Returns false if the local map is the
+// same than the last one published.
+bool OdometryROS::updateLocalMapMsg(const std_msgs::Header & header)
+{
+	const std::multimap<int, pcl::PointXYZ> & map = ((OdometryBOW*)odometry_)->getLocalMap();
+	bool reused = localMapMsg_.get() && localMapMsg_.unique();
+	bool changed = !reused || localMapMsg_->width != map.size();
+	sensor_msgs::PointCloud2 & msg = xyzCloudMsg(localMapMsg_, map.size(), header, odomFrameId_);
+	float * ptr = (float*)msg.data.data();
+	for(std::multimap<int, pcl::PointXYZ>::const_iterator iter=map.begin(); iter!=map.end(); ++iter, ptr+=4)
+	{
+		// compare while writing, most points are the same between frames
+		if(ptr[0] != iter->second.x || ptr[1] != iter->second.y || ptr[2] != iter->second.z)
+		{
+			ptr[0] = iter->second.x;
+			ptr[1] = iter->second.y;
+			ptr[2] = iter->second.z;
+			ptr[3] = 1.0f;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// Called with odometryMutex_ locked. The points are transformed in the odom
+// frame directly in the message.
+bool OdometryROS::updateLastFrameMsg(const rtabmap::Transform & pose, const std_msgs::Header & header)
+{
+	Eigen::Affine3f t = pose.toEigen3f();
+	if(dynamic_cast<OdometryBOW*>(odometry_))
+	{
+		const rtabmap::Signature * s  = ((OdometryBOW*)odometry_)->getMemory()->getLastWorkingSignature();
+		if(s == 0)
+		{
+			return false;
+		}
+		const std::multimap<int, pcl::PointXYZ> & words3 = s->getWords3();
+		sensor_msgs::PointCloud2 & msg = xyzCloudMsg(lastFrameMsg_, words3.size(), header, odomFrameId_);
+		float * ptr = (float*)msg.data.data();
+		for(std::multimap<int, pcl::PointXYZ>::const_iterator iter=words3.begin(); iter!=words3.end(); ++iter, ptr+=4)
+		{
+			Eigen::Vector3f v = t * iter->second.getVector3fMap();
+			ptr[0] = v[0];
+			ptr[1] = v[1];
+			ptr[2] = v[2];
+			ptr[3] = 1.0f;
+		}
+	}
+	else
+	{
+		//Optical flow
+		const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud = ((OdometryOpticalFlow*)odometry_)->getLastCorners3D();
+		if(cloud->size() == 0)
+		{
+			return false;
+		}
+		sensor_msgs::PointCloud2 & msg = xyzCloudMsg(lastFrameMsg_, cloud->size(), header, odomFrameId_);
+		float * ptr = (float*)msg.data.data();
+		for(unsigned int i=0; i<cloud->size(); ++i, ptr+=4)
+		{
+			Eigen::Vector3f v = t * cloud->at(i).getVector3fMap();
+			ptr[0] = v[0];
+			ptr[1] = v[1];
+			ptr[2] = v[2];
+			ptr[3] = 1.0f;
+		}
+	}
+	return true;
+}
+
+void OdometryROS::process(const SensorData & data, const std_msgs::Header & header)
+{
+	boost::mutex::scoped_lock lock(odometryMutex_);
 	if(odometry_->getPose().isNull() &&
 	   !groundTruthFrameId_.empty())
 	{
@@ -309,8 +534,12 @@ void OdometryROS::processData(const SensorData & data, const std_msgs::Header &
 
 	// process data
 	ros::WallTime time = ros::WallTime::now();
+	// time between the images and their processing (synchronization, conversion and pipeline queue)
+	latency_.record(latencyInputDelay_, (ros::Time::now() - header.stamp).toSec());
 	rtabmap::OdometryInfo info;
 	rtabmap::Transform pose = odometry_->process(data, &info);
+	ros::WallTime processed = ros::WallTime::now();
+	latency_.record(latencyOdometry_, (processed - time).toSec());
 	if(!pose.isNull())
 	{
 		//*********************
@@ -353,58 +582,43 @@ void OdometryROS::processData(const SensorData & data, const std_msgs::Header &
 			odomPub_.publish(odom);
 		}
 
-		if(odomLocalMap_.getNumSubscribers() && dynamic_cast<OdometryBOW*>(odometry_))
+		// the debug clouds are filled here, but published by the debug
+		// thread in pipelined mode
+		sensor_msgs::PointCloud2Ptr localMap;
+		sensor_msgs::PointCloud2Ptr lastFrame;
+		if(odomLocalMap_.getNumSubscribers() && dynamic_cast<OdometryBOW*>(odometry_) &&
+		   ++localMapCount_ >= localMapDecimation_)
 		{
-			const std::multimap<int, pcl::PointXYZ> & map = ((OdometryBOW*)odometry_)->getLocalMap();
-			pcl::PointCloud<pcl::PointXYZ> cloud;
-			for(std::multimap<int, pcl::PointXYZ>::const_iterator iter=map.begin(); iter!=map.end(); ++iter)
+			localMapCount_ = 0;
+			if(updateLocalMapMsg(header))
 			{
-				cloud.push_back(iter->second);
+				localMap = localMapMsg_;
 			}
-			sensor_msgs::PointCloud2 cloudMsg;
-			pcl::toROSMsg(cloud, cloudMsg);
-			cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-			cloudMsg.header.frame_id = odomFrameId_;
-			odomLocalMap_.publish(cloudMsg);
 		}
 
-		if(odomLastFrame_.getNumSubscribers())
+		if(odomLastFrame_.getNumSubscribers() && updateLastFrameMsg(pose, header))
 		{
-			if(dynamic_cast<OdometryBOW*>(odometry_))
-			{
-				const rtabmap::Signature * s  = ((OdometryBOW*)odometry_)->getMemory()->getLastWorkingSignature();
-				if(s)
-				{
-					const std::multimap<int, pcl::PointXYZ> & words3 = s->getWords3();
-					pcl::PointCloud<pcl::PointXYZ> cloud;
-					rtabmap::Transform t = data.localTransform();
-					for(std::multimap<int, pcl::PointXYZ>::const_iterator iter=words3.begin(); iter!=words3.end(); ++iter)
-					{
-						// transform to odom frame
-						pcl::PointXYZ pt = util3d::transformPoint(iter->second, pose);
-						cloud.push_back(pt);
-					}
+			lastFrame = lastFrameMsg_;
+		}
 
-					sensor_msgs::PointCloud2 cloudMsg;
-					pcl::toROSMsg(cloud, cloudMsg);
-					cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-					cloudMsg.header.frame_id = odomFrameId_;
-					odomLastFrame_.publish(cloudMsg);
-				}
+		if(localMap.get() || lastFrame.get())
+		{
+			if(debugThread_)
+			{
+				boost::mutex::scoped_lock debugLock(debugMutex_);
+				debugLocalMap_ = localMap;
+				debugLastFrame_ = lastFrame;
+				debugCondition_.notify_one();
 			}
 			else
 			{
-				//Optical flow
-				const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud = ((OdometryOpticalFlow*)odometry_)->getLastCorners3D();
-				if(cloud->size())
+				if(localMap.get())
 				{
-					pcl::PointCloud<pcl::PointXYZ>::Ptr cloudTransformed;
-					cloudTransformed = util3d::transformPointCloud(cloud, pose);
-					sensor_msgs::PointCloud2 cloudMsg;
-					pcl::toROSMsg(*cloudTransformed, cloudMsg);
-					cloudMsg.header.stamp = header.stamp; // use corresponding time stamp to image
-					cloudMsg.header.frame_id = odomFrameId_;
-					odomLastFrame_.publish(cloudMsg);
+					odomLocalMap_.publish(localMap);
+				}
+				if(lastFrame.get())
+				{
+					odomLastFrame_.publish(lastFrame);
 				}
 			}
 		}
@@ -432,6 +646,7 @@ void OdometryROS::processData(const SensorData & data, const std_msgs::Header &
 		odomInfoPub_.publish(infoMsg);
 	}
 
+	latency_.record(latencyPublishing_, (ros::WallTime::now() - processed).toSec());
 	ROS_INFO("Odom: quality=%d, std dev=%fm, update time=%fs", info.inliers, pose.isNull()?0.0f:std::sqrt(info.variance), (ros::WallTime::now()-time).toSec());
 }
 
@@ -443,6 +658,11 @@ bool OdometryROS::isOdometryBOW() const
 bool OdometryROS::reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
 {
 	ROS_INFO("visual_odometry: reset odom!");
+	{
+		boost::mutex::scoped_lock lock(queueMutex_);
+		queue_.clear();
+	}
+	boost::mutex::scoped_lock lock(odometryMutex_);
 	odometry_->reset();
 	return true;
 }
@@ -451,6 +671,11 @@ bool OdometryROS::resetToPose(rtabmap_ros::ResetPose::Request& req, rtabmap_ros:
 {
 	Transform pose(req.x, req.y, req.z, req.roll, req.pitch, req.yaw);
 	ROS_INFO("visual_odometry: reset odom to pose %s!", pose.prettyPrint().c_str());
+	{
+		boost::mutex::scoped_lock lock(queueMutex_);
+		queue_.clear();
+	}
+	boost::mutex::scoped_lock lock(odometryMutex_);
 	odometry_->reset(pose);
 	return true;
 }
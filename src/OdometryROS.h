@@ -37,9 +37,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <std_msgs/Header.h>
 
 #include <rtabmap_ros/ResetPose.h>
+#include <rtabmap_ros/LatencyStats.h>
 #include <rtabmap/core/SensorData.h>
 #include <rtabmap/core/Parameters.h>
 
+#include <sensor_msgs/PointCloud2.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <list>
+
 namespace rtabmap {
 class Odometry;
 }
@@ -53,6 +61,9 @@ public:
 	~OdometryROS();
 
 	void processArguments(int argc, char * argv[]);
+
+	// In pipelined mode, the data is queued and processed by the odometry
+	// thread, so the images of data must not be shared with the ROS messages.
 	void processData(const rtabmap::SensorData & data, const std_msgs::Header & header);
 
 	bool reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&);
@@ -67,9 +78,18 @@ public:
 	bool isPaused() const {return paused_;}
 	bool isOdometryBOW() const;
 	bool waitForTransform() const {return waitForTransform_;}
+	bool isPipelined() const {return pipelined_;}
+
+private:
+	void process(const rtabmap::SensorData & data, const std_msgs::Header & header);
+	void odometryLoop();
+	void debugLoop();
+	bool updateLocalMapMsg(const std_msgs::Header & header);
+	bool updateLastFrameMsg(const rtabmap::Transform & pose, const std_msgs::Header & header);
 
 private:
 	rtabmap::Odometry * odometry_;
+	boost::mutex odometryMutex_; // odometry_ is used by the services and the odometry thread
 
 	// parameters
 	std::string frameId_;
@@ -91,6 +111,35 @@ private:
 	tf::TransformListener tfListener_;
 
 	bool paused_;
+
+	LatencyStats latency_;
+	int latencyInputDelay_;
+	int latencyOdometry_;
+	int latencyPublishing_;
+
+	// pipelined mode: the images are converted in the callback thread while
+	// the odometry thread processes the previous frame
+	bool pipelined_;
+	int pipelineQueueSize_;
+	bool stopping_;
+	boost::thread * odometryThread_;
+	boost::mutex queueMutex_;
+	boost::condition_variable queueCondition_;
+	std::list<std::pair<rtabmap::SensorData, std_msgs::Header> > queue_;
+
+	// debug clouds, the messages are reused when they are not referenced
+	// anymore by the publishers
+	int localMapDecimation_;
+	int localMapCount_;
+	sensor_msgs::PointCloud2Ptr localMapMsg_;
+	sensor_msgs::PointCloud2Ptr lastFrameMsg_;
+
+	// debug clouds published by the debug thread, latest only
+	boost::thread * debugThread_;
+	boost::mutex debugMutex_;
+	boost::condition_variable debugCondition_;
+	sensor_msgs::PointCloud2Ptr debugLocalMap_;
+	sensor_msgs::PointCloud2Ptr debugLastFrame_;
 };
 
 }
@@ -0,0 +1,241 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/PoseIndex.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <Eigen/Core>
+#include <algorithm>
+#include <set>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+PoseIndex::PoseIndex(float cellSize) :
+		cellSize_(cellSize>0.0f?cellSize:1.0f)
+{
+}
+
+void PoseIndex::setCellSize(float cellSize)
+{
+	if(cellSize <= 0.0f)
+	{
+		cellSize = 1.0f;
+	}
+	if(cellSize != cellSize_)
+	{
+		cellSize_ = cellSize;
+		cells_.clear();
+		for(std::map<int, rtabmap::Transform>::iterator iter=poses_.begin(); iter!=poses_.end(); ++iter)
+		{
+			cells_[key(iter->second.x(), iter->second.y())].push_back(iter->first);
+		}
+	}
+}
+
+void PoseIndex::clear()
+{
+	poses_.clear();
+	cells_.clear();
+}
+
+// 32 bits per axis
+boost::uint64_t PoseIndex::key(float x, float y) const
+{
+	boost::uint64_t i = boost::uint64_t(boost::uint32_t(int(std::floor(x / cellSize_))));
+	boost::uint64_t j = boost::uint64_t(boost::uint32_t(int(std::floor(y / cellSize_))));
+	return (i << 32) | j;
+}
+
+void PoseIndex::insert(int id, const rtabmap::Transform & pose)
+{
+	cells_[key(pose.x(), pose.y())].push_back(id);
+}
+
+void PoseIndex::remove(int id, const rtabmap::Transform & pose)
+{
+	boost::unordered_map<boost::uint64_t, std::vector<int> >::iterator iter = cells_.find(key(pose.x(), pose.y()));
+	if(iter != cells_.end())
+	{
+		std::vector<int>::iterator jter = std::find(iter->second.begin(), iter->second.end(), id);
+		if(jter != iter->second.end())
+		{
+			*jter = iter->second.back();
+			iter->second.pop_back();
+		}
+		if(iter->second.empty())
+		{
+			cells_.erase(iter);
+		}
+	}
+}
+
+// Both maps are sorted by ID, so they are compared in one pass
+void PoseIndex::update(const std::map<int, rtabmap::Transform> & poses)
+{
+	std::map<int, rtabmap::Transform>::iterator iter = poses_.begin();
+	std::map<int, rtabmap::Transform>::const_iterator jter = poses.begin();
+	while(iter != poses_.end() || jter != poses.end())
+	{
+		if(jter == poses.end() || (iter != poses_.end() && iter->first < jter->first))
+		{
+			// removed
+			remove(iter->first, iter->second);
+			poses_.erase(iter++);
+		}
+		else if(iter == poses_.end() || jter->first < iter->first)
+		{
+			// added
+			if(!jter->second.isNull())
+			{
+				insert(jter->first, jter->second);
+				poses_.insert(iter, *jter);
+			}
+			++jter;
+		}
+		else
+		{
+			if(jter->second.isNull())
+			{
+				remove(iter->first, iter->second);
+				poses_.erase(iter++);
+			}
+			else
+			{
+				if(key(iter->second.x(), iter->second.y()) != key(jter->second.x(), jter->second.y()))
+				{
+					remove(iter->first, iter->second);
+					insert(jter->first, jter->second);
+				}
+				iter->second = jter->second;
+				++iter;
+			}
+			++jter;
+		}
+	}
+}
+
+std::vector<int> PoseIndex::radiusSearch(float x, float y, float z, float radius) const
+{
+	std::vector<int> ids;
+	int cells = int(std::ceil(radius / cellSize_));
+	int ci = int(std::floor(x / cellSize_));
+	int cj = int(std::floor(y / cellSize_));
+	float radiusSqr = radius*radius;
+	for(int i=ci-cells; i<=ci+cells; ++i)
+	{
+		for(int j=cj-cells; j<=cj+cells; ++j)
+		{
+			boost::uint64_t k = (boost::uint64_t(boost::uint32_t(i)) << 32) | boost::uint64_t(boost::uint32_t(j));
+			boost::unordered_map<boost::uint64_t, std::vector<int> >::const_iterator iter = cells_.find(k);
+			if(iter != cells_.end())
+			{
+				for(unsigned int n=0; n<iter->second.size(); ++n)
+				{
+					const rtabmap::Transform & pose = poses_.at(iter->second[n]);
+					float dx = pose.x()-x;
+					float dy = pose.y()-y;
+					float dz = pose.z()-z;
+					if(dx*dx + dy*dy + dz*dz <= radiusSqr)
+					{
+						ids.push_back(iter->second[n]);
+					}
+				}
+			}
+		}
+	}
+	std::sort(ids.begin(), ids.end());
+	return ids;
+}
+
+// From the latest node, the nodes in its radius (and with an orientation
+// close to it) are removed, then the next latest node kept, and so on.
+std::map<int, rtabmap::Transform> PoseIndex::radiusFiltering(float radius, float angle, const std::vector<int> * ids) const
+{
+	std::map<int, rtabmap::Transform> output;
+	if(radius <= 0.0f)
+	{
+		if(ids)
+		{
+			for(unsigned int i=0; i<ids->size(); ++i)
+			{
+				output.insert(*poses_.find(ids->at(i)));
+			}
+			return output;
+		}
+		return poses_;
+	}
+
+	std::vector<int> allIds;
+	if(ids == 0)
+	{
+		allIds.reserve(poses_.size());
+		for(std::map<int, rtabmap::Transform>::const_iterator iter=poses_.begin(); iter!=poses_.end(); ++iter)
+		{
+			allIds.push_back(iter->first);
+		}
+		ids = &allIds;
+	}
+
+	// oldest first, the latest node of each cluster is kept
+	std::set<int> checked;
+	for(std::vector<int>::const_iterator iter=ids->begin(); iter!=ids->end(); ++iter)
+	{
+		if(checked.find(*iter) != checked.end())
+		{
+			continue;
+		}
+		const rtabmap::Transform & pose = poses_.at(*iter);
+		Eigen::Vector3f vA = pose.toEigen3f().rotation()*Eigen::Vector3f(1,0,0);
+		std::vector<int> neighbors = radiusSearch(pose.x(), pose.y(), pose.z(), radius);
+		int latest = *iter;
+		for(unsigned int i=0; i<neighbors.size(); ++i)
+		{
+			// only the nodes of the subset are filtered
+			if(checked.find(neighbors[i]) != checked.end() ||
+			   (ids != &allIds && !std::binary_search(ids->begin(), ids->end(), neighbors[i])))
+			{
+				continue;
+			}
+			if(angle > 0.0f)
+			{
+				Eigen::Vector3f vB = poses_.at(neighbors[i]).toEigen3f().rotation()*Eigen::Vector3f(1,0,0);
+				float cosAngle = vA.dot(vB) / (vA.norm()*vB.norm());
+				if(std::acos(std::max(-1.0f, std::min(1.0f, cosAngle))) > angle)
+				{
+					continue;
+				}
+			}
+			checked.insert(neighbors[i]);
+			latest = std::max(latest, neighbors[i]);
+		}
+		checked.insert(*iter);
+		output.insert(*poses_.find(latest));
+	}
+	return output;
+}
+
+}
@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/PosesDiff.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+PosesDiff::PosesDiff(float linearTolerance, float angularTolerance, bool planar) :
+		linearTolerance_(linearTolerance),
+		angularTolerance_(angularTolerance),
+		planar_(planar)
+{
+}
+
+void PosesDiff::setTolerances(float linearTolerance, float angularTolerance, bool planar)
+{
+	linearTolerance_ = linearTolerance;
+	angularTolerance_ = angularTolerance;
+	planar_ = planar;
+}
+
+void PosesDiff::clear()
+{
+	poses_.clear();
+	added_.clear();
+	removed_.clear();
+	moved_.clear();
+}
+
+void PosesDiff::update(const std::map<int, rtabmap::Transform> & poses)
+{
+	added_.clear();
+	removed_.clear();
+	moved_.clear();
+
+	// both maps are sorted by ID, walk them together
+	std::map<int, rtabmap::Transform>::iterator iter = poses_.begin();
+	std::map<int, rtabmap::Transform>::const_iterator jter = poses.begin();
+	while(iter != poses_.end() || jter != poses.end())
+	{
+		if(jter == poses.end() || (iter != poses_.end() && iter->first < jter->first))
+		{
+			removed_.insert(iter->first);
+			poses_.erase(iter++);
+		}
+		else if(iter == poses_.end() || jter->first < iter->first)
+		{
+			if(!jter->second.isNull())
+			{
+				added_.insert(jter->first);
+				iter = poses_.insert(iter, *jter);
+				++iter;
+			}
+			++jter;
+		}
+		else
+		{
+			if(jter->second.isNull())
+			{
+				removed_.insert(iter->first);
+				poses_.erase(iter++);
+			}
+			else
+			{
+				if(hasMoved(iter->second, jter->second, linearTolerance_, angularTolerance_, planar_))
+				{
+					moved_.insert(iter->first);
+					iter->second = jter->second;
+				}
+				++iter;
+			}
+			++jter;
+		}
+	}
+	UDEBUG("added=%d removed=%d moved=%d total=%d",
+			(int)added_.size(), (int)removed_.size(), (int)moved_.size(), (int)poses_.size());
+}
+
+void PosesDiff::remove(int id)
+{
+	poses_.erase(id);
+	added_.erase(id);
+	moved_.erase(id);
+}
+
+bool PosesDiff::hasMoved(
+		const rtabmap::Transform & previous,
+		const rtabmap::Transform & current,
+		float linearTolerance,
+		float angularTolerance,
+		bool planar)
+{
+	float x,y,z,roll,pitch,yaw;
+	(previous.inverse() * current).getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+	if(planar)
+	{
+		return x*x+y*y > linearTolerance*linearTolerance ||
+				fabs(yaw) > angularTolerance;
+	}
+	return x*x+y*y+z*z > linearTolerance*linearTolerance ||
+			fabs(roll) > angularTolerance ||
+			fabs(pitch) > angularTolerance ||
+			fabs(yaw) > angularTolerance;
+}
+
+}
@@ -142,8 +142,9 @@ public:
 				float fy = model.fy();
 				float cx = model.cx();
 				float cy = model.cy();
-				cv_bridge::CvImageConstPtr ptrImage = cv_bridge::toCvShare(image, "mono8");
-				cv_bridge::CvImageConstPtr ptrDepth = cv_bridge::toCvShare(depth);
+				// In pipelined mode, the images are queued: they must not share the message buffers
+				cv_bridge::CvImageConstPtr ptrImage = this->isPipelined()?cv_bridge::CvImageConstPtr(cv_bridge::toCvCopy(image, "mono8")):cv_bridge::toCvShare(image, "mono8");
+				cv_bridge::CvImageConstPtr ptrDepth = this->isPipelined()?cv_bridge::CvImageConstPtr(cv_bridge::toCvCopy(depth)):cv_bridge::toCvShare(depth);
 
 				rtabmap::SensorData data(
 						ptrImage->image,
@@ -0,0 +1,129 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/SessionFilter.h"
+#include "rtabmap_ros/PoseIndex.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+
+namespace rtabmap_ros {
+
+SessionFilter::SessionFilter(float radius, float angle, float linearUpdate, float angularUpdate) :
+		radius_(radius),
+		angle_(angle),
+		linearUpdate_(linearUpdate),
+		angularUpdate_(angularUpdate)
+{
+}
+
+void SessionFilter::setParameters(float radius, float angle, float linearUpdate, float angularUpdate)
+{
+	if(radius != radius_ || angle != angle_ || linearUpdate != linearUpdate_ || angularUpdate != angularUpdate_)
+	{
+		radius_ = radius;
+		angle_ = angle;
+		linearUpdate_ = linearUpdate;
+		angularUpdate_ = angularUpdate;
+		clear();
+	}
+}
+
+void SessionFilter::clear()
+{
+	sessions_.clear();
+	changed_.clear();
+}
+
+std::map<int, rtabmap::Transform> SessionFilter::filter(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, int> & mapIds)
+{
+	UTimer timer;
+	changed_.clear();
+
+	// split the graph by session, both maps are sorted by node ID
+	std::map<int, std::map<int, rtabmap::Transform> > sessionPoses;
+	std::map<int, int>::const_iterator mapIter = mapIds.begin();
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		while(mapIter != mapIds.end() && mapIter->first < iter->first)
+		{
+			++mapIter;
+		}
+		int mapId = mapIter != mapIds.end() && mapIter->first == iter->first?mapIter->second:-1;
+		std::map<int, rtabmap::Transform> & session = sessionPoses[mapId];
+		session.insert(session.end(), *iter);
+	}
+
+	// sessions not in the graph anymore
+	for(std::map<int, Session>::iterator iter=sessions_.begin(); iter!=sessions_.end();)
+	{
+		if(sessionPoses.find(iter->first) == sessionPoses.end())
+		{
+			changed_.insert(iter->first);
+			sessions_.erase(iter++);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+
+	std::map<int, rtabmap::Transform> output;
+	for(std::map<int, std::map<int, rtabmap::Transform> >::iterator iter=sessionPoses.begin(); iter!=sessionPoses.end(); ++iter)
+	{
+		std::map<int, Session>::iterator jter = sessions_.find(iter->first);
+		if(jter == sessions_.end())
+		{
+			jter = sessions_.insert(std::make_pair(iter->first, Session())).first;
+			jter->second.poses.setTolerances(linearUpdate_, angularUpdate_);
+		}
+		Session & session = jter->second;
+		session.poses.update(iter->second);
+		if(session.poses.changed())
+		{
+			if(radius_ > 0.0f)
+			{
+				PoseIndex index(radius_);
+				index.update(session.poses.poses());
+				session.filtered = index.radiusFiltering(radius_, angle_);
+			}
+			else
+			{
+				session.filtered = session.poses.poses();
+			}
+			changed_.insert(iter->first);
+		}
+		output.insert(session.filtered.begin(), session.filtered.end());
+	}
+
+	UDEBUG("sessions=%d changed=%d poses=%d filtered=%d (%fs)",
+			(int)sessions_.size(), (int)changed_.size(), (int)poses.size(), (int)output.size(), timer.ticks());
+	return output;
+}
+
+}
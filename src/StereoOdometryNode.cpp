@@ -164,8 +164,9 @@ public:
 				float cx = model.left().cx();
 				float cy = model.left().cy();
 				float baseline = model.baseline();
-				cv_bridge::CvImageConstPtr ptrImageLeft = cv_bridge::toCvShare(imageRectLeft, "mono8");
-				cv_bridge::CvImageConstPtr ptrImageRight = cv_bridge::toCvShare(imageRectRight, "mono8");
+				// In pipelined mode, the images are queued: they must not share the message buffers
+				cv_bridge::CvImageConstPtr ptrImageLeft = this->isPipelined()?cv_bridge::CvImageConstPtr(cv_bridge::toCvCopy(imageRectLeft, "mono8")):cv_bridge::toCvShare(imageRectLeft, "mono8");
+				cv_bridge::CvImageConstPtr ptrImageRight = this->isPipelined()?cv_bridge::CvImageConstPtr(cv_bridge::toCvCopy(imageRectRight, "mono8")):cv_bridge::toCvShare(imageRectRight, "mono8");
 
 				if(baseline <= 0)
 				{
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/ThreadPool.h"
+#include <boost/bind.hpp>
+
+namespace rtabmap_ros {
+
+ThreadPool & ThreadPool::instance()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool::ThreadPool(int threads) :
+		job_(0),
+		count_(0),
+		next_(0),
+		running_(0),
+		stop_(false)
+{
+	if(threads <= 0)
+	{
+		threads = boost::thread::hardware_concurrency();
+	}
+	for(int i=1; i<threads; ++i)
+	{
+		workers_.push_back(new boost::thread(boost::bind(&ThreadPool::workerLoop, this)));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		stop_ = true;
+	}
+	jobCondition_.notify_all();
+	for(unsigned int i=0; i<workers_.size(); ++i)
+	{
+		workers_[i]->join();
+		delete workers_[i];
+	}
+}
+
+void ThreadPool::parallelFor(int count, const boost::function<void (int)> & job)
+{
+	if(count <= 0)
+	{
+		return;
+	}
+	if(workers_.empty() || count == 1)
+	{
+		for(int i=0; i<count; ++i)
+		{
+			job(i);
+		}
+		return;
+	}
+
+	boost::mutex::scoped_lock batchLock(batchMutex_);
+	boost::mutex::scoped_lock lock(mutex_);
+	job_ = &job;
+	count_ = count;
+	next_ = 0;
+	running_ = 0;
+	jobCondition_.notify_all();
+
+	runJobs(lock);
+	while(running_ > 0)
+	{
+		doneCondition_.wait(lock);
+	}
+	job_ = 0;
+
+	if(error_)
+	{
+		boost::exception_ptr error = error_;
+		error_ = boost::exception_ptr();
+		boost::rethrow_exception(error);
+	}
+}
+
+// Process jobs of the current batch until there are no more to start
+void ThreadPool::runJobs(boost::mutex::scoped_lock & lock)
+{
+	while(job_ && next_ < count_)
+	{
+		int i = next_++;
+		++running_;
+		const boost::function<void (int)> * job = job_;
+		lock.unlock();
+		boost::exception_ptr error;
+		try
+		{
+			(*job)(i);
+		}
+		catch(...)
+		{
+			// running_ must be decremented, the caller would wait forever
+			error = boost::current_exception();
+		}
+		lock.lock();
+		if(error)
+		{
+			if(!error_)
+			{
+				error_ = error;
+			}
+			next_ = count_; // skip the jobs not started
+		}
+		if(--running_ == 0 && next_ >= count_)
+		{
+			doneCondition_.notify_all();
+		}
+	}
+}
+
+void ThreadPool::workerLoop()
+{
+	boost::mutex::scoped_lock lock(mutex_);
+	while(!stop_)
+	{
+		runJobs(lock);
+		if(!stop_)
+		{
+			jobCondition_.wait(lock);
+		}
+	}
+}
+
+}
@@ -0,0 +1,342 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "rtabmap_ros/TiledGrid.h"
+#include <rtabmap/utilite/ULogger.h>
+#include <limits>
+#include <cmath>
+
+namespace rtabmap_ros {
+
+// tiles must be divisible at each resolution level
+static int roundTileCells(int tileCells, int levels)
+{
+	int multiple = 1 << (levels-1);
+	return tileCells < multiple?multiple:(tileCells/multiple)*multiple;
+}
+
+// rounded toward negative infinity
+static int floorDiv(int a, int b)
+{
+	return a>=0?a/b:-((-a-1)/b)-1;
+}
+
+TiledGrid::TiledGrid(float cellSize, int tileCells, int levels, float fullResolutionRadius) :
+		cellSize_(cellSize),
+		tileCells_(0),
+		levels_(levels),
+		fullResolutionRadius_(fullResolutionRadius),
+		viewX_(0.0f),
+		viewY_(0.0f)
+{
+	UASSERT(cellSize_ > 0.0f);
+	UASSERT(levels_ >= 1 && levels_ <= 16);
+	tileCells_ = roundTileCells(tileCells, levels_);
+}
+
+void TiledGrid::setParameters(float cellSize, int tileCells, int levels, float fullResolutionRadius)
+{
+	UASSERT(cellSize > 0.0f);
+	UASSERT(levels >= 1 && levels <= 16);
+	tileCells = roundTileCells(tileCells, levels);
+	if(cellSize != cellSize_ || tileCells != tileCells_ || levels != levels_)
+	{
+		cellSize_ = cellSize;
+		tileCells_ = tileCells;
+		levels_ = levels;
+		clear();
+	}
+	if(fullResolutionRadius != fullResolutionRadius_)
+	{
+		fullResolutionRadius_ = fullResolutionRadius;
+		setViewpoint(viewX_, viewY_);
+	}
+}
+
+void TiledGrid::clear()
+{
+	nodes_.clear();
+	posesDiff_.clear();
+	tiles_.clear();
+	modified_.clear();
+	removed_.clear();
+}
+
+size_t TiledGrid::bytes() const
+{
+	size_t bytes = 0;
+	for(std::map<TileKey, Tile>::const_iterator iter=tiles_.begin(); iter!=tiles_.end(); ++iter)
+	{
+		bytes += sizeof(Tile) +
+				iter->second.groundCounts.total()*iter->second.groundCounts.elemSize() +
+				iter->second.obstacleCounts.total()*iter->second.obstacleCounts.elemSize();
+	}
+	for(std::map<int, NodeCells>::const_iterator iter=nodes_.begin(); iter!=nodes_.end(); ++iter)
+	{
+		bytes += sizeof(NodeCells) + (iter->second.ground.capacity() + iter->second.obstacles.capacity())*sizeof(cv::Point2i);
+	}
+	return bytes;
+}
+
+int TiledGrid::update(
+		const std::map<int, rtabmap::Transform> & poses,
+		const std::map<int, std::pair<cv::Mat, cv::Mat> > & localMaps,
+		float linearUpdate,
+		float angularUpdate)
+{
+	// only nodes with a local map are in the grid
+	std::map<int, rtabmap::Transform> posesWithMaps;
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=poses.begin(); iter!=poses.end(); ++iter)
+	{
+		if(localMaps.find(iter->first) != localMaps.end())
+		{
+			posesWithMaps.insert(posesWithMaps.end(), *iter);
+		}
+	}
+	posesDiff_.setTolerances(linearUpdate, angularUpdate, true);
+	posesDiff_.update(posesWithMaps);
+
+	std::set<TileKey> touched;
+
+	// remove nodes not in the graph anymore or moved
+	std::vector<int> toRemove(posesDiff_.removed().begin(), posesDiff_.removed().end());
+	toRemove.insert(toRemove.end(), posesDiff_.moved().begin(), posesDiff_.moved().end());
+	for(unsigned int i=0; i<toRemove.size(); ++i)
+	{
+		std::map<int, NodeCells>::iterator iter = nodes_.find(toRemove[i]);
+		if(iter != nodes_.end())
+		{
+			rasterize(iter->second, -1, touched);
+			nodes_.erase(iter);
+		}
+	}
+
+	// add the new and moved nodes
+	int added = 0;
+	for(std::map<int, rtabmap::Transform>::const_iterator iter=posesDiff_.poses().begin(); iter!=posesDiff_.poses().end(); ++iter)
+	{
+		if(nodes_.find(iter->first) == nodes_.end())
+		{
+			const std::pair<cv::Mat, cv::Mat> & localMap = localMaps.at(iter->first);
+			NodeCells & node = nodes_[iter->first];
+
+			float x,y,z,roll,pitch,yaw;
+			iter->second.getTranslationAndEulerAngles(x,y,z,roll,pitch,yaw);
+			float cosT = cos(yaw);
+			float sinT = sin(yaw);
+			for(int k=0; k<2; ++k)
+			{
+				const cv::Mat & points = k==0?localMap.first:localMap.second;
+				std::vector<cv::Point2i> & cells = k==0?node.ground:node.obstacles;
+				if(points.empty())
+				{
+					continue;
+				}
+				UASSERT(points.type() == CV_32FC2);
+				cells.resize(points.total());
+				const cv::Point2f * ptr = points.ptr<cv::Point2f>();
+				for(unsigned int i=0; i<cells.size(); ++i)
+				{
+					float px = cosT*ptr[i].x - sinT*ptr[i].y + x;
+					float py = sinT*ptr[i].x + cosT*ptr[i].y + y;
+					cells[i].x = std::floor(px/cellSize_ + 0.5f);
+					cells[i].y = std::floor(py/cellSize_ + 0.5f);
+				}
+			}
+			rasterize(node, 1, touched);
+			++added;
+		}
+	}
+
+	// tiles without any local map left
+	for(std::set<TileKey>::iterator iter=touched.begin(); iter!=touched.end(); ++iter)
+	{
+		std::map<TileKey, Tile>::iterator jter = tiles_.find(*iter);
+		if(jter != tiles_.end() && jter->second.points == 0)
+		{
+			tiles_.erase(jter);
+			modified_.erase(*iter);
+			removed_.insert(*iter);
+		}
+		else
+		{
+			modified_.insert(*iter);
+		}
+	}
+
+	UDEBUG("nodes=%d added=%d removed=%d tiles=%d modified=%d",
+			(int)nodes_.size(), added, (int)toRemove.size(), (int)tiles_.size(), (int)touched.size());
+	return (int)touched.size();
+}
+
+void TiledGrid::setViewpoint(float x, float y)
+{
+	viewX_ = x;
+	viewY_ = y;
+	for(std::map<TileKey, Tile>::iterator iter=tiles_.begin(); iter!=tiles_.end(); ++iter)
+	{
+		int level = tileLevel(iter->first);
+		if(level != iter->second.level)
+		{
+			iter->second.level = level;
+			modified_.insert(iter->first);
+		}
+	}
+}
+
+std::vector<TiledGrid::TileKey> TiledGrid::takeModified(bool all, std::vector<TileKey> & removed)
+{
+	std::vector<TileKey> keys;
+	removed.clear();
+	if(all)
+	{
+		keys.reserve(tiles_.size());
+		for(std::map<TileKey, Tile>::iterator iter=tiles_.begin(); iter!=tiles_.end(); ++iter)
+		{
+			keys.push_back(iter->first);
+		}
+	}
+	else
+	{
+		keys.assign(modified_.begin(), modified_.end());
+		removed.assign(removed_.begin(), removed_.end());
+	}
+	modified_.clear();
+	removed_.clear();
+	return keys;
+}
+
+std::vector<TiledGrid::TileKey> TiledGrid::tileKeys() const
+{
+	std::vector<TileKey> keys;
+	keys.reserve(tiles_.size());
+	for(std::map<TileKey, Tile>::const_iterator iter=tiles_.begin(); iter!=tiles_.end(); ++iter)
+	{
+		keys.push_back(iter->first);
+	}
+	return keys;
+}
+
+// A coarse cell is occupied if one of its cells is occupied, empty if one
+// of its cells is empty, unknown otherwise.
+cv::Mat TiledGrid::tileMap(const TileKey & key, int & level) const
+{
+	level = 0;
+	std::map<TileKey, Tile>::const_iterator iter = tiles_.find(key);
+	if(iter == tiles_.end())
+	{
+		return cv::Mat();
+	}
+	const Tile & tile = iter->second;
+	level = tile.level;
+	int factor = 1 << level;
+	cv::Mat map(tileCells_/factor, tileCells_/factor, CV_8SC1, cv::Scalar(-1));
+	for(int i=0; i<tileCells_; ++i)
+	{
+		const unsigned short * ground = tile.groundCounts.ptr<unsigned short>(i);
+		const unsigned short * obstacles = tile.obstacleCounts.ptr<unsigned short>(i);
+		char * row = map.ptr<char>(i/factor);
+		for(int j=0; j<tileCells_; ++j)
+		{
+			char & value = row[j/factor];
+			if(obstacles[j])
+			{
+				value = 100;
+			}
+			else if(ground[j] && value == -1)
+			{
+				value = 0;
+			}
+		}
+	}
+	return map;
+}
+
+void TiledGrid::rasterize(const NodeCells & node, int increment, std::set<TileKey> & touched)
+{
+	static const unsigned short saturated = std::numeric_limits<unsigned short>::max();
+	Tile * tile = 0;
+	TileKey key;
+	for(int k=0; k<2; ++k)
+	{
+		const std::vector<cv::Point2i> & cells = k==0?node.ground:node.obstacles;
+		for(unsigned int i=0; i<cells.size(); ++i)
+		{
+			// consecutive cells are generally in the same tile
+			TileKey cellKey(floorDiv(cells[i].x, tileCells_), floorDiv(cells[i].y, tileCells_));
+			if(tile == 0 || cellKey != key)
+			{
+				key = cellKey;
+				std::map<TileKey, Tile>::iterator iter = tiles_.find(key);
+				if(iter == tiles_.end())
+				{
+					UASSERT(increment > 0);
+					iter = tiles_.insert(std::make_pair(key, Tile())).first;
+					iter->second.groundCounts = cv::Mat::zeros(tileCells_, tileCells_, CV_16UC1);
+					iter->second.obstacleCounts = cv::Mat::zeros(tileCells_, tileCells_, CV_16UC1);
+					iter->second.level = tileLevel(key);
+					removed_.erase(key);
+				}
+				tile = &iter->second;
+				touched.insert(key);
+			}
+
+			// saturated counters stay saturated
+			cv::Mat & counts = k==0?tile->groundCounts:tile->obstacleCounts;
+			unsigned short & count = counts.at<unsigned short>(cells[i].y - key.second*tileCells_, cells[i].x - key.first*tileCells_);
+			if(count != saturated)
+			{
+				UASSERT(increment > 0 || count > 0);
+				count += increment;
+				tile->points += increment;
+			}
+		}
+	}
+}
+
+int TiledGrid::tileLevel(const TileKey & key) const
+{
+	if(levels_ <= 1 || fullResolutionRadius_ <= 0.0f)
+	{
+		return 0;
+	}
+	// distance from the viewpoint to the closest point of the tile
+	float length = tileLength();
+	float x0 = float(key.first)*length;
+	float y0 = float(key.second)*length;
+	float dx = viewX_<x0?x0-viewX_:viewX_>x0+length?viewX_-(x0+length):0.0f;
+	float dy = viewY_<y0?y0-viewY_:viewY_>y0+length?viewY_-(y0+length):0.0f;
+	float distance = std::sqrt(dx*dx + dy*dy);
+	if(distance <= fullResolutionRadius_)
+	{
+		return 0;
+	}
+	int level = 1 + int(std::floor(std::log(distance/fullResolutionRadius_)/std::log(2.0f)));
+	return level<levels_?level:levels_-1;
+}
+
+}
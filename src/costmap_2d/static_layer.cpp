@@ -38,11 +38,14 @@
 
 /*
  * Modified: added "layered_costmap_->updateMap(0,0,0);" below
+ * Modified: map values are interpreted with a lookup table and
+ *           only the changed part of a new map is reported in updateBounds()
  */
 
 #include "static_layer.h"
 #include <costmap_2d/costmap_math.h>
 #include <pluginlib/class_list_macros.h>
+#include <cstring>
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::StaticLayer, costmap_2d::Layer)
 
@@ -82,6 +85,7 @@ void StaticLayer::onInitialize()
 
   lethal_threshold_ = std::max(std::min(temp_lethal_threshold, 100), 0);
   unknown_cost_value_ = temp_unknown_cost_value;
+  updateCostLut();
   //we'll subscribe to the latched topic that the map server uses
   ROS_INFO("Requesting the map...");
   map_sub_ = g_nh.subscribe(map_topic, 1, &StaticLayer::incomingMap, this);
@@ -147,6 +151,40 @@ unsigned char StaticLayer::interpretValue(unsigned char value)
   return scale * LETHAL_OBSTACLE;
 }
 
+void StaticLayer::updateCostLut()
+{
+  for (unsigned int i = 0; i < 256; ++i)
+  {
+    cost_lut_[i] = interpretValue((unsigned char)i);
+  }
+}
+
+bool StaticLayer::copyRow(const int8_t* data, unsigned char* costs, unsigned int size,
+                          unsigned int& first, unsigned int& last)
+{
+  if (size == 0)
+    return false;
+  if (row_.size() < size)
+    row_.resize(size);
+  const unsigned char* values = (const unsigned char*)data;
+  unsigned char* row = &row_[0];
+  for (unsigned int i = 0; i < size; ++i)
+  {
+    row[i] = cost_lut_[values[i]];
+  }
+  if (memcmp(row, costs, size) == 0)
+    return false;
+
+  first = 0;
+  while (row[first] == costs[first])
+    ++first;
+  last = size - 1;
+  while (row[last] == costs[last])
+    --last;
+  memcpy(costs + first, row + first, last - first + 1);
+  return true;
+}
+
 void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
 {
   unsigned int size_x = new_map->info.width, size_y = new_map->info.height;
@@ -155,6 +193,7 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
 
   // resize costmap if size, resolution or origin do not match
   Costmap2D* master = layered_costmap_->getCostmap();
+  bool resized = !map_received_;
   if (master->getSizeInCellsX() != size_x ||
       master->getSizeInCellsY() != size_y ||
       master->getResolution() != new_map->info.resolution ||
@@ -165,45 +204,64 @@ void StaticLayer::incomingMap(const nav_msgs::OccupancyGridConstPtr& new_map)
     ROS_INFO("Resizing costmap to %d X %d at %f m/pix", size_x, size_y, new_map->info.resolution);
     layered_costmap_->resizeMap(size_x, size_y, new_map->info.resolution, new_map->info.origin.position.x,
                                 new_map->info.origin.position.y, true);
+    resized = true;
   }else if(size_x_ != size_x || size_y_ != size_y ||
       resolution_ != new_map->info.resolution ||
       origin_x_ != new_map->info.origin.position.x ||
       origin_y_ != new_map->info.origin.position.y){
     matchSize();
+    resized = true;
   }
 
-  unsigned int index = 0;
-
-  //initialize the costmap with static data
+  //initialize the costmap with static data, keeping the bounding box of the changed cells
+  unsigned int min_x = size_x, min_y = size_y, max_x = 0, max_y = 0;
   for (unsigned int i = 0; i < size_y; ++i)
   {
-    for (unsigned int j = 0; j < size_x; ++j)
+    unsigned int first, last;
+    if (copyRow(new_map->data.data() + i * size_x, costmap_ + i * size_x, size_x, first, last))
     {
-      unsigned char value = new_map->data[index];
-      costmap_[index] = interpretValue(value);
-      ++index;
+      min_x = std::min(min_x, first);
+      max_x = std::max(max_x, last);
+      min_y = std::min(min_y, i);
+      max_y = i;
     }
   }
-  x_ = y_ = 0;
-  width_ = size_x_;
-  height_ = size_y_;
+  if (resized)
+  {
+    x_ = y_ = 0;
+    width_ = size_x_;
+    height_ = size_y_;
+    has_updated_data_ = true;
+  }
+  else if (min_x <= max_x)
+  {
+    // add to the bounds not yet reported
+    if (has_updated_data_)
+    {
+      max_x = std::max(max_x, x_ + width_ - 1);
+      max_y = std::max(max_y, y_ + height_ - 1);
+      min_x = std::min(min_x, x_);
+      min_y = std::min(min_y, y_);
+    }
+    x_ = min_x;
+    y_ = min_y;
+    width_ = max_x - min_x + 1;
+    height_ = max_y - min_y + 1;
+    has_updated_data_ = true;
+  }
+  ROS_DEBUG("Map update bounds: %d,%d %dx%d (%s)", x_, y_, width_, height_, has_updated_data_?"changed":"unchanged");
   map_received_ = true;
-  has_updated_data_ = true;
 
   layered_costmap_->updateMap(0,0,0);
 }
 
 void StaticLayer::incomingUpdate(const map_msgs::OccupancyGridUpdateConstPtr& update)
 {
-    unsigned int di = 0;
+    unsigned int first, last;
     for (unsigned int y = 0; y < update->height ; y++)
     {
         unsigned int index_base = (update->y + y) * size_x_;
-        for (unsigned int x = 0; x < update->width ; x++)
-        {
-            unsigned int index = index_base + x + update->x;
-            costmap_[index] = interpretValue( update->data[di++] );
-        }
+        copyRow(update->data.data() + y * update->width, costmap_ + index_base + update->x, update->width, first, last);
     }
     x_ = update->x;
     y_ = update->y;
@@ -78,6 +78,10 @@ private:
   void reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_t level);
 
   unsigned char interpretValue(unsigned char value);
+  void updateCostLut();
+  // Interprets "size" values with cost_lut_ and copies them to "costs", returns
+  // false if they were the same. first and last are the changed indexes.
+  bool copyRow(const int8_t* data, unsigned char* costs, unsigned int size, unsigned int& first, unsigned int& last);
 
   std::string global_frame_; ///< @brief The global frame for the costmap
   bool subscribe_to_updates_;
@@ -90,6 +94,8 @@ private:
   ros::Subscriber map_sub_, map_update_sub_;
 
   unsigned char lethal_threshold_, unknown_cost_value_;
+  unsigned char cost_lut_[256]; ///< @brief interpretValue() of each map value
+  std::vector<unsigned char> row_;
 
   mutable boost::recursive_mutex lock_;
   dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig> *dsrv_;
@@ -0,0 +1,328 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "tiled_layer.h"
+#include <costmap_2d/costmap_math.h>
+#include <pluginlib/class_list_macros.h>
+#include <cstring>
+#include <cmath>
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::TiledLayer, costmap_2d::Layer)
+
+using costmap_2d::NO_INFORMATION;
+using costmap_2d::LETHAL_OBSTACLE;
+using costmap_2d::FREE_SPACE;
+
+namespace rtabmap_ros
+{
+
+TiledLayer::TiledLayer() :
+    rolling_window_(false),
+    map_received_(false),
+    rewrite_(false),
+    tile_length_(0.0),
+    dsrv_(NULL)
+{}
+
+TiledLayer::~TiledLayer()
+{
+  if (dsrv_)
+    delete dsrv_;
+}
+
+void TiledLayer::onInitialize()
+{
+  ros::NodeHandle nh("~/" + name_), g_nh;
+  current_ = true;
+
+  global_frame_ = layered_costmap_->getGlobalFrameID();
+  rolling_window_ = layered_costmap_->isRolling();
+
+  std::string map_topic;
+  nh.param("map_topic", map_topic, std::string("grid_map_tiles"));
+
+  nh.param("track_unknown_space", track_unknown_space_, true);
+  nh.param("use_maximum", use_maximum_, false);
+
+  int temp_lethal_threshold, temp_unknown_cost_value;
+  nh.param("lethal_cost_threshold", temp_lethal_threshold, int(100));
+  nh.param("unknown_cost_value", temp_unknown_cost_value, int(-1));
+  nh.param("trinary_costmap", trinary_costmap_, true);
+
+  lethal_threshold_ = std::max(std::min(temp_lethal_threshold, 100), 0);
+  unknown_cost_value_ = temp_unknown_cost_value;
+  updateCostLut();
+  default_value_ = track_unknown_space_ ? NO_INFORMATION : FREE_SPACE;
+  matchSize();
+
+  // the costmap keeps its size, it doesn't wait for the map like StaticLayer
+  {
+    boost::recursive_mutex::scoped_lock lock(lock_);
+    tiles_.clear();
+    changed_.clear();
+    map_received_ = false;
+  }
+  ROS_INFO("Subscribing to map tiles on \"%s\"", g_nh.resolveName(map_topic).c_str());
+  // the tiles not full are updates, they should not be dropped
+  tiles_sub_ = g_nh.subscribe(map_topic, 10, &TiledLayer::incomingTiles, this);
+
+  if (dsrv_)
+  {
+    delete dsrv_;
+  }
+
+  dsrv_ = new dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig>(nh);
+  dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig>::CallbackType cb = boost::bind(
+      &TiledLayer::reconfigureCB, this, _1, _2);
+  dsrv_->setCallback(cb);
+}
+
+void TiledLayer::reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_t level)
+{
+  if (config.enabled != enabled_)
+  {
+    boost::recursive_mutex::scoped_lock lock(lock_);
+    enabled_ = config.enabled;
+    rewrite_ = true;
+  }
+}
+
+void TiledLayer::matchSize()
+{
+  boost::recursive_mutex::scoped_lock lock(lock_);
+  Costmap2D* master = layered_costmap_->getCostmap();
+  resizeMap(master->getSizeInCellsX(), master->getSizeInCellsY(), master->getResolution(),
+            master->getOriginX(), master->getOriginY());
+  rewrite_ = true;
+}
+
+unsigned char TiledLayer::interpretValue(unsigned char value)
+{
+  //check if the static value is above the unknown or lethal thresholds
+  if (track_unknown_space_ && value == unknown_cost_value_)
+    return NO_INFORMATION;
+  else if (value >= lethal_threshold_)
+    return LETHAL_OBSTACLE;
+  else if (trinary_costmap_)
+    return FREE_SPACE;
+
+  double scale = (double) value / lethal_threshold_;
+  return scale * LETHAL_OBSTACLE;
+}
+
+void TiledLayer::updateCostLut()
+{
+  for (unsigned int i = 0; i < 256; ++i)
+  {
+    cost_lut_[i] = interpretValue((unsigned char)i);
+  }
+}
+
+void TiledLayer::incomingTiles(const rtabmap_ros::MapTilesConstPtr& tiles)
+{
+  if (tiles->header.frame_id != global_frame_)
+  {
+    ROS_WARN_THROTTLE(5.0, "Map tiles are in frame \"%s\" but the costmap is in frame \"%s\", ignoring them.",
+                      tiles->header.frame_id.c_str(), global_frame_.c_str());
+    return;
+  }
+
+  boost::recursive_mutex::scoped_lock lock(lock_);
+  if (!map_received_ && !tiles->full)
+  {
+    // (re)initialized: the updates are relative to all the tiles, sent on connection
+    ROS_DEBUG("Waiting for all the map tiles, ignoring %d updated tiles", (int)tiles->tiles.size());
+    return;
+  }
+  if (tiles->full || tiles->tile_length != tile_length_)
+  {
+    tiles_.clear();
+    changed_.clear();
+    rewrite_ = true;
+  }
+  tile_length_ = tiles->tile_length;
+
+  size_t bytes = 0;
+  for (unsigned int i = 0; i < tiles->tiles.size(); ++i)
+  {
+    const rtabmap_ros::MapTile& msg = tiles->tiles[i];
+    TileKey key(msg.x, msg.y);
+    if (msg.data.empty() || msg.size == 0 || msg.data.size() != msg.size * msg.size)
+    {
+      // removed from the map
+      tiles_.erase(key);
+    }
+    else
+    {
+      Tile& tile = tiles_[key];
+      tile.size = msg.size;
+      tile.costs.resize(msg.data.size());
+      const unsigned char* values = (const unsigned char*)msg.data.data();
+      for (unsigned int j = 0; j < tile.costs.size(); ++j)
+      {
+        tile.costs[j] = cost_lut_[values[j]];
+      }
+      bytes += tile.costs.size();
+    }
+    if (!rewrite_)
+      changed_.insert(key);
+  }
+  ROS_DEBUG("Received %d map tiles (%d bytes, full=%d), %d tiles kept", (int)tiles->tiles.size(), (int)bytes,
+            tiles->full ? 1 : 0, (int)tiles_.size());
+  map_received_ = true;
+}
+
+bool TiledLayer::writeTile(const TileKey& key, const Tile* tile, unsigned int& min_i, unsigned int& min_j,
+                           unsigned int& max_i, unsigned int& max_j)
+{
+  // cells of the window with their center inside the tile
+  double x0 = key.first * tile_length_;
+  double y0 = key.second * tile_length_;
+  int i0 = std::max(0, (int)std::ceil((x0 - origin_x_) / resolution_ - 0.5));
+  int j0 = std::max(0, (int)std::ceil((y0 - origin_y_) / resolution_ - 0.5));
+  int i1 = std::min((int)size_x_, (int)std::ceil((x0 + tile_length_ - origin_x_) / resolution_ - 0.5));
+  int j1 = std::min((int)size_y_, (int)std::ceil((y0 + tile_length_ - origin_y_) / resolution_ - 0.5));
+  if (i0 >= i1 || j0 >= j1)
+    return false;
+
+  double tile_resolution = tile ? tile_length_ / tile->size : 0.0;
+  for (int j = j0; j < j1; ++j)
+  {
+    unsigned char* row = costmap_ + j * size_x_;
+    if (tile == NULL)
+    {
+      memset(row + i0, default_value_, i1 - i0);
+      continue;
+    }
+    double wy = origin_y_ + (j + 0.5) * resolution_;
+    unsigned int ty = std::min(tile->size - 1, (unsigned int)std::max(0.0, (wy - y0) / tile_resolution));
+    const unsigned char* tile_row = &tile->costs[ty * tile->size];
+    for (int i = i0; i < i1; ++i)
+    {
+      double wx = origin_x_ + (i + 0.5) * resolution_;
+      unsigned int tx = std::min(tile->size - 1, (unsigned int)std::max(0.0, (wx - x0) / tile_resolution));
+      row[i] = tile_row[tx];
+    }
+  }
+  min_i = std::min(min_i, (unsigned int)i0);
+  min_j = std::min(min_j, (unsigned int)j0);
+  max_i = std::max(max_i, (unsigned int)i1 - 1);
+  max_j = std::max(max_j, (unsigned int)j1 - 1);
+  return true;
+}
+
+void TiledLayer::activate()
+{
+  onInitialize();
+}
+
+void TiledLayer::deactivate()
+{
+  tiles_sub_.shutdown();
+}
+
+void TiledLayer::reset()
+{
+  deactivate();
+  activate();
+}
+
+void TiledLayer::updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y,
+                              double* max_x, double* max_y)
+{
+  boost::recursive_mutex::scoped_lock lock(lock_);
+  if (rolling_window_)
+  {
+    // cells entering the window are copied from the tiles below
+    double old_x = origin_x_, old_y = origin_y_;
+    updateOrigin(robot_x - getSizeInMetersX() / 2, robot_y - getSizeInMetersY() / 2);
+    if (origin_x_ != old_x || origin_y_ != old_y)
+      rewrite_ = true;
+  }
+
+  if (!map_received_ || !(rewrite_ || !changed_.empty() || has_extra_bounds_))
+    return;
+
+  useExtraBounds(min_x, min_y, max_x, max_y);
+
+  unsigned int min_i = size_x_, min_j = size_y_, max_i = 0, max_j = 0;
+  int tiles = 0;
+  if (rewrite_)
+  {
+    // only the tiles covering the window
+    resetMap(0, 0, size_x_, size_y_);
+    int tx0 = (int)std::floor(origin_x_ / tile_length_);
+    int ty0 = (int)std::floor(origin_y_ / tile_length_);
+    int tx1 = (int)std::floor((origin_x_ + getSizeInMetersX()) / tile_length_);
+    int ty1 = (int)std::floor((origin_y_ + getSizeInMetersY()) / tile_length_);
+    for (int ty = ty0; ty <= ty1; ++ty)
+    {
+      for (int tx = tx0; tx <= tx1; ++tx)
+      {
+        std::map<TileKey, Tile>::const_iterator iter = tiles_.find(TileKey(tx, ty));
+        if (iter != tiles_.end() && writeTile(iter->first, &iter->second, min_i, min_j, max_i, max_j))
+          ++tiles;
+      }
+    }
+    min_i = min_j = 0;
+    max_i = size_x_ - 1;
+    max_j = size_y_ - 1;
+  }
+  else
+  {
+    for (std::set<TileKey>::iterator iter = changed_.begin(); iter != changed_.end(); ++iter)
+    {
+      std::map<TileKey, Tile>::const_iterator jter = tiles_.find(*iter);
+      if (writeTile(*iter, jter != tiles_.end() ? &jter->second : NULL, min_i, min_j, max_i, max_j))
+        ++tiles;
+    }
+  }
+  ROS_DEBUG("Copied %d map tiles in the costmap (%s)", tiles, rewrite_ ? "whole window" : "changed tiles");
+  rewrite_ = false;
+  changed_.clear();
+
+  if (min_i <= max_i && min_j <= max_j)
+  {
+    *min_x = std::min(*min_x, origin_x_ + min_i * resolution_);
+    *min_y = std::min(*min_y, origin_y_ + min_j * resolution_);
+    *max_x = std::max(*max_x, origin_x_ + (max_i + 1) * resolution_);
+    *max_y = std::max(*max_y, origin_y_ + (max_j + 1) * resolution_);
+  }
+}
+
+void TiledLayer::updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j)
+{
+  boost::recursive_mutex::scoped_lock lock(lock_);
+  if (!map_received_)
+    return;
+  if (!use_maximum_)
+    updateWithTrueOverwrite(master_grid, min_i, min_j, max_i, max_j);
+  else
+    updateWithMax(master_grid, min_i, min_j, max_i, max_j);
+}
+
+}  // namespace rtabmap_ros
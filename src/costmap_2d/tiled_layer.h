@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef RTABMAP_ROS_TILED_LAYER_H_
+#define RTABMAP_ROS_TILED_LAYER_H_
+
+#include <ros/ros.h>
+#include <costmap_2d/costmap_layer.h>
+#include <costmap_2d/layered_costmap.h>
+#include <costmap_2d/GenericPluginConfig.h>
+#include <dynamic_reconfigure/server.h>
+#include <rtabmap_ros/MapTiles.h>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace rtabmap_ros
+{
+
+/**
+ * Static layer receiving the map as tiles (see the "grid_map_tiles" topic
+ * of rtabmap with "grid_tiled"). The costmap is not resized to the map:
+ * only the tiles covering the costmap window are copied in it, at the
+ * resolution of the costmap, so a rolling window costmap only reads the
+ * tiles around the robot. The tiles received are kept for when the window
+ * moves over them.
+ */
+class TiledLayer : public costmap_2d::CostmapLayer
+{
+public:
+  TiledLayer();
+  virtual ~TiledLayer();
+  virtual void onInitialize();
+  virtual void activate();
+  virtual void deactivate();
+  virtual void reset();
+
+  virtual void updateBounds(double robot_x, double robot_y, double robot_yaw, double* min_x, double* min_y, double* max_x,
+                             double* max_y);
+  virtual void updateCosts(costmap_2d::Costmap2D& master_grid, int min_i, int min_j, int max_i, int max_j);
+
+  virtual void matchSize();
+
+private:
+  typedef std::pair<int, int> TileKey;
+  struct Tile
+  {
+    unsigned int size; ///< @brief cells per side
+    std::vector<unsigned char> costs; ///< @brief map values interpreted with cost_lut_
+  };
+
+  void incomingTiles(const rtabmap_ros::MapTilesConstPtr& tiles);
+  void reconfigureCB(costmap_2d::GenericPluginConfig &config, uint32_t level);
+
+  unsigned char interpretValue(unsigned char value);
+  void updateCostLut();
+  // Copies the tile (or the default value if null) in the cells of the
+  // window it covers, and extends the cell bounds. Returns false if the tile
+  // is outside the window.
+  bool writeTile(const TileKey& key, const Tile* tile, unsigned int& min_i, unsigned int& min_j, unsigned int& max_i,
+                 unsigned int& max_j);
+
+  std::string global_frame_; ///< @brief The global frame for the costmap
+  bool rolling_window_;
+  bool map_received_;
+  bool rewrite_; ///< @brief all the tiles covering the window should be copied
+  bool track_unknown_space_;
+  bool use_maximum_;
+  bool trinary_costmap_;
+  ros::Subscriber tiles_sub_;
+
+  unsigned char lethal_threshold_, unknown_cost_value_;
+  unsigned char cost_lut_[256]; ///< @brief interpretValue() of each map value
+
+  double tile_length_;
+  std::map<TileKey, Tile> tiles_;
+  std::set<TileKey> changed_; ///< @brief tiles received (or removed) since the last update
+
+  mutable boost::recursive_mutex lock_;
+  dynamic_reconfigure::Server<costmap_2d::GenericPluginConfig> *dsrv_;
+};
+
+}  // namespace rtabmap_ros
+
+#endif  // RTABMAP_ROS_TILED_LAYER_H_
@@ -42,6 +42,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cv_bridge/cv_bridge.h>
 
 #include <rtabmap/core/util2d.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "rtabmap_ros/AdaptiveRate.h"
 
 namespace rtabmap_ros
 {
@@ -102,6 +105,8 @@ private:
 		ROS_INFO("Decimation=%d", decimation_);
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
+		adaptiveRate_.init(nh, private_nh);
+
 		if(approxSync)
 		{
 			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), image_sub_, image_depth_sub_, info_sub_);
@@ -126,10 +131,11 @@ private:
 			const sensor_msgs::ImageConstPtr& imageDepth,
 			const sensor_msgs::CameraInfoConstPtr& camInfo)
 	{
-		if (rate_ > 0.0)
+		double rate = adaptiveRate_.rate(rate_);
+		if (rate > 0.0)
 		{
-			NODELET_DEBUG("update set to %f", rate_);
-			if ( last_update_ + ros::Duration(1.0/rate_) > ros::Time::now())
+			NODELET_DEBUG("update set to %f", rate);
+			if ( last_update_ + ros::Duration(1.0/rate) > ros::Time::now())
 			{
 				NODELET_DEBUG("throttle last update at %f skipping", last_update_.toSec());
 				return;
@@ -148,7 +154,9 @@ private:
 				cv_bridge::CvImage out;
 				out.header = imagePtr->header;
 				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
+				// same sampling as the depth image (first pixel of each block,
+				// like util2d::decimate), so the rgb and depth pixels stay registered
+				cv::resize(imagePtr->image, out.image, cv::Size(imagePtr->image.cols/decimation_, imagePtr->image.rows/decimation_), 0, 0, cv::INTER_NEAREST);
 				imagePub_.publish(out.toImageMsg());
 			}
 			else
@@ -212,6 +220,7 @@ private:
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
 
 	int decimation_;
+	AdaptiveRate adaptiveRate_;
 
 };
 
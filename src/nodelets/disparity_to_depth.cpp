@@ -37,9 +37,74 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cv_bridge/cv_bridge.h>
 
+#include <opencv2/core/core.hpp>
+
 namespace rtabmap_ros
 {
 
+// Converts rows of the disparity image in parallel, 32F and 16U depth in the same pass
+class DisparityToDepthBody : public cv::ParallelLoopBody
+{
+public:
+	DisparityToDepthBody(
+			const cv::Mat & disparity,
+			float minDisparity,
+			float maxDisparity,
+			float baselineFocal,
+			cv::Mat * depth32f,
+			cv::Mat * depth16u) :
+		disparity_(disparity),
+		minDisparity_(minDisparity),
+		maxDisparity_(maxDisparity),
+		baselineFocal_(baselineFocal),
+		depth32f_(depth32f),
+		depth16u_(depth16u)
+	{}
+
+	virtual void operator()(const cv::Range & range) const
+	{
+		const int cols = disparity_.cols;
+		for(int i = range.start; i < range.end; ++i)
+		{
+			const float * d = disparity_.ptr<float>(i);
+			float * out32f = depth32f_?depth32f_->ptr<float>(i):0;
+			unsigned short * out16u = depth16u_?depth16u_->ptr<unsigned short>(i):0;
+			if(out32f && out16u)
+			{
+				for(int j = 0; j < cols; ++j)
+				{
+					// baseline * focal / disparity
+					float depth = d[j] > minDisparity_ && d[j] < maxDisparity_?baselineFocal_ / d[j]:0.0f;
+					out32f[j] = depth;
+					out16u[j] = (unsigned short)(depth*1000.0f);
+				}
+			}
+			else if(out32f)
+			{
+				for(int j = 0; j < cols; ++j)
+				{
+					out32f[j] = d[j] > minDisparity_ && d[j] < maxDisparity_?baselineFocal_ / d[j]:0.0f;
+				}
+			}
+			else
+			{
+				for(int j = 0; j < cols; ++j)
+				{
+					out16u[j] = d[j] > minDisparity_ && d[j] < maxDisparity_?(unsigned short)(baselineFocal_ / d[j]*1000.0f):0;
+				}
+			}
+		}
+	}
+
+private:
+	const cv::Mat & disparity_;
+	float minDisparity_;
+	float maxDisparity_;
+	float baselineFocal_;
+	cv::Mat * depth32f_;
+	cv::Mat * depth16u_;
+};
+
 class DisparityToDepth : public nodelet::Nodelet
 {
 public:
@@ -73,38 +138,34 @@ private:
 		if(publish32f || publish16u)
 		{
 			// sensor_msgs::image_encodings::TYPE_32FC1
-			cv::Mat disparity(disparityMsg->image.height, disparityMsg->image.width, CV_32FC1, const_cast<uchar*>(disparityMsg->image.data.data()));
-
+			cv::Mat disparity(
+					disparityMsg->image.height,
+					disparityMsg->image.width,
+					CV_32FC1,
+					const_cast<uchar*>(disparityMsg->image.data.data()),
+					disparityMsg->image.step);
+
+			ros::WallTime start = ros::WallTime::now();
 			cv::Mat depth32f;
 			cv::Mat depth16u;
 			if(publish32f)
 			{
-				depth32f = cv::Mat::zeros(disparity.rows, disparity.cols, CV_32F);
+				depth32f = cv::Mat(disparity.rows, disparity.cols, CV_32F);
 			}
 			if(publish16u)
 			{
-				depth16u = cv::Mat::zeros(disparity.rows, disparity.cols, CV_16U);
-			}
-			for (int i = 0; i < disparity.rows; i++)
-			{
-				for (int j = 0; j < disparity.cols; j++)
-				{
-					float disparity_value = disparity.at<float>(i,j);
-					if (disparity_value > disparityMsg->min_disparity && disparity_value < disparityMsg->max_disparity)
-					{
-						// baseline * focal / disparity
-						float depth = disparityMsg->T * disparityMsg->f / disparity_value;
-						if(publish32f)
-						{
-							depth32f.at<float>(i,j) = depth;
-						}
-						if(publish16u)
-						{
-							depth16u.at<unsigned short>(i,j) = (unsigned short)(depth*1000.0f);
-						}
-					}
-				}
+				depth16u = cv::Mat(disparity.rows, disparity.cols, CV_16U);
 			}
+			// every pixel is written, invalid disparities are set to 0
+			cv::parallel_for_(cv::Range(0, disparity.rows),
+					DisparityToDepthBody(
+							disparity,
+							disparityMsg->min_disparity,
+							disparityMsg->max_disparity,
+							disparityMsg->T * disparityMsg->f,
+							publish32f?&depth32f:0,
+							publish16u?&depth16u:0));
+			NODELET_DEBUG("Converted disparity %dx%d in %f ms", disparity.cols, disparity.rows, (ros::WallTime::now()-start).toSec()*1000.0);
 
 			if(publish32f)
 			{
@@ -0,0 +1,289 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include "rtabmap_ros/MapData.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/IncrementalGrid.h"
+#include "rtabmap_ros/SessionFilter.h"
+#include "rtabmap_ros/MapDataDelta.h"
+#include "rtabmap_ros/ThreadPool.h"
+#include <rtabmap/core/util3d_mapping.h>
+#include <rtabmap/core/Graph.h>
+#include <rtabmap/core/Compression.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <nav_msgs/GetMap.h>
+#include <std_srvs/Empty.h>
+#include <boost/bind.hpp>
+#include <pcl_ros/transforms.h>
+#include <pcl_conversions/pcl_conversions.h>
+
+using namespace rtabmap;
+
+namespace rtabmap_ros
+{
+
+class GridMapAssembler : public nodelet::Nodelet
+{
+
+public:
+	GridMapAssembler() :
+		gridCellSize_(0.05), // meters
+		mapSize_(0), // meters
+		eroded_(false),
+		filterRadius_(0.5),
+		filterAngle_(30.0), // degrees
+		filterBySession_(false),
+		linearUpdate_(0.01), // meters
+		angularUpdate_(1.0), // degrees
+		mapDataDelta_(false)
+	{}
+
+	~GridMapAssembler()
+	{
+	}
+
+	virtual void onInit()
+	{
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+		pnh.param("cell_size", gridCellSize_, gridCellSize_); // m
+		pnh.param("map_size", mapSize_, mapSize_); // m
+		pnh.param("filter_radius", filterRadius_, filterRadius_);
+		pnh.param("filter_angle", filterAngle_, filterAngle_);
+		// filter each session (map ID) separately, unchanged sessions are not filtered again
+		pnh.param("filter_by_session", filterBySession_, filterBySession_);
+		pnh.param("eroded", eroded_, eroded_);
+		// nodes moved less than this are not added again to the map
+		pnh.param("linear_update", linearUpdate_, linearUpdate_);
+		pnh.param("angular_update", angularUpdate_, angularUpdate_);
+		// subscribe to mapData_delta instead of mapData, the graph is rebuilt from the deltas
+		pnh.param("map_data_delta", mapDataDelta_, mapDataDelta_);
+
+		UASSERT(gridCellSize_ > 0.0);
+		UASSERT(mapSize_ >= 0.0);
+
+		grid_.setParameters(gridCellSize_, mapSize_, eroded_);
+		sessionFilter_.setParameters(
+				filterAngle_ > 0.0?filterRadius_:0.0,
+				filterAngle_*CV_PI/180.0,
+				linearUpdate_,
+				angularUpdate_*CV_PI/180.0);
+
+		ros::NodeHandle & nh = getNodeHandle();
+		if(mapDataDelta_)
+		{
+			mapDataTopic_ = nh.subscribe("mapData_delta", 10, &GridMapAssembler::mapDataDeltaReceivedCallback, this);
+		}
+		else
+		{
+			mapDataTopic_ = nh.subscribe("mapData", 1, &GridMapAssembler::mapDataReceivedCallback, this);
+		}
+
+		gridMap_ = nh.advertise<nav_msgs::OccupancyGrid>("grid_map", 1);
+
+		//private service
+		getMapService_ = pnh.advertiseService("get_map", &GridMapAssembler::getGridMapCallback, this);
+		resetService_ = pnh.advertiseService("reset", &GridMapAssembler::reset, this);
+	}
+
+	void mapDataDeltaReceivedCallback(const rtabmap_ros::MapDataConstPtr & msg)
+	{
+		rtabmap_ros::MapDataPtr map(new rtabmap_ros::MapData);
+		if(mapDataDecoder_.decode(*msg, *map))
+		{
+			mapDataReceivedCallback(map);
+		}
+		else if((ros::Time::now() - lastResyncRequest_).toSec() > 1.0)
+		{
+			// missed messages, ask rtabmap for a keyframe
+			lastResyncRequest_ = ros::Time::now();
+			std_srvs::Empty srv;
+			if(!ros::service::call(getNodeHandle().resolveName("resync_map_data"), srv))
+			{
+				ROS_WARN("grid_map_assembler: Cannot call \"resync_map_data\" service, waiting for a keyframe...");
+			}
+		}
+	}
+
+	void mapDataReceivedCallback(const rtabmap_ros::MapDataConstPtr & msg)
+	{
+		UTimer timer;
+
+		// decompress and create the local maps of new nodes in parallel
+		std::vector<LocalMap> localMaps;
+		for(unsigned int i=0; i<msg->nodes.size(); ++i)
+		{
+			if(!uContains(gridMaps_, msg->nodes[i].id) && msg->nodes[i].laserScan.size())
+			{
+				LocalMap localMap;
+				localMap.node = &msg->nodes[i];
+				localMaps.push_back(localMap);
+			}
+		}
+		rtabmap_ros::ThreadPool::instance().parallelFor(localMaps.size(), boost::bind(&GridMapAssembler::createLocalMap, this, &localMaps, _1));
+		for(unsigned int i=0; i<localMaps.size(); ++i)
+		{
+			if(!localMaps[i].ground.empty() || !localMaps[i].obstacles.empty())
+			{
+				gridMaps_.insert(std::make_pair(localMaps[i].node->id, std::make_pair(localMaps[i].ground, localMaps[i].obstacles)));
+			}
+		}
+
+		std::map<int, Transform> poses;
+		rtabmap_ros::Graph unpackedGraph;
+		const rtabmap_ros::Graph & graphMsg = rtabmap_ros::mapGraphUnpacked(msg->graph, unpackedGraph);
+		for(unsigned int i=0; i<graphMsg.nodeIds.size() && i<graphMsg.poses.size(); ++i)
+		{
+			poses.insert(std::make_pair(graphMsg.nodeIds[i], rtabmap_ros::transformFromPoseMsg(graphMsg.poses[i])));
+		}
+
+		if(filterBySession_)
+		{
+			std::map<int, int> mapIds;
+			for(unsigned int i=0; i<graphMsg.nodeIds.size() && i<graphMsg.mapIds.size(); ++i)
+			{
+				mapIds.insert(mapIds.end(), std::make_pair(graphMsg.nodeIds[i], graphMsg.mapIds[i]));
+			}
+			poses = sessionFilter_.filter(poses, mapIds);
+		}
+		else if(filterRadius_ > 0.0 && filterAngle_ > 0.0)
+		{
+			poses = rtabmap::graph::radiusPosesFiltering(poses, filterRadius_, filterAngle_*CV_PI/180.0);
+		}
+
+		if(gridMap_.getNumSubscribers())
+		{
+			// update the map, only local maps of new or moved nodes are added
+			grid_.update(poses, gridMaps_, linearUpdate_, angularUpdate_*CV_PI/180.0);
+			const cv::Mat & pixels = grid_.map();
+			float xMin = grid_.xMin();
+			float yMin = grid_.yMin();
+
+			if(!pixels.empty())
+			{
+				//init
+				map_.info.resolution = gridCellSize_;
+				map_.info.origin.position.x = 0.0;
+				map_.info.origin.position.y = 0.0;
+				map_.info.origin.position.z = 0.0;
+				map_.info.origin.orientation.x = 0.0;
+				map_.info.origin.orientation.y = 0.0;
+				map_.info.origin.orientation.z = 0.0;
+				map_.info.origin.orientation.w = 1.0;
+
+				map_.info.width = pixels.cols;
+				map_.info.height = pixels.rows;
+				map_.info.origin.position.x = xMin;
+				map_.info.origin.position.y = yMin;
+				map_.data.resize(map_.info.width * map_.info.height);
+
+				memcpy(map_.data.data(), pixels.data, map_.info.width * map_.info.height);
+
+				map_.header.frame_id = msg->header.frame_id;
+				map_.header.stamp = ros::Time::now();
+
+				gridMap_.publish(map_);
+				ROS_INFO("Grid Map published [%d,%d] (%fs)", pixels.cols, pixels.rows, timer.ticks());
+			}
+		}
+	}
+
+	bool getGridMapCallback(nav_msgs::GetMap::Request  &req, nav_msgs::GetMap::Response &res)
+	{
+		if(map_.data.size())
+		{
+			res.map = map_;
+			return true;
+		}
+		return false;
+	}
+
+	bool reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+	{
+		ROS_INFO("grid_map_assembler: reset!");
+		gridMaps_.clear();
+		grid_.clear();
+		sessionFilter_.clear();
+		map_ = nav_msgs::OccupancyGrid();
+		mapDataDecoder_.clear();
+		return true;
+	}
+
+private:
+	struct LocalMap
+	{
+		LocalMap() : node(0) {}
+		const rtabmap_ros::NodeData * node;
+		cv::Mat ground; // output
+		cv::Mat obstacles; // output
+	};
+
+	// Called by the thread pool, only the map at "index" is modified
+	void createLocalMap(std::vector<LocalMap> * localMaps, int index) const
+	{
+		LocalMap & localMap = localMaps->at(index);
+		cv::Mat laserScan = rtabmap::uncompressData(localMap.node->laserScan);
+		if(!laserScan.empty())
+		{
+			util3d::occupancy2DFromLaserScan(laserScan, localMap.ground, localMap.obstacles, gridCellSize_);
+		}
+	}
+
+private:
+	double gridCellSize_;
+	double mapSize_;
+	bool eroded_;
+	double filterRadius_;
+	double filterAngle_;
+	bool filterBySession_;
+	double linearUpdate_;
+	double angularUpdate_;
+	bool mapDataDelta_;
+
+	ros::Subscriber mapDataTopic_;
+	rtabmap_ros::MapDataDeltaDecoder mapDataDecoder_;
+	ros::Time lastResyncRequest_;
+
+	ros::Publisher gridMap_;
+
+	ros::ServiceServer getMapService_;
+	ros::ServiceServer resetService_;
+
+	std::map<int, std::pair<cv::Mat, cv::Mat> > gridMaps_; //<ground,obstacles>
+	rtabmap_ros::IncrementalGrid grid_;
+	rtabmap_ros::SessionFilter sessionFilter_;
+
+	nav_msgs::OccupancyGrid map_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::GridMapAssembler, nodelet::Nodelet);
+}
@@ -0,0 +1,612 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include "rtabmap_ros/MapData.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include "rtabmap_ros/PosesDiff.h"
+#include "rtabmap_ros/SessionFilter.h"
+#include "rtabmap_ros/VoxelHash.h"
+#include "rtabmap_ros/IncrementalGrid.h"
+#include "rtabmap_ros/CompactCloud.h"
+#include "rtabmap_ros/MapDataDelta.h"
+#include "rtabmap_ros/ThreadPool.h"
+#include <rtabmap/core/util3d_transforms.h>
+#include <rtabmap/core/util3d.h>
+#include <rtabmap/core/util3d_filtering.h>
+#include <rtabmap/core/util3d_mapping.h>
+#include <rtabmap/core/util3d_conversions.h>
+#include <rtabmap/core/Compression.h>
+#include <rtabmap/core/Graph.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UStl.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <pcl_ros/transforms.h>
+#include <pcl_conversions/pcl_conversions.h>
+#include <nav_msgs/OccupancyGrid.h>
+#include <std_srvs/Empty.h>
+#include <boost/bind.hpp>
+
+using namespace rtabmap;
+
+namespace rtabmap_ros
+{
+
+class MapAssembler : public nodelet::Nodelet
+{
+
+public:
+	MapAssembler() :
+		cloudDecimation_(4),
+		cloudMaxDepth_(4.0),
+		cloudVoxelSize_(0.02),
+		scanVoxelSize_(0.01),
+		nodeFilteringAngle_(30), // degrees
+		nodeFilteringRadius_(0.5),
+		filterBySession_(false),
+		noiseFilterRadius_(0.0),
+		noiseFilterMinNeighbors_(5),
+		computeOccupancyGrid_(false),
+		gridCellSize_(0.05),
+		groundMaxAngle_(M_PI_4),
+		clusterMinSize_(20),
+		maxHeight_(0),
+		occupancyMapSize_(0.0),
+		linearUpdate_(0.01), // meters
+		angularUpdate_(1.0), // degrees
+		compactClouds_(false),
+		mapDataDelta_(false)
+	{}
+
+	~MapAssembler()
+	{
+	}
+
+	virtual void onInit()
+	{
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+		pnh.param("cloud_decimation", cloudDecimation_, cloudDecimation_);
+		pnh.param("cloud_max_depth", cloudMaxDepth_, cloudMaxDepth_);
+		pnh.param("cloud_voxel_size", cloudVoxelSize_, cloudVoxelSize_);
+		pnh.param("scan_voxel_size", scanVoxelSize_, scanVoxelSize_);
+
+		pnh.param("filter_radius", nodeFilteringRadius_, nodeFilteringRadius_);
+		pnh.param("filter_angle", nodeFilteringAngle_, nodeFilteringAngle_);
+		// filter each session (map ID) separately, unchanged sessions are not filtered again
+		pnh.param("filter_by_session", filterBySession_, filterBySession_);
+
+		pnh.param("noise_filter_radius", noiseFilterRadius_, noiseFilterRadius_);
+		pnh.param("noise_filter_min_neighbors", noiseFilterMinNeighbors_, noiseFilterMinNeighbors_);
+
+		pnh.param("occupancy_grid", computeOccupancyGrid_, computeOccupancyGrid_);
+		pnh.param("occupancy_cell_size", gridCellSize_, gridCellSize_);
+		pnh.param("occupancy_ground_max_angle", groundMaxAngle_, groundMaxAngle_);
+		pnh.param("occupancy_cluster_min_size", clusterMinSize_, clusterMinSize_);
+		pnh.param("occupancy_max_height", maxHeight_, maxHeight_);
+		pnh.param("occupancy_map_size", occupancyMapSize_, occupancyMapSize_);
+
+		// nodes moved less than this are not transformed again
+		pnh.param("linear_update", linearUpdate_, linearUpdate_);
+		pnh.param("angular_update", angularUpdate_, angularUpdate_);
+
+		// keep node clouds quantized in memory (9 bytes/point instead of 32)
+		pnh.param("compact_clouds", compactClouds_, compactClouds_);
+
+		// subscribe to mapData_delta instead of mapData, the graph is rebuilt from the deltas
+		pnh.param("map_data_delta", mapDataDelta_, mapDataDelta_);
+
+		UASSERT(gridCellSize_ > 0);
+		UASSERT(maxHeight_ >= 0);
+		UASSERT(occupancyMapSize_ >=0.0);
+
+		cloudPoses_.setTolerances(linearUpdate_, angularUpdate_*CV_PI/180.0);
+		scanPoses_.setTolerances(linearUpdate_, angularUpdate_*CV_PI/180.0);
+		cloudVoxels_.setVoxelSize(cloudVoxelSize_);
+		scanVoxels_.setVoxelSize(scanVoxelSize_);
+		occupancyGrid_.setParameters(gridCellSize_, occupancyMapSize_, false);
+		sessionFilter_.setParameters(
+				nodeFilteringAngle_ > 0.0?nodeFilteringRadius_:0.0,
+				nodeFilteringAngle_*CV_PI/180.0,
+				linearUpdate_,
+				angularUpdate_*CV_PI/180.0);
+
+		ros::NodeHandle & nh = getNodeHandle();
+		if(mapDataDelta_)
+		{
+			mapDataTopic_ = nh.subscribe("mapData_delta", 10, &MapAssembler::mapDataDeltaReceivedCallback, this);
+		}
+		else
+		{
+			mapDataTopic_ = nh.subscribe("mapData", 1, &MapAssembler::mapDataReceivedCallback, this);
+		}
+
+		assembledMapClouds_ = nh.advertise<sensor_msgs::PointCloud2>("assembled_clouds", 1);
+		assembledMapScans_ = nh.advertise<sensor_msgs::PointCloud2>("assembled_scans", 1);
+		if(computeOccupancyGrid_)
+		{
+			occupancyMapPub_ = nh.advertise<nav_msgs::OccupancyGrid>("grid_projection_map", 1);
+		}
+
+		// private service
+		resetService_ = pnh.advertiseService("reset", &MapAssembler::reset, this);
+	}
+
+	void mapDataDeltaReceivedCallback(const rtabmap_ros::MapDataConstPtr & msg)
+	{
+		rtabmap_ros::MapDataPtr map(new rtabmap_ros::MapData);
+		if(mapDataDecoder_.decode(*msg, *map))
+		{
+			mapDataReceivedCallback(map);
+		}
+		else if((ros::Time::now() - lastResyncRequest_).toSec() > 1.0)
+		{
+			// missed messages, ask rtabmap for a keyframe
+			lastResyncRequest_ = ros::Time::now();
+			std_srvs::Empty srv;
+			if(!ros::service::call(getNodeHandle().resolveName("resync_map_data"), srv))
+			{
+				ROS_WARN("map_assembler: Cannot call \"resync_map_data\" service, waiting for a keyframe...");
+			}
+		}
+	}
+
+	void mapDataReceivedCallback(const rtabmap_ros::MapDataConstPtr & msg)
+	{
+		UTimer timer;
+
+		// decompress and create the local maps of new nodes in parallel
+		std::vector<LocalData> localData;
+		for(unsigned int i=0; i<msg->nodes.size(); ++i)
+		{
+			int id = msg->nodes[i].id;
+			LocalData data;
+			data.node = &msg->nodes[i];
+			data.cloudRequired = !uContains(rgbClouds_, id) && !uContains(rgbCompactClouds_, id);
+			data.scanRequired = !uContains(scans_, id) && msg->nodes[i].laserScan.size();
+			if(data.cloudRequired || data.scanRequired)
+			{
+				localData.push_back(data);
+			}
+		}
+		rtabmap_ros::ThreadPool::instance().parallelFor(localData.size(), boost::bind(&MapAssembler::createLocalData, this, &localData, _1));
+
+		// merge in node order
+		for(unsigned int i=0; i<localData.size(); ++i)
+		{
+			int id = localData[i].node->id;
+			if(localData[i].cloud.get())
+			{
+				if(compactClouds_)
+				{
+					rgbCompactClouds_.insert(std::make_pair(id, rtabmap_ros::CompactCloud(*localData[i].cloud)));
+				}
+				else
+				{
+					rgbClouds_.insert(std::make_pair(id, localData[i].cloud));
+				}
+			}
+			if(!localData[i].ground.empty() || !localData[i].obstacles.empty())
+			{
+				occupancyLocalMaps_.insert(std::make_pair(id, std::make_pair(localData[i].ground, localData[i].obstacles)));
+			}
+			if(localData[i].scan.get())
+			{
+				scans_.insert(std::make_pair(id, localData[i].scan));
+			}
+		}
+		ROS_DEBUG("map_assembler: %d nodes processed (%d threads, %fs)",
+				(int)localData.size(), rtabmap_ros::ThreadPool::instance().threads(), timer.elapsed());
+
+		// filter poses
+		std::map<int, Transform> poses;
+		rtabmap_ros::Graph unpackedGraph;
+		const rtabmap_ros::Graph & graphMsg = rtabmap_ros::mapGraphUnpacked(msg->graph, unpackedGraph);
+		for(unsigned int i=0; i<graphMsg.nodeIds.size() && i<graphMsg.poses.size(); ++i)
+		{
+			poses.insert(std::make_pair(graphMsg.nodeIds[i], rtabmap_ros::transformFromPoseMsg(graphMsg.poses[i])));
+		}
+		if(filterBySession_)
+		{
+			std::map<int, int> mapIds;
+			for(unsigned int i=0; i<graphMsg.nodeIds.size() && i<graphMsg.mapIds.size(); ++i)
+			{
+				mapIds.insert(mapIds.end(), std::make_pair(graphMsg.nodeIds[i], graphMsg.mapIds[i]));
+			}
+			poses = sessionFilter_.filter(poses, mapIds);
+		}
+		else if(nodeFilteringAngle_ > 0.0 && nodeFilteringRadius_ > 0.0)
+		{
+			poses = rtabmap::graph::radiusPosesFiltering(poses, nodeFilteringRadius_, nodeFilteringAngle_*CV_PI/180.0);
+		}
+
+		if(assembledMapClouds_.getNumSubscribers())
+		{
+			// generate the assembled cloud!
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr assembledCloud = compactClouds_?
+					assemble(poses, rgbCompactClouds_, cloudPoses_, transformedClouds_, cloudVoxels_, cloudVoxelSize_ > 0):
+					assemble(poses, rgbClouds_, cloudPoses_, transformedClouds_, cloudVoxels_, cloudVoxelSize_ > 0);
+
+			if(assembledCloud->size())
+			{
+				sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
+				pcl::toROSMsg(*assembledCloud, *cloudMsg);
+				cloudMsg->header.stamp = ros::Time::now();
+				cloudMsg->header.frame_id = msg->header.frame_id;
+				assembledMapClouds_.publish(cloudMsg);
+			}
+		}
+
+		if(assembledMapScans_.getNumSubscribers())
+		{
+			// generate the assembled scan!
+			pcl::PointCloud<pcl::PointXYZ>::Ptr assembledCloud = assemble(
+					poses, scans_, scanPoses_, transformedScans_, scanVoxels_, scanVoxelSize_ > 0);
+
+			if(assembledCloud->size())
+			{
+				sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
+				pcl::toROSMsg(*assembledCloud, *cloudMsg);
+				cloudMsg->header.stamp = ros::Time::now();
+				cloudMsg->header.frame_id = msg->header.frame_id;
+				assembledMapScans_.publish(cloudMsg);
+			}
+		}
+
+		if(occupancyMapPub_.getNumSubscribers())
+		{
+			// update the map, only local maps of new or moved nodes are added
+			occupancyGrid_.update(poses, occupancyLocalMaps_, linearUpdate_, angularUpdate_*CV_PI/180.0);
+			const cv::Mat & pixels = occupancyGrid_.map();
+			float xMin = occupancyGrid_.xMin();
+			float yMin = occupancyGrid_.yMin();
+
+			if(!pixels.empty())
+			{
+				//init
+				nav_msgs::OccupancyGrid map;
+				map.info.resolution = gridCellSize_;
+				map.info.origin.position.x = 0.0;
+				map.info.origin.position.y = 0.0;
+				map.info.origin.position.z = 0.0;
+				map.info.origin.orientation.x = 0.0;
+				map.info.origin.orientation.y = 0.0;
+				map.info.origin.orientation.z = 0.0;
+				map.info.origin.orientation.w = 1.0;
+
+				map.info.width = pixels.cols;
+				map.info.height = pixels.rows;
+				map.info.origin.position.x = xMin;
+				map.info.origin.position.y = yMin;
+				map.data.resize(map.info.width * map.info.height);
+
+				memcpy(map.data.data(), pixels.data, map.info.width * map.info.height);
+
+				map.header.frame_id = msg->header.frame_id;
+				map.header.stamp = ros::Time::now();
+
+				occupancyMapPub_.publish(map);
+			}
+		}
+		ROS_INFO("Processing data %fs", timer.ticks());
+	}
+
+	bool reset(std_srvs::Empty::Request&, std_srvs::Empty::Response&)
+	{
+		ROS_INFO("map_assembler: reset!");
+		occupancyLocalMaps_.clear();
+		rgbClouds_.clear();
+		rgbCompactClouds_.clear();
+		scans_.clear();
+		cloudPoses_.clear();
+		scanPoses_.clear();
+		transformedClouds_.clear();
+		transformedScans_.clear();
+		cloudVoxels_.clear();
+		scanVoxels_.clear();
+		occupancyGrid_.clear();
+		sessionFilter_.clear();
+		mapDataDecoder_.clear();
+		return true;
+	}
+
+private:
+	struct LocalData
+	{
+		LocalData() :
+			node(0),
+			cloudRequired(false),
+			scanRequired(false)
+		{}
+		const rtabmap_ros::NodeData * node;
+		bool cloudRequired;
+		bool scanRequired;
+
+		// outputs
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+		cv::Mat ground;
+		cv::Mat obstacles;
+		pcl::PointCloud<pcl::PointXYZ>::Ptr scan;
+	};
+
+	// Called by the thread pool, only the data at "index" is modified
+	void createLocalData(std::vector<LocalData> * localData, int index) const
+	{
+		LocalData & data = localData->at(index);
+		const rtabmap_ros::NodeData & node = *data.node;
+		if(data.cloudRequired)
+		{
+			rtabmap::Transform localTransform = rtabmap_ros::transformFromGeometryMsg(node.localTransform);
+			if(!localTransform.isNull())
+			{
+				float fx = node.fx;
+				float fy = node.fy;
+				float cx = node.cx;
+				float cy = node.cy;
+
+				//uncompress data
+				cv::Mat image = rtabmap::uncompressImage(rtabmap_ros::compressedMatFromBytes(node.image, false));
+				cv::Mat depth = rtabmap::uncompressImage(rtabmap_ros::compressedMatFromBytes(node.depth, false));
+
+				if(!image.empty() && !depth.empty() && fx > 0.0f && fy > 0.0f && cx >= 0.0f && cy >= 0.0f)
+				{
+					pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+					if(depth.type() == CV_8UC1)
+					{
+						cloud = util3d::cloudFromStereoImages(image, depth, cx, cy, fx, fy, cloudDecimation_);
+					}
+					else
+					{
+						cloud = util3d::cloudFromDepthRGB(image, depth, cx, cy, fx, fy, cloudDecimation_);
+					}
+
+					if(cloud->size() && cloudMaxDepth_ > 0)
+					{
+						cloud = util3d::passThrough(cloud, "z", 0, cloudMaxDepth_);
+					}
+					if(cloud->size() && noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0)
+					{
+						pcl::IndicesPtr indices = rtabmap::util3d::radiusFiltering(cloud, noiseFilterRadius_, noiseFilterMinNeighbors_);
+						pcl::PointCloud<pcl::PointXYZRGB>::Ptr tmp(new pcl::PointCloud<pcl::PointXYZRGB>);
+						pcl::copyPointCloud(*cloud, *indices, *tmp);
+						cloud = tmp;
+					}
+					if(cloud->size() && cloudVoxelSize_ > 0)
+					{
+						cloud = util3d::voxelize(cloud, cloudVoxelSize_);
+					}
+
+					if(cloud->size())
+					{
+						cloud = util3d::transformPointCloud(cloud, localTransform);
+						data.cloud = cloud;
+
+						if(computeOccupancyGrid_)
+						{
+							pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloudClipped = cloud;
+							if(cloudClipped->size() && maxHeight_ > 0)
+							{
+								cloudClipped = util3d::passThrough(cloudClipped, "z", std::numeric_limits<int>::min(), maxHeight_);
+							}
+							if(cloudClipped->size())
+							{
+								cloudClipped = util3d::voxelize(cloudClipped, gridCellSize_);
+								util3d::occupancy2DFromCloud3D<pcl::PointXYZRGB>(cloudClipped, data.ground, data.obstacles, gridCellSize_, groundMaxAngle_, clusterMinSize_);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		if(data.scanRequired)
+		{
+			cv::Mat laserScan = rtabmap::uncompressData(node.laserScan);
+			if(!laserScan.empty())
+			{
+				pcl::PointCloud<pcl::PointXYZ>::Ptr cloud = util3d::laserScanToPointCloud(laserScan);
+				if(cloud->size() && scanVoxelSize_ > 0)
+				{
+					cloud = util3d::voxelize(cloud, scanVoxelSize_);
+				}
+				if(cloud->size())
+				{
+					data.scan = cloud;
+				}
+			}
+		}
+	}
+
+	// Only clouds of new or moved nodes are transformed, output is voxelized incrementally
+	static pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformCloud(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud, const Transform & transform)
+	{
+		return util3d::transformPointCloud(cloud, transform);
+	}
+	static pcl::PointCloud<pcl::PointXYZ>::Ptr transformCloud(const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud, const Transform & transform)
+	{
+		return util3d::transformPointCloud(cloud, transform);
+	}
+	static pcl::PointCloud<pcl::PointXYZRGB>::Ptr transformCloud(const rtabmap_ros::CompactCloud & cloud, const Transform & transform)
+	{
+		return cloud.uncompress(transform);
+	}
+
+	// The clouds in map frame are kept compact (9 bytes per point). They are
+	// added to the voxels as expanded from the compact form, so they can be
+	// removed exactly.
+	static void storeCloud(rtabmap_ros::CompactCloud & stored, const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud)
+	{
+		stored.set(*cloud);
+	}
+	static void storeCloud(pcl::PointCloud<pcl::PointXYZ>::Ptr & stored, const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud)
+	{
+		stored = cloud;
+	}
+	static pcl::PointCloud<pcl::PointXYZRGB>::Ptr storedCloud(const rtabmap_ros::CompactCloud & stored)
+	{
+		return stored.uncompress();
+	}
+	static pcl::PointCloud<pcl::PointXYZ>::Ptr storedCloud(const pcl::PointCloud<pcl::PointXYZ>::Ptr & stored)
+	{
+		return stored;
+	}
+	static void appendStoredCloud(pcl::PointCloud<pcl::PointXYZRGB> & output, const rtabmap_ros::CompactCloud & stored)
+	{
+		stored.appendTo(output);
+	}
+	static void appendStoredCloud(pcl::PointCloud<pcl::PointXYZ> & output, const pcl::PointCloud<pcl::PointXYZ>::Ptr & stored)
+	{
+		output += *stored;
+	}
+	static size_t storedSize(const rtabmap_ros::CompactCloud & stored)
+	{
+		return stored.size();
+	}
+	static size_t storedSize(const pcl::PointCloud<pcl::PointXYZ>::Ptr & stored)
+	{
+		return stored->size();
+	}
+
+	template<typename PointT, typename CloudT, typename StoredT>
+	typename pcl::PointCloud<PointT>::Ptr assemble(
+			const std::map<int, Transform> & poses,
+			const std::map<int, CloudT> & clouds,
+			rtabmap_ros::PosesDiff & posesDiff,
+			std::map<int, StoredT> & transformedClouds,
+			rtabmap_ros::VoxelHash<PointT> & voxels,
+			bool voxelized)
+	{
+		std::map<int, Transform> posesWithClouds;
+		for(std::map<int, Transform>::const_iterator iter = poses.begin(); iter!=poses.end(); ++iter)
+		{
+			if(clouds.find(iter->first) != clouds.end())
+			{
+				posesWithClouds.insert(posesWithClouds.end(), *iter);
+			}
+		}
+		posesDiff.update(posesWithClouds);
+
+		std::vector<int> removed(posesDiff.removed().begin(), posesDiff.removed().end());
+		removed.insert(removed.end(), posesDiff.moved().begin(), posesDiff.moved().end());
+		for(unsigned int i=0; i<removed.size(); ++i)
+		{
+			typename std::map<int, StoredT>::iterator iter = transformedClouds.find(removed[i]);
+			if(iter != transformedClouds.end())
+			{
+				if(voxelized)
+				{
+					voxels.remove(*storedCloud(iter->second));
+				}
+				transformedClouds.erase(iter);
+			}
+		}
+
+		size_t totalSize = 0;
+		for(std::map<int, Transform>::const_iterator iter = posesDiff.poses().begin(); iter!=posesDiff.poses().end(); ++iter)
+		{
+			typename std::map<int, StoredT>::iterator jter = transformedClouds.find(iter->first);
+			if(jter == transformedClouds.end())
+			{
+				jter = transformedClouds.insert(std::make_pair(iter->first, StoredT())).first;
+				storeCloud(jter->second, transformCloud(clouds.at(iter->first), iter->second));
+				if(voxelized)
+				{
+					voxels.add(*storedCloud(jter->second));
+				}
+			}
+			totalSize += storedSize(jter->second);
+		}
+		UDEBUG("added=%d removed=%d moved=%d", (int)posesDiff.added().size(), (int)posesDiff.removed().size(), (int)posesDiff.moved().size());
+
+		if(voxelized)
+		{
+			return voxels.getCloud();
+		}
+
+		typename pcl::PointCloud<PointT>::Ptr assembledCloud(new pcl::PointCloud<PointT>);
+		assembledCloud->reserve(totalSize);
+		for(typename std::map<int, StoredT>::iterator iter=transformedClouds.begin(); iter!=transformedClouds.end(); ++iter)
+		{
+			appendStoredCloud(*assembledCloud, iter->second);
+		}
+		return assembledCloud;
+	}
+
+private:
+	int cloudDecimation_;
+	double cloudMaxDepth_;
+	double cloudVoxelSize_;
+	double scanVoxelSize_;
+
+	double nodeFilteringAngle_;
+	double nodeFilteringRadius_;
+	bool filterBySession_;
+
+	double noiseFilterRadius_;
+	double noiseFilterMinNeighbors_;
+
+	bool computeOccupancyGrid_;
+	double gridCellSize_;
+	double groundMaxAngle_;
+	int clusterMinSize_;
+	double maxHeight_;
+	double occupancyMapSize_;
+	double linearUpdate_;
+	double angularUpdate_;
+	bool compactClouds_;
+	bool mapDataDelta_;
+
+	std::map<int, std::pair<cv::Mat, cv::Mat> > occupancyLocalMaps_; // <ground, obstacles>
+
+	ros::Subscriber mapDataTopic_;
+	rtabmap_ros::MapDataDeltaDecoder mapDataDecoder_;
+	ros::Time lastResyncRequest_;
+
+	ros::Publisher assembledMapClouds_;
+	ros::Publisher assembledMapScans_;
+	ros::Publisher occupancyMapPub_;
+
+	ros::ServiceServer resetService_;
+
+	std::map<int, pcl::PointCloud<pcl::PointXYZRGB>::Ptr > rgbClouds_;
+	std::map<int, rtabmap_ros::CompactCloud> rgbCompactClouds_; // used instead of rgbClouds_ with compact_clouds
+	std::map<int, pcl::PointCloud<pcl::PointXYZ>::Ptr > scans_;
+
+	// incremental assembly
+	rtabmap_ros::PosesDiff cloudPoses_;
+	rtabmap_ros::PosesDiff scanPoses_;
+	std::map<int, rtabmap_ros::CompactCloud> transformedClouds_; // in map frame
+	std::map<int, pcl::PointCloud<pcl::PointXYZ>::Ptr > transformedScans_; // in map frame
+	rtabmap_ros::VoxelHash<pcl::PointXYZRGB> cloudVoxels_;
+	rtabmap_ros::VoxelHash<pcl::PointXYZ> scanVoxels_;
+	rtabmap_ros::IncrementalGrid occupancyGrid_;
+	rtabmap_ros::SessionFilter sessionFilter_;
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::MapAssembler, nodelet::Nodelet);
+}
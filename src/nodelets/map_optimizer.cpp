@@ -0,0 +1,764 @@
+/*
+Copyright (c) 2010-2014, Mathieu Labbe - IntRoLab - Universite de Sherbrooke
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the Universite de Sherbrooke nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include "rtabmap_ros/MapData.h"
+#include "rtabmap_ros/MsgConversion.h"
+#include <rtabmap/core/util3d.h>
+#include <rtabmap/core/Graph.h>
+#include <rtabmap/core/Parameters.h>
+#include <rtabmap/utilite/ULogger.h>
+#include <rtabmap/utilite/UTimer.h>
+#include <ros/subscriber.h>
+#include <ros/publisher.h>
+#include <tf2_ros/transform_broadcaster.h>
+#include <boost/thread.hpp>
+#include <algorithm>
+
+using namespace rtabmap;
+
+namespace rtabmap_ros
+{
+
+class MapOptimizer : public nodelet::Nodelet
+{
+
+public:
+	MapOptimizer() :
+		mapFrameId_("map"),
+		odomFrameId_("odom"),
+		iterations_(100),
+		ignoreVariance_(false),
+		globalOptimization_(true),
+		optimizeFromLastNode_(false),
+		incrementalOptimization_(false),
+		backgroundOptimization_(true),
+		cancelIterations_(0),
+		mapToOdom_(rtabmap::Transform::getIdentity()),
+		optimizing_(false),
+		cancel_(false),
+		shutdown_(false),
+		fullOptimizationNeeded_(false),
+		carriedConstraints_(0),
+		transformThread_(0),
+		optimizationThread_(0),
+		stopping_(false)
+	{}
+
+	~MapOptimizer()
+	{
+		mapToOdomMutex_.lock();
+		stopping_ = true;
+		mapToOdomMutex_.unlock();
+		if(transformThread_)
+		{
+			transformThread_->join();
+			delete transformThread_;
+		}
+		if(optimizationThread_)
+		{
+			pendingMutex_.lock();
+			shutdown_ = true;
+			pendingMutex_.unlock();
+			pendingCondition_.notify_one();
+			optimizationThread_->join();
+			delete optimizationThread_;
+		}
+	}
+
+	virtual void onInit()
+	{
+		ros::NodeHandle & nh = getNodeHandle();
+		ros::NodeHandle & pnh = getPrivateNodeHandle();
+
+		pnh.param("map_frame_id", mapFrameId_, mapFrameId_);
+		pnh.param("odom_frame_id", odomFrameId_, odomFrameId_);
+		pnh.param("iterations", iterations_, iterations_);
+		pnh.param("ignore_variance", ignoreVariance_, ignoreVariance_);
+		pnh.param("global_optimization", globalOptimization_, globalOptimization_);
+		pnh.param("optimize_from_last_node", optimizeFromLastNode_, optimizeFromLastNode_);
+		pnh.param("incremental_optimization", incrementalOptimization_, incrementalOptimization_);
+		pnh.param("background_optimization", backgroundOptimization_, backgroundOptimization_);
+		pnh.param("cancel_iterations", cancelIterations_, cancelIterations_);
+
+		UASSERT(iterations_ > 0);
+
+		if(incrementalOptimization_ && (!globalOptimization_ || optimizeFromLastNode_))
+		{
+			ROS_WARN("map_optimizer: incremental_optimization is only used with "
+					"global_optimization=true and optimize_from_last_node=false, it is disabled.");
+			incrementalOptimization_ = false;
+		}
+
+		double tfDelay = 0.05; // 20 Hz
+		bool publishTf = true;
+		pnh.param("publish_tf", publishTf, publishTf);
+		pnh.param("tf_delay", tfDelay, tfDelay);
+
+		mapDataTopic_ = nh.subscribe("mapData", 1, &MapOptimizer::mapDataReceivedCallback, this);
+		mapDataPub_ = nh.advertise<rtabmap_ros::MapData>(nh.resolveName("mapData")+"_optimized", 1);
+
+		if(backgroundOptimization_)
+		{
+			ROS_INFO("map_optimizer: background_optimization = true (cancel_iterations=%d)", cancelIterations_);
+			if(cancelIterations_ > 0 && cancelIterations_ < iterations_)
+			{
+				ROS_WARN("map_optimizer: cancel_iterations=%d: the optimizer is restarted every %d iterations, "
+						"the result may differ from a single run of %d iterations.",
+						cancelIterations_, cancelIterations_, iterations_);
+			}
+			optimizationThread_ = new boost::thread(boost::bind(&MapOptimizer::optimizationLoop, this));
+		}
+
+		if(publishTf)
+		{
+			ROS_INFO("map_optimizer will publish tf between frames \"%s\" and \"%s\"", mapFrameId_.c_str(), odomFrameId_.c_str());
+			ROS_INFO("map_optimizer: map_frame_id = %s", mapFrameId_.c_str());
+			ROS_INFO("map_optimizer: odom_frame_id = %s", odomFrameId_.c_str());
+			ROS_INFO("map_optimizer: tf_delay = %f", tfDelay);
+			transformThread_ = new boost::thread(boost::bind(&MapOptimizer::publishLoop, this, tfDelay));
+		}
+	}
+
+	void publishLoop(double tfDelay)
+	{
+		if(tfDelay == 0)
+			return;
+		ros::Rate r(1.0 / tfDelay);
+		bool stopping = false;
+		while(ros::ok() && !stopping)
+		{
+			mapToOdomMutex_.lock();
+			stopping = stopping_;
+			ros::Time tfExpiration = ros::Time::now() + ros::Duration(tfDelay);
+			geometry_msgs::TransformStamped msg;
+			msg.child_frame_id = odomFrameId_;
+			msg.header.frame_id = mapFrameId_;
+			msg.header.stamp = tfExpiration;
+			rtabmap_ros::transformToGeometryMsg(mapToOdom_, msg.transform);
+			tfBroadcaster_.sendTransform(msg);
+			mapToOdomMutex_.unlock();
+			r.sleep();
+		}
+	}
+
+	// Only merges the new nodes and links, the optimization is done
+	// by process(), in the optimization thread with background_optimization.
+	void mapDataReceivedCallback(const rtabmap_ros::MapDataConstPtr & msg)
+	{
+		UTimer timer;
+
+		// save new poses and constraints
+		// Assuming that nodes/constraints are all linked together
+		rtabmap_ros::Graph unpackedGraph;
+		const rtabmap_ros::Graph & graphMsg = rtabmap_ros::mapGraphUnpacked(msg->graph, unpackedGraph);
+		UASSERT(graphMsg.nodeIds.size() == graphMsg.poses.size());
+		UASSERT(graphMsg.nodeIds.size() == graphMsg.mapIds.size());
+		UASSERT(graphMsg.nodeIds.size() == graphMsg.stamps.size());
+		UASSERT(graphMsg.nodeIds.size() == graphMsg.labels.size());
+		UASSERT(graphMsg.nodeIds.size() == graphMsg.userDatas.size());
+
+		bool dataChanged = false;
+		bool loopClosure = false;
+
+		std::multimap<int, Link> newConstraints;
+		std::vector<Link> addedConstraints;
+		for(unsigned int i=0; i<graphMsg.links.size(); ++i)
+		{
+			Link link = rtabmap_ros::linkFromROS(graphMsg.links[i]);
+			newConstraints.insert(std::make_pair(link.from(), link));
+
+			bool edgeAlreadyAdded = false;
+			for(std::multimap<int, Link>::iterator iter = receivedConstraints_.lower_bound(link.from());
+					iter != receivedConstraints_.end() && iter->first == link.from();
+					++iter)
+			{
+				if(iter->second.to() == link.to())
+				{
+					edgeAlreadyAdded = true;
+					if(iter->second.transform() != link.transform())
+					{
+						dataChanged = true;
+					}
+				}
+			}
+			if(!edgeAlreadyAdded)
+			{
+				receivedConstraints_.insert(std::make_pair(link.from(), link));
+				addedConstraints.push_back(link);
+				if(link.type() != Link::kNeighbor)
+				{
+					loopClosure = true;
+				}
+			}
+		}
+
+		GraphDelta newNodes;
+		// add new odometry poses
+		for(unsigned int i=0; i<msg->nodes.size(); ++i)
+		{
+			int id = msg->nodes[i].id;
+			Transform pose = rtabmap_ros::transformFromPoseMsg(msg->nodes[i].pose);
+			newNodes.poses.insert(std::make_pair(id, pose));
+			newNodes.mapIds.insert(std::make_pair(id, msg->nodes[i].mapId));
+			newNodes.stamps.insert(std::make_pair(id, msg->nodes[i].stamp));
+			newNodes.labels.insert(std::make_pair(id, msg->nodes[i].label));
+			newNodes.userDatas.insert(std::make_pair(id, msg->nodes[i].userData.data));
+
+			std::pair<std::map<int, Transform>::iterator, bool> p = receivedPoses_.insert(std::make_pair(id, pose));
+			if(!p.second && pose != receivedPoses_.at(id))
+			{
+				dataChanged = true;
+			}
+		}
+
+		pendingMutex_.lock();
+		if(dataChanged)
+		{
+			ROS_WARN("Graph data has changed! Reset cache...");
+			receivedPoses_ = newNodes.poses;
+			receivedConstraints_ = newConstraints;
+			pending_.clear();
+			pending_.reset = true;
+			pending_.poses.swap(newNodes.poses);
+			pending_.mapIds.swap(newNodes.mapIds);
+			pending_.stamps.swap(newNodes.stamps);
+			pending_.labels.swap(newNodes.labels);
+			pending_.userDatas.swap(newNodes.userDatas);
+			pending_.constraints.assign(newConstraints.begin(), newConstraints.end());
+		}
+		else
+		{
+			for(std::map<int, Transform>::iterator iter=newNodes.poses.begin(); iter!=newNodes.poses.end(); ++iter)
+			{
+				if(pending_.poses.insert(*iter).second)
+				{
+					pending_.mapIds.insert(*newNodes.mapIds.find(iter->first));
+					pending_.stamps.insert(*newNodes.stamps.find(iter->first));
+					pending_.labels.insert(*newNodes.labels.find(iter->first));
+					pending_.userDatas.insert(*newNodes.userDatas.find(iter->first));
+				}
+			}
+			for(unsigned int i=0; i<addedConstraints.size(); ++i)
+			{
+				pending_.constraints.push_back(addedConstraints[i]);
+			}
+		}
+		if(optimizing_ && (loopClosure || dataChanged))
+		{
+			// the result of the current optimization is obsolete
+			cancel_ = true;
+		}
+		latestMsg_ = msg;
+		latestConstraints_.swap(newConstraints);
+		pendingMutex_.unlock();
+
+		if(backgroundOptimization_)
+		{
+			pendingCondition_.notify_one();
+			ROS_DEBUG("map_optimizer: cache update = %f s", timer.ticks());
+		}
+		else
+		{
+			process();
+		}
+	}
+
+	void optimizationLoop()
+	{
+		while(true)
+		{
+			{
+				boost::mutex::scoped_lock lock(pendingMutex_);
+				while(!latestMsg_.get() && !shutdown_)
+				{
+					pendingCondition_.wait(lock);
+				}
+				if(shutdown_)
+				{
+					break;
+				}
+			}
+			if(!ros::ok())
+			{
+				break;
+			}
+			process();
+		}
+	}
+
+	// Optimizes the most recent graph received, the graphs received
+	// in the meantime are merged and skipped.
+	void process()
+	{
+		UTimer timer;
+
+		rtabmap_ros::MapDataConstPtr msg;
+		GraphDelta delta;
+		std::multimap<int, Link> newConstraints;
+		pendingMutex_.lock();
+		msg = latestMsg_;
+		latestMsg_.reset();
+		delta.swap(pending_);
+		newConstraints.swap(latestConstraints_);
+		cancel_ = false;
+		optimizing_ = true;
+		pendingMutex_.unlock();
+
+		if(msg.get())
+		{
+			if(delta.reset)
+			{
+				cachedPoses_.clear();
+				cachedMapIds_.clear();
+				cachedStamps_.clear();
+				cachedLabels_.clear();
+				cachedUserDatas_.clear();
+				cachedConstraints_.clear();
+				optimizedPoses_.clear();
+				pendingConstraints_.clear();
+				fullOptimizationNeeded_ = false;
+				carriedConstraints_ = 0;
+			}
+			cachedPoses_.insert(delta.poses.begin(), delta.poses.end());
+			cachedMapIds_.insert(delta.mapIds.begin(), delta.mapIds.end());
+			cachedStamps_.insert(delta.stamps.begin(), delta.stamps.end());
+			cachedLabels_.insert(delta.labels.begin(), delta.labels.end());
+			cachedUserDatas_.insert(delta.userDatas.begin(), delta.userDatas.end());
+			for(unsigned int i=0; i<delta.constraints.size(); ++i)
+			{
+				cachedConstraints_.insert(std::make_pair(delta.constraints[i].from(), delta.constraints[i]));
+			}
+			pendingConstraints_.insert(pendingConstraints_.end(), delta.constraints.begin(), delta.constraints.end());
+			double cacheTime = timer.ticks();
+
+			// Optimize only if there is a subscriber
+			if(mapDataPub_.getNumSubscribers())
+			{
+				publishOptimizedGraph(msg, newConstraints, timer, cacheTime);
+			}
+		}
+
+		pendingMutex_.lock();
+		optimizing_ = false;
+		pendingMutex_.unlock();
+	}
+
+	void publishOptimizedGraph(
+			const rtabmap_ros::MapDataConstPtr & msg,
+			const std::multimap<int, Link> & newConstraints,
+			UTimer & timer,
+			double cacheTime)
+	{
+		rtabmap_ros::Graph unpackedGraph;
+		const rtabmap_ros::Graph & graphMsg = rtabmap_ros::mapGraphUnpacked(msg->graph, unpackedGraph);
+
+		std::map<int, Transform> localOptimizedPoses;
+		const std::map<int, Transform> * optimizedPoses = &localOptimizedPoses;
+		std::map<int, Transform> localPoses;
+		const std::map<int, Transform> * poses = &localPoses;
+		const std::multimap<int, Link> * constraints = &newConstraints;
+		std::string mode = "full";
+		bool cancelled = false;
+		if(globalOptimization_)
+		{
+			// the caches are used directly, without copy
+			poses = &cachedPoses_;
+			constraints = &cachedConstraints_;
+			if(incrementalOptimization_)
+			{
+				bool warmStart = optimizedPoses_.size() > 0;
+				if(optimizeIncremental(cancelled))
+				{
+					mode = "incremental";
+				}
+				else if(warmStart)
+				{
+					mode = "full (warm start)";
+				}
+				optimizedPoses = &optimizedPoses_;
+			}
+			else
+			{
+				cancelled = !optimizeGraph(cachedPoses_, cachedConstraints_, localOptimizedPoses);
+			}
+		}
+		else
+		{
+			for(unsigned int i=0; i<graphMsg.nodeIds.size(); ++i)
+			{
+				std::map<int, Transform>::iterator iter = cachedPoses_.find(graphMsg.nodeIds[i]);
+				if(iter != cachedPoses_.end())
+				{
+					localPoses.insert(*iter);
+				}
+				else
+				{
+					ROS_ERROR("Odometry pose of node %d not found in cache!", graphMsg.nodeIds[i]);
+					return;
+				}
+			}
+			cancelled = !optimizeGraph(localPoses, newConstraints, localOptimizedPoses);
+		}
+		double optimizationTime = timer.ticks();
+
+		if(cancelled)
+		{
+			ROS_INFO("map_optimizer: %s optimization of %d nodes cancelled after %f s, a newer graph is available",
+					mode.c_str(), (int)poses->size(), optimizationTime);
+			return;
+		}
+
+		Transform mapCorrection = Transform::getIdentity();
+		if(optimizedPoses->size() && poses->size() > 1 && constraints->size())
+		{
+			int lastId = optimizedPoses->rbegin()->first;
+			mapCorrection = optimizedPoses->at(lastId) * poses->at(lastId).inverse();
+		}
+
+		std::map<int, int> mapIds;
+		std::map<int, double> stamps;
+		std::map<int, std::string> labels;
+		std::map<int, std::vector<unsigned char> > userDatas;
+		bool allCached = optimizedPoses->size() == cachedPoses_.size();
+		if(!allCached)
+		{
+			for(std::map<int, Transform>::const_iterator iter=optimizedPoses->begin(); iter!=optimizedPoses->end(); ++iter)
+			{
+				std::map<int, int>::const_iterator mapIdIter = cachedMapIds_.find(iter->first);
+				if(mapIdIter != cachedMapIds_.end())
+				{
+					mapIds.insert(mapIds.end(), *mapIdIter);
+				}
+				std::map<int, double>::const_iterator stampIter = cachedStamps_.find(iter->first);
+				if(stampIter != cachedStamps_.end())
+				{
+					stamps.insert(stamps.end(), *stampIter);
+				}
+				std::map<int, std::string>::const_iterator labelIter = cachedLabels_.find(iter->first);
+				if(labelIter != cachedLabels_.end())
+				{
+					labels.insert(labels.end(), *labelIter);
+				}
+				std::map<int, std::vector<unsigned char> >::const_iterator userDataIter = cachedUserDatas_.find(iter->first);
+				if(userDataIter != cachedUserDatas_.end())
+				{
+					userDatas.insert(userDatas.end(), *userDataIter);
+				}
+			}
+		}
+
+		// published by pointer, not copied by nodelets of the same manager
+		rtabmap_ros::MapDataPtr outputMsg(new rtabmap_ros::MapData);
+		rtabmap_ros::mapGraphToROS(
+				*optimizedPoses,
+				allCached?cachedMapIds_:mapIds,
+				allCached?cachedStamps_:stamps,
+				allCached?cachedLabels_:labels,
+				allCached?cachedUserDatas_:userDatas,
+				std::multimap<int, rtabmap::Link>(),
+				mapCorrection,
+				outputMsg->graph);
+		outputMsg->graph.links = graphMsg.links;
+		outputMsg->header = msg->header;
+		outputMsg->nodes = msg->nodes;
+
+		// tf and the published graph are updated together
+		mapToOdomMutex_.lock();
+		if(optimizedPoses->size() && poses->size() > 1 && constraints->size())
+		{
+			mapToOdom_ = mapCorrection;
+		}
+		mapDataPub_.publish(outputMsg);
+		mapToOdomMutex_.unlock();
+
+		ROS_INFO("map_optimizer: %s optimization of %d nodes and %d links = %f s (cache update=%f s, publishing=%f s)",
+				mode.c_str(),
+				(int)optimizedPoses->size(),
+				(int)constraints->size(),
+				optimizationTime,
+				cacheTime,
+				timer.ticks());
+	}
+
+	bool isCancelled()
+	{
+		boost::mutex::scoped_lock lock(pendingMutex_);
+		return cancel_ || shutdown_;
+	}
+
+	// Optimizes the graph connected to the first node (or to the last
+	// node with optimize_from_last_node). If "initialGuess" is not null,
+	// it is used as starting point instead of the odometry poses. With
+	// background_optimization and cancel_iterations>0 (default 0), the
+	// iterations are done by blocks of cancel_iterations and false is
+	// returned if a newer graph makes the result obsolete, "optimizedPoses"
+	// then contains the partial result. Each block restarts the optimizer
+	// from the poses of the previous one (its iteration schedule too), so
+	// the result is not the same as the one of a single run.
+	bool optimizeGraph(
+			const std::map<int, Transform> & poses,
+			const std::multimap<int, Link> & constraints,
+			std::map<int, Transform> & optimizedPoses,
+			const std::map<int, Transform> * initialGuess = 0)
+	{
+		optimizedPoses.clear();
+		if(poses.size() > 1 && constraints.size() > 0)
+		{
+			int fromId = optimizeFromLastNode_?poses.rbegin()->first:poses.begin()->first;
+			std::map<int, rtabmap::Transform> posesOut;
+			std::multimap<int, rtabmap::Link> linksOut;
+			graph::TOROOptimizer(iterations_, false, ignoreVariance_).getConnectedGraph(
+					fromId,
+					initialGuess?*initialGuess:poses,
+					constraints,
+					posesOut,
+					linksOut);
+			int block = backgroundOptimization_ && cancelIterations_ > 0?cancelIterations_:iterations_;
+			for(int i=0; i<iterations_ && (i==0 || optimizedPoses.size()); i+=block)
+			{
+				if(i > 0)
+				{
+					if(isCancelled())
+					{
+						return false;
+					}
+					// continue from the last block
+					posesOut.swap(optimizedPoses);
+				}
+				graph::TOROOptimizer optimizer(std::min(block, iterations_-i), false, ignoreVariance_);
+				optimizedPoses = optimizer.optimize(fromId, posesOut, linksOut);
+			}
+		}
+		else if(poses.size() == 1 && constraints.size() == 0)
+		{
+			optimizedPoses = poses;
+		}
+		else if(poses.size() || constraints.size())
+		{
+			ROS_ERROR("map_optimizer: Poses=%d and edges=%d (poses must "
+				   "not be null if there are edges, and edges must be null if poses <= 1)",
+				  (int)poses.size(), (int)constraints.size());
+		}
+		return true;
+	}
+
+	// Updates optimizedPoses_ with the constraints added since the last
+	// call. Nodes only linked by a single constraint to the already
+	// optimized graph don't change its solution: they are chained from
+	// it. When a constraint closes a loop, or links a node not received
+	// yet, the whole graph is optimized again starting from the previous
+	// solution. Constraints not connected to the solution yet (e.g., of
+	// another session) are kept for the next calls. Returns false if the
+	// graph had to be optimized.
+	bool optimizeIncremental(bool & cancelled)
+	{
+		cancelled = false;
+		bool incremental = optimizedPoses_.size() > 0 && !fullOptimizationNeeded_;
+		std::vector<bool> used(pendingConstraints_.size(), false);
+		bool progress = optimizedPoses_.size() > 0;
+		while(progress)
+		{
+			progress = false;
+			for(unsigned int i=0; i<pendingConstraints_.size(); ++i)
+			{
+				if(used[i])
+				{
+					continue;
+				}
+				const Link & link = pendingConstraints_[i];
+				std::map<int, Transform>::iterator from = optimizedPoses_.find(link.from());
+				std::map<int, Transform>::iterator to = optimizedPoses_.find(link.to());
+				if((from == optimizedPoses_.end()) == (to == optimizedPoses_.end()))
+				{
+					// not connected to the solution yet, or both ends already in it
+					continue;
+				}
+				int unknownId = from != optimizedPoses_.end()?link.to():link.from();
+				if(cachedPoses_.find(unknownId) == cachedPoses_.end())
+				{
+					// odometry pose not received: only chained when it is
+					if(i >= carriedConstraints_)
+					{
+						incremental = false;
+					}
+					continue;
+				}
+				if(from != optimizedPoses_.end())
+				{
+					optimizedPoses_.insert(std::make_pair(link.to(), from->second * link.transform()));
+				}
+				else
+				{
+					optimizedPoses_.insert(std::make_pair(link.from(), to->second * link.transform().inverse()));
+				}
+				used[i] = progress = true;
+			}
+		}
+		for(unsigned int i=0; i<pendingConstraints_.size() && incremental; ++i)
+		{
+			// not used to chain a node and both ends are in the
+			// graph: the constraint closes a loop
+			if(!used[i] &&
+			   optimizedPoses_.find(pendingConstraints_[i].from()) != optimizedPoses_.end() &&
+			   optimizedPoses_.find(pendingConstraints_[i].to()) != optimizedPoses_.end())
+			{
+				incremental = false;
+			}
+		}
+
+		if(!incremental)
+		{
+			// warm start: the nodes connected to the graph are already
+			// chained to the previous solution, the other nodes keep their
+			// odometry pose so the connected graph is the same as without it
+			std::map<int, Transform> initialGuess;
+			if(optimizedPoses_.size())
+			{
+				initialGuess = cachedPoses_;
+				for(std::map<int, Transform>::iterator iter=optimizedPoses_.begin(); iter!=optimizedPoses_.end(); ++iter)
+				{
+					std::map<int, Transform>::iterator jter = initialGuess.find(iter->first);
+					if(jter != initialGuess.end())
+					{
+						jter->second = iter->second;
+					}
+				}
+			}
+			std::map<int, Transform> optimizedPoses;
+			cancelled = !optimizeGraph(cachedPoses_, cachedConstraints_, optimizedPoses, initialGuess.size()?&initialGuess:0);
+			// a cancelled optimization is still a better starting point
+			// for the next one, which has to be a full optimization
+			fullOptimizationNeeded_ = cancelled;
+			optimizedPoses_.swap(optimizedPoses);
+		}
+
+		// keep the constraints with an end not in the solution
+		std::vector<Link> unsolved;
+		for(unsigned int i=0; i<pendingConstraints_.size(); ++i)
+		{
+			if(!used[i] &&
+			   (optimizedPoses_.find(pendingConstraints_[i].from()) == optimizedPoses_.end() ||
+			    optimizedPoses_.find(pendingConstraints_[i].to()) == optimizedPoses_.end()))
+			{
+				unsolved.push_back(pendingConstraints_[i]);
+			}
+		}
+		pendingConstraints_.swap(unsolved);
+		carriedConstraints_ = pendingConstraints_.size();
+		return incremental;
+	}
+
+private:
+	// nodes and links not yet merged in the caches by process()
+	struct GraphDelta
+	{
+		GraphDelta() : reset(false) {}
+		void clear()
+		{
+			reset = false;
+			poses.clear();
+			mapIds.clear();
+			stamps.clear();
+			labels.clear();
+			userDatas.clear();
+			constraints.clear();
+		}
+		void swap(GraphDelta & other)
+		{
+			std::swap(reset, other.reset);
+			poses.swap(other.poses);
+			mapIds.swap(other.mapIds);
+			stamps.swap(other.stamps);
+			labels.swap(other.labels);
+			userDatas.swap(other.userDatas);
+			constraints.swap(other.constraints);
+		}
+		bool reset; // the caches are replaced
+		std::map<int, Transform> poses;
+		std::map<int, int> mapIds;
+		std::map<int, double> stamps;
+		std::map<int, std::string> labels;
+		std::map<int, std::vector<unsigned char> > userDatas;
+		std::vector<Link> constraints;
+	};
+
+	std::string mapFrameId_;
+	std::string odomFrameId_;
+	int iterations_;
+	bool ignoreVariance_;
+	bool globalOptimization_;
+	bool optimizeFromLastNode_;
+	bool incrementalOptimization_;
+	bool backgroundOptimization_;
+	int cancelIterations_;
+
+	rtabmap::Transform mapToOdom_;
+	boost::mutex mapToOdomMutex_;
+
+	ros::Subscriber mapDataTopic_;
+
+	ros::Publisher mapDataPub_;
+
+	// used by the callback to detect new and changed data
+	std::map<int, Transform> receivedPoses_;
+	std::multimap<int, Link> receivedConstraints_;
+
+	// shared between the callback and the optimization thread
+	GraphDelta pending_;
+	rtabmap_ros::MapDataConstPtr latestMsg_;
+	std::multimap<int, Link> latestConstraints_;
+	bool optimizing_;
+	bool cancel_; // the current optimization is obsolete, reset by process()
+	bool shutdown_; // nodelet unloaded, stops the optimization thread
+	boost::mutex pendingMutex_;
+	boost::condition_variable pendingCondition_;
+
+	// used only by process()
+	std::map<int, Transform> cachedPoses_;
+	std::map<int, int> cachedMapIds_;
+	std::map<int, double> cachedStamps_;
+	std::map<int, std::string> cachedLabels_;
+	std::map<int, std::vector<unsigned char> > cachedUserDatas_;
+	std::multimap<int, Link> cachedConstraints_;
+
+	// incremental_optimization
+	std::map<int, Transform> optimizedPoses_; // last solution
+	std::vector<Link> pendingConstraints_; // added since the last solution
+	bool fullOptimizationNeeded_; // the last optimization was cancelled
+	unsigned int carriedConstraints_; // first constraints of pendingConstraints_, kept from the previous calls
+
+	tf2_ros::TransformBroadcaster tfBroadcaster_;
+	boost::thread* transformThread_;
+	boost::thread* optimizationThread_;
+	bool stopping_; // nodelet unloaded
+};
+
+PLUGINLIB_EXPORT_CLASS(rtabmap_ros::MapOptimizer, nodelet::Nodelet);
+}
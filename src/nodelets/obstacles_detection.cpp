@@ -31,6 +31,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
+#include <pcl/features/integral_image_normal.h>
 #include <pcl_conversions/pcl_conversions.h>
 
 #include <tf/transform_listener.h>
@@ -53,11 +54,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <opencv2/highgui/highgui.hpp>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include "rtabmap_ros/LatencyStats.h"
 
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
 #include "rtabmap/core/util3d_mapping.h"
 #include "rtabmap/core/util3d_transforms.h"
+#include <rtabmap/utilite/UMath.h>
+#include <cstring>
+#include <limits>
 
 namespace rtabmap_ros
 {
@@ -74,7 +79,22 @@ public:
 		maxObstaclesHeight_(1.5),
 		waitForTransform_(false),
 		simpleSegmentation_(false),
-		optimizeForCloseObject_(true)
+		optimizeForCloseObject_(true),
+		organizedSegmentation_(false),
+		normalSmoothingSize_(10.0),
+		maxDepthChangeFactor_(0.02),
+		hypotheticalGroundCloud_(new pcl::PointCloud<pcl::PointXYZ>),
+		hypotheticalGroundCloudNear_(new pcl::PointCloud<pcl::PointXYZ>),
+		hypotheticalGroundCloudFar_(new pcl::PointCloud<pcl::PointXYZ>),
+		obstaclesCloud_(new pcl::PointCloud<pcl::PointXYZ>),
+		groundCloud_(new pcl::PointCloud<pcl::PointXYZ>),
+		sensorCloud_(new pcl::PointCloud<pcl::PointXYZ>),
+		organizedCloud_(new pcl::PointCloud<pcl::PointXYZ>),
+		normals_(new pcl::PointCloud<pcl::Normal>),
+		latency_("obstacles_detection"),
+		latencySplit_(latency_.addStage("split")),
+		latencySegmentation_(latency_.addStage("segmentation")),
+		latencyPublishing_(latency_.addStage("publishing"))
 	{}
 
 	virtual ~ObstaclesDetection()
@@ -97,13 +117,16 @@ private:
 		pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 		pnh.param("simple_segmentation", simpleSegmentation_, simpleSegmentation_);
 		pnh.param("optimize_for_close_object", optimizeForCloseObject_, optimizeForCloseObject_);
+		pnh.param("organized_segmentation", organizedSegmentation_, organizedSegmentation_);
+		pnh.param("normal_smoothing_size", normalSmoothingSize_, normalSmoothingSize_);
+		pnh.param("max_depth_change_factor", maxDepthChangeFactor_, maxDepthChangeFactor_);
 
 		cloudSub_ = nh.subscribe("cloud", 1, &ObstaclesDetection::callback, this);
 
 		groundPub_ = nh.advertise<sensor_msgs::PointCloud2>("ground", 1);
 		obstaclesPub_ = nh.advertise<sensor_msgs::PointCloud2>("obstacles", 1);
 
-		this->_lastFrameTime = ros::Time::now();
+		latency_.init(nh, pnh);
 	}
 
 
@@ -137,55 +160,50 @@ private:
 			return;
 		}
 
-		pcl::PointCloud<pcl::PointXYZ>::Ptr originalCloud(new pcl::PointCloud<pcl::PointXYZ>);
-		pcl::fromROSMsg(*cloudMsg, *originalCloud);
+		ros::WallTime start = ros::WallTime::now();
+
+		// The scratch clouds are members, their memory is reused from frame to frame
+		hypotheticalGroundCloud_->clear();
+		hypotheticalGroundCloudNear_->clear();
+		hypotheticalGroundCloudFar_->clear();
+		obstaclesCloud_->clear();
+		groundCloud_->clear();
+
+		//Transform, then split by z (and x with optimize_for_close_object) in one pass
+		bool organized = organizedSegmentation_ && !simpleSegmentation_ && cloudMsg->height > 1;
+		int points = splitCloud(*cloudMsg, localTransform, organized);
+		ros::WallTime split = ros::WallTime::now();
+		latency_.record(latencySplit_, (split - start).toSec());
 
 		//Even if the original cloud is empty, we need to publish the empty cloud,
 		//Otherwise, the aggregator of point cloud would wait indefinitely to get a valid pointcloud
-		if(originalCloud->size() == 0)
+		if(points == 0)
 		{
-			ROS_ERROR("Recieved empty point cloud!");
-			if(groundPub_.getNumSubscribers())
+			if(cloudMsg->width * cloudMsg->height == 0)
 			{
-				sensor_msgs::PointCloud2 rosCloud;
-				pcl::toROSMsg(*originalCloud, rosCloud);
-				rosCloud.header.stamp = cloudMsg->header.stamp;
-				rosCloud.header.frame_id = frameId_;
-
-				//publish the message
-				groundPub_.publish(rosCloud);
+				ROS_ERROR("Recieved empty point cloud!");
 			}
-
-			if(obstaclesPub_.getNumSubscribers())
+			else
 			{
-				sensor_msgs::PointCloud2 rosCloud;
-				pcl::toROSMsg(*originalCloud, rosCloud);
-				rosCloud.header.stamp = cloudMsg->header.stamp;
-				rosCloud.header.frame_id = frameId_;
-
-				//publish the message
-				obstaclesPub_.publish(rosCloud);
+				// e.g., a depth camera facing open space or too close to a wall
+				ROS_DEBUG("Recieved point cloud without valid points.");
 			}
+			publish(*groundCloud_, *obstaclesCloud_, cloudMsg->header.stamp);
 			return;
 		}
 
-		//Common variables for all strategies
-		pcl::PointCloud<pcl::PointXYZ>::Ptr hypotheticalGroundCloud(new pcl::PointCloud<pcl::PointXYZ>);
-		pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesCloud(new pcl::PointCloud<pcl::PointXYZ>);
 		pcl::IndicesPtr ground, obstacles;
-		pcl::PointCloud<pcl::PointXYZ>::Ptr groundCloud(new pcl::PointCloud<pcl::PointXYZ>);
 
-		ros::Time lasttime = ros::Time::now();
-
-		originalCloud = rtabmap::util3d::transformPointCloud(originalCloud, localTransform);
-		hypotheticalGroundCloud  = rtabmap::util3d::passThrough(originalCloud, "z", std::numeric_limits<int>::min(), maxFloorHeight_);
-		obstaclesCloud = rtabmap::util3d::passThrough(originalCloud, "z", maxFloorHeight_, maxObstaclesHeight_);
+		if (organized) {
+			// The image structure of the cloud is kept, see segmentOrganizedCloud()
+			segmentOrganizedCloud(localTransform);
+		}
 
-		if (simpleSegmentation_) {
+		else if (simpleSegmentation_) {
 		    // If the option simple segmentation has been set to true,
 		    // the floor is just the hypothetical ground cloud, simply
 		    // cut off based on z
-		    groundCloud = hypotheticalGroundCloud;
+		    groundCloud_.swap(hypotheticalGroundCloud_);
 		}
 
 		else if (!optimizeForCloseObject_) {
@@ -195,21 +213,11 @@ private:
 			// The algorithm then extracts (and removes) from the hypothetical ground cloud
 			// the detected obstacles, and adds them to the obstacles pointcloud
 
-			rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(hypotheticalGroundCloud,
+			rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(hypotheticalGroundCloud_,
 					ground, obstacles, normalEstimationRadius_, groundNormalAngle_, minClusterSize_);
 
-			if(ground.get() && ground->size())
-			{
-				pcl::copyPointCloud(*hypotheticalGroundCloud, *ground, *groundCloud);
-			}
-
-			if(obstacles.get() && obstacles->size())
-			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesFloorCloud(new pcl::PointCloud<pcl::PointXYZ>);
-				pcl::copyPointCloud(*hypotheticalGroundCloud, *obstacles, *obstaclesFloorCloud);
-				*obstaclesCloud += *obstaclesFloorCloud;
-			}
-
+			appendPoints(*hypotheticalGroundCloud_, ground, *groundCloud_);
+			appendPoints(*hypotheticalGroundCloud_, obstacles, *obstaclesCloud_);
 		}
 
 		else {
@@ -220,56 +228,250 @@ private:
 			// which allows to detect smaller objects, without increasing the number of false positive.
 			// For all other points, we use a bigger normal estimation radius (* 3.) and tolerance for the
 			// grond normal angle (* 2.).
-
-			pcl::PointCloud<pcl::PointXYZ>::Ptr hypotheticalGroundCloud_near = rtabmap::util3d::passThrough(hypotheticalGroundCloud, "x", std::numeric_limits<int>::min(), 1.);
-			pcl::PointCloud<pcl::PointXYZ>::Ptr hypotheticalGroundCloud_far = rtabmap::util3d::passThrough(hypotheticalGroundCloud, "x", 1., std::numeric_limits<int>::max());
-
-			obstaclesCloud = rtabmap::util3d::passThrough(obstaclesCloud, "x",  0.8, std::numeric_limits<int>::max());
+			// (the near/far split and the obstacles x > 0.8 filter are done in splitCloud())
 
 			// Part 1: segment floor and obstacles near the robot
-			rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(hypotheticalGroundCloud_near,
+			rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(hypotheticalGroundCloudNear_,
 								ground, obstacles, normalEstimationRadius_, groundNormalAngle_, minClusterSize_);
 
-			if(ground.get() && ground->size())
+			appendPoints(*hypotheticalGroundCloudNear_, ground, *groundCloud_);
+			appendPoints(*hypotheticalGroundCloudNear_, obstacles, *obstaclesCloud_);
+
+			// Part 2: segment floor and obstacles far from the robot
+			rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(hypotheticalGroundCloudFar_,
+											ground, obstacles, 3.*normalEstimationRadius_, 2.*groundNormalAngle_, minClusterSize_);
+
+			appendPoints(*hypotheticalGroundCloudFar_, ground, *groundCloud_);
+			appendPoints(*hypotheticalGroundCloudFar_, obstacles, *obstaclesCloud_);
+		}
+		ros::WallTime segmented = ros::WallTime::now();
+		latency_.record(latencySegmentation_, (segmented - split).toSec());
+
+		publish(*groundCloud_, *obstaclesCloud_, cloudMsg->header.stamp);
+		latency_.record(latencyPublishing_, (ros::WallTime::now() - segmented).toSec());
+	}
+
+	// Reads the xyz fields of the message directly (without pcl::fromROSMsg),
+	// transforms the points and dispatches them in the scratch clouds like
+	// the passThrough filters did. Returns the number of valid points.
+	// If "organized" is true, the points are kept in organizedCloud_ (and
+	// sensorCloud_ before the transform) and labeled instead.
+	int splitCloud(const sensor_msgs::PointCloud2 & cloudMsg, const rtabmap::Transform & localTransform, bool organized)
+	{
+		int offsets[3] = {-1, -1, -1};
+		for(unsigned int i=0; i<cloudMsg.fields.size(); ++i)
+		{
+			const sensor_msgs::PointField & field = cloudMsg.fields[i];
+			if(field.datatype == sensor_msgs::PointField::FLOAT32 && field.name.size() == 1 && field.name[0] >= 'x' && field.name[0] <= 'z')
 			{
-				pcl::copyPointCloud(*hypotheticalGroundCloud_near, *ground, *groundCloud);
+				offsets[field.name[0]-'x'] = field.offset;
 			}
+		}
+		if(offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0)
+		{
+			ROS_ERROR("Input cloud must have float32 x, y and z fields!");
+			return 0;
+		}
 
-
-			if(obstacles.get() && obstacles->size())
+		// when x, y and z are contiguous, they are mapped without copy
+		bool contiguous = offsets[1] == offsets[0]+4 && offsets[2] == offsets[0]+8;
+		Eigen::Affine3f t = localTransform.toEigen3f();
+		int points = 0;
+		if(organized)
+		{
+			sensorCloud_->width = organizedCloud_->width = cloudMsg.width;
+			sensorCloud_->height = organizedCloud_->height = cloudMsg.height;
+			sensorCloud_->is_dense = organizedCloud_->is_dense = false;
+			sensorCloud_->resize(cloudMsg.width*cloudMsg.height);
+			organizedCloud_->resize(cloudMsg.width*cloudMsg.height);
+			labels_.assign(cloudMsg.width*cloudMsg.height, kIgnored);
+		}
+		const float bad = std::numeric_limits<float>::quiet_NaN();
+		for(unsigned int row=0; row<cloudMsg.height; ++row)
+		{
+			const unsigned char * data = cloudMsg.data.data() + row*cloudMsg.row_step;
+			for(unsigned int col=0; col<cloudMsg.width; ++col, data+=cloudMsg.point_step)
 			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesFloorCloud_near(new pcl::PointCloud<pcl::PointXYZ>);
-				pcl::copyPointCloud(*hypotheticalGroundCloud_near, *obstacles, *obstaclesFloorCloud_near);
-				*obstaclesCloud += *obstaclesFloorCloud_near;
+				Eigen::Vector3f v;
+				if(contiguous)
+				{
+					v = Eigen::Map<const Eigen::Vector3f>((const float*)(data+offsets[0]));
+				}
+				else
+				{
+					memcpy(&v[0], data+offsets[0], sizeof(float));
+					memcpy(&v[1], data+offsets[1], sizeof(float));
+					memcpy(&v[2], data+offsets[2], sizeof(float));
+				}
+				if(!uIsFinite(v[0]) || !uIsFinite(v[1]) || !uIsFinite(v[2]))
+				{
+					if(organized)
+					{
+						sensorCloud_->at(row*cloudMsg.width+col) = pcl::PointXYZ(bad, bad, bad);
+						organizedCloud_->at(row*cloudMsg.width+col) = pcl::PointXYZ(bad, bad, bad);
+					}
+					continue;
+				}
+				++points;
+				if(organized)
+				{
+					sensorCloud_->at(row*cloudMsg.width+col) = pcl::PointXYZ(v[0], v[1], v[2]);
+				}
+				v = t * v;
+				pcl::PointXYZ pt(v[0], v[1], v[2]);
+				if(organized)
+				{
+					int index = row*cloudMsg.width+col;
+					organizedCloud_->at(index) = pt;
+					if(pt.z <= maxFloorHeight_)
+					{
+						labels_[index] = kGroundCandidate;
+					}
+					else if(pt.z <= maxObstaclesHeight_ && (!optimizeForCloseObject_ || pt.x >= 0.8f))
+					{
+						labels_[index] = kObstacle;
+					}
+				}
+				else if(pt.z <= maxFloorHeight_)
+				{
+					hypotheticalGroundCloud_->push_back(pt);
+					if(optimizeForCloseObject_)
+					{
+						if(pt.x <= 1.0f)
+						{
+							hypotheticalGroundCloudNear_->push_back(pt);
+						}
+						if(pt.x >= 1.0f)
+						{
+							hypotheticalGroundCloudFar_->push_back(pt);
+						}
+					}
+				}
+				else if(pt.z <= maxObstaclesHeight_ &&
+						(!optimizeForCloseObject_ || simpleSegmentation_ || pt.x >= 0.8f))
+				{
+					obstaclesCloud_->push_back(pt);
+				}
 			}
+		}
+		return points;
+	}
 
-			// Part 2: segment floor and obstacles far from the robot
-			rtabmap::util3d::segmentObstaclesFromGround<pcl::PointXYZ>(hypotheticalGroundCloud_far,
-											ground, obstacles, 3.*normalEstimationRadius_, 2.*groundNormalAngle_, minClusterSize_);
+	// Organized-cloud mode: pixel labels of organizedCloud_
+	enum {kIgnored=0, kGroundCandidate, kObstacle, kGround, kVisited};
 
-			if(ground.get() && ground->size())
+	// Integral image normals of the organized cloud (in the sensor frame, where
+	// the depth discontinuities are along z), then ground is what is flat
+	// enough and the other ground candidates are clustered by connected
+	// components on the image grid. The candidates without normal (at depth
+	// discontinuities) are ignored. Points are added to groundCloud_ and obstaclesCloud_.
+	void segmentOrganizedCloud(const rtabmap::Transform & localTransform)
+	{
+		pcl::IntegralImageNormalEstimation<pcl::PointXYZ, pcl::Normal> ne;
+		ne.setNormalEstimationMethod(ne.AVERAGE_3D_GRADIENT);
+		ne.setMaxDepthChangeFactor(maxDepthChangeFactor_);
+		ne.setNormalSmoothingSize(normalSmoothingSize_);
+		// the normals of the image borders are computed too (NaN with the default policy)
+		ne.setBorderPolicy(ne.BORDER_POLICY_MIRROR);
+		ne.setInputCloud(sensorCloud_);
+		ne.compute(*normals_);
+
+		Eigen::Matrix3f rotation = localTransform.toEigen3f().linear();
+		// z axis in the sensor frame
+		Eigen::Vector3f up = rotation.transpose() * Eigen::Vector3f::UnitZ();
+		for(unsigned int i=0; i<labels_.size(); ++i)
+		{
+			if(labels_[i] == kGroundCandidate)
+			{
+				const pcl::Normal & n = normals_->at(i);
+				if(uIsFinite(n.normal_x))
+				{
+					float angle = std::acos(std::min(1.0f, std::fabs(n.normal_x*up[0] + n.normal_y*up[1] + n.normal_z*up[2])));
+					const pcl::PointXYZ & pt = organizedCloud_->at(i);
+					// same tolerances than the near/far clouds of the unorganized mode
+					float maxAngle = optimizeForCloseObject_ && pt.x > 1.0f?2.0f*groundNormalAngle_:groundNormalAngle_;
+					if(angle < maxAngle)
+					{
+						labels_[i] = kGround;
+						groundCloud_->push_back(pt);
+					}
+				}
+				else
+				{
+					labels_[i] = kIgnored;
+				}
+			}
+			else if(labels_[i] == kObstacle)
 			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr groundCloud2 (new pcl::PointCloud<pcl::PointXYZ>);
-				pcl::copyPointCloud(*hypotheticalGroundCloud_far, *ground, *groundCloud2);
-				*groundCloud += *groundCloud2;
+				obstaclesCloud_->push_back(organizedCloud_->at(i));
 			}
+		}
 
-
-			if(obstacles.get() && obstacles->size())
+		// remaining ground candidates (finite and not flat normals): obstacles on the floor
+		int width = organizedCloud_->width;
+		int height = organizedCloud_->height;
+		for(unsigned int i=0; i<labels_.size(); ++i)
+		{
+			if(labels_[i] != kGroundCandidate)
+			{
+				continue;
+			}
+			cluster_.clear();
+			cluster_.push_back(i);
+			labels_[i] = kVisited;
+			for(unsigned int j=0; j<cluster_.size(); ++j)
+			{
+				int index = cluster_[j];
+				int u = index % width;
+				int v = index / width;
+				const pcl::PointXYZ & pt = organizedCloud_->at(index);
+				float tolerance = 2.0f*normalEstimationRadius_*(optimizeForCloseObject_ && pt.x > 1.0f?3.0f:1.0f);
+				int neighbors[4] = {u>0?index-1:-1, u<width-1?index+1:-1, v>0?index-width:-1, v<height-1?index+width:-1};
+				for(int k=0; k<4; ++k)
+				{
+					int n = neighbors[k];
+					if(n >= 0 && labels_[n] == kGroundCandidate)
+					{
+						const pcl::PointXYZ & npt = organizedCloud_->at(n);
+						float dx = npt.x-pt.x, dy = npt.y-pt.y, dz = npt.z-pt.z;
+						if(dx*dx+dy*dy+dz*dz < tolerance*tolerance)
+						{
+							labels_[n] = kVisited;
+							cluster_.push_back(n);
+						}
+					}
+				}
+			}
+			if((int)cluster_.size() >= minClusterSize_)
 			{
-				pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesFloorCloud_far(new pcl::PointCloud<pcl::PointXYZ>);
-				pcl::copyPointCloud(*hypotheticalGroundCloud_far, *obstacles, *obstaclesFloorCloud_far);
-				*obstaclesCloud += *obstaclesFloorCloud_far;
+				for(unsigned int j=0; j<cluster_.size(); ++j)
+				{
+					obstaclesCloud_->push_back(organizedCloud_->at(cluster_[j]));
+				}
 			}
+		}
+	}
 
+	static void appendPoints(const pcl::PointCloud<pcl::PointXYZ> & cloud, const pcl::IndicesPtr & indices, pcl::PointCloud<pcl::PointXYZ> & output)
+	{
+		if(indices.get() && indices->size())
+		{
+			output.reserve(output.size() + indices->size());
+			for(unsigned int i=0; i<indices->size(); ++i)
+			{
+				output.push_back(cloud.at(indices->at(i)));
+			}
 		}
+	}
 
+	void publish(const pcl::PointCloud<pcl::PointXYZ> & groundCloud, const pcl::PointCloud<pcl::PointXYZ> & obstaclesCloud, const ros::Time & stamp)
+	{
 		if(groundPub_.getNumSubscribers())
 		{
-			sensor_msgs::PointCloud2 rosCloud;
-			pcl::toROSMsg(*groundCloud, rosCloud);
-			rosCloud.header.stamp = cloudMsg->header.stamp;
-			rosCloud.header.frame_id = frameId_;
+			sensor_msgs::PointCloud2Ptr rosCloud(new sensor_msgs::PointCloud2);
+			pcl::toROSMsg(groundCloud, *rosCloud);
+			rosCloud->header.stamp = stamp;
+			rosCloud->header.frame_id = frameId_;
 
 			//publish the message
 			groundPub_.publish(rosCloud);
@@ -277,20 +479,14 @@ private:
 
 		if(obstaclesPub_.getNumSubscribers())
 		{
-			sensor_msgs::PointCloud2 rosCloud;
-			pcl::toROSMsg(*obstaclesCloud, rosCloud);
-			rosCloud.header.stamp = cloudMsg->header.stamp;
-			rosCloud.header.frame_id = frameId_;
+			sensor_msgs::PointCloud2Ptr rosCloud(new sensor_msgs::PointCloud2);
+			pcl::toROSMsg(obstaclesCloud, *rosCloud);
+			rosCloud->header.stamp = stamp;
+			rosCloud->header.frame_id = frameId_;
 
 			//publish the message
 			obstaclesPub_.publish(rosCloud);
 		}
-
-		ros::Time curtime = ros::Time::now();
-
-		ros::Duration process_duration = curtime - lasttime;
-		ros::Duration between_frames = curtime - this->_lastFrameTime;
-		this->_lastFrameTime = curtime;
 	}
 
 private:
@@ -303,6 +499,9 @@ private:
 	bool waitForTransform_;
 	bool simpleSegmentation_;
 	bool optimizeForCloseObject_;
+	bool organizedSegmentation_; // used for organized input clouds
+	double normalSmoothingSize_;
+	double maxDepthChangeFactor_;
 
 	tf::TransformListener tfListener_;
 
@@ -310,7 +509,25 @@ private:
 	ros::Publisher obstaclesPub_;
 
 	ros::Subscriber cloudSub_;
-	ros::Time _lastFrameTime;
+
+	// scratch clouds reused between frames
+	pcl::PointCloud<pcl::PointXYZ>::Ptr hypotheticalGroundCloud_;
+	pcl::PointCloud<pcl::PointXYZ>::Ptr hypotheticalGroundCloudNear_;
+	pcl::PointCloud<pcl::PointXYZ>::Ptr hypotheticalGroundCloudFar_;
+	pcl::PointCloud<pcl::PointXYZ>::Ptr obstaclesCloud_;
+	pcl::PointCloud<pcl::PointXYZ>::Ptr groundCloud_;
+
+	// organized_segmentation
+	pcl::PointCloud<pcl::PointXYZ>::Ptr sensorCloud_;
+	pcl::PointCloud<pcl::PointXYZ>::Ptr organizedCloud_;
+	pcl::PointCloud<pcl::Normal>::Ptr normals_;
+	std::vector<unsigned char> labels_;
+	std::vector<int> cluster_;
+
+	LatencyStats latency_;
+	int latencySplit_;
+	int latencySegmentation_;
+	int latencyPublishing_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::ObstaclesDetection, nodelet::Nodelet);
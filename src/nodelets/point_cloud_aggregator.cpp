@@ -2,86 +2,288 @@
 #include <pluginlib/class_list_macros.h>
 #include <nodelet/nodelet.h>
 
-#include <pcl/point_cloud.h>
-#include <pcl/point_types.h>
-#include <pcl_conversions/pcl_conversions.h>
-
 #include <tf/transform_listener.h>
 
 #include <sensor_msgs/PointCloud2.h>
 
-#include <image_transport/image_transport.h>
-#include <image_transport/subscriber_filter.h>
-
-#include <message_filters/sync_policies/approximate_time.h>
-#include <message_filters/subscriber.h>
-#include <message_filters/sync_policies/approximate_time.h>
+#include <boost/thread/mutex.hpp>
 
 #include <rtabmap_ros/MsgConversion.h>
+#include <rtabmap/utilite/UMath.h>
+#include <rtabmap/utilite/UConversion.h>
+
+#include <cstring>
 
 namespace rtabmap_ros
 {
 
+/**
+ * Concatenates the clouds of "count" inputs (cloud1, cloud2, ..., cloudN) in
+ * one xyz cloud. The latest cloud of each input is kept: the combined cloud
+ * is published as soon as all inputs have received a cloud or, if
+ * "max_wait" > 0, "max_wait" seconds after the first cloud was received, with
+ * the clouds received so far. A slow (or dead) input then doesn't stall the
+ * output. All clouds are transformed in "frame_id" (default the frame of the
+ * first input cloud).
+ */
 class PointCloudAggregator : public nodelet::Nodelet
 {
 public:
-	PointCloudAggregator() : sync(NULL)
+	PointCloudAggregator() :
+		count_(3),
+		maxWait_(0.1),
+		waitForTransform_(false),
+		received_(0)
 	{}
 
 	virtual ~PointCloudAggregator()
 	{
-	    if (sync!=NULL) delete sync;
 	}
 
 private:
-	void clouds_callback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg_1,
-	                     const sensor_msgs::PointCloud2ConstPtr & cloudMsg_2,
-	                     const sensor_msgs::PointCloud2ConstPtr & cloudMsg_3)
-	{
-		if(cloudPub_.getNumSubscribers())
-		{
-			pcl::fromROSMsg(*cloudMsg_1, cloud1);
-			pcl::fromROSMsg(*cloudMsg_2, cloud2);
-			pcl::fromROSMsg(*cloudMsg_3, cloud3);
-		    pcl::PointCloud<pcl::PointXYZ> totalCloud;
-		    totalCloud = cloud1 + cloud2;
-		    totalCloud += cloud3;
-		    sensor_msgs::PointCloud2 rosCloud;
-		    pcl::toROSMsg(totalCloud, rosCloud);
-		    rosCloud.header.stamp = cloudMsg_1->header.stamp;
-		    rosCloud.header.frame_id = cloudMsg_1->header.frame_id;
-		    cloudPub_.publish(rosCloud);
-		}
-	}
-
-    typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::PointCloud2, sensor_msgs::PointCloud2> MySyncPolicy;
 	virtual void onInit()
 	{
 		ros::NodeHandle & nh = getNodeHandle();
 		ros::NodeHandle & pnh = getPrivateNodeHandle();
 
-		int queueSize = 15;
+		int queueSize = 1;
 		pnh.param("queue_size", queueSize, queueSize);
+		pnh.param("count", count_, count_);
+		pnh.param("max_wait", maxWait_, maxWait_);
+		pnh.param("frame_id", frameId_, frameId_);
+		pnh.param("wait_for_transform", waitForTransform_, waitForTransform_);
 
-		cloudSub_1_.subscribe(nh, "cloud1", 1);
-		cloudSub_2_.subscribe(nh, "cloud2", 1);
-		cloudSub_3_.subscribe(nh, "cloud3", 1);
+		if(count_ < 1)
+		{
+			ROS_WARN("point_cloud_aggregator: count (%d) should be >= 1, setting it to 1.", count_);
+			count_ = 1;
+		}
+		clouds_.resize(count_);
+
+		ROS_INFO("point_cloud_aggregator: count=%d, max_wait=%f s, frame_id=\"%s\"",
+				count_, maxWait_, frameId_.c_str());
+
+		cloudSubs_.resize(count_);
+		for(int i=0; i<count_; ++i)
+		{
+			cloudSubs_[i] = nh.subscribe<sensor_msgs::PointCloud2>(
+					uFormat("cloud%d", i+1),
+					queueSize,
+					boost::bind(&PointCloudAggregator::cloudCallback, this, _1, i));
+		}
 
-        sync = new message_filters::Synchronizer<MySyncPolicy>(MySyncPolicy(queueSize), cloudSub_1_, cloudSub_2_, cloudSub_3_);
-        sync->registerCallback(boost::bind(&rtabmap_ros::PointCloudAggregator::clouds_callback, this, _1, _2, _3));
+		if(maxWait_ > 0.0)
+		{
+			timer_ = nh.createTimer(ros::Duration(maxWait_), &PointCloudAggregator::timerCallback, this, true, false);
+		}
 
 		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("combined_cloud", 1);
 	}
 
-    message_filters::Synchronizer<MySyncPolicy>* sync;
-	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_1_;
-	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_2_;
-	message_filters::Subscriber<sensor_msgs::PointCloud2> cloudSub_3_;
-	pcl::PointCloud<pcl::PointXYZ> cloud1, cloud2, cloud3;
+	void cloudCallback(const sensor_msgs::PointCloud2ConstPtr & cloudMsg, int index)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(clouds_[index].get() == 0)
+		{
+			if(received_ == 0 && maxWait_ > 0.0)
+			{
+				// first cloud of the window
+				timer_.stop();
+				timer_.setPeriod(ros::Duration(maxWait_));
+				timer_.start();
+			}
+			++received_;
+		}
+		// a newer cloud of the same input replaces the older one
+		clouds_[index] = cloudMsg;
+
+		if(received_ == count_)
+		{
+			if(maxWait_ > 0.0)
+			{
+				timer_.stop();
+			}
+			publish();
+		}
+	}
 
+	void timerCallback(const ros::TimerEvent &)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		if(received_ > 0 && received_ < count_)
+		{
+			std::string missing;
+			for(int i=0; i<count_; ++i)
+			{
+				if(clouds_[i].get() == 0)
+				{
+					missing += uFormat(" cloud%d", i+1);
+				}
+			}
+			ROS_WARN_THROTTLE(5.0, "point_cloud_aggregator: No cloud received after %f s on%s, "
+					"publishing the %d other clouds.", maxWait_, missing.c_str(), received_);
+			publish();
+		}
+	}
+
+	// Called with mutex_ locked. The clouds are concatenated directly in the
+	// output message, with one TF lookup per input cloud.
+	void publish()
+	{
+		std::vector<sensor_msgs::PointCloud2ConstPtr> clouds;
+		clouds.swap(clouds_);
+		clouds_.resize(count_);
+		received_ = 0;
+
+		if(cloudPub_.getNumSubscribers() == 0)
+		{
+			return;
+		}
+
+		std::string frameId = frameId_;
+		ros::Time stamp;
+		size_t totalPoints = 0;
+		for(unsigned int i=0; i<clouds.size(); ++i)
+		{
+			if(clouds[i].get())
+			{
+				if(frameId.empty())
+				{
+					frameId = clouds[i]->header.frame_id;
+				}
+				if(clouds[i]->header.stamp > stamp)
+				{
+					stamp = clouds[i]->header.stamp;
+				}
+				totalPoints += clouds[i]->width*clouds[i]->height;
+			}
+		}
+
+		sensor_msgs::PointCloud2Ptr output(new sensor_msgs::PointCloud2);
+		output->header.stamp = stamp;
+		output->header.frame_id = frameId;
+		output->fields.resize(3);
+		const char * names[3] = {"x", "y", "z"};
+		for(int i=0; i<3; ++i)
+		{
+			output->fields[i].name = names[i];
+			output->fields[i].offset = i*4;
+			output->fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+			output->fields[i].count = 1;
+		}
+		// same layout than pcl::PointXYZ
+		output->point_step = 16;
+		output->is_bigendian = false;
+		output->is_dense = true;
+		output->height = 1;
+		output->data.resize(totalPoints*output->point_step);
+
+		size_t points = 0;
+		for(unsigned int i=0; i<clouds.size(); ++i)
+		{
+			if(clouds[i].get())
+			{
+				points += appendCloud(*clouds[i], frameId, output->data.data() + points*output->point_step);
+			}
+		}
+		output->data.resize(points*output->point_step);
+		output->width = points;
+		output->row_step = output->width*output->point_step;
+
+		cloudPub_.publish(output);
+	}
+
+	// Writes the finite points of the cloud (transformed in "frameId") in
+	// "out", returns the number of points written.
+	size_t appendCloud(const sensor_msgs::PointCloud2 & cloudMsg, const std::string & frameId, unsigned char * out)
+	{
+		int offsets[3] = {-1, -1, -1};
+		for(unsigned int i=0; i<cloudMsg.fields.size(); ++i)
+		{
+			const sensor_msgs::PointField & field = cloudMsg.fields[i];
+			if(field.datatype == sensor_msgs::PointField::FLOAT32 && field.name.size() == 1 &&
+			   field.name[0] >= 'x' && field.name[0] <= 'z')
+			{
+				offsets[field.name[0]-'x'] = field.offset;
+			}
+		}
+		if(offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0)
+		{
+			ROS_ERROR("point_cloud_aggregator: Cloud in frame \"%s\" doesn't have float32 x, y and z fields!", cloudMsg.header.frame_id.c_str());
+			return 0;
+		}
+
+		rtabmap::Transform transform = rtabmap::Transform::getIdentity();
+		if(cloudMsg.header.frame_id.compare(frameId) != 0)
+		{
+			try
+			{
+				if(waitForTransform_)
+				{
+					if(!tfListener_.waitForTransform(frameId, cloudMsg.header.frame_id, cloudMsg.header.stamp, ros::Duration(1)))
+					{
+						ROS_ERROR("Could not get transform from %s to %s after 1 second!", cloudMsg.header.frame_id.c_str(), frameId.c_str());
+						return 0;
+					}
+				}
+				tf::StampedTransform tmp;
+				tfListener_.lookupTransform(frameId, cloudMsg.header.frame_id, cloudMsg.header.stamp, tmp);
+				transform = rtabmap_ros::transformFromTF(tmp);
+			}
+			catch(tf::TransformException & ex)
+			{
+				ROS_ERROR("%s",ex.what());
+				return 0;
+			}
+		}
+		bool identity = transform.isIdentity();
+		Eigen::Affine3f t = transform.toEigen3f();
+
+		size_t points = 0;
+		float * outPtr = (float*)out;
+		for(unsigned int row=0; row<cloudMsg.height; ++row)
+		{
+			const unsigned char * data = cloudMsg.data.data() + row*cloudMsg.row_step;
+			for(unsigned int col=0; col<cloudMsg.width; ++col, data+=cloudMsg.point_step)
+			{
+				Eigen::Vector3f v;
+				memcpy(&v[0], data+offsets[0], sizeof(float));
+				memcpy(&v[1], data+offsets[1], sizeof(float));
+				memcpy(&v[2], data+offsets[2], sizeof(float));
+				if(!uIsFinite(v[0]) || !uIsFinite(v[1]) || !uIsFinite(v[2]))
+				{
+					continue;
+				}
+				if(!identity)
+				{
+					v = t * v;
+				}
+				outPtr[0] = v[0];
+				outPtr[1] = v[1];
+				outPtr[2] = v[2];
+				outPtr[3] = 1.0f;
+				outPtr += 4;
+				++points;
+			}
+		}
+		return points;
+	}
+
+private:
+	int count_;
+	double maxWait_;
+	std::string frameId_;
+	bool waitForTransform_;
+
+	boost::mutex mutex_;
+	std::vector<sensor_msgs::PointCloud2ConstPtr> clouds_;
+	int received_;
+
+	std::vector<ros::Subscriber> cloudSubs_;
+	ros::Timer timer_;
 	ros::Publisher cloudPub_;
+	tf::TransformListener tfListener_;
 };
 
 PLUGINLIB_EXPORT_CLASS(rtabmap_ros::PointCloudAggregator, nodelet::Nodelet);
 }
-
@@ -53,6 +53,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
+#include "rtabmap_ros/DepthToCloud.h"
+#include "rtabmap_ros/LatencyStats.h"
 
 namespace rtabmap_ros
 {
@@ -72,7 +74,11 @@ public:
 		exactSyncDisparity_(0),
 		cut_right_(0),
 		cut_left_(0),
-		create_close_obstacle_if_depth_is_missing_(false)
+		create_close_obstacle_if_depth_is_missing_(false),
+		latency_("point_cloud_xyz"),
+		latencyConversion_(latency_.addStage("conversion")),
+		latencyFiltering_(latency_.addStage("filtering")),
+		latencyPublishing_(latency_.addStage("publishing"))
 	{}
 
 	virtual ~PointCloudXYZ()
@@ -108,6 +114,14 @@ private:
 
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
+		depthToCloud_.setDecimation(decimation_);
+		depthToCloud_.setMaxDepth(maxDepth_);
+		// radius filtering must be done before voxelization, see processAndPublish()
+		depthToCloud_.setVoxelSize(noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0?0.0f:voxelSize_);
+		disparityToCloud_.setDecimation(decimation_);
+		disparityToCloud_.setMaxDepth(maxDepth_);
+		disparityToCloud_.setVoxelSize(noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0?0.0f:voxelSize_);
+
 		if(approxSync)
 		{
 			approxSyncDepth_ = new message_filters::Synchronizer<MyApproxSyncDepthPolicy>(MyApproxSyncDepthPolicy(queueSize), imageDepthSub_, cameraInfoSub_);
@@ -137,6 +151,8 @@ private:
 		disparityCameraInfoSub_.subscribe(nh, "disparity/camera_info", 1);
 
 		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1);
+
+		latency_.init(nh, pnh);
 	}
 
 	void callback(
@@ -153,6 +169,7 @@ private:
 
 		if(cloudPub_.getNumSubscribers())
 		{
+			ros::WallTime start = ros::WallTime::now();
 			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(depth);
 			cv::Mat image=imageDepthPtr->image;
 			int rows = image.rows;
@@ -203,15 +220,8 @@ private:
 			float cx = model.cx();
 			float cy = model.cy();
 
-			pcl::PointCloud<pcl::PointXYZ>::Ptr pclCloud;
-			pclCloud = rtabmap::util3d::cloudFromDepth(
-					image,
-					cx,
-					cy,
-					fx,
-					fy,
-					decimation_);
-			processAndPublish(pclCloud, depth->header);
+			// rows are projected in parallel in the reused buffers of depthToCloud_
+			processAndPublish(depthToCloud_.project(image, cv::Mat(), fx, fy, cx, cy), depth->header, start);
 		}
 	}
 
@@ -238,6 +248,7 @@ private:
 
 		if(cloudPub_.getNumSubscribers())
 		{
+			ros::WallTime start = ros::WallTime::now();
 			image_geometry::PinholeCameraModel model;
 			model.fromCameraInfo(*cameraInfo);
 			float cx = model.cx();
@@ -252,37 +263,42 @@ private:
 					disparityMsg->T,
 					decimation_);
 
-			processAndPublish(pclCloud, disparityMsg->header);
+			processAndPublish(disparityToCloud_.filter(*pclCloud), disparityMsg->header, start);
 		}
 	}
 
-	void processAndPublish(pcl::PointCloud<pcl::PointXYZ>::Ptr & pclCloud, const std_msgs::Header & header)
+	// "cloud" is already clipped (and voxelized if there is no noise filtering)
+	// "start" is the time when the callback started the conversion
+	void processAndPublish(const pcl::PointCloud<pcl::PointXYZ>::Ptr & cloud, const std_msgs::Header & header, const ros::WallTime & start)
 	{
-		if(pclCloud->size() && maxDepth_ > 0)
-		{
-			pclCloud = rtabmap::util3d::passThrough(pclCloud, "z", 0, maxDepth_);
-		}
+		ros::WallTime converted = ros::WallTime::now();
+		latency_.record(latencyConversion_, (converted - start).toSec());
 
+		pcl::PointCloud<pcl::PointXYZ>::Ptr pclCloud = cloud;
 		if(pclCloud->size() && noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0)
 		{
 			pcl::IndicesPtr indices = rtabmap::util3d::radiusFiltering(pclCloud, noiseFilterRadius_, noiseFilterMinNeighbors_);
 			pcl::PointCloud<pcl::PointXYZ>::Ptr tmp(new pcl::PointCloud<pcl::PointXYZ>);
 			pcl::copyPointCloud(*pclCloud, *indices, *tmp);
 			pclCloud = tmp;
-		}
 
-		if(pclCloud->size() && voxelSize_ > 0.0)
-		{
-			pclCloud = rtabmap::util3d::voxelize(pclCloud, voxelSize_);
+			if(pclCloud->size() && voxelSize_ > 0.0)
+			{
+				pclCloud = rtabmap::util3d::voxelize(pclCloud, voxelSize_);
+			}
 		}
 
-		sensor_msgs::PointCloud2 rosCloud;
-		pcl::toROSMsg(*pclCloud, rosCloud);
-		rosCloud.header.stamp = header.stamp;
-		rosCloud.header.frame_id = header.frame_id;
+		ros::WallTime filtered = ros::WallTime::now();
+		latency_.record(latencyFiltering_, (filtered - converted).toSec());
+
+		sensor_msgs::PointCloud2Ptr rosCloud(new sensor_msgs::PointCloud2);
+		pcl::toROSMsg(*pclCloud, *rosCloud);
+		rosCloud->header.stamp = header.stamp;
+		rosCloud->header.frame_id = header.frame_id;
 
 		//publish the message
 		cloudPub_.publish(rosCloud);
+		latency_.record(latencyPublishing_, (ros::WallTime::now() - filtered).toSec());
 	}
 
 private:
@@ -296,8 +312,17 @@ private:
 	int cut_right_;
 	bool create_close_obstacle_if_depth_is_missing_;
 
+	// one per callback, they can be called at the same time by a multi-threaded nodelet manager
+	DepthToCloud<pcl::PointXYZ> depthToCloud_;
+	DepthToCloud<pcl::PointXYZ> disparityToCloud_;
+
 	ros::Publisher cloudPub_;
 
+	LatencyStats latency_;
+	int latencyConversion_;
+	int latencyFiltering_;
+	int latencyPublishing_;
+
 	image_transport::SubscriberFilter imageDepthSub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
 
@@ -53,6 +53,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "rtabmap/core/util3d.h"
 #include "rtabmap/core/util3d_filtering.h"
+#include "rtabmap_ros/DepthToCloud.h"
+#include "rtabmap_ros/LatencyStats.h"
 
 namespace rtabmap_ros
 {
@@ -69,7 +71,11 @@ public:
 		approxSyncDepth_(0),
 		approxSyncStereo_(0),
 		exactSyncDepth_(0),
-		exactSyncStereo_(0)
+		exactSyncStereo_(0),
+		latency_("point_cloud_xyzrgb"),
+		latencyConversion_(latency_.addStage("conversion")),
+		latencyFiltering_(latency_.addStage("filtering")),
+		latencyPublishing_(latency_.addStage("publishing"))
 	{}
 
 	virtual ~PointCloudXYZRGB()
@@ -102,8 +108,18 @@ private:
 
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
+		depthToCloud_.setDecimation(decimation_);
+		depthToCloud_.setMaxDepth(maxDepth_);
+		// radius filtering must be done before voxelization, see processAndPublish()
+		depthToCloud_.setVoxelSize(noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0?0.0f:voxelSize_);
+		stereoToCloud_.setDecimation(decimation_);
+		stereoToCloud_.setMaxDepth(maxDepth_);
+		stereoToCloud_.setVoxelSize(noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0?0.0f:voxelSize_);
+
 		cloudPub_ = nh.advertise<sensor_msgs::PointCloud2>("cloud", 1);
 
+		latency_.init(nh, pnh);
+
 		if(approxSync)
 		{
 
@@ -170,9 +186,20 @@ private:
 
 		if(cloudPub_.getNumSubscribers())
 		{
+			ros::WallTime start = ros::WallTime::now();
 			cv_bridge::CvImageConstPtr imagePtr = cv_bridge::toCvShare(image, "bgr8");
 			cv_bridge::CvImageConstPtr imageDepthPtr = cv_bridge::toCvShare(imageDepth);
 
+			const cv::Mat & rgb = imagePtr->image;
+			const cv::Mat & depth = imageDepthPtr->image;
+			if(depth.empty() || rgb.cols < depth.cols || rgb.cols % depth.cols != 0 ||
+			   rgb.rows != depth.rows * (rgb.cols / depth.cols))
+			{
+				ROS_WARN_THROTTLE(5.0, "point_cloud_xyzrgb: The rgb image size (%dx%d) must be a multiple "
+						"of the depth image size (%dx%d), an empty cloud is published.",
+						rgb.cols, rgb.rows, depth.cols, depth.rows);
+			}
+
 			image_geometry::PinholeCameraModel model;
 			model.fromCameraInfo(*cameraInfo);
 			float fx = model.fx();
@@ -180,18 +207,8 @@ private:
 			float cx = model.cx();
 			float cy = model.cy();
 
-			pcl::PointCloud<pcl::PointXYZRGB>::Ptr pclCloud;
-			pclCloud = rtabmap::util3d::cloudFromDepthRGB(
-					imagePtr->image,
-					imageDepthPtr->image,
-					cx,
-					cy,
-					fx,
-					fy,
-					decimation_);
-
-
-			processAndPublish(pclCloud, imagePtr->header);
+			// rows are projected in parallel in the reused buffers of depthToCloud_
+			processAndPublish(depthToCloud_.project(depth, rgb, fx, fy, cx, cy), imagePtr->header, start);
 		}
 	}
 
@@ -215,6 +232,7 @@ private:
 
 		if(cloudPub_.getNumSubscribers())
 		{
+			ros::WallTime start = ros::WallTime::now();
 			cv_bridge::CvImageConstPtr ptrLeftImage, ptrRightImage;
 			if(imageLeft->encoding.compare(sensor_msgs::image_encodings::MONO8) == 0 ||
 				imageLeft->encoding.compare(sensor_msgs::image_encodings::MONO16) == 0)
@@ -245,37 +263,42 @@ private:
 					baseline,
 					decimation_);
 
-			processAndPublish(pclCloud, imageLeft->header);
+			processAndPublish(stereoToCloud_.filter(*pclCloud), imageLeft->header, start);
 		}
 	}
 
-	void processAndPublish(pcl::PointCloud<pcl::PointXYZRGB>::Ptr & pclCloud, const std_msgs::Header & header)
+	// "cloud" is already clipped (and voxelized if there is no noise filtering)
+	// "start" is the time when the callback started the conversion
+	void processAndPublish(const pcl::PointCloud<pcl::PointXYZRGB>::Ptr & cloud, const std_msgs::Header & header, const ros::WallTime & start)
 	{
-		if(pclCloud->size() && maxDepth_ > 0)
-		{
-			pclCloud = rtabmap::util3d::passThrough(pclCloud, "z", 0, maxDepth_);
-		}
+		ros::WallTime converted = ros::WallTime::now();
+		latency_.record(latencyConversion_, (converted - start).toSec());
 
+		pcl::PointCloud<pcl::PointXYZRGB>::Ptr pclCloud = cloud;
 		if(pclCloud->size() && noiseFilterRadius_ > 0.0 && noiseFilterMinNeighbors_ > 0)
 		{
 			pcl::IndicesPtr indices = rtabmap::util3d::radiusFiltering(pclCloud, noiseFilterRadius_, noiseFilterMinNeighbors_);
 			pcl::PointCloud<pcl::PointXYZRGB>::Ptr tmp(new pcl::PointCloud<pcl::PointXYZRGB>);
 			pcl::copyPointCloud(*pclCloud, *indices, *tmp);
 			pclCloud = tmp;
-		}
 
-		if(pclCloud->size() && voxelSize_ > 0.0)
-		{
-			pclCloud = rtabmap::util3d::voxelize(pclCloud, voxelSize_);
+			if(pclCloud->size() && voxelSize_ > 0.0)
+			{
+				pclCloud = rtabmap::util3d::voxelize(pclCloud, voxelSize_);
+			}
 		}
 
-		sensor_msgs::PointCloud2 rosCloud;
-		pcl::toROSMsg(*pclCloud, rosCloud);
-		rosCloud.header.stamp = header.stamp;
-		rosCloud.header.frame_id = header.frame_id;
+		ros::WallTime filtered = ros::WallTime::now();
+		latency_.record(latencyFiltering_, (filtered - converted).toSec());
+
+		sensor_msgs::PointCloud2Ptr rosCloud(new sensor_msgs::PointCloud2);
+		pcl::toROSMsg(*pclCloud, *rosCloud);
+		rosCloud->header.stamp = header.stamp;
+		rosCloud->header.frame_id = header.frame_id;
 
 		//publish the message
 		cloudPub_.publish(rosCloud);
+		latency_.record(latencyPublishing_, (ros::WallTime::now() - filtered).toSec());
 	}
 
 private:
@@ -286,8 +309,17 @@ private:
 	double noiseFilterRadius_;
 	int noiseFilterMinNeighbors_;
 
+	// one per callback, they can be called at the same time by a multi-threaded nodelet manager
+	DepthToCloud<pcl::PointXYZRGB> depthToCloud_;
+	DepthToCloud<pcl::PointXYZRGB> stereoToCloud_;
+
 	ros::Publisher cloudPub_;
 
+	LatencyStats latency_;
+	int latencyConversion_;
+	int latencyFiltering_;
+	int latencyPublishing_;
+
 	image_transport::SubscriberFilter imageSub_;
 	image_transport::SubscriberFilter imageDepthSub_;
 	message_filters::Subscriber<sensor_msgs::CameraInfo> cameraInfoSub_;
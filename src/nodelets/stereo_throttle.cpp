@@ -40,7 +40,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cv_bridge/cv_bridge.h>
 
-#include <rtabmap/core/util2d.h>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "rtabmap_ros/AdaptiveRate.h"
 
 namespace rtabmap_ros
 {
@@ -97,6 +99,8 @@ private:
 		ROS_INFO("Decimation=%d", decimation_);
 		ROS_INFO("Approximate time sync = %s", approxSync?"true":"false");
 
+		adaptiveRate_.init(nh, pnh);
+
 		if(approxSync)
 		{
 			approxSync_ = new message_filters::Synchronizer<MyApproxSyncPolicy>(MyApproxSyncPolicy(queueSize), imageLeft_, imageRight_, cameraInfoLeft_, cameraInfoRight_);
@@ -124,10 +128,11 @@ private:
 			const sensor_msgs::CameraInfoConstPtr& camInfoLeft,
 			const sensor_msgs::CameraInfoConstPtr& camInfoRight)
 	{
-		if (rate_ > 0.0)
+		double rate = adaptiveRate_.rate(rate_);
+		if (rate > 0.0)
 		{
-			NODELET_DEBUG("update set to %f", rate_);
-			if ( last_update_ + ros::Duration(1.0/rate_) > ros::Time::now())
+			NODELET_DEBUG("update set to %f", rate);
+			if ( last_update_ + ros::Duration(1.0/rate) > ros::Time::now())
 			{
 				NODELET_DEBUG("throttle last update at %f skipping", last_update_.toSec());
 				return;
@@ -146,7 +151,8 @@ private:
 				cv_bridge::CvImage out;
 				out.header = imagePtr->header;
 				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
+				// area interpolation: averages the pixels instead of skipping them
+				cv::resize(imagePtr->image, out.image, cv::Size(imagePtr->image.cols/decimation_, imagePtr->image.rows/decimation_), 0, 0, cv::INTER_AREA);
 				imageLeftPub_.publish(out.toImageMsg());
 			}
 			else
@@ -162,7 +168,7 @@ private:
 				cv_bridge::CvImage out;
 				out.header = imagePtr->header;
 				out.encoding = imagePtr->encoding;
-				out.image = rtabmap::util2d::decimate(imagePtr->image, decimation_);
+				cv::resize(imagePtr->image, out.image, cv::Size(imagePtr->image.cols/decimation_, imagePtr->image.rows/decimation_), 0, 0, cv::INTER_AREA);
 				imageRightPub_.publish(out.toImageMsg());
 			}
 			else
@@ -179,12 +185,13 @@ private:
 				info.width /= decimation_;
 				info.roi.height /= decimation_;
 				info.roi.width /= decimation_;
-				info.K[2]/=float(decimation_); // cx
-				info.K[5]/=float(decimation_); // cy
+				// area interpolation: a pixel is the center of its block
+				info.K[2] = (info.K[2]+0.5)/float(decimation_)-0.5; // cx
+				info.K[5] = (info.K[5]+0.5)/float(decimation_)-0.5; // cy
 				info.K[0]/=float(decimation_); // fx
 				info.K[4]/=float(decimation_); // fy
-				info.P[2]/=float(decimation_); // cx
-				info.P[6]/=float(decimation_); // cy
+				info.P[2] = (info.P[2]+0.5)/float(decimation_)-0.5; // cx
+				info.P[6] = (info.P[6]+0.5)/float(decimation_)-0.5; // cy
 				info.P[0]/=float(decimation_); // fx
 				info.P[5]/=float(decimation_); // fy
 				info.P[3]/=float(decimation_); // Tx
@@ -204,12 +211,13 @@ private:
 				info.width /= decimation_;
 				info.roi.height /= decimation_;
 				info.roi.width /= decimation_;
-				info.K[2]/=float(decimation_); // cx
-				info.K[5]/=float(decimation_); // cy
+				// area interpolation: a pixel is the center of its block
+				info.K[2] = (info.K[2]+0.5)/float(decimation_)-0.5; // cx
+				info.K[5] = (info.K[5]+0.5)/float(decimation_)-0.5; // cy
 				info.K[0]/=float(decimation_); // fx
 				info.K[4]/=float(decimation_); // fy
-				info.P[2]/=float(decimation_); // cx
-				info.P[6]/=float(decimation_); // cy
+				info.P[2] = (info.P[2]+0.5)/float(decimation_)-0.5; // cx
+				info.P[6] = (info.P[6]+0.5)/float(decimation_)-0.5; // cy
 				info.P[0]/=float(decimation_); // fx
 				info.P[5]/=float(decimation_); // fy
 				info.P[3]/=float(decimation_); // Tx
@@ -238,6 +246,7 @@ private:
 	message_filters::Synchronizer<MyExactSyncPolicy> * exactSync_;
 
 	int decimation_;
+	AdaptiveRate adaptiveRate_;
 
 };
 
@@ -31,6 +31,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <OgreSceneNode.h>
 #include <OgreSceneManager.h>
+#include <OgreCamera.h>
+#include <OgreSphere.h>
 
 #include <ros/time.h>
 
@@ -38,6 +40,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <rviz/display_context.h>
 #include <rviz/frame_manager.h>
+#include <rviz/view_manager.h>
+#include <rviz/view_controller.h>
 #include <rviz/ogre_helpers/point_cloud.h>
 #include <rviz/validate_floats.h>
 #include <rviz/properties/int_property.h>
@@ -57,16 +61,234 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <rtabmap/core/Graph.h>
 #include <rtabmap_ros/MsgConversion.h>
 #include <rtabmap_ros/GetMap.h>
+#include <rtabmap_ros/ThreadPool.h>
+#include <boost/bind.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/cstdint.hpp>
+#include <limits>
+#include <set>
+#include <algorithm>
+#include <cmath>
 
 
 namespace rtabmap_ros
 {
 
+namespace
+{
+// Same for all clouds of a batch
+struct CloudBatch
+{
+	CloudBatch() :
+		lodLevels(1),
+		lodVoxelSize(0.0f),
+		transformersMutex(0),
+		output(0),
+		outputMutex(0)
+	{}
+	std_msgs::Header header;
+	rviz::PointCloudTransformerPtr xyzTransformer;
+	rviz::PointCloudTransformerPtr colorTransformer;
+	int lodLevels;
+	float lodVoxelSize;
+	boost::recursive_mutex * transformersMutex;
+	std::map<int, MapCloudDisplay::CloudInfoPtr> * output;
+	boost::mutex * outputMutex;
+};
+
+struct NodeCloud
+{
+	NodeCloud() :
+		node(0),
+		decimation(1),
+		maxDepth(0.0f),
+		voxelSize(0.0f),
+		floorHeight(0.0f)
+	{}
+	const rtabmap_ros::NodeData * node;
+	int decimation;
+	float maxDepth;
+	float voxelSize;
+	float floorHeight;
+};
+
+void computeLods(MapCloudDisplay::CloudInfo & info, int levels, float voxelSize);
+
+// Fill the transformed points of the cloud. The position transformers don't
+// have a state, but some color transformers update their properties (like
+// the auto min/max intensity), so they are called one at a time.
+void transformPoints(
+		MapCloudDisplay::CloudInfo & info,
+		const rviz::PointCloudTransformerPtr & xyzTransformer,
+		const rviz::PointCloudTransformerPtr & colorTransformer,
+		boost::recursive_mutex & transformersMutex)
+{
+	rviz::V_PointCloudPoint& cloud_points = info.transformed_points_;
+	cloud_points.clear();
+
+	size_t size = info.message_->width * info.message_->height;
+	rviz::PointCloud::Point default_pt;
+	default_pt.color = Ogre::ColourValue(1, 1, 1);
+	default_pt.position = Ogre::Vector3::ZERO;
+	cloud_points.resize(size, default_pt);
+
+	xyzTransformer->transform(info.message_, rviz::PointCloudTransformer::Support_XYZ, Ogre::Matrix4::IDENTITY, cloud_points);
+	{
+		boost::recursive_mutex::scoped_lock lock(transformersMutex);
+		colorTransformer->transform(info.message_, rviz::PointCloudTransformer::Support_Color, Ogre::Matrix4::IDENTITY, cloud_points);
+	}
+
+	for (rviz::V_PointCloudPoint::iterator cloud_point = cloud_points.begin(); cloud_point != cloud_points.end(); ++cloud_point)
+	{
+		if (!rviz::validateFloats(cloud_point->position))
+		{
+			cloud_point->position.x = 999999.0f;
+			cloud_point->position.y = 999999.0f;
+			cloud_point->position.z = 999999.0f;
+		}
+	}
+}
+
+// Called by the thread pool, properties are read before by the caller. The
+// cloud is added to the output as soon as it is ready, to be shown by the
+// next update() without waiting the other clouds of the batch.
+void createNodeCloud(const CloudBatch * batch, std::vector<NodeCloud> * nodeClouds, int index)
+{
+	NodeCloud & nodeCloud = nodeClouds->at(index);
+	const rtabmap_ros::NodeData & node = *nodeCloud.node;
+	rtabmap::Transform localTransform = transformFromGeometryMsg(node.localTransform);
+	if(!localTransform.isNull())
+	{
+		float fx = node.fx;
+		float fy = node.fy;
+		float cx = node.cx;
+		float cy = node.cy;
+
+		//uncompress data
+		cv::Mat image = rtabmap::uncompressImage(compressedMatFromBytes(node.image, false));
+		cv::Mat depth = rtabmap::uncompressImage(compressedMatFromBytes(node.depth, false));
+
+		if(!image.empty() && !depth.empty() && fx > 0.0f && fy > 0.0f && cx >= 0.0f && cy >= 0.0f)
+		{
+			pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
+			if(depth.type() == CV_8UC1)
+			{
+				cloud = rtabmap::util3d::cloudFromStereoImages(image, depth, cx, cy, fx, fy, nodeCloud.decimation);
+			}
+			else
+			{
+				cloud = rtabmap::util3d::cloudFromDepthRGB(image, depth, cx, cy, fx, fy, nodeCloud.decimation);
+			}
+			if(nodeCloud.maxDepth > 0.0f)
+			{
+				cloud = rtabmap::util3d::passThrough(cloud, "z", 0, nodeCloud.maxDepth);
+			}
+			if(nodeCloud.voxelSize > 0.0f)
+			{
+				cloud = rtabmap::util3d::voxelize(cloud, nodeCloud.voxelSize);
+			}
+
+			cloud = rtabmap::util3d::transformPointCloud(cloud, localTransform);
+
+			// do it after local transform
+			if(nodeCloud.floorHeight > 0.0f)
+			{
+				cloud = rtabmap::util3d::passThrough(cloud, "z", nodeCloud.floorHeight, 999.0f);
+			}
+
+			sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
+			pcl::toROSMsg(*cloud, *cloudMsg);
+			cloudMsg->header = batch->header;
+
+			MapCloudDisplay::CloudInfoPtr info(new MapCloudDisplay::CloudInfo);
+			info->message_ = cloudMsg;
+			info->pose_ = rtabmap::Transform::getIdentity();
+			info->id_ = node.id;
+			transformPoints(*info, batch->xyzTransformer, batch->colorTransformer, *batch->transformersMutex);
+			computeLods(*info, batch->lodLevels, batch->lodVoxelSize);
+
+			boost::mutex::scoped_lock lock(*batch->outputMutex);
+			batch->output->insert(std::make_pair(node.id, info));
+		}
+	}
+}
+
+// for ThreadPool::parallelFor() on existing clouds
+void retransformCloud(
+		std::vector<MapCloudDisplay::CloudInfo*> * clouds,
+		const CloudBatch * batch,
+		int index)
+{
+	MapCloudDisplay::CloudInfo & info = *clouds->at(index);
+	transformPoints(info, batch->xyzTransformer, batch->colorTransformer, *batch->transformersMutex);
+	computeLods(info, batch->lodLevels, batch->lodVoxelSize);
+}
+
+// Bounding sphere and decimated levels of the transformed points, each
+// level keeps one point per voxel, the voxel size doubling at each level.
+// Only the indices are computed, the Ogre clouds of the levels are created
+// in the render thread (see showCloud()).
+void computeLods(MapCloudDisplay::CloudInfo & info, int levels, float voxelSize)
+{
+	const std::vector<rviz::PointCloud::Point> & points = info.transformed_points_;
+	info.lod_indices_.clear();
+
+	Ogre::Vector3 min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	Ogre::Vector3 max = -min;
+	for(unsigned int i=0; i<points.size(); ++i)
+	{
+		if(points[i].position.x != 999999.0f) // invalid points, see transformPoints()
+		{
+			min.makeFloor(points[i].position);
+			max.makeCeil(points[i].position);
+		}
+	}
+	if(min.x > max.x)
+	{
+		info.center_ = Ogre::Vector3::ZERO;
+		info.radius_ = 0.0f;
+		return;
+	}
+	info.center_ = (min + max) / 2.0f;
+	info.radius_ = (max - info.center_).length();
+
+	for(int level=1; level<levels && voxelSize > 0.0f; ++level, voxelSize*=2.0f)
+	{
+		std::vector<unsigned int> indices;
+		boost::unordered_set<boost::uint64_t> voxels;
+		const std::vector<unsigned int> * previous = level>1?&info.lod_indices_.back():0;
+		unsigned int size = previous?previous->size():points.size();
+		for(unsigned int i=0; i<size; ++i)
+		{
+			unsigned int index = previous?previous->at(i):i;
+			const Ogre::Vector3 & pt = points[index].position;
+			if(pt.x == 999999.0f)
+			{
+				continue;
+			}
+			// 21 bits per axis, like VoxelHash
+			boost::uint64_t x = boost::uint64_t(int(std::floor(pt.x / voxelSize)) & 0x1FFFFF);
+			boost::uint64_t y = boost::uint64_t(int(std::floor(pt.y / voxelSize)) & 0x1FFFFF);
+			boost::uint64_t z = boost::uint64_t(int(std::floor(pt.z / voxelSize)) & 0x1FFFFF);
+			if(voxels.insert((x << 42) | (y << 21) | z).second)
+			{
+				indices.push_back(index);
+			}
+		}
+		info.lod_indices_.push_back(indices);
+	}
+}
+}
+
 
 MapCloudDisplay::CloudInfo::CloudInfo() :
 		manager_(0),
 		pose_(rtabmap::Transform::getIdentity()),
-		scene_node_(0)
+		scene_node_(0),
+		lod_(-1),
+		visible_(false),
+		center_(Ogre::Vector3::ZERO),
+		radius_(0.0f)
 {}
 
 MapCloudDisplay::CloudInfo::~CloudInfo()
@@ -81,10 +303,20 @@ void MapCloudDisplay::CloudInfo::clear()
 		manager_->destroySceneNode( scene_node_ );
 		scene_node_=0;
 	}
+	lod_ = -1;
+	visible_ = false;
+}
+
+int MapCloudDisplay::CloudInfo::lodSize(int level) const
+{
+	return level == 0?(int)transformed_points_.size():(int)lod_indices_[level-1].size();
 }
 
 MapCloudDisplay::MapCloudDisplay()
   : spinner_(1, &cbqueue_),
+    new_xyz_transformer_(false),
+    new_color_transformer_(false),
+    needs_retransform_(false),
     transformer_class_loader_(NULL)
 {
 	//QIcon icon;
@@ -164,6 +396,36 @@ MapCloudDisplay::MapCloudDisplay()
 	node_filtering_angle_->setMin( 0.0f );
 	node_filtering_angle_->setMax( 359.0f );
 
+	lod_levels_ = new rviz::IntProperty( "LOD levels", 3,
+										 "Levels of detail created for each cloud (1=full resolution only). "
+										 "Each level keeps one point per voxel, the voxel size doubling at each level.",
+										 this, SLOT( updateCloudParameters() ), this );
+	lod_levels_->setMin( 1 );
+	lod_levels_->setMax( 8 );
+
+	lod_voxel_size_ = new rviz::FloatProperty( "LOD voxel size (m)", 0.05f,
+										 "Voxel size of the first decimated level of detail.",
+										 this, SLOT( updateCloudParameters() ), this );
+	lod_voxel_size_->setMin( 0.001f );
+	lod_voxel_size_->setMax( 10.0f );
+
+	lod_distance_ = new rviz::FloatProperty( "LOD distance (m)", 5.0f,
+										 "(Disabled=0) Clouds farther than this distance from the camera are shown "
+										 "decimated, one level more each time the distance doubles.",
+										 this );
+	lod_distance_->setMin( 0.0f );
+	lod_distance_->setMax( 999.0f );
+
+	frustum_culling_ = new rviz::BoolProperty( "Frustum culling", true,
+										 "Hide the clouds outside the view of the camera.",
+										 this );
+
+	point_budget_ = new rviz::IntProperty( "Point budget", 0,
+										 "(Disabled=0) Maximum points shown, the closest clouds are shown first "
+										 "and the others are decimated or hidden to respect the budget.",
+										 this );
+	point_budget_->setMin( 0 );
+
 	download_map_ = new rviz::BoolProperty( "Download map", false,
 										 "Download the optimized global map using rtabmap/GetMap service. This will force to re-create all clouds.",
 										 this, SLOT( downloadMap() ), this );
@@ -172,6 +434,10 @@ MapCloudDisplay::MapCloudDisplay()
 											 "Download the optimized global graph (without cloud data) using rtabmap/GetMap service.",
 											 this, SLOT( downloadGraph() ), this );
 
+	sensor_msgs::PointCloud2::Ptr templateCloud(new sensor_msgs::PointCloud2);
+	pcl::toROSMsg(pcl::PointCloud<pcl::PointXYZRGB>(), *templateCloud);
+	template_cloud_ = templateCloud;
+
 	// PointCloudCommon sets up a callback queue with a thread for each
 	// instance.  Use that for processing incoming messages.
 	update_nh_.setCallbackQueue( &cbqueue_ );
@@ -245,84 +511,46 @@ void MapCloudDisplay::processMessage( const rtabmap_ros::MapDataConstPtr& msg )
 
 void MapCloudDisplay::processMapData(const rtabmap_ros::MapData& map)
 {
-	// Add new clouds...
+	// Add new clouds, created in parallel
+	std::vector<NodeCloud> nodeClouds;
 	for(unsigned int i=0; i<map.nodes.size() && i<map.nodes.size(); ++i)
 	{
-		int id = map.nodes[i].id;
-		if(cloud_infos_.find(id) == cloud_infos_.end())
+		if(cloud_infos_.find(map.nodes[i].id) == cloud_infos_.end())
 		{
 			// Cloud not added to RVIZ, add it!
-			rtabmap::Transform localTransform = transformFromGeometryMsg(map.nodes[i].localTransform);
-			if(!localTransform.isNull())
-			{
-				cv::Mat image, depth;
-				float fx = map.nodes[i].fx;
-				float fy = map.nodes[i].fy;
-				float cx = map.nodes[i].cx;
-				float cy = map.nodes[i].cy;
-
-				//uncompress data
-				rtabmap::CompressionThread ctImage(compressedMatFromBytes(map.nodes[i].image, false), true);
-				rtabmap::CompressionThread ctDepth(compressedMatFromBytes(map.nodes[i].depth, false), true);
-				ctImage.start();
-				ctDepth.start();
-				ctImage.join();
-				ctDepth.join();
-				image = ctImage.getUncompressedData();
-				depth = ctDepth.getUncompressedData();
-
-				if(!image.empty() && !depth.empty() && fx > 0.0f && fy > 0.0f && cx >= 0.0f && cy >= 0.0f)
-				{
-					pcl::PointCloud<pcl::PointXYZRGB>::Ptr cloud;
-					if(depth.type() == CV_8UC1)
-					{
-						cloud = rtabmap::util3d::cloudFromStereoImages(image, depth, cx, cy, fx, fy, cloud_decimation_->getInt());
-					}
-					else
-					{
-						cloud = rtabmap::util3d::cloudFromDepthRGB(image, depth, cx, cy, fx, fy, cloud_decimation_->getInt());
-					}
-					if(cloud_max_depth_->getFloat() > 0.0f)
-					{
-						cloud = rtabmap::util3d::passThrough(cloud, "z", 0, cloud_max_depth_->getFloat());
-					}
-					if(cloud_voxel_size_->getFloat() > 0.0f)
-					{
-						cloud = rtabmap::util3d::voxelize(cloud, cloud_voxel_size_->getFloat());
-					}
-
-					cloud = rtabmap::util3d::transformPointCloud(cloud, localTransform);
-
-					// do it after local transform
-					if(cloud_filter_floor_height_->getFloat() > 0.0f)
-					{
-						cloud = rtabmap::util3d::passThrough(cloud, "z", cloud_filter_floor_height_->getFloat(), 999.0f);
-					}
-
-					sensor_msgs::PointCloud2::Ptr cloudMsg(new sensor_msgs::PointCloud2);
-					pcl::toROSMsg(*cloud, *cloudMsg);
-					cloudMsg->header = map.header;
-
-					CloudInfoPtr info(new CloudInfo);
-					info->message_ = cloudMsg;
-					info->pose_ = rtabmap::Transform::getIdentity();
-					info->id_ = id;
+			NodeCloud nodeCloud;
+			nodeCloud.node = &map.nodes[i];
+			nodeCloud.decimation = cloud_decimation_->getInt();
+			nodeCloud.maxDepth = cloud_max_depth_->getFloat();
+			nodeCloud.voxelSize = cloud_voxel_size_->getFloat();
+			nodeCloud.floorHeight = cloud_filter_floor_height_->getFloat();
+			nodeClouds.push_back(nodeCloud);
+		}
+	}
 
-					if (transformCloud(info, true))
-					{
-						boost::mutex::scoped_lock lock(new_clouds_mutex_);
-						new_cloud_infos_.insert(std::make_pair(id, info));
-					}
-				}
-			}
+	if(nodeClouds.size())
+	{
+		// All clouds have the same fields, select the transformers once
+		CloudBatch batch;
+		batch.header = map.header;
+		batch.lodLevels = lod_levels_->getInt();
+		batch.lodVoxelSize = lod_voxel_size_->getFloat();
+		batch.transformersMutex = &transformers_mutex_;
+		batch.output = &new_cloud_infos_;
+		batch.outputMutex = &new_clouds_mutex_;
+		if(getTransformers(template_cloud_, true, batch.xyzTransformer, batch.colorTransformer))
+		{
+			ThreadPool::instance().parallelFor(nodeClouds.size(), boost::bind(&createNodeCloud, &batch, &nodeClouds, _1));
 		}
 	}
 
 	// Update graph
 	std::map<int, rtabmap::Transform> poses;
-	for(unsigned int i=0; i<map.graph.nodeIds.size() && i<map.graph.poses.size(); ++i)
+	rtabmap_ros::Graph unpackedGraph;
+	const rtabmap_ros::Graph & graphMsg = rtabmap_ros::mapGraphUnpacked(map.graph, unpackedGraph);
+	for(unsigned int i=0; i<graphMsg.nodeIds.size() && i<graphMsg.poses.size(); ++i)
 	{
-		poses.insert(std::make_pair(map.graph.nodeIds[i], rtabmap_ros::transformFromPoseMsg(map.graph.poses[i])));
+		poses.insert(std::make_pair(graphMsg.nodeIds[i], rtabmap_ros::transformFromPoseMsg(graphMsg.poses[i])));
 	}
 
 	if(node_filtering_angle_->getFloat() > 0.0f && node_filtering_radius_->getFloat() > 0.0f)
@@ -421,6 +649,13 @@ void MapCloudDisplay::updateAlpha()
 	for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
 		it->second->cloud_->setAlpha( alpha_property_->getFloat() );
+		for(unsigned int i=0; i<it->second->lod_clouds_.size(); ++i)
+		{
+			if(it->second->lod_clouds_[i].get())
+			{
+				it->second->lod_clouds_[i]->setAlpha( alpha_property_->getFloat() );
+			}
+		}
 	}
 }
 
@@ -440,6 +675,13 @@ void MapCloudDisplay::updateStyle()
 	for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
 		it->second->cloud_->setRenderMode( mode );
+		for(unsigned int i=0; i<it->second->lod_clouds_.size(); ++i)
+		{
+			if(it->second->lod_clouds_[i].get())
+			{
+				it->second->lod_clouds_[i]->setRenderMode( mode );
+			}
+		}
 	}
 	updateBillboardSize();
 }
@@ -459,6 +701,13 @@ void MapCloudDisplay::updateBillboardSize()
 	 for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
 		it->second->cloud_->setDimensions( size, size, size );
+		for(unsigned int i=0; i<it->second->lod_clouds_.size(); ++i)
+		{
+			if(it->second->lod_clouds_[i].get())
+			{
+				it->second->lod_clouds_[i]->setDimensions( size, size, size );
+			}
+		}
 	}
 	context_->queueRender();
 }
@@ -586,10 +835,90 @@ void MapCloudDisplay::causeRetransform()
   needs_retransform_ = true;
 }
 
-void MapCloudDisplay::update( float wall_dt, float ros_dt )
+// Render settings of the properties
+void MapCloudDisplay::setupCloud(rviz::PointCloud & cloud) const
 {
 	rviz::PointCloud::RenderMode mode = (rviz::PointCloud::RenderMode) style_property_->getOptionInt();
+	float size;
+	if( mode == rviz::PointCloud::RM_POINTS ) {
+		size = point_pixel_size_property_->getFloat();
+	} else {
+		size = point_world_size_property_->getFloat();
+	}
+	cloud.setRenderMode( mode );
+	cloud.setAlpha( alpha_property_->getFloat() );
+	cloud.setDimensions( size, size, size );
+	cloud.setAutoSize(false);
+}
+
+// Attach the level of detail to the scene node of the cloud
+void MapCloudDisplay::showCloud(CloudInfo & cloud_info, int level)
+{
+	if(cloud_info.lod_ != level)
+	{
+		rviz::PointCloud * cloud = cloud_info.cloud_.get();
+		if(level > 0)
+		{
+			if(cloud_info.lod_clouds_.size() < cloud_info.lod_indices_.size())
+			{
+				cloud_info.lod_clouds_.resize(cloud_info.lod_indices_.size());
+			}
+			boost::shared_ptr<rviz::PointCloud> & lodCloud = cloud_info.lod_clouds_[level-1];
+			if(!lodCloud.get())
+			{
+				const std::vector<unsigned int> & indices = cloud_info.lod_indices_[level-1];
+				std::vector<rviz::PointCloud::Point> points(indices.size());
+				for(unsigned int i=0; i<indices.size(); ++i)
+				{
+					points[i] = cloud_info.transformed_points_[indices[i]];
+				}
+				lodCloud.reset(new rviz::PointCloud());
+				if(points.size())
+				{
+					lodCloud->addPoints(&points.front(), points.size());
+				}
+				setupCloud(*lodCloud);
+			}
+			cloud = lodCloud.get();
+		}
+		cloud_info.scene_node_->detachAllObjects();
+		cloud_info.scene_node_->attachObject(cloud);
+		cloud_info.lod_ = level;
+	}
+	if(!cloud_info.visible_)
+	{
+		cloud_info.scene_node_->setVisible(true);
+		cloud_info.visible_ = true;
+	}
+}
+
+void MapCloudDisplay::hideCloud(CloudInfo & cloud_info)
+{
+	if(cloud_info.visible_)
+	{
+		cloud_info.scene_node_->setVisible(false);
+		cloud_info.visible_ = false;
+	}
+}
 
+namespace
+{
+struct ShownCloud
+{
+	ShownCloud(float distance, MapCloudDisplay::CloudInfo * info, int level) :
+		distance(distance),
+		info(info),
+		level(level)
+	{}
+	bool operator<(const ShownCloud & other) const {return distance < other.distance;}
+	float distance; // to the camera
+	MapCloudDisplay::CloudInfo * info;
+	int level;
+};
+}
+
+void MapCloudDisplay::update( float wall_dt, float ros_dt )
+{
 	if (needs_retransform_)
 	{
 		retransform();
@@ -600,13 +929,6 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 		boost::mutex::scoped_lock lock(new_clouds_mutex_);
 		if( !new_cloud_infos_.empty() )
 		{
-			float size;
-			if( mode == rviz::PointCloud::RM_POINTS ) {
-				size = point_pixel_size_property_->getFloat();
-			} else {
-				size = point_world_size_property_->getFloat();
-			}
-
 			std::map<int, CloudInfoPtr>::iterator it = new_cloud_infos_.begin();
 			std::map<int, CloudInfoPtr>::iterator end = new_cloud_infos_.end();
 			for (; it != end; ++it)
@@ -615,16 +937,11 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 
 				cloud_info->cloud_.reset( new rviz::PointCloud() );
 				cloud_info->cloud_->addPoints( &(cloud_info->transformed_points_.front()), cloud_info->transformed_points_.size() );
-				cloud_info->cloud_->setRenderMode( mode );
-				cloud_info->cloud_->setAlpha( alpha_property_->getFloat() );
-				cloud_info->cloud_->setDimensions( size, size, size );
-				cloud_info->cloud_->setAutoSize(false);
+				setupCloud(*cloud_info->cloud_);
 
 				cloud_info->manager_ = context_->getSceneManager();
 
 				cloud_info->scene_node_ = scene_node_->createChildSceneNode();
-
-				cloud_info->scene_node_->attachObject( cloud_info->cloud_.get() );
 				cloud_info->scene_node_->setVisible(false);
 
 				cloud_infos_.insert(*it);
@@ -665,21 +982,27 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 		boost::mutex::scoped_lock lock(current_map_mutex_);
 		if(!current_map_.empty())
 		{
+			Ogre::Camera * camera = context_->getViewManager()->getCurrent()?context_->getViewManager()->getCurrent()->getCamera():0;
+			bool frustumCulling = camera && frustum_culling_->getBool();
+			float lodDistance = camera?lod_distance_->getFloat():0.0f;
+
+			std::vector<ShownCloud> shown;
+			shown.reserve(current_map_.size());
 			for (std::map<int, rtabmap::Transform>::iterator it=current_map_.begin(); it != current_map_.end(); ++it)
 			{
 				std::map<int, CloudInfoPtr>::iterator cloudInfoIt = cloud_infos_.find(it->first);
 				if(cloudInfoIt != cloud_infos_.end())
 				{
-					totalPoints += cloudInfoIt->second->transformed_points_.size();
-					cloudInfoIt->second->pose_ = it->second;
+					CloudInfo & cloudInfo = *cloudInfoIt->second;
+					cloudInfo.pose_ = it->second;
 					Ogre::Vector3 framePosition;
 					Ogre::Quaternion frameOrientation;
-					if (context_->getFrameManager()->getTransform(cloudInfoIt->second->message_->header, framePosition, frameOrientation))
+					if (context_->getFrameManager()->getTransform(cloudInfo.message_->header, framePosition, frameOrientation))
 					{
 						// Multiply frame with pose
 						Ogre::Matrix4 frameTransform;
 						frameTransform.makeTransform( framePosition, Ogre::Vector3(1,1,1), frameOrientation);
-						const rtabmap::Transform & p = cloudInfoIt->second->pose_;
+						const rtabmap::Transform & p = cloudInfo.pose_;
 						Ogre::Matrix4 pose(p[0], p[1], p[2], p[3],
 										 p[4], p[5], p[6], p[7],
 										 p[8], p[9], p[10], p[11],
@@ -689,24 +1012,64 @@ void MapCloudDisplay::update( float wall_dt, float ros_dt )
 						Ogre::Quaternion poseOrientation = frameTransform.extractQuaternion();
 						poseOrientation.normalise();
 
-						cloudInfoIt->second->scene_node_->setPosition(posePosition);
-						cloudInfoIt->second->scene_node_->setOrientation(poseOrientation);
-						cloudInfoIt->second->scene_node_->setVisible(true);
-						++totalNodesShown;
+						cloudInfo.scene_node_->setPosition(posePosition);
+						cloudInfo.scene_node_->setOrientation(poseOrientation);
+
+						// level of detail from the distance between the camera and the cloud
+						Ogre::Vector3 center = frameTransform * cloudInfo.center_;
+						if(frustumCulling && !camera->isVisible(Ogre::Sphere(center, cloudInfo.radius_)))
+						{
+							hideCloud(cloudInfo);
+							continue;
+						}
+						float distance = camera?camera->getDerivedPosition().distance(center) - cloudInfo.radius_:0.0f;
+						int level = 0;
+						if(lodDistance > 0.0f && distance > lodDistance)
+						{
+							level = std::min(int(std::log(distance/lodDistance)/std::log(2.0f)) + 1, (int)cloudInfo.lod_indices_.size());
+						}
+						shown.push_back(ShownCloud(distance, &cloudInfo, level));
 					}
 					else
 					{
 						ROS_ERROR("MapCloudDisplay: Could not update pose of node %d", it->first);
 					}
+				}
+			}
 
+			// closest clouds first, the farthest ones are decimated
+			// more (or hidden) if the point budget is exceeded
+			std::sort(shown.begin(), shown.end());
+			int budget = point_budget_->getInt();
+			std::set<CloudInfo*> shownClouds;
+			for(unsigned int i=0; i<shown.size(); ++i)
+			{
+				CloudInfo & cloudInfo = *shown[i].info;
+				int level = shown[i].level;
+				if(budget > 0)
+				{
+					while(totalPoints + cloudInfo.lodSize(level) > budget && level < (int)cloudInfo.lod_indices_.size())
+					{
+						++level;
+					}
+					if(totalPoints + cloudInfo.lodSize(level) > budget)
+					{
+						hideCloud(cloudInfo);
+						continue;
+					}
 				}
+				showCloud(cloudInfo, level);
+				shownClouds.insert(&cloudInfo);
+				totalPoints += cloudInfo.lodSize(level);
+				++totalNodesShown;
 			}
+
 			//hide not used clouds
 			for(std::map<int, CloudInfoPtr>::iterator iter = cloud_infos_.begin(); iter!=cloud_infos_.end(); ++iter)
 			{
-				if(current_map_.find(iter->first) == current_map_.end())
+				if(shownClouds.find(iter->second.get()) == shownClouds.end())
 				{
-					iter->second->scene_node_->setVisible(false);
+					hideCloud(*iter->second);
 				}
 			}
 		}
@@ -822,67 +1185,90 @@ rviz::PointCloudTransformerPtr MapCloudDisplay::getColorTransformer( const senso
 
 void MapCloudDisplay::retransform()
 {
-	boost::recursive_mutex::scoped_lock lock(transformers_mutex_);
-
-	for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
+	if(cloud_infos_.empty())
 	{
-		const CloudInfoPtr& cloud_info = it->second;
-		transformCloud(cloud_info, false);
-		cloud_info->cloud_->clear();
-		cloud_info->cloud_->addPoints(&cloud_info->transformed_points_.front(), cloud_info->transformed_points_.size());
+		return;
 	}
-}
 
-bool MapCloudDisplay::transformCloud(const CloudInfoPtr& cloud_info, bool update_transformers)
-{
-	rviz::V_PointCloudPoint& cloud_points = cloud_info->transformed_points_;
-	cloud_points.clear();
-
-	size_t size = cloud_info->message_->width * cloud_info->message_->height;
-	rviz::PointCloud::Point default_pt;
-	default_pt.color = Ogre::ColourValue(1, 1, 1);
-	default_pt.position = Ogre::Vector3::ZERO;
-	cloud_points.resize(size, default_pt);
+	CloudBatch batch;
+	batch.lodLevels = lod_levels_->getInt();
+	batch.lodVoxelSize = lod_voxel_size_->getFloat();
+	batch.transformersMutex = &transformers_mutex_;
+	if(!getTransformers(template_cloud_, false, batch.xyzTransformer, batch.colorTransformer))
+	{
+		return;
+	}
 
+	std::vector<CloudInfo*> clouds;
+	clouds.reserve(cloud_infos_.size());
+	for( std::map<int, CloudInfoPtr>::iterator it = cloud_infos_.begin(); it != cloud_infos_.end(); ++it )
 	{
-		boost::recursive_mutex::scoped_lock lock(transformers_mutex_);
-		if( update_transformers )
+		CloudInfo & cloud_info = *it->second;
+		// the decimated levels are detached and destroyed here in the render
+		// thread, they are created again when shown
+		if(cloud_info.lod_ > 0)
 		{
-			updateTransformers( cloud_info->message_ );
+			cloud_info.scene_node_->detachAllObjects();
+			cloud_info.lod_ = -1;
+			cloud_info.visible_ = false;
+			cloud_info.scene_node_->setVisible(false);
 		}
-		rviz::PointCloudTransformerPtr xyz_trans = getXYZTransformer(cloud_info->message_);
-		rviz::PointCloudTransformerPtr color_trans = getColorTransformer(cloud_info->message_);
+		cloud_info.lod_clouds_.clear();
+		clouds.push_back(&cloud_info);
+	}
 
-		if (!xyz_trans)
+	if(new_xyz_transformer_)
+	{
+		// positions changed, the levels of detail are computed again
+		ThreadPool::instance().parallelFor(clouds.size(), boost::bind(&retransformCloud, &clouds, &batch, _1));
+	}
+	else
+	{
+		// only recolor the points, positions and levels of detail are the same
+		boost::recursive_mutex::scoped_lock lock(transformers_mutex_);
+		for(unsigned int i=0; i<clouds.size(); ++i)
 		{
-			std::stringstream ss;
-			ss << "No position transformer available for cloud";
-			this->setStatusStd(rviz::StatusProperty::Error, "Message", ss.str());
-			return false;
+			batch.colorTransformer->transform(clouds[i]->message_, rviz::PointCloudTransformer::Support_Color, Ogre::Matrix4::IDENTITY, clouds[i]->transformed_points_);
 		}
+	}
 
-		if (!color_trans)
-		{
-			std::stringstream ss;
-			ss << "No color transformer available for cloud";
-			this->setStatusStd(rviz::StatusProperty::Error, "Message", ss.str());
-			return false;
-		}
+	for(unsigned int i=0; i<clouds.size(); ++i)
+	{
+		CloudInfo & cloud_info = *clouds[i];
+		cloud_info.cloud_->clear();
+		cloud_info.cloud_->addPoints(&cloud_info.transformed_points_.front(), cloud_info.transformed_points_.size());
+	}
+}
 
-		xyz_trans->transform(cloud_info->message_, rviz::PointCloudTransformer::Support_XYZ, Ogre::Matrix4::IDENTITY, cloud_points);
-		color_trans->transform(cloud_info->message_, rviz::PointCloudTransformer::Support_Color, Ogre::Matrix4::IDENTITY, cloud_points);
+bool MapCloudDisplay::getTransformers(
+		const sensor_msgs::PointCloud2ConstPtr& cloud,
+		bool update_transformers,
+		rviz::PointCloudTransformerPtr & xyz_trans,
+		rviz::PointCloudTransformerPtr & color_trans)
+{
+	boost::recursive_mutex::scoped_lock lock(transformers_mutex_);
+	if( update_transformers )
+	{
+		updateTransformers( cloud );
 	}
+	xyz_trans = getXYZTransformer(cloud);
+	color_trans = getColorTransformer(cloud);
 
-	for (rviz::V_PointCloudPoint::iterator cloud_point = cloud_points.begin(); cloud_point != cloud_points.end(); ++cloud_point)
+	if (!xyz_trans)
 	{
-		if (!rviz::validateFloats(cloud_point->position))
-		{
-			cloud_point->position.x = 999999.0f;
-			cloud_point->position.y = 999999.0f;
-			cloud_point->position.z = 999999.0f;
-		}
+		std::stringstream ss;
+		ss << "No position transformer available for cloud";
+		this->setStatusStd(rviz::StatusProperty::Error, "Message", ss.str());
+		return false;
 	}
 
+	if (!color_trans)
+	{
+		std::stringstream ss;
+		ss << "No color transformer available for cloud";
+		this->setStatusStd(rviz::StatusProperty::Error, "Message", ss.str());
+		return false;
+	}
 	return true;
 }
 
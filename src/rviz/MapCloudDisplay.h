@@ -86,9 +86,20 @@ public:
 		int id_;
 
 		Ogre::SceneNode *scene_node_;
-		boost::shared_ptr<rviz::PointCloud> cloud_;
+		boost::shared_ptr<rviz::PointCloud> cloud_; // full resolution
 
 		std::vector<rviz::PointCloud::Point> transformed_points_;
+
+		// Levels of detail: voxel-decimated versions of transformed_points_,
+		// the rviz clouds are created the first time a level is shown
+		std::vector<std::vector<unsigned int> > lod_indices_; // levels 1, 2, ...
+		std::vector<boost::shared_ptr<rviz::PointCloud> > lod_clouds_;
+		int lod_; // level attached to scene_node_ (0=cloud_), -1 if none
+		bool visible_;
+		Ogre::Vector3 center_; // bounding sphere in the node frame
+		float radius_;
+
+		int lodSize(int level) const;
 	};
 	typedef boost::shared_ptr<CloudInfo> CloudInfoPtr;
 
@@ -110,6 +121,11 @@ public:
 	rviz::FloatProperty* cloud_filter_floor_height_;
 	rviz::FloatProperty* node_filtering_radius_;
 	rviz::FloatProperty* node_filtering_angle_;
+	rviz::IntProperty* lod_levels_;
+	rviz::FloatProperty* lod_voxel_size_;
+	rviz::FloatProperty* lod_distance_;
+	rviz::BoolProperty* frustum_culling_;
+	rviz::IntProperty* point_budget_;
 	rviz::BoolProperty* download_map_;
 	rviz::BoolProperty* download_graph_;
 
@@ -139,9 +155,17 @@ private:
 	void processMapData(const rtabmap_ros::MapData& map);
 
 	/**
-	* \brief Transforms the cloud into the correct frame, and sets up our renderable cloud
+	* \brief Selects the transformers of the clouds, all clouds have the fields of template_cloud_
 	*/
-	bool transformCloud(const CloudInfoPtr& cloud, bool fully_update_transformers);
+	bool getTransformers(
+			const sensor_msgs::PointCloud2ConstPtr& cloud,
+			bool update_transformers,
+			rviz::PointCloudTransformerPtr & xyz_trans,
+			rviz::PointCloudTransformerPtr & color_trans);
+
+	void setupCloud(rviz::PointCloud & cloud) const;
+	void showCloud(CloudInfo & cloud, int level);
+	void hideCloud(CloudInfo & cloud);
 
 	rviz::PointCloudTransformerPtr getXYZTransformer(const sensor_msgs::PointCloud2ConstPtr& cloud);
 	rviz::PointCloudTransformerPtr getColorTransformer(const sensor_msgs::PointCloud2ConstPtr& cloud);
@@ -178,6 +202,7 @@ private:
 
 	boost::recursive_mutex transformers_mutex_;
 	M_TransformerInfo transformers_;
+	sensor_msgs::PointCloud2ConstPtr template_cloud_; // empty cloud with the fields of the node clouds
 	bool new_xyz_transformer_;
 	bool new_color_transformer_;
 	bool needs_retransform_;
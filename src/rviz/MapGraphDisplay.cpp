@@ -32,6 +32,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <OgreManualObject.h>
 #include <OgreBillboardSet.h>
 #include <OgreMatrix4.h>
+#include <OgreHardwareBuffer.h>
+#include <OgreHardwareVertexBuffer.h>
 
 #include <tf/transform_listener.h>
 
@@ -43,27 +45,37 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "MapGraphDisplay.h"
 
-#include <rtabmap/core/Link.h>
 #include <rtabmap_ros/MsgConversion.h>
 
 namespace rtabmap_ros
 {
 
-MapGraphDisplay::MapGraphDisplay()
+// over this number of chunks, the links are rebuilt in a single one
+static const unsigned int kMaxChunks = 32;
+
+MapGraphDisplay::MapGraphDisplay() :
+		vertex_count_(0),
+		dead_vertices_(0)
 {
 	color_neighbor_property_ = new rviz::ColorProperty( "Neighbor", Qt::blue,
-                                       "Color to draw neighbor links.", this );
+                                       "Color to draw neighbor links.", this, SLOT( updateColors() ) );
 	color_global_property_ = new rviz::ColorProperty( "Global loop closure", Qt::red,
-	                                       "Color to draw global loop closure links.", this );
+	                                       "Color to draw global loop closure links.", this, SLOT( updateColors() ) );
 	color_local_property_ = new rviz::ColorProperty( "Local loop closure", Qt::yellow,
-	                                       "Color to draw local loop closure links.", this );
+	                                       "Color to draw local loop closure links.", this, SLOT( updateColors() ) );
 	color_user_property_ = new rviz::ColorProperty( "User", Qt::red,
-	                                       "Color to draw user links.", this );
+	                                       "Color to draw user links.", this, SLOT( updateColors() ) );
 	color_virtual_property_ = new rviz::ColorProperty( "Virtual", Qt::magenta,
-	                                       "Color to draw virtual links.", this );
+	                                       "Color to draw virtual links.", this, SLOT( updateColors() ) );
 
 	alpha_property_ = new rviz::FloatProperty( "Alpha", 1.0,
-                                       "Amount of transparency to apply to the path.", this );
+                                       "Amount of transparency to apply to the path.", this, SLOT( updateColors() ) );
+
+	rebuild_ratio_property_ = new rviz::FloatProperty( "Rebuild ratio", 0.3,
+	                                       "All links are rebuilt when the ratio of vertices to update "
+	                                       "(moved or removed) is over this value, otherwise they are updated in place.", this );
+	rebuild_ratio_property_->setMin( 0 );
+	rebuild_ratio_property_->setMax( 1 );
 }
 
 MapGraphDisplay::~MapGraphDisplay()
@@ -81,6 +93,18 @@ void MapGraphDisplay::reset()
 {
   MFDClass::reset();
   destroyObjects();
+  graph_poses_.clear();
+  graph_links_.clear();
+}
+
+// The colors are set per vertex when a chunk is created, all links are rebuilt
+void MapGraphDisplay::updateColors()
+{
+	if(manual_objects_.size())
+	{
+		rebuild(graph_poses_, graph_links_);
+		context_->queueRender();
+	}
 }
 
 void MapGraphDisplay::destroyObjects()
@@ -91,10 +115,109 @@ void MapGraphDisplay::destroyObjects()
 		scene_manager_->destroyManualObject( manual_objects_[i] );
 	}
 	manual_objects_.clear();
+	links_.clear();
+	node_positions_.clear();
+	node_vertices_.clear();
+	vertex_count_ = 0;
+	dead_vertices_ = 0;
+}
+
+Ogre::ColourValue MapGraphDisplay::linkColor(int type) const
+{
+	Ogre::ColourValue color;
+	if(type == rtabmap::Link::kNeighbor)
+	{
+		color = color_neighbor_property_->getOgreColor();
+	}
+	else if(type == rtabmap::Link::kVirtualClosure)
+	{
+		color = color_virtual_property_->getOgreColor();
+	}
+	else if(type == rtabmap::Link::kUserClosure)
+	{
+		color = color_user_property_->getOgreColor();
+	}
+	else if(type == rtabmap::Link::kLocalSpaceClosure || type == rtabmap::Link::kLocalTimeClosure)
+	{
+		color = color_local_property_->getOgreColor();
+	}
+	else
+	{
+		color = color_global_property_->getOgreColor();
+	}
+	color.a = alpha_property_->getFloat();
+	return color;
+}
+
+// The links must have their two poses
+void MapGraphDisplay::addChunk(const std::map<int, rtabmap::Transform> & poses, const std::vector<const rtabmap::Link*> & links)
+{
+	if(links.empty())
+	{
+		return;
+	}
+	int chunk = (int)manual_objects_.size();
+	Ogre::ManualObject* manual_object = scene_manager_->createManualObject();
+	manual_object->setDynamic( true );
+	scene_node_->attachObject( manual_object );
+	manual_objects_.push_back(manual_object);
+
+	manual_object->estimateVertexCount(links.size() * 2);
+	manual_object->begin( "BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST );
+	for(unsigned int i=0; i<links.size(); ++i)
+	{
+		const rtabmap::Link & link = *links[i];
+		Ogre::ColourValue color = linkColor(link.type());
+		LinkVertices vertices(chunk, i*2);
+		int ids[2] = {link.from(), link.to()};
+		for(int j=0; j<2; ++j)
+		{
+			const rtabmap::Transform & pose = poses.at(ids[j]);
+			Ogre::Vector3 pos(pose.x(), pose.y(), pose.z());
+			manual_object->position( pos );
+			manual_object->colour( color );
+			node_positions_[ids[j]] = pos;
+			node_vertices_.insert(std::make_pair(ids[j], LinkVertices(chunk, i*2+j)));
+		}
+		links_[LinkKey(link.from(), link.to())] = vertices;
+	}
+	manual_object->end();
+	vertex_count_ += links.size()*2;
+}
+
+// Write directly the position of a vertex in the hardware buffer of the chunk
+void MapGraphDisplay::setVertexPosition(int chunk, unsigned int vertex, const Ogre::Vector3 & position)
+{
+	Ogre::ManualObject* manual_object = manual_objects_[chunk];
+	Ogre::VertexData * vertexData = manual_object->getSection(0)->getRenderOperation()->vertexData;
+	const Ogre::VertexElement * element = vertexData->vertexDeclaration->findElementBySemantic(Ogre::VES_POSITION);
+	Ogre::HardwareVertexBufferSharedPtr buffer = vertexData->vertexBufferBinding->getBuffer(element->getSource());
+	float xyz[3] = {position.x, position.y, position.z};
+	buffer->writeData((vertexData->vertexStart + vertex) * buffer->getVertexSize() + element->getOffset(), sizeof(xyz), xyz);
+
+	Ogre::AxisAlignedBox box = manual_object->getBoundingBox();
+	box.merge(position);
+	manual_object->setBoundingBox(box);
+}
+
+void MapGraphDisplay::rebuild(const std::map<int, rtabmap::Transform> & poses, const std::multimap<int, rtabmap::Link> & links)
+{
+	destroyObjects();
+	std::vector<const rtabmap::Link*> validLinks;
+	validLinks.reserve(links.size());
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		if(poses.find(iter->second.from()) != poses.end() && poses.find(iter->second.to()) != poses.end())
+		{
+			validLinks.push_back(&iter->second);
+		}
+	}
+	addChunk(poses, validLinks);
 }
 
 void MapGraphDisplay::processMessage( const rtabmap_ros::MapData::ConstPtr& msg )
 {
+	// a packed graph has empty arrays, it is decoded by mapGraphFromROS()
 	if(!(msg->graph.mapIds.size() == msg->graph.nodeIds.size() && msg->graph.poses.size() == msg->graph.nodeIds.size()))
 	{
 		ROS_ERROR("rtabmap_ros::MapGraph: Error map ids, pose ids and poses must have all the same size.");
@@ -111,67 +234,100 @@ void MapGraphDisplay::processMessage( const rtabmap_ros::MapData::ConstPtr& msg
 	rtabmap::Transform mapToOdom;
 	rtabmap_ros::mapGraphFromROS(msg->graph, poses, mapIds, stamps, labels, userDatas, links, mapToOdom);
 
-	destroyObjects();
-
-	Ogre::Vector3 position;
-	Ogre::Quaternion orientation;
+	Ogre::Vector3 position = Ogre::Vector3::ZERO;
+	Ogre::Quaternion orientation = Ogre::Quaternion::IDENTITY;
 	if( !context_->getFrameManager()->getTransform( msg->header, position, orientation ))
 	{
 		ROS_DEBUG( "Error transforming from frame '%s' to frame '%s'", msg->header.frame_id.c_str(), qPrintable( fixed_frame_ ));
 	}
+	// the vertices stay in the frame of the graph
+	scene_node_->setPosition( position );
+	scene_node_->setOrientation( orientation );
 
-	Ogre::Matrix4 transform( orientation );
-	transform.setTrans( position );
+	updateLinks(poses, links);
+	graph_poses_.swap(poses);
+	graph_links_.swap(links);
+}
 
-	if(links.size())
+void MapGraphDisplay::updateLinks(const std::map<int, rtabmap::Transform> & poses, const std::multimap<int, rtabmap::Link> & links)
+{
+	if(manual_objects_.size() == 0 || manual_objects_.size() >= kMaxChunks)
 	{
-		Ogre::ColourValue color;
-		Ogre::ManualObject* manual_object = scene_manager_->createManualObject();
-		manual_object->setDynamic( true );
-		scene_node_->attachObject( manual_object );
-		manual_objects_.push_back(manual_object);
+		rebuild(poses, links);
+		return;
+	}
 
-		manual_object->estimateVertexCount(links.size() * 2);
-		manual_object->begin( "BaseWhiteNoLighting", Ogre::RenderOperation::OT_LINE_LIST );
-		for(std::map<int, rtabmap::Link>::iterator iter=links.begin(); iter!=links.end(); ++iter)
+	// New and removed links
+	std::vector<const rtabmap::Link*> newLinks;
+	std::map<LinkKey, LinkVertices> removedLinks = links_;
+	for(std::multimap<int, rtabmap::Link>::const_iterator iter=links.begin(); iter!=links.end(); ++iter)
+	{
+		if(poses.find(iter->second.from()) != poses.end() && poses.find(iter->second.to()) != poses.end())
 		{
-			std::map<int, rtabmap::Transform>::iterator poseIterFrom = poses.find(iter->second.from());
-			std::map<int, rtabmap::Transform>::iterator poseIterTo = poses.find(iter->second.to());
-			if(poseIterFrom != poses.end() && poseIterTo != poses.end())
+			LinkKey key(iter->second.from(), iter->second.to());
+			if(removedLinks.erase(key) == 0 && links_.find(key) == links_.end())
 			{
-				if(iter->second.type() == rtabmap::Link::kNeighbor)
-				{
-					color = color_neighbor_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kVirtualClosure)
-				{
-					color = color_virtual_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kUserClosure)
-				{
-					color = color_user_property_->getOgreColor();
-				}
-				else if(iter->second.type() == rtabmap::Link::kLocalSpaceClosure || iter->second.type() == rtabmap::Link::kLocalTimeClosure)
-				{
-					color = color_local_property_->getOgreColor();
-				}
-				else
+				newLinks.push_back(&iter->second);
+			}
+		}
+	}
+
+	// Moved nodes
+	std::vector<std::pair<int, Ogre::Vector3> > movedNodes;
+	unsigned int movedVertices = 0;
+	for(std::map<int, Ogre::Vector3>::iterator iter=node_positions_.begin(); iter!=node_positions_.end(); ++iter)
+	{
+		std::map<int, rtabmap::Transform>::const_iterator poseIter = poses.find(iter->first);
+		if(poseIter != poses.end())
+		{
+			Ogre::Vector3 pos(poseIter->second.x(), poseIter->second.y(), poseIter->second.z());
+			if(pos != iter->second)
+			{
+				movedNodes.push_back(std::make_pair(iter->first, pos));
+				movedVertices += node_vertices_.count(iter->first);
+			}
+		}
+	}
+
+	if(float(dead_vertices_ + removedLinks.size()*2 + movedVertices) > rebuild_ratio_property_->getFloat() * float(vertex_count_))
+	{
+		rebuild(poses, links);
+		return;
+	}
+
+	// Collapse removed links on their first vertex
+	for(std::map<LinkKey, LinkVertices>::iterator iter=removedLinks.begin(); iter!=removedLinks.end(); ++iter)
+	{
+		const LinkVertices & vertices = iter->second;
+		int ids[2] = {iter->first.first, iter->first.second};
+		for(int j=0; j<2; ++j)
+		{
+			std::pair<std::multimap<int, LinkVertices>::iterator, std::multimap<int, LinkVertices>::iterator> range = node_vertices_.equal_range(ids[j]);
+			for(std::multimap<int, LinkVertices>::iterator jter=range.first; jter!=range.second; ++jter)
+			{
+				if(jter->second.chunk == vertices.chunk && jter->second.vertex == vertices.vertex+j)
 				{
-					color = color_global_property_->getOgreColor();
+					node_vertices_.erase(jter);
+					break;
 				}
-				color.a = alpha_property_->getFloat();
-				Ogre::Vector3 pos;
-				pos = transform * Ogre::Vector3( poseIterFrom->second.x(), poseIterFrom->second.y(), poseIterFrom->second.z() );
-				manual_object->position( pos.x, pos.y, pos.z );
-				manual_object->colour( color );
-				pos = transform * Ogre::Vector3( poseIterTo->second.x(), poseIterTo->second.y(), poseIterTo->second.z() );
-				manual_object->position( pos.x, pos.y, pos.z );
-				manual_object->colour( color );
 			}
 		}
+		setVertexPosition(vertices.chunk, vertices.vertex+1, node_positions_.at(ids[0]));
+		links_.erase(iter->first);
+		dead_vertices_ += 2;
+	}
 
-		manual_object->end();
+	for(unsigned int i=0; i<movedNodes.size(); ++i)
+	{
+		std::pair<std::multimap<int, LinkVertices>::iterator, std::multimap<int, LinkVertices>::iterator> range = node_vertices_.equal_range(movedNodes[i].first);
+		for(std::multimap<int, LinkVertices>::iterator iter=range.first; iter!=range.second; ++iter)
+		{
+			setVertexPosition(iter->second.chunk, iter->second.vertex, movedNodes[i].second);
+		}
+		node_positions_[movedNodes[i].first] = movedNodes[i].second;
 	}
+
+	addChunk(poses, newLinks);
 }
 
 } // namespace rtabmap_ros
@@ -30,6 +30,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define MAP_GRAPH_DISPLAY_H
 
 #include <rtabmap_ros/MapData.h>
+#include <rtabmap/core/Link.h>
+#include <rtabmap/core/Transform.h>
+
+#include <OgreVector3.h>
+#include <OgreColourValue.h>
+
+#include <map>
 
 #include <rviz/message_filter_display.h>
 
@@ -52,6 +59,12 @@ namespace rtabmap_ros
 /**
  * \class MapGraphDisplay
  * \brief Displays the graph in rtabmap::MapData message
+ *
+ * The links are kept in the vertex buffers between messages: new links are
+ * added in a new chunk (manual object), vertices of the nodes that moved are
+ * updated in place and removed links are collapsed. All links are rebuilt in
+ * a single chunk only when a large part of the graph changed (e.g. after a
+ * loop closure), or when there are too many chunks.
  */
 class MapGraphDisplay: public MessageFilterDisplay<rtabmap_ros::MapData>
 {
@@ -70,10 +83,36 @@ protected:
   /** @brief Overridden from MessageFilterDisplay. */
   void processMessage( const rtabmap_ros::MapData::ConstPtr& msg );
 
+private Q_SLOTS:
+  void updateColors();
+
 private:
   void destroyObjects();
-
-  std::vector<Ogre::ManualObject*> manual_objects_;
+  void updateLinks(const std::map<int, rtabmap::Transform> & poses, const std::multimap<int, rtabmap::Link> & links);
+  void rebuild(const std::map<int, rtabmap::Transform> & poses, const std::multimap<int, rtabmap::Link> & links);
+  void addChunk(const std::map<int, rtabmap::Transform> & poses, const std::vector<const rtabmap::Link*> & links);
+  void setVertexPosition(int chunk, unsigned int vertex, const Ogre::Vector3 & position);
+  Ogre::ColourValue linkColor(int type) const;
+
+  // first vertex of the link (the second one is the next vertex)
+  struct LinkVertices
+  {
+    LinkVertices(int chunk = 0, unsigned int vertex = 0) : chunk(chunk), vertex(vertex) {}
+    int chunk;
+    unsigned int vertex;
+  };
+  typedef std::pair<int, int> LinkKey; // from, to
+
+  std::vector<Ogre::ManualObject*> manual_objects_; // chunks
+  std::map<LinkKey, LinkVertices> links_;
+  std::map<int, Ogre::Vector3> node_positions_; // of the nodes referred by a link
+  std::multimap<int, LinkVertices> node_vertices_;
+  unsigned int vertex_count_;
+  unsigned int dead_vertices_; // of the removed links
+
+  // graph of the last message, to rebuild the links when the colors change
+  std::map<int, rtabmap::Transform> graph_poses_;
+  std::multimap<int, rtabmap::Link> graph_links_;
 
   ColorProperty* color_neighbor_property_;
   ColorProperty* color_global_property_;
@@ -81,6 +120,7 @@ private:
   ColorProperty* color_user_property_;
   ColorProperty* color_virtual_property_;
   FloatProperty* alpha_property_;
+  FloatProperty* rebuild_ratio_property_;
 };
 
 } // namespace rtabmap_ros